@@ -0,0 +1,335 @@
+#include "pch.h"
+#include "blockcompression.h"
+#include "mymath.h"
+
+/* the BGR byte triplet of the 5:6:5 color */
+static inline void Expand565( const int c, BYTE * bgr )
+{
+	const int r = ( c >> 11 ) & 31;
+	const int g = ( c >> 5 ) & 63;
+	const int b = c & 31;
+
+	bgr[0] = static_cast<BYTE>( ( b << 3 ) | ( b >> 2 ) );
+	bgr[1] = static_cast<BYTE>( ( g << 2 ) | ( g >> 4 ) );
+	bgr[2] = static_cast<BYTE>( ( r << 3 ) | ( r >> 2 ) );
+}
+
+/* rgb in [0, 255] to the nearest 5:6:5 color */
+static inline int Quantize565( const float r, const float g, const float b )
+{
+	const int r5 = static_cast<int>( max( 0.0f, min( 255.0f, r ) ) * ( 31.0f / 255.0f ) + 0.5f );
+	const int g6 = static_cast<int>( max( 0.0f, min( 255.0f, g ) ) * ( 63.0f / 255.0f ) + 0.5f );
+	const int b5 = static_cast<int>( max( 0.0f, min( 255.0f, b ) ) * ( 31.0f / 255.0f ) + 0.5f );
+
+	return ( r5 << 11 ) | ( g6 << 5 ) | b5;
+}
+
+/* the four colors of the opaque block, c0 > c1 */
+static void BC1Palette( const int c0, const int c1, BYTE palette[4][3] )
+{
+	Expand565( c0, palette[0] );
+	Expand565( c1, palette[1] );
+
+	for ( int c = 0; c < 3; ++c )
+	{
+		if ( c0 > c1 )
+		{
+			palette[2][c] = static_cast<BYTE>( ( 2 * palette[0][c] + palette[1][c] + 1 ) / 3 );
+			palette[3][c] = static_cast<BYTE>( ( palette[0][c] + 2 * palette[1][c] + 1 ) / 3 );
+		}
+		else
+		{
+			palette[2][c] = static_cast<BYTE>( ( palette[0][c] + palette[1][c] + 1 ) / 2 );
+			palette[3][c] = 0;
+		}
+	}
+}
+
+/* picks the nearest palette entry of every texel, returns the squared error */
+static int BC1Indices( const BYTE * bgr, const BYTE palette[4][3], unsigned int & indices )
+{
+	int error = 0;
+	indices = 0;
+
+	for ( int i = 0; i < 16; ++i )
+	{
+		int best = 0;
+		int best_distance = 1 << 30;
+
+		for ( int j = 0; j < 4; ++j )
+		{
+			const int db = bgr[3 * i] - palette[j][0];
+			const int dg = bgr[3 * i + 1] - palette[j][1];
+			const int dr = bgr[3 * i + 2] - palette[j][2];
+			const int distance = db * db + dg * dg + dr * dr;
+
+			if ( distance < best_distance )
+			{
+				best = j;
+				best_distance = distance;
+			}
+		}
+
+		indices |= best << ( 2 * i );
+		error += best_distance;
+	}
+
+	return error;
+}
+
+static void WriteBC1( int c0, int c1, BYTE * block )
+{
+	block[0] = static_cast<BYTE>( c0 & 0xff );
+	block[1] = static_cast<BYTE>( c0 >> 8 );
+	block[2] = static_cast<BYTE>( c1 & 0xff );
+	block[3] = static_cast<BYTE>( c1 >> 8 );
+}
+
+/* orders the endpoints for the four color mode, the equal endpoints give the single color block */
+static int EncodeBC1Endpoints( const BYTE * bgr, int c0, int c1, BYTE * block )
+{
+	if ( c0 < c1 )
+	{
+		std::swap( c0, c1 );
+	}
+
+	BYTE palette[4][3];
+	BC1Palette( c0, c1, palette );
+
+	unsigned int indices = 0;
+	const int error = BC1Indices( bgr, palette, indices );
+
+	WriteBC1( c0, c1, block );
+	block[4] = static_cast<BYTE>( indices );
+	block[5] = static_cast<BYTE>( indices >> 8 );
+	block[6] = static_cast<BYTE>( indices >> 16 );
+	block[7] = static_cast<BYTE>( indices >> 24 );
+
+	return error;
+}
+
+void EncodeBC1( const BYTE * bgr, BYTE * block )
+{
+	// principal axis of the colors in the rgb order
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+
+	for ( int i = 0; i < 16; ++i )
+	{
+		for ( int c = 0; c < 3; ++c ) mean[c] += bgr[3 * i + 2 - c];
+	}
+
+	for ( int c = 0; c < 3; ++c ) mean[c] *= 1.0f / 16.0f;
+
+	float covariance[6] = { 0.0f }; // rr, rg, rb, gg, gb, bb
+
+	for ( int i = 0; i < 16; ++i )
+	{
+		const float r = bgr[3 * i + 2] - mean[0];
+		const float g = bgr[3 * i + 1] - mean[1];
+		const float b = bgr[3 * i] - mean[2];
+
+		covariance[0] += r * r; covariance[1] += r * g; covariance[2] += r * b;
+		covariance[3] += g * g; covariance[4] += g * b; covariance[5] += b * b;
+	}
+
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+
+	for ( int iteration = 0; iteration < 8; ++iteration )
+	{
+		const float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+		const float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+		const float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+		const float norm = max( fabsf( x ), max( fabsf( y ), fabsf( z ) ) );
+
+		if ( norm < 1e-6f )
+		{
+			break; // single color block
+		}
+
+		axis[0] = x / norm; axis[1] = y / norm; axis[2] = z / norm;
+	}
+
+	const float axis_length2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+	float t_min = 0.0f;
+	float t_max = 0.0f;
+
+	for ( int i = 0; i < 16; ++i )
+	{
+		const float t = ( ( bgr[3 * i + 2] - mean[0] ) * axis[0] + ( bgr[3 * i + 1] - mean[1] ) * axis[1] +
+			( bgr[3 * i] - mean[2] ) * axis[2] ) / axis_length2;
+
+		t_min = min( t_min, t );
+		t_max = max( t_max, t );
+	}
+
+	int c0 = Quantize565( mean[0] + axis[0] * t_max, mean[1] + axis[1] * t_max, mean[2] + axis[2] * t_max );
+	int c1 = Quantize565( mean[0] + axis[0] * t_min, mean[1] + axis[1] * t_min, mean[2] + axis[2] * t_min );
+	const int error = EncodeBC1Endpoints( bgr, c0, c1, block );
+
+	if ( error == 0 || c0 == c1 )
+	{
+		return;
+	}
+
+	// least squares endpoints for the chosen indices, texel = w * a + ( 1 - w ) * b
+	static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+	const unsigned int indices = block[4] | ( block[5] << 8 ) | ( block[6] << 16 ) | ( unsigned( block[7] ) << 24 );
+	float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+	float ax[3] = { 0.0f, 0.0f, 0.0f }, bx[3] = { 0.0f, 0.0f, 0.0f };
+
+	for ( int i = 0; i < 16; ++i )
+	{
+		const float w = weights[( indices >> ( 2 * i ) ) & 3];
+
+		aa += w * w; ab += w * ( 1.0f - w ); bb += ( 1.0f - w ) * ( 1.0f - w );
+
+		for ( int c = 0; c < 3; ++c )
+		{
+			ax[c] += w * bgr[3 * i + 2 - c];
+			bx[c] += ( 1.0f - w ) * bgr[3 * i + 2 - c];
+		}
+	}
+
+	const float determinant = aa * bb - ab * ab;
+
+	if ( fabsf( determinant ) < 1e-6f )
+	{
+		return;
+	}
+
+	float a[3], b[3];
+
+	for ( int c = 0; c < 3; ++c )
+	{
+		a[c] = ( ax[c] * bb - bx[c] * ab ) / determinant;
+		b[c] = ( bx[c] * aa - ax[c] * ab ) / determinant;
+	}
+
+	BYTE refined[BC_BLOCK_BYTES];
+
+	if ( EncodeBC1Endpoints( bgr, Quantize565( a[0], a[1], a[2] ), Quantize565( b[0], b[1], b[2] ), refined ) < error )
+	{
+		memcpy( block, refined, BC_BLOCK_BYTES );
+	}
+}
+
+void DecodeBC1( const BYTE * block, BYTE * bgr )
+{
+	BYTE palette[4][3];
+	BC1Palette( block[0] | ( block[1] << 8 ), block[2] | ( block[3] << 8 ), palette );
+
+	for ( int i = 0; i < 16; ++i )
+	{
+		const BYTE * color = palette[( block[4 + ( i >> 2 )] >> ( 2 * ( i & 3 ) ) ) & 3];
+
+		bgr[3 * i] = color[0];
+		bgr[3 * i + 1] = color[1];
+		bgr[3 * i + 2] = color[2];
+	}
+}
+
+void DecodeBC1Texel( const BYTE * block, const int i, BYTE * bgr )
+{
+	const int c0 = block[0] | ( block[1] << 8 );
+	const int c1 = block[2] | ( block[3] << 8 );
+	const int index = ( block[4 + ( i >> 2 )] >> ( 2 * ( i & 3 ) ) ) & 3;
+
+	if ( index < 2 )
+	{
+		Expand565( ( index == 0 ) ? c0 : c1, bgr );
+
+		return;
+	}
+
+	BYTE palette[4][3];
+	BC1Palette( c0, c1, palette );
+	memcpy( bgr, palette[index], 3 );
+}
+
+/* the eight values of the block, a0 > a1 */
+static void BC4Palette( const int a0, const int a1, int palette[8] )
+{
+	palette[0] = a0;
+	palette[1] = a1;
+
+	if ( a0 > a1 )
+	{
+		for ( int j = 1; j < 7; ++j ) palette[j + 1] = ( ( 7 - j ) * a0 + j * a1 + 3 ) / 7;
+	}
+	else
+	{
+		for ( int j = 1; j < 5; ++j ) palette[j + 1] = ( ( 5 - j ) * a0 + j * a1 + 2 ) / 5;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+void EncodeBC4( const BYTE * values, BYTE * block )
+{
+	int a0 = 0;
+	int a1 = 255;
+
+	for ( int i = 0; i < 16; ++i )
+	{
+		a0 = max( a0, int( values[i] ) );
+		a1 = min( a1, int( values[i] ) );
+	}
+
+	block[0] = static_cast<BYTE>( a0 );
+	block[1] = static_cast<BYTE>( a1 );
+
+	int palette[8];
+	BC4Palette( a0, a1, palette );
+
+	unsigned long long indices = 0;
+
+	for ( int i = 0; i < 16 && a0 > a1; ++i )
+	{
+		int best = 0;
+
+		for ( int j = 1; j < 8; ++j )
+		{
+			if ( abs( values[i] - palette[j] ) < abs( values[i] - palette[best] ) ) best = j;
+		}
+
+		indices |= static_cast<unsigned long long>( best ) << ( 3 * i );
+	}
+
+	for ( int i = 0; i < 6; ++i )
+	{
+		block[2 + i] = static_cast<BYTE>( indices >> ( 8 * i ) );
+	}
+}
+
+static inline unsigned long long BC4Indices( const BYTE * block )
+{
+	unsigned long long indices = 0;
+
+	for ( int i = 0; i < 6; ++i )
+	{
+		indices |= static_cast<unsigned long long>( block[2 + i] ) << ( 8 * i );
+	}
+
+	return indices;
+}
+
+void DecodeBC4( const BYTE * block, BYTE * values )
+{
+	int palette[8];
+	BC4Palette( block[0], block[1], palette );
+
+	const unsigned long long indices = BC4Indices( block );
+
+	for ( int i = 0; i < 16; ++i )
+	{
+		values[i] = static_cast<BYTE>( palette[( indices >> ( 3 * i ) ) & 7] );
+	}
+}
+
+BYTE DecodeBC4Texel( const BYTE * block, const int i )
+{
+	int palette[8];
+	BC4Palette( block[0], block[1], palette );
+
+	return static_cast<BYTE>( palette[( BC4Indices( block ) >> ( 3 * i ) ) & 7] );
+}
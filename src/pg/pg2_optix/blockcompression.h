@@ -0,0 +1,23 @@
+#ifndef BLOCK_COMPRESSION_H_
+#define BLOCK_COMPRESSION_H_
+
+/* the BC1 ( DXT1 ) and BC4 blocks store 4x4 texels in 8 bytes, the layout is the same as in the D3D and OpenGL formats */
+#define BC_BLOCK_SIZE 4
+#define BC_BLOCK_BYTES 8
+
+/* encodes 16 BGR texels ( 3 bytes each, row-major in the block ) to an opaque BC1 block, the endpoints are fitted
+along the principal axis of the colors and refined once by the least squares */
+void EncodeBC1( const BYTE * bgr, BYTE * block );
+/* decodes the BC1 block to 16 BGR texels */
+void DecodeBC1( const BYTE * block, BYTE * bgr );
+/* decodes the texel i of the BC1 block, i = 4 * y + x */
+void DecodeBC1Texel( const BYTE * block, const int i, BYTE * bgr );
+
+/* encodes 16 single channel values to a BC4 block in the eight values mode */
+void EncodeBC4( const BYTE * values, BYTE * block );
+/* decodes the BC4 block to 16 values */
+void DecodeBC4( const BYTE * block, BYTE * values );
+/* decodes the value i of the BC4 block, i = 4 * y + x */
+BYTE DecodeBC4Texel( const BYTE * block, const int i );
+
+#endif
@@ -0,0 +1,95 @@
+#include "pch.h"
+#include "bsdf.h"
+#include "mymath.h"
+
+/* reflected radiance under the uniform white sky is the directional albedo, computed with the given sampling of the hemisphere */
+template <class Sampler>
+static void ReportGgxEstimate( const char * name, const GgxBrdf & brdf, const int no_samples, std::mt19937 & generator,
+	const Sampler & sampler, const double reference )
+{
+	std::uniform_real_distribution<float> uniform( 0.0f, 1.0f );
+	double sum = 0.0, sqr_sum = 0.0;
+
+	for ( int i = 0; i < no_samples; ++i )
+	{
+		const float u0 = uniform( generator ), u1 = uniform( generator ), u2 = uniform( generator );
+		const double y = sampler( brdf, u0, u1, u2 );
+
+		sum += y;
+		sqr_sum += y * y;
+	}
+
+	const double mean = sum / no_samples;
+	const double variance = max( 0.0, sqr_sum / no_samples - mean * mean );
+	// relative error of the estimate with all the samples
+	const double relative_error = ( reference > 0.0 ) ? sqrt( variance / no_samples ) / reference : 0.0;
+
+	printf( "  %-20s %0.4f, relative error %0.5f\n", name, mean, relative_error );
+}
+
+static double GgxVndfSample( const GgxBrdf & brdf, const float u0, const float u1, const float u2 )
+{
+	optix::float3 omega_i, weight;
+	float pdf = 0.0f;
+
+	return brdf.Sample( u0, u1, u2, omega_i, weight, pdf ) ? Luminance( weight ) : 0.0;
+}
+
+static double GgxCosineSample( const GgxBrdf & brdf, const float /*u0*/, const float u1, const float u2 )
+{
+	const optix::float3 omega_i = SampleCosineHemisphere( brdf.normal, u1, u2 );
+	const float pdf = fmaxf( 0.0f, optix::dot( brdf.normal, omega_i ) ) * M_1_PIf;
+
+	return ( pdf > 0.0f ) ? Luminance( brdf( omega_i ) ) / pdf : 0.0;
+}
+
+static double GgxUniformSample( const GgxBrdf & brdf, const float /*u0*/, const float u1, const float u2 )
+{
+	const optix::float3 omega_i = SphericalDirection( brdf.normal, u2, 2.0f * M_PIf * u1 );
+
+	return Luminance( brdf( omega_i ) ) * 2.0 * M_PI;
+}
+
+void ReportGgxConvergence( const int no_samples )
+{
+	if ( no_samples <= 0 )
+	{
+		return;
+	}
+
+	std::mt19937 generator( 0 );
+	const float roughnesses[] = { 0.05f, 0.1f, 0.3f, 0.6f, 1.0f };
+	const float metallics[] = { 0.0f, 1.0f };
+
+	printf( "GGX reflected radiance under the uniform sky, %d samples per estimate, view at 60 deg:\n", no_samples );
+
+	for ( const float metallic : metallics )
+	{
+		for ( const float roughness : roughnesses )
+		{
+			GgxBrdf brdf;
+			brdf.base_color = optix::make_float3( 0.9f, 0.6f, 0.3f );
+			brdf.roughness = roughness;
+			brdf.metallic = metallic;
+			brdf.normal = optix::make_float3( 0.0f, 0.0f, 1.0f );
+			brdf.omega_o = optix::make_float3( sinf( float( M_PI ) / 3.0f ), 0.0f, cosf( float( M_PI ) / 3.0f ) );
+
+			// reference value from a long run of the visible normal sampling
+			double reference = 0.0;
+			std::uniform_real_distribution<float> uniform( 0.0f, 1.0f );
+
+			for ( int i = 0; i < 16 * no_samples; ++i )
+			{
+				const float u0 = uniform( generator ), u1 = uniform( generator ), u2 = uniform( generator );
+				reference += GgxVndfSample( brdf, u0, u1, u2 );
+			}
+
+			reference /= 16 * no_samples;
+
+			printf( " roughness %0.2f, metallic %0.0f, reference %0.4f\n", roughness, metallic, reference );
+			ReportGgxEstimate( "visible normals", brdf, no_samples, generator, GgxVndfSample, reference );
+			ReportGgxEstimate( "cosine hemisphere", brdf, no_samples, generator, GgxCosineSample, reference );
+			ReportGgxEstimate( "uniform hemisphere", brdf, no_samples, generator, GgxUniformSample, reference );
+		}
+	}
+}
@@ -0,0 +1,405 @@
+#ifndef BSDF_H_
+#define BSDF_H_
+
+#include <optixu/optixu_math_namespace.h>
+
+RT_HOSTDEVICE inline float Luminance( const optix::float3 & c )
+{
+	return 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z;
+}
+
+/* tangent t and bitangent b completing the unit vector n to an orthonormal basis */
+RT_HOSTDEVICE inline void OrthonormalBasis( const optix::float3 & n, optix::float3 & t, optix::float3 & b )
+{
+	t = optix::normalize( ( fabsf( n.x ) > fabsf( n.z ) ) ?
+		optix::make_float3( -n.y, n.x, 0.0f ) : optix::make_float3( 0.0f, -n.z, n.y ) );
+	b = optix::cross( n, t );
+}
+
+/* direction around the axis n with the given cosine and azimuth */
+RT_HOSTDEVICE inline optix::float3 SphericalDirection( const optix::float3 & n, const float cos_theta, const float phi )
+{
+	optix::float3 t, b;
+	OrthonormalBasis( n, t, b );
+	const float sin_theta = sqrtf( fmaxf( 0.0f, 1.0f - cos_theta * cos_theta ) );
+
+	return t * ( sin_theta * cosf( phi ) ) + b * ( sin_theta * sinf( phi ) ) + n * cos_theta;
+}
+
+/* cosine weighted direction in the hemisphere around the normal n, the pdf is cos( theta ) / pi */
+RT_HOSTDEVICE inline optix::float3 SampleCosineHemisphere( const optix::float3 & n, const float u0, const float u1 )
+{
+	return SphericalDirection( n, sqrtf( u1 ), 2.0f * M_PIf * u0 );
+}
+
+/* mirror reflection of the direction omega ( pointing away from the surface ) about the normal n */
+RT_HOSTDEVICE inline optix::float3 ReflectDirection( const optix::float3 & omega, const optix::float3 & n )
+{
+	return 2.0f * optix::dot( n, omega ) * n - omega;
+}
+
+/* power heuristic weight of the strategy with the density pdf_f combined with the strategy with the density pdf_g */
+RT_HOSTDEVICE inline float PowerHeuristic( const float pdf_f, const float pdf_g )
+{
+	const float f2 = pdf_f * pdf_f;
+	const float g2 = pdf_g * pdf_g;
+
+	return ( f2 + g2 > 0.0f ) ? f2 / ( f2 + g2 ) : 0.0f;
+}
+
+/* the light samples keep their full weight, used where no BSDF sampled path can find the light */
+struct NoMis
+{
+	RT_HOSTDEVICE float operator()( const optix::float3 & /*omega_l*/, const float /*light_pdf*/ ) const
+	{
+		return 1.0f;
+	}
+};
+
+/* multiple importance sampling weight of a light sample against the BSDF sampling of the same direction */
+template <class Bsdf>
+struct BsdfMis
+{
+	const Bsdf * bsdf;
+
+	RT_HOSTDEVICE float operator()( const optix::float3 & omega_l, const float light_pdf ) const
+	{
+		return PowerHeuristic( light_pdf, bsdf->Pdf( omega_l ) );
+	}
+};
+
+/* Lambertian BRDF times the cosine term */
+struct LambertBrdf
+{
+	optix::float3 albedo;
+	optix::float3 normal;
+
+	RT_HOSTDEVICE optix::float3 operator()( const optix::float3 & omega_l ) const
+	{
+		return albedo * ( M_1_PIf * optix::dot( normal, omega_l ) );
+	}
+
+	/* solid angle density of the directions generated by Sample */
+	RT_HOSTDEVICE float Pdf( const optix::float3 & omega_i ) const
+	{
+		return fmaxf( 0.0f, optix::dot( normal, omega_i ) ) * M_1_PIf;
+	}
+
+	/* cosine weighted continuation of the path, weight is the BRDF times the cosine over the pdf */
+	RT_HOSTDEVICE bool Sample( const float u0, const float u1, const float /*u2*/, optix::float3 & omega_i, optix::float3 & weight, float & pdf ) const
+	{
+		omega_i = SampleCosineHemisphere( normal, u0, u1 );
+		weight = albedo;
+		pdf = Pdf( omega_i );
+
+		return pdf > 0.0f;
+	}
+};
+
+/* energy normalized Phong BRDF times the cosine term */
+struct PhongBrdf
+{
+	optix::float3 albedo;
+	optix::float3 specular;
+	float shininess;
+	optix::float3 normal;
+	optix::float3 omega_o;
+
+	RT_HOSTDEVICE optix::float3 operator()( const optix::float3 & omega_l ) const
+	{
+		const float cos_theta = optix::dot( normal, omega_l );
+		const optix::float3 omega_r = 2.0f * cos_theta * normal - omega_l;
+		const float cos_alpha = optix::clamp( optix::dot( omega_o, omega_r ), 0.0f, 1.0f );
+
+		return ( albedo * M_1_PIf + specular * ( ( shininess + 2.0f ) * 0.5f * M_1_PIf * powf( cos_alpha, shininess ) ) ) * cos_theta;
+	}
+
+	/* probability of sampling the diffuse lobe, the lobes are picked by their luminance */
+	RT_HOSTDEVICE float DiffuseProbability() const
+	{
+		const float l_d = Luminance( albedo );
+		const float l_s = Luminance( specular );
+
+		return ( l_d + l_s > 0.0f ) ? l_d / ( l_d + l_s ) : 0.0f;
+	}
+
+	/* solid angle density of the directions generated by Sample, the pdf of the whole mixture */
+	RT_HOSTDEVICE float Pdf( const optix::float3 & omega_i ) const
+	{
+		const float cos_theta = optix::dot( normal, omega_i );
+
+		if ( cos_theta <= 0.0f )
+		{
+			return 0.0f;
+		}
+
+		const float p_d = DiffuseProbability();
+		const float cos_alpha = fmaxf( 0.0f, optix::dot( ReflectDirection( omega_o, normal ), omega_i ) );
+
+		return p_d * cos_theta * M_1_PIf + ( 1.0f - p_d ) * ( shininess + 1.0f ) * 0.5f * M_1_PIf * powf( cos_alpha, shininess );
+	}
+
+	/* picks the diffuse or the specular lobe by their luminance, the weight uses the pdf of the whole mixture */
+	RT_HOSTDEVICE bool Sample( const float u0, const float u1, const float u2, optix::float3 & omega_i, optix::float3 & weight, float & pdf ) const
+	{
+		if ( Luminance( albedo ) + Luminance( specular ) <= 0.0f )
+		{
+			return false;
+		}
+
+		if ( u0 < DiffuseProbability() )
+		{
+			omega_i = SampleCosineHemisphere( normal, u1, u2 );
+		}
+		else
+		{
+			omega_i = SphericalDirection( ReflectDirection( omega_o, normal ), powf( u2, 1.0f / ( shininess + 1.0f ) ), 2.0f * M_PIf * u1 );
+		}
+
+		pdf = Pdf( omega_i );
+
+		if ( pdf <= 0.0f )
+		{
+			return false;
+		}
+
+		weight = ( *this )( omega_i ) / pdf;
+
+		return true;
+	}
+};
+
+/* the smallest GGX roughness, sharper lobes run out of the float precision */
+#define GGX_MIN_ALPHA 1e-3f
+
+/* GGX ( Trowbridge-Reitz ) distribution of the microfacet normals with the cosine cos_h to the macro normal */
+RT_HOSTDEVICE inline float GgxD( const float cos_h, const float alpha )
+{
+	if ( cos_h <= 0.0f )
+	{
+		return 0.0f;
+	}
+
+	const float alpha2 = alpha * alpha;
+	const float d = cos_h * cos_h * ( alpha2 - 1.0f ) + 1.0f;
+
+	return alpha2 / ( M_PIf * d * d );
+}
+
+/* Smith's auxiliary function of the GGX distribution for the direction with the cosine cos_theta to the macro normal */
+RT_HOSTDEVICE inline float GgxLambda( const float cos_theta, const float alpha )
+{
+	const float cos2 = cos_theta * cos_theta;
+	const float tan2 = fmaxf( 0.0f, 1.0f - cos2 ) / fmaxf( cos2, 1e-12f );
+
+	return 0.5f * ( sqrtf( 1.0f + alpha * alpha * tan2 ) - 1.0f );
+}
+
+/* Smith masking function */
+RT_HOSTDEVICE inline float GgxG1( const float cos_theta, const float alpha )
+{
+	return 1.0f / ( 1.0f + GgxLambda( cos_theta, alpha ) );
+}
+
+/* height correlated masking and shadowing function */
+RT_HOSTDEVICE inline float GgxG2( const float cos_o, const float cos_i, const float alpha )
+{
+	return 1.0f / ( 1.0f + GgxLambda( cos_o, alpha ) + GgxLambda( cos_i, alpha ) );
+}
+
+/*! \fn optix::float3 SampleGgxVndf( const optix::float3 & v, const float alpha, const float u0, const float u1 )
+\brief Samples a microfacet normal from the distribution of the normals visible from the direction v (Heitz 2018).
+
+Both \a v and the returned normal are in the local frame with the macro normal along z.
+The density of the reflected direction is G1( v ) D( m ) / ( 4 v.z ).
+*/
+RT_HOSTDEVICE inline optix::float3 SampleGgxVndf( const optix::float3 & v, const float alpha, const float u0, const float u1 )
+{
+	// the view direction in the hemisphere configuration
+	const optix::float3 v_h = optix::normalize( optix::make_float3( alpha * v.x, alpha * v.y, v.z ) );
+	const float length2 = v_h.x * v_h.x + v_h.y * v_h.y;
+	const optix::float3 t1 = ( length2 > 0.0f ) ? optix::make_float3( -v_h.y, v_h.x, 0.0f ) / sqrtf( length2 ) : optix::make_float3( 1.0f, 0.0f, 0.0f );
+	const optix::float3 t2 = optix::cross( v_h, t1 );
+
+	// point on the projected hemisphere
+	const float r = sqrtf( u0 );
+	const float phi = 2.0f * M_PIf * u1;
+	const float p1 = r * cosf( phi );
+	const float s = 0.5f * ( 1.0f + v_h.z );
+	const float p2 = ( 1.0f - s ) * sqrtf( fmaxf( 0.0f, 1.0f - p1 * p1 ) ) + s * r * sinf( phi );
+	const optix::float3 n_h = t1 * p1 + t2 * p2 + v_h * sqrtf( fmaxf( 0.0f, 1.0f - p1 * p1 - p2 * p2 ) );
+
+	// back to the ellipsoid configuration
+	return optix::normalize( optix::make_float3( alpha * n_h.x, alpha * n_h.y, fmaxf( 1e-6f, n_h.z ) ) );
+}
+
+RT_HOSTDEVICE inline optix::float3 FresnelSchlick( const optix::float3 & f0, const float cos_theta )
+{
+	const float m = fminf( 1.0f, fmaxf( 0.0f, 1.0f - cos_theta ) );
+	const float m2 = m * m;
+
+	return f0 + ( optix::make_float3( 1.0f ) - f0 ) * ( m2 * m2 * m );
+}
+
+/*! \struct GgxBrdf
+\brief Cook-Torrance BRDF with the GGX distribution and the metallic workflow, times the cosine term.
+
+Dielectrics reflect 4 % at the normal incidence and scatter the rest by the Lambertian lobe,
+metals reflect the base colour. The specular lobe is sampled by its visible normals.
+*/
+struct GgxBrdf
+{
+	optix::float3 base_color;
+	float roughness; /*!< Perceptual roughness, alpha = roughness^2. */
+	float metallic;
+	optix::float3 normal;
+	optix::float3 omega_o;
+
+	RT_HOSTDEVICE float alpha() const
+	{
+		return fmaxf( GGX_MIN_ALPHA, roughness * roughness );
+	}
+
+	/* reflectance at the normal incidence */
+	RT_HOSTDEVICE optix::float3 f0() const
+	{
+		return optix::lerp( optix::make_float3( 0.04f ), base_color, metallic );
+	}
+
+	RT_HOSTDEVICE optix::float3 operator()( const optix::float3 & omega_l ) const
+	{
+		const float cos_o = optix::dot( normal, omega_o );
+		const float cos_i = optix::dot( normal, omega_l );
+
+		if ( cos_o <= 0.0f || cos_i <= 0.0f )
+		{
+			return optix::make_float3( 0.0f );
+		}
+
+		const optix::float3 h = optix::normalize( omega_o + omega_l );
+		const float a = alpha();
+		const optix::float3 f = FresnelSchlick( f0(), optix::dot( omega_l, h ) );
+		// D G F / ( 4 cos_o cos_i ) times cos_i
+		const optix::float3 specular = f * ( GgxD( optix::dot( normal, h ), a ) * GgxG2( cos_o, cos_i, a ) / ( 4.0f * cos_o ) );
+		const optix::float3 diffuse = ( optix::make_float3( 1.0f ) - f ) * base_color * ( ( 1.0f - metallic ) * M_1_PIf * cos_i );
+
+		return diffuse + specular;
+	}
+
+	/* probability of sampling the specular lobe, never too small so the highlights of the dielectrics converge */
+	RT_HOSTDEVICE float SpecularProbability() const
+	{
+		const float l_s = Luminance( FresnelSchlick( f0(), optix::dot( normal, omega_o ) ) );
+		const float l_d = ( 1.0f - metallic ) * Luminance( base_color );
+
+		if ( l_d <= 0.0f )
+		{
+			return 1.0f;
+		}
+
+		return fminf( 1.0f, fmaxf( 0.25f, l_s / ( l_s + l_d ) ) );
+	}
+
+	/* solid angle density of the directions generated by Sample */
+	RT_HOSTDEVICE float Pdf( const optix::float3 & omega_i ) const
+	{
+		const float cos_o = optix::dot( normal, omega_o );
+		const float cos_i = optix::dot( normal, omega_i );
+
+		if ( cos_o <= 0.0f || cos_i <= 0.0f )
+		{
+			return 0.0f;
+		}
+
+		const float a = alpha();
+		const optix::float3 h = optix::normalize( omega_o + omega_i );
+		const float pdf_s = GgxG1( cos_o, a ) * GgxD( optix::dot( normal, h ), a ) / ( 4.0f * cos_o );
+		const float p_s = SpecularProbability();
+
+		return p_s * pdf_s + ( 1.0f - p_s ) * cos_i * M_1_PIf;
+	}
+
+	/* picks the specular lobe ( visible normals ) or the diffuse lobe ( cosine ), the weight uses the pdf of the whole mixture */
+	RT_HOSTDEVICE bool Sample( const float u0, const float u1, const float u2, optix::float3 & omega_i, optix::float3 & weight, float & pdf ) const
+	{
+		const float cos_o = optix::dot( normal, omega_o );
+
+		if ( cos_o <= 0.0f )
+		{
+			return false;
+		}
+
+		if ( u0 < SpecularProbability() )
+		{
+			optix::float3 t, b;
+			OrthonormalBasis( normal, t, b );
+			const optix::float3 v = optix::make_float3( optix::dot( omega_o, t ), optix::dot( omega_o, b ), cos_o );
+			const optix::float3 m = SampleGgxVndf( v, alpha(), u1, u2 );
+			omega_i = ReflectDirection( omega_o, t * m.x + b * m.y + normal * m.z );
+		}
+		else
+		{
+			omega_i = SampleCosineHemisphere( normal, u1, u2 );
+		}
+
+		pdf = Pdf( omega_i );
+
+		if ( pdf <= 0.0f )
+		{
+			return false;
+		}
+
+		weight = ( *this )( omega_i ) / pdf;
+
+		return true;
+	}
+};
+
+/* Fresnel reflectance of an unpolarized light at the interface, cos_i is measured on the side with the index n1 */
+RT_HOSTDEVICE inline float FresnelDielectric( const float cos_i, const float n1, const float n2 )
+{
+	const float eta = n1 / n2;
+	const float sin2_t = eta * eta * fmaxf( 0.0f, 1.0f - cos_i * cos_i );
+
+	if ( sin2_t >= 1.0f )
+	{
+		return 1.0f; // total internal reflection
+	}
+
+	const float cos_t = sqrtf( 1.0f - sin2_t );
+	const float r_s = ( n1 * cos_i - n2 * cos_t ) / ( n1 * cos_i + n2 * cos_t );
+	const float r_p = ( n2 * cos_i - n1 * cos_t ) / ( n2 * cos_i + n1 * cos_t );
+
+	return 0.5f * ( r_s * r_s + r_p * r_p );
+}
+
+/*! \fn optix::float3 SampleDielectric( const optix::float3 & direction, const optix::float3 & normal, const bool front_face, const float ior, const float u )
+\brief Reflects or refracts the incoming ray by the Fresnel reflectance, the path weight is one.
+\param normal normal facing the incoming ray.
+\param front_face true when the ray enters the material.
+*/
+RT_HOSTDEVICE inline optix::float3 SampleDielectric( const optix::float3 & direction, const optix::float3 & normal,
+	const bool front_face, const float ior, const float u )
+{
+	const float n1 = front_face ? 1.0f : ior;
+	const float n2 = front_face ? ior : 1.0f;
+	const float cos_i = fminf( 1.0f, -optix::dot( direction, normal ) );
+
+	if ( u < FresnelDielectric( cos_i, n1, n2 ) )
+	{
+		return ReflectDirection( -direction, normal );
+	}
+
+	const float eta = n1 / n2;
+	const float cos_t = sqrtf( fmaxf( 0.0f, 1.0f - eta * eta * ( 1.0f - cos_i * cos_i ) ) );
+
+	return optix::normalize( eta * direction + ( eta * cos_i - cos_t ) * normal );
+}
+
+#ifndef __CUDACC__
+/* prints the error of the reflected radiance estimate of a GGX surface under a uniform white sky for several roughnesses,
+the visible normal sampling is compared with the cosine and the uniform hemisphere sampling at the same sample count */
+void ReportGgxConvergence( const int no_samples );
+#endif // !__CUDACC__
+
+#endif
@@ -0,0 +1,400 @@
+#include "pch.h"
+#include "colorkernels.h"
+#include "structs.h"
+#include "mymath.h"
+
+#if defined( COLOR_KERNELS_AVX2 )
+#include <immintrin.h>
+#elif defined( COLOR_KERNELS_SSE2 )
+#include <emmintrin.h>
+#endif
+
+const char * ColorKernelsIsa()
+{
+#if defined( COLOR_KERNELS_AVX2 )
+	return "AVX2";
+#elif defined( COLOR_KERNELS_SSE2 )
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
+
+const float * SrgbToLinearTable()
+{
+	struct Table
+	{
+		float values[256];
+
+		Table()
+		{
+			for ( int i = 0; i < 256; ++i )
+			{
+				values[i] = c_linear( i / 255.0f );
+			}
+		}
+	};
+
+	static const Table table; // thread-safe initialization
+
+	return table.values;
+}
+
+void BuildSrgbEncodeTable( const float gamma, BYTE * table )
+{
+	for ( int i = 0; i < SRGB_LUT_SIZE; ++i )
+	{
+		table[i] = static_cast<BYTE>( c_srgb( float( i ) / ( SRGB_LUT_SIZE - 1 ), gamma ) * 255.0f + 0.5f );
+	}
+
+	for ( int i = SRGB_LUT_SIZE; i < SRGB_ENCODE_TABLE_SIZE; ++i )
+	{
+		table[i] = 255;
+	}
+}
+
+static inline void ConvertBgr8ToFloat4Scalar( const BYTE * p, const int pixel_size, const float * table, optix::float4 & dst )
+{
+	const float s = 1.0f / 255.0f;
+	const float a = ( pixel_size == 4 ) ? p[3] * s : 1.0f;
+
+	if ( table )
+	{
+		dst = optix::make_float4( table[p[2]], table[p[1]], table[p[0]], a );
+	}
+	else
+	{
+		dst = optix::make_float4( p[2] * s, p[1] * s, p[0] * s, a );
+	}
+}
+
+void ConvertBgr8ToFloat4( const BYTE * src, const int pixel_size, const int count, const bool linearize, optix::float4 * dst )
+{
+	const float * table = linearize ? SrgbToLinearTable() : nullptr;
+	int i = 0;
+
+#if defined( COLOR_KERNELS_AVX2 )
+	// two pixels per iteration, the 3 byte pixels read one byte of the next pixel so the last pair is left to the scalar loop
+	const __m256 s = _mm256_set1_ps( 1.0f / 255.0f );
+	const __m256 one = _mm256_set1_ps( 1.0f );
+	const int n = ( pixel_size == 4 ) ? count - 1 : count - 2;
+
+	for ( ; i < n; i += 2 )
+	{
+		const BYTE * p = src + i * pixel_size;
+		int w0, w1;
+		memcpy( &w0, p, 4 );
+		memcpy( &w1, p + pixel_size, 4 );
+
+		const __m256i bytes = _mm256_cvtepu8_epi32( _mm_unpacklo_epi32( _mm_cvtsi32_si128( w0 ), _mm_cvtsi32_si128( w1 ) ) );
+		const __m256 normalized = _mm256_mul_ps( _mm256_cvtepi32_ps( bytes ), s );
+		__m256 v = table ? _mm256_i32gather_ps( table, bytes, 4 ) : normalized;
+
+		// alpha from the source or one, then BGRA -> RGBA within each pixel
+		v = _mm256_blend_ps( v, ( pixel_size == 4 ) ? normalized : one, 0x88 );
+		_mm256_storeu_ps( &dst[i].x, _mm256_permute_ps( v, _MM_SHUFFLE( 3, 0, 1, 2 ) ) );
+	}
+#elif defined( COLOR_KERNELS_SSE2 )
+	const __m128 s = _mm_set1_ps( 1.0f / 255.0f );
+	const __m128i zero = _mm_setzero_si128();
+	const int n = ( pixel_size == 4 ) ? count : count - 1;
+
+	for ( ; i < n; ++i )
+	{
+		const BYTE * p = src + i * pixel_size;
+
+		if ( table )
+		{
+			_mm_storeu_ps( &dst[i].x, _mm_set_ps( ( pixel_size == 4 ) ? p[3] * ( 1.0f / 255.0f ) : 1.0f, table[p[0]], table[p[1]], table[p[2]] ) );
+		}
+		else
+		{
+			int w;
+			memcpy( &w, p, 4 );
+			const __m128i bytes = _mm_unpacklo_epi16( _mm_unpacklo_epi8( _mm_cvtsi32_si128( w ), zero ), zero );
+			__m128 v = _mm_mul_ps( _mm_cvtepi32_ps( bytes ), s );
+			v = _mm_shuffle_ps( v, v, _MM_SHUFFLE( 3, 0, 1, 2 ) );
+			_mm_storeu_ps( &dst[i].x, v );
+
+			if ( pixel_size != 4 )
+			{
+				dst[i].w = 1.0f;
+			}
+		}
+	}
+#endif
+
+	for ( ; i < count; ++i )
+	{
+		ConvertBgr8ToFloat4Scalar( src + i * pixel_size, pixel_size, table, dst[i] );
+	}
+}
+
+void ConvertFloat4ToSrgb8( const optix::float4 * src, const int count, const BYTE * table, BYTE * dst )
+{
+	const float lut_scale = float( SRGB_LUT_SIZE - 1 );
+	int i = 0;
+
+#if defined( COLOR_KERNELS_AVX2 )
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps( 1.0f );
+	const __m256 scale = _mm256_set1_ps( lut_scale );
+	const __m256 half = _mm256_set1_ps( 0.5f );
+	const __m256i byte_mask = _mm256_set1_epi32( 0xFF );
+	const __m256i alpha = _mm256_set1_epi32( 255 );
+
+	for ( ; i + 1 < count; i += 2 )
+	{
+		// NaNs end up as black, max returns its second operand for them
+		const __m256 v = _mm256_min_ps( _mm256_max_ps( _mm256_loadu_ps( &src[i].x ), zero ), one );
+		const __m256i index = _mm256_cvttps_epi32( _mm256_add_ps( _mm256_mul_ps( v, scale ), half ) );
+		// 32-bit words starting at the table bytes, only their lowest byte is used
+		__m256i bytes = _mm256_and_si256( _mm256_i32gather_epi32( reinterpret_cast<const int *>( table ), index, 1 ), byte_mask );
+		bytes = _mm256_blend_epi32( bytes, alpha, 0x88 );
+
+		const __m256i packed = _mm256_packus_epi16( _mm256_packus_epi32( bytes, bytes ), _mm256_setzero_si256() );
+		const int p0 = _mm_cvtsi128_si32( _mm256_castsi256_si128( packed ) );
+		const int p1 = _mm_cvtsi128_si32( _mm256_extracti128_si256( packed, 1 ) );
+		memcpy( dst + i * 4, &p0, 4 );
+		memcpy( dst + i * 4 + 4, &p1, 4 );
+	}
+#elif defined( COLOR_KERNELS_SSE2 )
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps( 1.0f );
+	const __m128 scale = _mm_set1_ps( lut_scale );
+	const __m128 half = _mm_set1_ps( 0.5f );
+
+	for ( ; i < count; ++i )
+	{
+		const __m128 v = _mm_min_ps( _mm_max_ps( _mm_loadu_ps( &src[i].x ), zero ), one );
+		alignas( 16 ) int index[4];
+		_mm_store_si128( reinterpret_cast<__m128i *>( index ), _mm_cvttps_epi32( _mm_add_ps( _mm_mul_ps( v, scale ), half ) ) );
+
+		BYTE * p = dst + i * 4;
+		p[0] = table[index[0]];
+		p[1] = table[index[1]];
+		p[2] = table[index[2]];
+		p[3] = 255;
+	}
+#endif
+
+	for ( ; i < count; ++i )
+	{
+		const float rgb[3] = { src[i].x, src[i].y, src[i].z };
+		BYTE * p = dst + i * 4;
+
+		for ( int j = 0; j < 3; ++j )
+		{
+			const float v = ( rgb[j] > 0.0f ) ? min( rgb[j], 1.0f ) : 0.0f;
+			p[j] = table[static_cast<int>( v * lut_scale + 0.5f )];
+		}
+
+		p[3] = 255;
+	}
+}
+
+void SwizzleBgr8ToRgba8( const BYTE * src, const int pixel_size, const int count, BYTE * dst )
+{
+	int i = 0;
+
+#if defined( COLOR_KERNELS_SSE2 )
+	if ( pixel_size == 1 )
+	{
+		// sixteen gray bytes are repeated four times by unpacking them with themselves twice
+		const __m128i alpha = _mm_set1_epi32( 0xFF000000 );
+
+		for ( ; i + 16 <= count; i += 16 )
+		{
+			const __m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i *>( src + i ) );
+			const __m128i low = _mm_unpacklo_epi8( v, v );
+			const __m128i high = _mm_unpackhi_epi8( v, v );
+			__m128i * q = reinterpret_cast<__m128i *>( dst + i * 4 );
+
+			_mm_storeu_si128( q, _mm_or_si128( _mm_unpacklo_epi16( low, low ), alpha ) );
+			_mm_storeu_si128( q + 1, _mm_or_si128( _mm_unpackhi_epi16( low, low ), alpha ) );
+			_mm_storeu_si128( q + 2, _mm_or_si128( _mm_unpacklo_epi16( high, high ), alpha ) );
+			_mm_storeu_si128( q + 3, _mm_or_si128( _mm_unpackhi_epi16( high, high ), alpha ) );
+		}
+	}
+#endif
+
+#if defined( COLOR_KERNELS_AVX2 )
+	if ( pixel_size == 4 )
+	{
+		const __m256i shuffle = _mm256_setr_epi8( 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+			2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15 );
+
+		for ( ; i + 8 <= count; i += 8 )
+		{
+			const __m256i v = _mm256_loadu_si256( reinterpret_cast<const __m256i *>( src + i * 4 ) );
+			_mm256_storeu_si256( reinterpret_cast<__m256i *>( dst + i * 4 ), _mm256_shuffle_epi8( v, shuffle ) );
+		}
+	}
+	else if ( pixel_size == 3 )
+	{
+		// four pixels from 12 bytes, the load reads 4 bytes ahead so the last group is left to the scalar loop
+		const __m128i shuffle = _mm_setr_epi8( 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1 );
+		const __m128i alpha = _mm_set1_epi32( 0xFF000000 );
+
+		for ( ; i + 5 < count; i += 4 )
+		{
+			const __m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i *>( src + i * 3 ) );
+			_mm_storeu_si128( reinterpret_cast<__m128i *>( dst + i * 4 ), _mm_or_si128( _mm_shuffle_epi8( v, shuffle ), alpha ) );
+		}
+	}
+#elif defined( COLOR_KERNELS_SSE2 )
+	if ( pixel_size == 4 )
+	{
+		// swaps the red and blue bytes of four pixels with shifts and masks, SSE2 has no byte shuffle
+		const __m128i ga = _mm_set1_epi32( 0xFF00FF00 );
+		const __m128i low = _mm_set1_epi32( 0xFF );
+
+		for ( ; i + 4 <= count; i += 4 )
+		{
+			const __m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i *>( src + i * 4 ) );
+			const __m128i r = _mm_and_si128( _mm_srli_epi32( v, 16 ), low );
+			const __m128i b = _mm_slli_epi32( _mm_and_si128( v, low ), 16 );
+			_mm_storeu_si128( reinterpret_cast<__m128i *>( dst + i * 4 ), _mm_or_si128( _mm_and_si128( v, ga ), _mm_or_si128( r, b ) ) );
+		}
+	}
+#endif
+
+	// the channels of the gray pixels are the same byte
+	const int g = min( 1, pixel_size - 1 );
+	const int r = min( 2, pixel_size - 1 );
+
+	for ( ; i < count; ++i )
+	{
+		const BYTE * p = src + i * pixel_size;
+		BYTE * q = dst + i * 4;
+
+		q[0] = p[r];
+		q[1] = p[g];
+		q[2] = p[0];
+		q[3] = ( pixel_size == 4 ) ? p[3] : 255;
+	}
+}
+
+void SwizzleRgbfToBgrf( const float * src, const int channels, const int count, float * dst )
+{
+	// simple enough for the compilers to vectorize, the loop is bound by the memory bandwidth
+	for ( int i = 0; i < count; ++i )
+	{
+		const float * p = src + i * channels;
+		float * q = dst + i * 3;
+
+		q[0] = p[2];
+		q[1] = p[1];
+		q[2] = p[0];
+	}
+}
+
+void ReportColorKernels( const int no_pixels )
+{
+	std::vector<BYTE> bgra( no_pixels * 4 );
+	std::vector<optix::float4> linear( no_pixels );
+	std::vector<optix::float4> reference( no_pixels );
+	std::vector<BYTE> rgba( no_pixels * 4 );
+	std::vector<BYTE> rgba_reference( no_pixels * 4 );
+	BYTE table[SRGB_ENCODE_TABLE_SIZE];
+	BuildSrgbEncodeTable( 2.4f, table );
+
+	std::mt19937 generator( 0 );
+	std::uniform_int_distribution<int> byte( 0, 255 );
+
+	for ( auto & b : bgra )
+	{
+		b = static_cast<BYTE>( byte( generator ) );
+	}
+
+	// best of three runs
+	auto gpixels = [&]( auto && body )
+	{
+		double seconds = 1e+30;
+
+		for ( int run = 0; run < 3; ++run )
+		{
+			const auto t0 = std::chrono::high_resolution_clock::now();
+			body();
+			const auto t1 = std::chrono::high_resolution_clock::now();
+			seconds = min( seconds, std::chrono::duration<double>( t1 - t0 ).count() );
+		}
+
+		return ( seconds > 0.0 ) ? no_pixels / seconds * 1e-9 : 0.0;
+	};
+
+	printf( "Color kernels (%s), %d px:\n", ColorKernelsIsa(), no_pixels );
+
+	for ( const int pixel_size : { 3, 4 } )
+	{
+		const double scalar = gpixels( [&]() {
+			for ( int i = 0; i < no_pixels; ++i )
+			{
+				const BYTE * p = &bgra[i * pixel_size];
+				reference[i] = optix::make_float4( c_linear( p[2] / 255.0f ), c_linear( p[1] / 255.0f ), c_linear( p[0] / 255.0f ),
+					( pixel_size == 4 ) ? p[3] / 255.0f : 1.0f );
+			} } );
+		const double kernel = gpixels( [&]() { ConvertBgr8ToFloat4( bgra.data(), pixel_size, no_pixels, true, linear.data() ); } );
+
+		float max_error = 0.0f;
+
+		for ( int i = 0; i < no_pixels; ++i )
+		{
+			max_error = max( max_error, max( max( fabsf( linear[i].x - reference[i].x ), fabsf( linear[i].y - reference[i].y ) ),
+				max( fabsf( linear[i].z - reference[i].z ), fabsf( linear[i].w - reference[i].w ) ) ) );
+		}
+
+		printf( "  BGR%s8 -> linear float4: c_linear %0.3f, kernel %0.3f Gpx/s, max error %g\n",
+			( pixel_size == 4 ) ? "A" : "", scalar, kernel, max_error );
+
+		const double divide = gpixels( [&]() {
+			for ( int i = 0; i < no_pixels; ++i )
+			{
+				const BYTE * p = &bgra[i * pixel_size];
+				reference[i] = optix::make_float4( p[2] / 255.0f, p[1] / 255.0f, p[0] / 255.0f, 1.0f );
+			} } );
+		const double normalized = gpixels( [&]() { ConvertBgr8ToFloat4( bgra.data(), pixel_size, no_pixels, false, linear.data() ); } );
+
+		printf( "  BGR%s8 -> float4: divide %0.3f, kernel %0.3f Gpx/s\n", ( pixel_size == 4 ) ? "A" : "", divide, normalized );
+
+		const double swizzle_scalar = gpixels( [&]() {
+			for ( int i = 0; i < no_pixels; ++i )
+			{
+				const BYTE * p = &bgra[i * pixel_size];
+				rgba_reference[i * 4] = p[2];
+				rgba_reference[i * 4 + 1] = p[1];
+				rgba_reference[i * 4 + 2] = p[0];
+				rgba_reference[i * 4 + 3] = ( pixel_size == 4 ) ? p[3] : 255;
+			} } );
+		const double swizzle = gpixels( [&]() { SwizzleBgr8ToRgba8( bgra.data(), pixel_size, no_pixels, rgba.data() ); } );
+
+		printf( "  BGR%s8 -> RGBA8: scalar %0.3f, kernel %0.3f Gpx/s, %s\n", ( pixel_size == 4 ) ? "A" : "", swizzle_scalar, swizzle,
+			( rgba == rgba_reference ) ? "identical" : "MISMATCH" );
+	}
+
+	// encoding of the values decoded above plus some out of range ones
+	for ( int i = 0; i < no_pixels; i += 97 )
+	{
+		linear[i].x = -linear[i].x;
+		linear[i].y *= 4.0f;
+	}
+
+	const double srgb_scalar = gpixels( [&]() {
+		for ( int i = 0; i < no_pixels; ++i )
+		{
+			rgba_reference[i * 4] = static_cast<BYTE>( c_srgb( linear[i].x ) * 255.0f + 0.5f );
+			rgba_reference[i * 4 + 1] = static_cast<BYTE>( c_srgb( linear[i].y ) * 255.0f + 0.5f );
+			rgba_reference[i * 4 + 2] = static_cast<BYTE>( c_srgb( linear[i].z ) * 255.0f + 0.5f );
+			rgba_reference[i * 4 + 3] = 255;
+		} } );
+	const double srgb = gpixels( [&]() { ConvertFloat4ToSrgb8( linear.data(), no_pixels, table, rgba.data() ); } );
+
+	int max_difference = 0;
+
+	for ( int i = 0; i < no_pixels * 4; ++i )
+	{
+		max_difference = max( max_difference, abs( int( rgba[i] ) - int( rgba_reference[i] ) ) );
+	}
+
+	printf( "  linear float4 -> sRGB8: c_srgb %0.3f, kernel %0.3f Gpx/s, max difference %d/255\n", srgb_scalar, srgb, max_difference );
+}
@@ -0,0 +1,51 @@
+#ifndef COLOR_KERNELS_H_
+#define COLOR_KERNELS_H_
+
+#include <optixu/optixu_math_namespace.h>
+
+/* the batch conversions are vectorized with AVX2 or SSE2 when the compiler targets them, the x64 configurations
+of the projects target AVX2 ( /arch:AVX2 ), define COLOR_KERNELS_SCALAR to force the portable version */
+#if !defined( COLOR_KERNELS_SCALAR )
+#if defined( __AVX2__ )
+#define COLOR_KERNELS_AVX2
+#endif
+#if defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 ) || defined( __SSE2__ )
+#define COLOR_KERNELS_SSE2
+#endif
+#endif
+
+/* number of linear values in [0, 1] in the sRGB encoding table */
+#define SRGB_LUT_SIZE 4096
+/* the table is padded so the AVX2 path can gather 32-bit words at any entry */
+#define SRGB_ENCODE_TABLE_SIZE ( SRGB_LUT_SIZE + 4 )
+
+/* name of the instruction set used by the kernels */
+const char * ColorKernelsIsa();
+
+/* linear values of all 256 sRGB bytes */
+const float * SrgbToLinearTable();
+
+/* fills the table with the sRGB bytes of the linear values i / ( SRGB_LUT_SIZE - 1 ), the table has SRGB_ENCODE_TABLE_SIZE entries */
+void BuildSrgbEncodeTable( const float gamma, BYTE * table );
+
+/*! \fn void ConvertBgr8ToFloat4( const BYTE * src, const int pixel_size, const int count, const bool linearize, optix::float4 * dst )
+\brief Expands count BGR or BGRA bytes ( \a pixel_size 3 or 4 ) into RGBA floats in [0, 1].
+
+\param linearize decodes the sRGB colour channels, the alpha stays linear.
+*/
+void ConvertBgr8ToFloat4( const BYTE * src, const int pixel_size, const int count, const bool linearize, optix::float4 * dst );
+
+/* clamps count linear RGBA floats to [0, 1] and encodes them to sRGB bytes with the table, the alpha is set to 255 */
+void ConvertFloat4ToSrgb8( const optix::float4 * src, const int count, const BYTE * table, BYTE * dst );
+
+/* reorders count gray, BGR or BGRA bytes ( \a pixel_size 1, 3 or 4 ) to RGBA, the gray byte is repeated to the colour channels,
+the missing alpha is set to 255 */
+void SwizzleBgr8ToRgba8( const BYTE * src, const int pixel_size, const int count, BYTE * dst );
+
+/* reorders count RGB or RGBA floats ( \a channels 3 or 4 ) to BGR floats */
+void SwizzleRgbfToBgrf( const float * src, const int channels, const int count, float * dst );
+
+/* prints Gpixels/s of the kernels and of the per channel c_linear / c_srgb conversions they replace */
+void ReportColorKernels( const int no_pixels = 1 << 22 );
+
+#endif
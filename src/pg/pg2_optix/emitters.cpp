@@ -0,0 +1,156 @@
+#include "pch.h"
+#include "emitters.h"
+#include "surface.h"
+
+float BuildAliasTable( const std::vector<float> & weights, std::vector<AliasEntry> & table )
+{
+	const size_t n = weights.size();
+	table.resize( n );
+
+	double sum = 0.0;
+	for ( const float w : weights )
+	{
+		sum += w;
+	}
+
+	if ( n == 0 || sum <= 0.0 )
+	{
+		for ( size_t i = 0; i < n; ++i )
+		{
+			table[i] = AliasEntry{ 1.0f, static_cast<unsigned int>( i ) };
+		}
+
+		return static_cast<float>( sum );
+	}
+
+	// weights scaled so that the mean bin holds exactly one unit
+	std::vector<double> scaled( n );
+	std::vector<unsigned int> small, large;
+	small.reserve( n );
+	large.reserve( n );
+
+	for ( size_t i = 0; i < n; ++i )
+	{
+		scaled[i] = weights[i] * n / sum;
+		( ( scaled[i] < 1.0 ) ? small : large ).push_back( static_cast<unsigned int>( i ) );
+	}
+
+	while ( !small.empty() && !large.empty() )
+	{
+		const unsigned int s = small.back(); small.pop_back();
+		const unsigned int l = large.back();
+
+		table[s] = AliasEntry{ static_cast<float>( scaled[s] ), l };
+
+		// the large bin donates the rest of the small one
+		scaled[l] = ( scaled[l] + scaled[s] ) - 1.0;
+
+		if ( scaled[l] < 1.0 )
+		{
+			large.pop_back();
+			small.push_back( l );
+		}
+	}
+
+	// leftovers are full bins up to the rounding errors
+	for ( const unsigned int i : large ) table[i] = AliasEntry{ 1.0f, i };
+	for ( const unsigned int i : small ) table[i] = AliasEntry{ 1.0f, i };
+
+	return static_cast<float>( sum );
+}
+
+void EmitterTable::Build( std::vector<Surface *> & surfaces )
+{
+	emitters_.clear();
+	table_.clear();
+	total_power_ = 0.0f;
+
+	std::vector<float> weights;
+
+	for ( auto surface : surfaces )
+	{
+		const Material * material = surface->get_material();
+
+		if ( material == nullptr || material->emission_.is_zero() )
+		{
+			continue;
+		}
+
+		const Color3f & e = material->emission_;
+		// luminance of the emitted radiance
+		const float luminance = 0.2126f * e.r + 0.7152f * e.g + 0.0722f * e.b;
+
+		for ( int i = 0; i < surface->no_triangles(); ++i )
+		{
+			Triangle & triangle = surface->get_triangle( i );
+			const Vector3 p0 = triangle.vertex( 0 ).position;
+			const Vector3 p1 = triangle.vertex( 1 ).position;
+			const Vector3 p2 = triangle.vertex( 2 ).position;
+
+			Emitter emitter;
+			emitter.v0 = optix::make_float3( p0.x, p0.y, p0.z );
+			emitter.e1 = optix::make_float3( p1.x - p0.x, p1.y - p0.y, p1.z - p0.z );
+			emitter.e2 = optix::make_float3( p2.x - p0.x, p2.y - p0.y, p2.z - p0.z );
+			emitter.area = 0.5f * optix::length( optix::cross( emitter.e1, emitter.e2 ) );
+			emitter.emission = optix::make_float3( e.r, e.g, e.b );
+			emitter.pdf = 0.0f;
+			emitter.pad = emitter.pad2 = 0.0f;
+
+			if ( emitter.area <= 0.0f )
+			{
+				continue; // degenerated triangles can not be sampled by area
+			}
+
+			emitters_.push_back( emitter );
+			// power of a two-sided Lambertian emitter is 2 * pi * A * L, the constant cancels out in the pdf
+			weights.push_back( emitter.area * luminance );
+		}
+	}
+
+	const float sum = BuildAliasTable( weights, table_ );
+
+	for ( size_t i = 0; i < emitters_.size(); ++i )
+	{
+		emitters_[i].pdf = weights[i] / sum;
+	}
+
+	total_power_ = 2.0f * float( M_PI ) * sum;
+
+	printf( "%u emissive triangle(s), total power %0.1f W.\n", size(), total_power_ );
+}
+
+bool EmitterTable::Sample( const float u0, const float u1, const float u2, const float u3, const optix::float3 & p,
+	optix::float3 & omega_l, float & distance, optix::float3 & radiance, float & pdf ) const
+{
+	if ( emitters_.empty() )
+	{
+		return false;
+	}
+
+	return SampleEmitter( emitters_.data(), table_.data(), size(), u0, u1, u2, u3, p, omega_l, distance, radiance, pdf );
+}
+
+const std::vector<Emitter> & EmitterTable::emitters() const
+{
+	return emitters_;
+}
+
+const std::vector<AliasEntry> & EmitterTable::table() const
+{
+	return table_;
+}
+
+unsigned int EmitterTable::size() const
+{
+	return static_cast<unsigned int>( emitters_.size() );
+}
+
+float EmitterTable::total_power() const
+{
+	return total_power_;
+}
+
+float EmitterTable::pdf_scale() const
+{
+	return ( total_power_ > 0.0f ) ? 2.0f * float( M_PI ) / total_power_ : 0.0f;
+}
@@ -0,0 +1,176 @@
+#ifndef EMITTERS_H_
+#define EMITTERS_H_
+
+#include <optixu/optixu_math_namespace.h>
+#include "bsdf.h"
+
+/*! \struct AliasEntry
+\brief Single bin of Walker's alias table.
+
+Bin i is taken with the probability \a threshold, otherwise the bin \a alias is taken instead.
+*/
+struct AliasEntry
+{
+	float threshold; /*!< Probability of keeping the bin itself. */
+	unsigned int alias; /*!< Index of the alternative bin. */
+};
+
+/*! \struct Emitter
+\brief Single emissive triangle prepared for the next event estimation.
+*/
+struct Emitter
+{
+	optix::float3 v0; /*!< First vertex of the triangle (ws). */
+	float area; /*!< Area of the triangle. */
+	optix::float3 e1; /*!< Edge v1 - v0. */
+	float pdf; /*!< Probability of selecting this emitter from the table. */
+	optix::float3 e2; /*!< Edge v2 - v0. */
+	float pad;
+	optix::float3 emission; /*!< Emitted radiance. */
+	float pad2;
+};
+
+/* O(1) sampling of a bin from an alias table of length n with two uniform random numbers */
+RT_HOSTDEVICE inline unsigned int SampleAlias( const AliasEntry * table, const unsigned int n, const float u0, const float u1 )
+{
+	unsigned int i = static_cast<unsigned int>( u0 * n );
+	if ( i >= n ) i = n - 1;
+
+	return ( u1 < table[i].threshold ) ? i : table[i].alias;
+}
+
+/* uniformly distributed point on the triangle */
+RT_HOSTDEVICE inline optix::float3 SampleTriangle( const Emitter & emitter, const float u0, const float u1 )
+{
+	const float su0 = sqrtf( u0 );
+
+	return emitter.v0 + emitter.e1 * ( su0 * ( 1.0f - u1 ) ) + emitter.e2 * ( su0 * u1 );
+}
+
+/*! \fn bool SampleEmitter( const Emitter * emitters, const AliasEntry * table, const unsigned int n, const float u0, const float u1,
+	const float u2, const float u3, const optix::float3 & p, optix::float3 & omega_l, float & distance, optix::float3 & radiance, float & pdf )
+\brief Picks an emitter proportionally to its power and a point on it uniformly by area.
+
+\param omega_l unit direction from \a p towards the sampled point.
+\param distance distance to the sampled point.
+\param radiance radiance emitted towards \a p.
+\param pdf probability density of the sample with respect to the solid angle at \a p.
+\return False when the sampled point faces away from \a p or no emitter exists.
+*/
+RT_HOSTDEVICE inline bool SampleEmitter( const Emitter * emitters, const AliasEntry * table, const unsigned int n,
+	const float u0, const float u1, const float u2, const float u3, const optix::float3 & p,
+	optix::float3 & omega_l, float & distance, optix::float3 & radiance, float & pdf )
+{
+	if ( n == 0 )
+	{
+		return false;
+	}
+
+	const Emitter & emitter = emitters[SampleAlias( table, n, u0, u1 )];
+	const optix::float3 x = SampleTriangle( emitter, u2, u3 );
+	const optix::float3 d = x - p;
+	const float sqr_distance = optix::dot( d, d );
+
+	if ( sqr_distance <= 0.0f )
+	{
+		return false;
+	}
+
+	distance = sqrtf( sqr_distance );
+	omega_l = d / distance;
+
+	// emitters are two-sided, the same way the attribute program unifies the normals
+	const optix::float3 n_l = optix::normalize( optix::cross( emitter.e1, emitter.e2 ) );
+	const float cos_l = fabsf( optix::dot( n_l, omega_l ) );
+
+	if ( cos_l <= 0.0f )
+	{
+		return false;
+	}
+
+	radiance = emitter.emission;
+	pdf = emitter.pdf / emitter.area * sqr_distance / cos_l;
+
+	return true;
+}
+
+/*! \fn float EmitterPdf( const optix::float3 & emission, const float pdf_scale, const float sqr_distance, const float cos_l )
+\brief Probability density of SampleEmitter generating the given point of an emissive triangle, with respect to the solid angle.
+
+The triangles are picked by their area times luminance, so the density per unit area is the luminance
+of the emission times \a pdf_scale, the reciprocal sum of the weights (see EmitterTable::pdf_scale).
+*/
+RT_HOSTDEVICE inline float EmitterPdf( const optix::float3 & emission, const float pdf_scale, const float sqr_distance, const float cos_l )
+{
+	return ( cos_l > 0.0f ) ? Luminance( emission ) * pdf_scale * sqr_distance / cos_l : 0.0f;
+}
+
+/*! \fn optix::float3 EvaluateEmitters( const Emitter * emitters, const AliasEntry * table, const unsigned int n, const float u0,
+	const float u1, const float u2, const float u3, const optix::float3 & p, const optix::float3 & normal, const Bsdf & bsdf,
+	const Visibility & visible, const Mis & mis )
+\brief Single sample next event estimation of the light arriving from the emissive triangles.
+
+\param bsdf functor returning the BSDF value times the cosine term for the given direction to the light.
+\param visible functor tracing a shadow ray, returns true when the light is not occluded.
+\param mis functor returning the weight of the sample given its direction and density, see BsdfMis.
+*/
+template <class Bsdf, class Visibility, class Mis = NoMis>
+RT_HOSTDEVICE inline optix::float3 EvaluateEmitters( const Emitter * emitters, const AliasEntry * table, const unsigned int n,
+	const float u0, const float u1, const float u2, const float u3, const optix::float3 & p, const optix::float3 & normal,
+	const Bsdf & bsdf, const Visibility & visible, const Mis & mis = Mis() )
+{
+	optix::float3 omega_l;
+	float distance = 0.0f;
+	optix::float3 radiance;
+	float pdf = 0.0f;
+
+	if ( !SampleEmitter( emitters, table, n, u0, u1, u2, u3, p, omega_l, distance, radiance, pdf ) || pdf <= 0.0f )
+	{
+		return optix::make_float3( 0.0f );
+	}
+
+	if ( optix::dot( normal, omega_l ) <= 0.0f || !visible( p, omega_l, distance ) )
+	{
+		return optix::make_float3( 0.0f );
+	}
+
+	return bsdf( omega_l ) * radiance * ( mis( omega_l, pdf ) / pdf );
+}
+
+#ifndef __CUDACC__
+/*! \fn float BuildAliasTable( const std::vector<float> & weights, std::vector<AliasEntry> & table )
+\brief Builds Walker's alias table (Vose's variant) for the given non-negative weights in O(n).
+\return Sum of all weights.
+*/
+float BuildAliasTable( const std::vector<float> & weights, std::vector<AliasEntry> & table );
+
+class Surface;
+
+/*! \class EmitterTable
+\brief Emissive triangles of the scene together with an alias table for their power sampling.
+*/
+class EmitterTable
+{
+public:
+	/* collects all triangles whose material has a non-zero emission, weighted by area x emitted power */
+	void Build( std::vector<Surface *> & surfaces );
+
+	/* host version of the device sampling, see SampleEmitter */
+	bool Sample( const float u0, const float u1, const float u2, const float u3, const optix::float3 & p,
+		optix::float3 & omega_l, float & distance, optix::float3 & radiance, float & pdf ) const;
+
+	const std::vector<Emitter> & emitters() const;
+	const std::vector<AliasEntry> & table() const;
+	unsigned int size() const;
+	float total_power() const;
+	/* reciprocal sum of the sampling weights, see EmitterPdf */
+	float pdf_scale() const;
+
+private:
+	std::vector<Emitter> emitters_;
+	std::vector<AliasEntry> table_;
+	float total_power_{ 0.0f };
+};
+#endif // !__CUDACC__
+
+#endif
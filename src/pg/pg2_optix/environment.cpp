@@ -0,0 +1,140 @@
+#include "pch.h"
+#include "environment.h"
+#include "texture.h"
+#include "mymath.h"
+
+EnvironmentMap::EnvironmentMap( const char * file_name )
+{
+	texture_ = new Texture( file_name );
+
+	if ( !is_valid() )
+	{
+		return;
+	}
+
+	linearize_ = texture_->pixel_size() < 12;
+
+	const auto t0 = std::chrono::high_resolution_clock::now();
+	BuildCdf();
+	const auto t1 = std::chrono::high_resolution_clock::now();
+
+	printf( "Environment map cdf (%d x %d px) built in %0.1f ms.\n", width(), height(),
+		std::chrono::duration<float, std::milli>( t1 - t0 ).count() );
+}
+
+EnvironmentMap::~EnvironmentMap()
+{
+	if ( texture_ )
+	{
+		delete texture_;
+		texture_ = nullptr;
+	}
+}
+
+bool EnvironmentMap::is_valid() const
+{
+	return texture_ && texture_->getData() && texture_->width() > 0 && texture_->height() > 0;
+}
+
+void BuildEnvironmentCdf( const std::vector<float> & luminance, const int w, const int h,
+	std::vector<float> & marginal, std::vector<float> & conditional )
+{
+	marginal.assign( h + 1, 0.0f );
+	conditional.assign( h * ( w + 1 ), 0.0f );
+
+	// the partial sums are normalized in double so that the trailing black pixels and rows keep zero width
+	std::vector<double> partial_sums( w );
+	std::vector<double> row_sums( h + 1, 0.0 );
+
+	for ( int y = 0; y < h; ++y )
+	{
+		// the rows near the poles cover a smaller solid angle
+		const float sin_theta = sinf( ( y + 0.5f ) / h * float( M_PI ) );
+		float * row = &conditional[y * ( w + 1 )];
+		double sum = 0.0;
+
+		for ( int x = 0; x < w; ++x )
+		{
+			partial_sums[x] = sum;
+			sum += max( 0.0f, luminance[y * w + x] ) * sin_theta;
+		}
+
+		// normalize the conditional cdf, black rows are sampled uniformly
+		for ( int x = 0; x < w; ++x )
+		{
+			row[x] = ( sum > 0.0 ) ? static_cast<float>( partial_sums[x] / sum ) : float( x ) / w;
+		}
+		row[w] = 1.0f;
+
+		row_sums[y + 1] = row_sums[y] + sum;
+	}
+
+	const double total = row_sums[h];
+
+	for ( int y = 0; y < h; ++y )
+	{
+		marginal[y] = ( total > 0.0 ) ? static_cast<float>( row_sums[y] / total ) : float( y ) / h;
+	}
+	marginal[h] = 1.0f;
+}
+
+void EnvironmentMap::BuildCdf()
+{
+	const int w = width();
+	const int h = height();
+	std::vector<float> luminance( size_t( w ) * h );
+
+	for ( int y = 0; y < h; ++y )
+	{
+		for ( int x = 0; x < w; ++x )
+		{
+			const Color3f c = texture_->texel( ( x + 0.5f ) / w, ( y + 0.5f ) / h, linearize_ );
+			luminance[y * w + x] = 0.2126f * c.r + 0.7152f * c.g + 0.0722f * c.b;
+		}
+	}
+
+	BuildEnvironmentCdf( luminance, w, h, marginal_, conditional_ );
+}
+
+optix::float3 EnvironmentMap::Radiance( const optix::float3 & direction ) const
+{
+	const optix::float2 uv = EnvironmentUV( direction );
+	const Color3f c = texture_->texel( uv.x, uv.y, linearize_ );
+
+	return optix::make_float3( c.r, c.g, c.b );
+}
+
+bool EnvironmentMap::Sample( const float u0, const float u1, optix::float3 & omega, float & pdf ) const
+{
+	return SampleEnvironment( marginal_.data(), conditional_.data(), width(), height(), u0, u1, omega, pdf );
+}
+
+float EnvironmentMap::Pdf( const optix::float3 & omega ) const
+{
+	return EnvironmentPdf( marginal_.data(), conditional_.data(), width(), height(), omega );
+}
+
+int EnvironmentMap::width() const
+{
+	return texture_->width();
+}
+
+int EnvironmentMap::height() const
+{
+	return texture_->height();
+}
+
+Texture * EnvironmentMap::texture() const
+{
+	return texture_;
+}
+
+const std::vector<float> & EnvironmentMap::marginal() const
+{
+	return marginal_;
+}
+
+const std::vector<float> & EnvironmentMap::conditional() const
+{
+	return conditional_;
+}
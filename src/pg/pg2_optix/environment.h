@@ -0,0 +1,219 @@
+#ifndef ENVIRONMENT_H_
+#define ENVIRONMENT_H_
+
+#include <optixu/optixu_math_namespace.h>
+#include "bsdf.h"
+
+/* the environment maps are equirectangular with the z axis pointing up, the first row is the zenith */
+
+/* texture coordinates of the direction, u goes along the azimuth and v from the zenith to the nadir */
+RT_HOSTDEVICE inline optix::float2 EnvironmentUV( const optix::float3 & direction )
+{
+	const float u = 0.5f + atan2f( direction.y, direction.x ) * ( 0.5f * M_1_PIf );
+	const float v = acosf( optix::clamp( direction.z, -1.0f, 1.0f ) ) * M_1_PIf;
+
+	return optix::make_float2( u, v );
+}
+
+RT_HOSTDEVICE inline optix::float3 EnvironmentDirection( const float u, const float v )
+{
+	const float phi = ( u - 0.5f ) * 2.0f * M_PIf;
+	const float theta = v * M_PIf;
+	const float sin_theta = sinf( theta );
+
+	return optix::make_float3( sin_theta * cosf( phi ), sin_theta * sinf( phi ), cosf( theta ) );
+}
+
+/* inverts the piecewise constant cdf of n bins (n + 1 values, cdf[0] = 0, cdf[n] = 1), du is the position within the bin */
+RT_HOSTDEVICE inline int SampleCdf( const float * cdf, const int n, const float u, float & du )
+{
+	int first = 0;
+	int last = n;
+
+	// the last bin i with cdf[i] <= u
+	while ( last - first > 1 )
+	{
+		const int middle = ( first + last ) / 2;
+
+		if ( cdf[middle] <= u )
+		{
+			first = middle;
+		}
+		else
+		{
+			last = middle;
+		}
+	}
+
+	const float width = cdf[first + 1] - cdf[first];
+	du = ( width > 0.0f ) ? optix::clamp( ( u - cdf[first] ) / width, 0.0f, 1.0f ) : 0.5f;
+
+	return first;
+}
+
+/*! \fn bool SampleEnvironment( const float * marginal, const float * conditional, const int width, const int height,
+	const float u0, const float u1, optix::float3 & omega, float & pdf )
+\brief Samples a direction proportionally to the luminance of the environment map.
+
+\param marginal cdf of the rows, \a height + 1 values.
+\param conditional cdfs of the pixels in each row, \a height x ( \a width + 1 ) values.
+\param pdf probability density of the sample with respect to the solid angle.
+*/
+RT_HOSTDEVICE inline bool SampleEnvironment( const float * marginal, const float * conditional, const int width, const int height,
+	const float u0, const float u1, optix::float3 & omega, float & pdf )
+{
+	float dv = 0.0f;
+	const int y = SampleCdf( marginal, height, u1, dv );
+	const float * row = conditional + y * ( width + 1 );
+	float du = 0.0f;
+	const int x = SampleCdf( row, width, u0, du );
+
+	const float u = ( x + du ) / width;
+	const float v = ( y + dv ) / height;
+	const float sin_theta = sinf( v * M_PIf );
+
+	if ( sin_theta <= 0.0f )
+	{
+		return false;
+	}
+
+	omega = EnvironmentDirection( u, v );
+
+	// the pdf over the unit square is converted to the solid angle with the jacobian 2 pi^2 sin(theta)
+	const float pdf_uv = ( marginal[y + 1] - marginal[y] ) * height * ( row[x + 1] - row[x] ) * width;
+	pdf = pdf_uv / ( 2.0f * M_PIf * M_PIf * sin_theta );
+
+	return pdf > 0.0f;
+}
+
+/* probability density of sampling the direction omega by SampleEnvironment with respect to the solid angle */
+RT_HOSTDEVICE inline float EnvironmentPdf( const float * marginal, const float * conditional, const int width, const int height,
+	const optix::float3 & omega )
+{
+	const optix::float2 uv = EnvironmentUV( omega );
+	int x = static_cast<int>( uv.x * width );
+	int y = static_cast<int>( uv.y * height );
+	x = ( x < 0 ) ? 0 : ( ( x >= width ) ? width - 1 : x );
+	y = ( y < 0 ) ? 0 : ( ( y >= height ) ? height - 1 : y );
+	const float sin_theta = sinf( uv.y * M_PIf );
+
+	if ( sin_theta <= 0.0f )
+	{
+		return 0.0f;
+	}
+
+	const float * row = conditional + y * ( width + 1 );
+	const float pdf_uv = ( marginal[y + 1] - marginal[y] ) * height * ( row[x + 1] - row[x] ) * width;
+
+	return pdf_uv / ( 2.0f * M_PIf * M_PIf * sin_theta );
+}
+
+/* uniformly distributed direction in the hemisphere around the normal n, the pdf is 1 / ( 2 pi ) */
+RT_HOSTDEVICE inline optix::float3 SampleUniformHemisphere( const optix::float3 & n, const float u0, const float u1 )
+{
+	const optix::float3 t = optix::normalize( ( fabsf( n.x ) > fabsf( n.z ) ) ?
+		optix::make_float3( -n.y, n.x, 0.0f ) : optix::make_float3( 0.0f, -n.z, n.y ) );
+	const optix::float3 b = optix::cross( n, t );
+
+	const float cos_theta = u1;
+	const float sin_theta = sqrtf( fmaxf( 0.0f, 1.0f - cos_theta * cos_theta ) );
+	const float phi = 2.0f * M_PIf * u0;
+
+	return t * ( sin_theta * cosf( phi ) ) + b * ( sin_theta * sinf( phi ) ) + n * cos_theta;
+}
+
+/* density of the direction omega generated by EvaluateEnvironment, the uniform hemisphere case assumes omega above the surface */
+RT_HOSTDEVICE inline float EnvironmentSamplingPdf( const float * marginal, const float * conditional, const int width, const int height,
+	const bool importance, const optix::float3 & omega )
+{
+	return importance ? EnvironmentPdf( marginal, conditional, width, height, omega ) : 0.5f * M_1_PIf;
+}
+
+/*! \fn optix::float3 EvaluateEnvironment( const float * marginal, const float * conditional, const int width, const int height,
+	const bool importance, const float u0, const float u1, const optix::float3 & p, const optix::float3 & normal,
+	const Bsdf & bsdf, const Visibility & visible, const Lookup & lookup, const Mis & mis )
+\brief Single sample estimate of the light arriving from the environment map.
+
+\param importance samples the map by its luminance, the hemisphere is sampled uniformly otherwise.
+\param bsdf functor returning the BSDF value times the cosine term for the given direction to the light.
+\param visible functor tracing a shadow ray, returns true when the light is not occluded.
+\param lookup functor returning the radiance of the map in the given direction.
+\param mis functor returning the weight of the sample given its direction and density, see BsdfMis.
+*/
+template <class Bsdf, class Visibility, class Lookup, class Mis = NoMis>
+RT_HOSTDEVICE inline optix::float3 EvaluateEnvironment( const float * marginal, const float * conditional, const int width, const int height,
+	const bool importance, const float u0, const float u1, const optix::float3 & p, const optix::float3 & normal,
+	const Bsdf & bsdf, const Visibility & visible, const Lookup & lookup, const Mis & mis = Mis() )
+{
+	optix::float3 omega;
+	float pdf = 0.0f;
+
+	if ( importance )
+	{
+		if ( !SampleEnvironment( marginal, conditional, width, height, u0, u1, omega, pdf ) )
+		{
+			return optix::make_float3( 0.0f );
+		}
+	}
+	else
+	{
+		omega = SampleUniformHemisphere( normal, u0, u1 );
+		pdf = 0.5f * M_1_PIf;
+	}
+
+	if ( optix::dot( normal, omega ) <= 0.0f || !visible( p, omega, 1e+16f ) )
+	{
+		return optix::make_float3( 0.0f );
+	}
+
+	return bsdf( omega ) * lookup( omega ) * ( mis( omega, pdf ) / pdf );
+}
+
+#ifndef __CUDACC__
+class Texture;
+
+/* builds the cdfs sampled by SampleEnvironment from the luminance of the width x height pixels stored row by row,
+the rows are weighted by the solid angle they cover and the black rows are sampled uniformly */
+void BuildEnvironmentCdf( const std::vector<float> & luminance, const int width, const int height,
+	std::vector<float> & marginal, std::vector<float> & conditional );
+
+/*! \class EnvironmentMap
+\brief Equirectangular environment map with the marginal and conditional cdfs for its importance sampling.
+*/
+class EnvironmentMap
+{
+public:
+	/* loads the map with the same FreeImage path as the textures, HDR maps stay in linear floats */
+	EnvironmentMap( const char * file_name );
+	~EnvironmentMap();
+
+	bool is_valid() const;
+
+	/* linear radiance of the map in the given direction */
+	optix::float3 Radiance( const optix::float3 & direction ) const;
+
+	/* host version of the device sampling, see SampleEnvironment */
+	bool Sample( const float u0, const float u1, optix::float3 & omega, float & pdf ) const;
+	float Pdf( const optix::float3 & omega ) const;
+
+	int width() const;
+	int height() const;
+	Texture * texture() const;
+	const std::vector<float> & marginal() const;
+	const std::vector<float> & conditional() const;
+
+private:
+	void BuildCdf();
+
+	Texture * texture_{ nullptr };
+	bool linearize_{ false }; // LDR maps are stored in sRGB
+
+	std::vector<float> marginal_; // cdf of the rows, height + 1 values
+	std::vector<float> conditional_; // cdfs of the pixels in the rows, height x ( width + 1 ) values
+
+	EnvironmentMap( const EnvironmentMap & ) = delete;
+	EnvironmentMap & operator=( const EnvironmentMap & ) = delete;
+};
+#endif // !__CUDACC__
+
+#endif
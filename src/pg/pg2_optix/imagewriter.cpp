@@ -0,0 +1,159 @@
+#include "pch.h"
+#include "imagewriter.h"
+#include "freeimage.h"
+
+bool SavePPM( const std::string & file_name, const BYTE * rgba, const int width, const int height )
+{
+	char header[64];
+	const int header_size = snprintf( header, sizeof( header ), "P6\n%d %d\n255\n", width, height );
+	const size_t no_pixels = size_t( width ) * height;
+
+	// the whole file is assembled in memory, the stream is not touched per pixel
+	std::vector<BYTE> data( header_size + 3 * no_pixels );
+	memcpy( data.data(), header, header_size );
+	BYTE * rgb = data.data() + header_size;
+
+	#pragma omp parallel for schedule( static )
+	for ( int i = 0; i < static_cast<int>( no_pixels ); ++i )
+	{
+		rgb[3 * i] = rgba[4 * i];
+		rgb[3 * i + 1] = rgba[4 * i + 1];
+		rgb[3 * i + 2] = rgba[4 * i + 2];
+	}
+
+	FILE * file = fopen( file_name.c_str(), "wb" );
+
+	if ( !file )
+	{
+		printf( "Unable to open '%s'.\n", file_name.c_str() );
+
+		return false;
+	}
+
+	const bool written = fwrite( data.data(), 1, data.size(), file ) == data.size();
+	fclose( file );
+
+	if ( !written )
+	{
+		printf( "Unable to write '%s'.\n", file_name.c_str() );
+	}
+
+	return written;
+}
+
+/* FreeImage saves the dib and releases it, the rows of the dib are stored bottom-up */
+static bool SaveDib( const std::string & file_name, const FREE_IMAGE_FORMAT fif, FIBITMAP * dib )
+{
+	const bool saved = FreeImage_Save( fif, dib, file_name.c_str(), 0 ) != 0;
+	FreeImage_Unload( dib );
+
+	if ( !saved )
+	{
+		printf( "Unable to write '%s'.\n", file_name.c_str() );
+	}
+
+	return saved;
+}
+
+bool SavePNG( const std::string & file_name, const BYTE * rgba, const int width, const int height )
+{
+	FIBITMAP * dib = FreeImage_AllocateT( FIT_BITMAP, width, height, 24 );
+
+	if ( !dib )
+	{
+		return false;
+	}
+
+	#pragma omp parallel for schedule( static )
+	for ( int y = 0; y < height; ++y )
+	{
+		const BYTE * src = rgba + size_t( y ) * width * 4;
+		BYTE * dst = FreeImage_GetScanLine( dib, height - 1 - y );
+
+		for ( int x = 0; x < width; ++x, src += 4, dst += 3 )
+		{
+			dst[FI_RGBA_RED] = src[0];
+			dst[FI_RGBA_GREEN] = src[1];
+			dst[FI_RGBA_BLUE] = src[2];
+		}
+	}
+
+	return SaveDib( file_name, FIF_PNG, dib );
+}
+
+bool SaveEXR( const std::string & file_name, const optix::float4 * hdr, const int width, const int height )
+{
+	FIBITMAP * dib = FreeImage_AllocateT( FIT_RGBF, width, height );
+
+	if ( !dib )
+	{
+		return false;
+	}
+
+	#pragma omp parallel for schedule( static )
+	for ( int y = 0; y < height; ++y )
+	{
+		const optix::float4 * src = hdr + size_t( y ) * width;
+		FIRGBF * dst = reinterpret_cast<FIRGBF *>( FreeImage_GetScanLine( dib, height - 1 - y ) );
+
+		for ( int x = 0; x < width; ++x )
+		{
+			dst[x].red = src[x].x;
+			dst[x].green = src[x].y;
+			dst[x].blue = src[x].z;
+		}
+	}
+
+	return SaveDib( file_name, FIF_EXR, dib );
+}
+
+/* lowercase extension of the file name without the dot */
+static std::string ImageExtension( const std::string & file_name )
+{
+	const size_t dot = file_name.find_last_of( '.' );
+	std::string extension = ( dot != std::string::npos ) ? file_name.substr( dot + 1 ) : "";
+	std::transform( extension.begin(), extension.end(), extension.begin(), []( const char c ) { return static_cast<char>( tolower( c ) ); } );
+
+	return extension;
+}
+
+bool IsSavableImage( const std::string & file_name )
+{
+	const std::string extension = ImageExtension( file_name );
+
+	return extension == "ppm" || extension == "png" || extension == "exr";
+}
+
+bool SaveImage( const std::string & file_name, const optix::float4 * hdr, const BYTE * rgba, const int width, const int height )
+{
+	const std::string extension = ImageExtension( file_name );
+	const auto t0 = std::chrono::high_resolution_clock::now();
+	bool saved = false;
+
+	if ( extension == "ppm" )
+	{
+		saved = SavePPM( file_name, rgba, width, height );
+	}
+	else if ( extension == "png" )
+	{
+		saved = SavePNG( file_name, rgba, width, height );
+	}
+	else if ( extension == "exr" )
+	{
+		saved = SaveEXR( file_name, hdr, width, height );
+	}
+	else
+	{
+		printf( "Unknown image format of '%s', use .ppm, .png or .exr.\n", file_name.c_str() );
+
+		return false;
+	}
+
+	if ( saved )
+	{
+		printf( "Image (%d x %d px) saved to '%s' in %0.1f ms.\n", width, height, file_name.c_str(),
+			std::chrono::duration<double, std::milli>( std::chrono::high_resolution_clock::now() - t0 ).count() );
+	}
+
+	return saved;
+}
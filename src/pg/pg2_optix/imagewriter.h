@@ -0,0 +1,19 @@
+#ifndef IMAGE_WRITER_H_
+#define IMAGE_WRITER_H_
+
+/* the images are stored top row first, the RGBA bytes are tonemapped, the float4 radiance is linear */
+
+/* binary P6 PPM, the header and all rows are written by a single fwrite */
+bool SavePPM( const std::string & file_name, const BYTE * rgba, const int width, const int height );
+/* 24-bit PNG encoded by FreeImage */
+bool SavePNG( const std::string & file_name, const BYTE * rgba, const int width, const int height );
+/* RGB float EXR encoded by FreeImage, the radiance is stored before the exposure and the tonemapping */
+bool SaveEXR( const std::string & file_name, const optix::float4 * hdr, const int width, const int height );
+
+/* true for the file names with the extension SaveImage writes ( .ppm, .png or .exr ), the case is ignored */
+bool IsSavableImage( const std::string & file_name );
+
+/* picks the format by the extension of the file name ( .ppm, .png or .exr ), returns false for the other ones */
+bool SaveImage( const std::string & file_name, const optix::float4 * hdr, const BYTE * rgba, const int width, const int height );
+
+#endif
@@ -0,0 +1,183 @@
+#ifndef LIGHT_H_
+#define LIGHT_H_
+
+#include <optixu/optixu_math_namespace.h>
+
+/* types of lights */
+enum LightType : int { LIGHT_POINT = 0, LIGHT_SPOT = 1, LIGHT_DIRECTIONAL = 2 };
+
+/*! \struct Light
+\brief Single analytic light source shared by the host and the device code.
+
+The layout is plain old data so the same struct can be copied into an OptiX
+user-format buffer. Point and spot lights fall off with the inverse square of
+the distance, the directional light is defined by the direction it shines to.
+*/
+struct Light
+{
+	optix::float3 position; /*!< Position of a point or spot light (ws). */
+	int type; /*!< One of \a LightType values. */
+	optix::float3 direction; /*!< Unit direction of a spot or directional light. */
+	float cos_inner; /*!< Cosine of the spot cone angle with the full intensity. */
+	optix::float3 intensity; /*!< Radiant intensity (W/sr) or irradiance for directional lights (W/m^2). */
+	float cos_outer; /*!< Cosine of the spot cone angle where the intensity drops to zero. */
+};
+
+RT_HOSTDEVICE inline Light MakePointLight( const optix::float3 & position, const optix::float3 & intensity )
+{
+	Light light;
+	light.position = position;
+	light.type = LIGHT_POINT;
+	light.direction = optix::make_float3( 0.0f, 0.0f, -1.0f );
+	light.cos_inner = -1.0f;
+	light.intensity = intensity;
+	light.cos_outer = -1.0f;
+
+	return light;
+}
+
+RT_HOSTDEVICE inline Light MakeSpotLight( const optix::float3 & position, const optix::float3 & direction,
+	const optix::float3 & intensity, const float inner_angle, const float outer_angle )
+{
+	Light light = MakePointLight( position, intensity );
+	light.type = LIGHT_SPOT;
+	light.direction = optix::normalize( direction );
+	light.cos_inner = cosf( inner_angle );
+	light.cos_outer = cosf( outer_angle );
+
+	return light;
+}
+
+RT_HOSTDEVICE inline Light MakeDirectionalLight( const optix::float3 & direction, const optix::float3 & irradiance )
+{
+	Light light = MakePointLight( optix::make_float3( 0.0f ), irradiance );
+	light.type = LIGHT_DIRECTIONAL;
+	light.direction = optix::normalize( direction );
+
+	return light;
+}
+
+/* computes the direction towards the light (omega_l), the distance to it and the radiance arriving at the point p */
+RT_HOSTDEVICE inline bool Illuminate( const Light & light, const optix::float3 & p,
+	optix::float3 & omega_l, float & distance, optix::float3 & radiance )
+{
+	if ( light.type == LIGHT_DIRECTIONAL )
+	{
+		omega_l = -light.direction;
+		distance = 1e+16f;
+		radiance = light.intensity;
+
+		return true;
+	}
+
+	const optix::float3 d = light.position - p;
+	const float sqr_distance = optix::dot( d, d );
+
+	if ( sqr_distance <= 0.0f )
+	{
+		return false;
+	}
+
+	distance = sqrtf( sqr_distance );
+	omega_l = d / distance;
+	radiance = light.intensity / sqr_distance;
+
+	if ( light.type == LIGHT_SPOT )
+	{
+		const float cos_theta = optix::dot( -omega_l, light.direction );
+
+		if ( cos_theta <= light.cos_outer )
+		{
+			return false;
+		}
+
+		if ( cos_theta < light.cos_inner )
+		{
+			const float t = ( cos_theta - light.cos_outer ) / ( light.cos_inner - light.cos_outer );
+			radiance *= t * t * ( 3.0f - 2.0f * t ); // smoothstep falloff between the cones
+		}
+	}
+
+	return true;
+}
+
+/* lights whose unshadowed contribution is below this threshold trace their shadow ray with a probability
+proportional to the contribution (Russian roulette) */
+#define LIGHT_CUTOFF 1e-4f
+
+/*! \fn optix::float3 EvaluateDirectLighting( const Light * lights, const unsigned int no_lights, const unsigned int max_samples,
+	const float u, const float u_rr, const optix::float3 & p, const optix::float3 & n, const Bsdf & bsdf, const Visibility & visible )
+\brief Sums the direct illumination reflected at the point p towards the viewer.
+
+Up to \a max_samples lights are evaluated per call. When the light list is longer, a stratified subset
+with a random offset \a u is taken and reweighted, so the number of shadow rays per hit stays bounded.
+Back-facing lights never spawn a shadow ray. The lights contributing less than LIGHT_CUTOFF survive the Russian
+roulette with the probability contribution / LIGHT_CUTOFF and are divided by it, the roulette numbers of the lights
+are the rotations of \a u_rr by the golden ratio, so the estimate stays unbiased.
+
+\param bsdf functor returning the BSDF value times the cosine term for the given direction to the light.
+\param visible functor tracing a shadow ray, returns true when the light is not occluded.
+*/
+template <class Bsdf, class Visibility>
+RT_HOSTDEVICE inline optix::float3 EvaluateDirectLighting( const Light * lights, const unsigned int no_lights,
+	const unsigned int max_samples, const float u, const float u_rr, const optix::float3 & p, const optix::float3 & n,
+	const Bsdf & bsdf, const Visibility & visible )
+{
+	optix::float3 result = optix::make_float3( 0.0f );
+
+	if ( no_lights == 0 || max_samples == 0 )
+	{
+		return result;
+	}
+
+	const unsigned int no_samples = ( no_lights < max_samples ) ? no_lights : max_samples;
+	const float stride = float( no_lights ) / float( no_samples );
+	const float weight = stride;
+	const float offset = ( no_samples < no_lights ) ? u * float( no_lights ) : 0.0f;
+
+	for ( unsigned int i = 0; i < no_samples; ++i )
+	{
+		unsigned int index = static_cast<unsigned int>( offset + i * stride );
+		if ( index >= no_lights ) index -= no_lights;
+
+		optix::float3 omega_l;
+		float distance = 0.0f;
+		optix::float3 radiance;
+
+		if ( !Illuminate( lights[index], p, omega_l, distance, radiance ) )
+		{
+			continue;
+		}
+
+		if ( optix::dot( n, omega_l ) <= 0.0f )
+		{
+			continue;
+		}
+
+		optix::float3 contribution = bsdf( omega_l ) * radiance * weight;
+		const float max_contribution = fmaxf( contribution.x, fmaxf( contribution.y, contribution.z ) );
+
+		if ( max_contribution < LIGHT_CUTOFF )
+		{
+			const float survival = max_contribution / LIGHT_CUTOFF;
+			float u_i = u_rr + i * 0.618034f;
+			u_i -= floorf( u_i );
+
+			if ( u_i >= survival )
+			{
+				continue;
+			}
+
+			contribution /= survival;
+		}
+
+		if ( visible( p, omega_l, distance ) )
+		{
+			result += contribution;
+		}
+	}
+
+	return result;
+}
+
+#endif
@@ -1,5 +1,7 @@
 #include "pch.h"
 #include "material.h"
+#include "raycone.h"
+#include "texturecache.h"
 
 const char Material::kDiffuseMapSlot = 0;
 const char Material::kSpecularMapSlot = 1;
@@ -7,6 +9,7 @@ const char Material::kNormalMapSlot = 2;
 const char Material::kOpacityMapSlot = 3;
 const char Material::kRoughnessMapSlot = 4;
 const char Material::kMetallicnessMapSlot = 5;
+const int Material::kShaderMapSlots = ( 1 << kDiffuseMapSlot ) | ( 1 << kRoughnessMapSlot ) | ( 1 << kMetallicnessMapSlot );
 
 Material::Material()
 {
@@ -55,13 +58,10 @@ Material::Material( std::string & name, const Color3f & ambient, const Color3f &
 
 Material::~Material()
 {
+	// the textures are shared and owned by TextureCache
 	for ( int i = 0; i < NO_TEXTURES; ++i )
 	{
-		if ( textures_[i] )
-		{
-			delete[] textures_[i];
-			textures_[i] = nullptr;
-		};
+		textures_[i] = nullptr;
 	}
 }
 
@@ -77,14 +77,83 @@ std::string Material::name() const
 
 void Material::set_texture( const int slot, Texture * texture )
 {
+	pending_textures_[slot] = std::shared_future<Texture *>();
+	texture_files_[slot].clear();
 	textures_[slot] = texture;
 }
 
+void Material::set_texture( const int slot, std::shared_future<Texture *> texture )
+{
+	textures_[slot] = nullptr;
+	pending_textures_[slot] = texture;
+	texture_files_[slot].clear();
+}
+
+void Material::set_texture( const int slot, const std::string & file_name )
+{
+	textures_[slot] = nullptr;
+	pending_textures_[slot] = std::shared_future<Texture *>();
+	texture_files_[slot] = file_name;
+}
+
+void Material::RequestTextures( const int slots )
+{
+	for ( int i = 0; i < NO_TEXTURES; ++i )
+	{
+		if ( ( slots & ( 1 << i ) ) && !texture_files_[i].empty() )
+		{
+			set_texture( i, TextureCache::Instance().LoadAsync( texture_files_[i] ) );
+		}
+	}
+}
+
+void Material::ResolveTextures()
+{
+	for ( int i = 0; i < NO_TEXTURES; ++i )
+	{
+		if ( pending_textures_[i].valid() )
+		{
+			textures_[i] = pending_textures_[i].get();
+			pending_textures_[i] = std::shared_future<Texture *>();
+		}
+	}
+}
+
 Texture * Material::texture( const int slot ) const
 {
+	return TextureCache::Instance().Acquire( ResolveTexture( slot ) );
+}
+
+Texture * Material::ResolveTexture( const int slot ) const
+{
+	if ( !texture_files_[slot].empty() && !textures_[slot] )
+	{
+		// the slots the device programs do not sample are loaded only by the host queries
+		textures_[slot] = TextureCache::Instance().Load( texture_files_[slot] );
+	}
+	else if ( pending_textures_[slot].valid() )
+	{
+		textures_[slot] = pending_textures_[slot].get();
+		pending_textures_[slot] = std::shared_future<Texture *>();
+	}
+
 	return textures_[slot];
 }
 
+/* reads the texel of the texture kept resident by the pin without locking the texture cache */
+static Color3f PinnedTexel( const TexturePin & pin, const Coord2f & tex_coord, const bool linearize, const float footprint )
+{
+	return pin->texel( tex_coord.u, tex_coord.v, linearize, TextureLod( footprint, pin->width(), pin->height() ) );
+}
+
+/* the texture may be pinned by another thread only, so it is pinned for this read */
+static Color3f PinnedTexel( Texture * texture, const Coord2f & tex_coord, const bool linearize, const float footprint )
+{
+	const TexturePin pin( texture );
+
+	return PinnedTexel( pin, tex_coord, linearize, footprint );
+}
+
 Shader Material::shader() const
 {
 	return shader_;
@@ -100,30 +169,37 @@ Color3f Material::ambient( const Coord2f * tex_coord ) const
 	return ambient_;
 }
 
-Color3f Material::diffuse( const Coord2f * tex_coord ) const
+Color3f Material::diffuse( const Coord2f * tex_coord, const float footprint ) const
 {
 	if ( tex_coord )
 	{
-		Texture * texture = textures_[kDiffuseMapSlot];
+		Texture * texture = ResolveTexture( kDiffuseMapSlot );
 
 		if ( texture )
 		{
-			return texture->texel( tex_coord->u, tex_coord->v, true );
+			return PinnedTexel( texture, *tex_coord, true, footprint );
 		}
 	}
 	
 	return diffuse_;
 }
 
+Color3f Material::diffuse( const TexturePin & pin, const Coord2f & tex_coord, const float footprint ) const
+{
+	assert( !pin || pin.get() == textures_[kDiffuseMapSlot] );
+
+	return ( pin ) ? PinnedTexel( pin, tex_coord, true, footprint ) : diffuse_;
+}
+
 Color3f Material::specular( const Coord2f * tex_coord ) const
 {
 	if ( tex_coord )
 	{
-		Texture * texture = textures_[kSpecularMapSlot];
+		Texture * texture = ResolveTexture( kSpecularMapSlot );
 
 		if ( texture )
 		{
-			return texture->texel( tex_coord->u, tex_coord->v, true );
+			return PinnedTexel( texture, *tex_coord, true, 0.0f );
 		}
 	}
 
@@ -134,33 +210,40 @@ Color3f Material::bump( const Coord2f * tex_coord ) const
 {	
 	if ( tex_coord )
 	{
-		Texture * texture = textures_[kNormalMapSlot];
+		Texture * texture = ResolveTexture( kNormalMapSlot );
 
 		if ( texture )
 		{
-			return texture->texel( tex_coord->u, tex_coord->v, false );
+			return PinnedTexel( texture, *tex_coord, false, 0.0f );
 		}
 	}
 
 	return Color3f{ 0.5f, 0.5f, 1.0f }; // n = ( 0, 0, 1 )	
 }
 
-float Material::roughness( const Coord2f * tex_coord ) const
+float Material::roughness( const Coord2f * tex_coord, const float footprint ) const
 {
 
 	if ( tex_coord )
 	{
-		Texture * texture = textures_[kRoughnessMapSlot];
+		Texture * texture = ResolveTexture( kRoughnessMapSlot );
 
 		if ( texture )
 		{
-			return texture->texel( tex_coord->u, tex_coord->v, false ).r;
+			return PinnedTexel( texture, *tex_coord, false, footprint ).r;
 		}
 	}
 
 	return roughness_;
 }
 
+float Material::roughness( const TexturePin & pin, const Coord2f & tex_coord, const float footprint ) const
+{
+	assert( !pin || pin.get() == textures_[kRoughnessMapSlot] );
+
+	return ( pin ) ? PinnedTexel( pin, tex_coord, false, footprint ).r : roughness_;
+}
+
 Color3f Material::emission( const Coord2f * tex_coord ) const
 {
 	return emission_;
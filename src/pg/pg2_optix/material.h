@@ -4,6 +4,8 @@
 #include "vector3.h"
 #include "texture.h"
 
+class TexturePin;
+
 /*! \def NO_TEXTURES
 \brief Maximln poet textur piazench materilu.
 */
@@ -90,10 +92,36 @@ public:
 	*/
 	void set_texture( const int slot, Texture * texture );
 
+	//! Sets the texture that is still being loaded.
+	/*!
+	The texture is assigned to the slot by \a ResolveTextures.
+	\param slot texture slot, at most \a NO_TEXTURES - 1.
+	\param texture texture decoded in the background.
+	*/
+	void set_texture( const int slot, std::shared_future<Texture *> texture );
+
+	//! Sets the texture file that is loaded on the first request.
+	/*!
+	\param slot texture slot, at most \a NO_TEXTURES - 1.
+	\param file_name full name of the image file.
+	*/
+	void set_texture( const int slot, const std::string & file_name );
+
+	//! Starts decoding the textures of the selected slots in the background.
+	/*!
+	\param slots bit mask of the slots, e.g. \a kShaderMapSlots.
+	*/
+	void RequestTextures( const int slots );
+
+	//! Waits for the textures loaded in the background and assigns them to their slots.
+	void ResolveTextures();
+
 	//! Vrt texturu.
 	/*!	
 	\param slot slo slotu textury. Maximln \a NO_TEXTURES - 1.
 	\return Ukazatel na zvolenou texturu.
+	The texture set by its file name is loaded on the first call and made resident again after the eviction,
+	pin it by \a TexturePin while its data are used.
 	*/
 	Texture * texture( const int slot ) const;
 
@@ -102,10 +130,17 @@ public:
 	void set_shader( Shader shader );
 
 	Color3f ambient( const Coord2f * tex_coord = nullptr ) const;
-	Color3f diffuse( const Coord2f * tex_coord = nullptr ) const;	
+	/* each texel query pins the texture for its read and so locks the texture cache twice,
+	footprint is the width of the ray cone in the texture space, it selects the mip level */
+	Color3f diffuse( const Coord2f * tex_coord = nullptr, const float footprint = 0.0f ) const;	
 	Color3f specular( const Coord2f * tex_coord = nullptr ) const;
 	Color3f bump( const Coord2f * tex_coord = nullptr ) const;
-	float roughness( const Coord2f * tex_coord = nullptr ) const;
+	float roughness( const Coord2f * tex_coord = nullptr, const float footprint = 0.0f ) const;
+
+	/* the texel queries of the caller holding the texture of the slot by pin do not lock the texture cache,
+	the empty pin returns the constant value */
+	Color3f diffuse( const TexturePin & pin, const Coord2f & tex_coord, const float footprint ) const;
+	float roughness( const TexturePin & pin, const Coord2f & tex_coord, const float footprint ) const;
 
 	Color3f emission( const Coord2f * tex_coord = nullptr ) const;
 
@@ -130,9 +165,12 @@ public:
 	static const char kOpacityMapSlot; /*!< slo slotu transparentn textury. */
 	static const char kRoughnessMapSlot; /*!< slo slotu textury drsnosti. */
 	static const char kMetallicnessMapSlot; /*!< slo slotu textury kovovosti. */
+	static const int kShaderMapSlots; /*!< Bit mask of the slots sampled by the device programs. */
 
 private:
-	Texture * textures_[NO_TEXTURES]; /*!< Pole ukazatel na textury. */
+	std::string texture_files_[NO_TEXTURES]; /*!< Textures not requested yet. */
+	mutable std::shared_future<Texture *> pending_textures_[NO_TEXTURES]; /*!< Textures still being decoded. */
+	mutable Texture * textures_[NO_TEXTURES]; /*!< Pole ukazatel na textury. */
 	/*
 	slot 0 - diffuse map + alpha
 	slot 1 - specular map + opaque alpha
@@ -143,6 +181,9 @@ private:
 	std::string name_; /*!< Material name. */
 
 	Shader shader_{ Shader::NORMAL }; /*!< Type of used shader. */
+
+	/* assigns the texture loaded by the file name or in the background to the slot, the cache is not locked once it is assigned */
+	Texture * ResolveTexture( const int slot ) const;
 };
 
 #endif
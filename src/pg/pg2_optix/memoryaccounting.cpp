@@ -0,0 +1,154 @@
+#include "pch.h"
+#include "memoryaccounting.h"
+
+MemoryAccounting & MemoryAccounting::Instance()
+{
+	// never destroyed, the textures and the surfaces owned by the other singletons are released during the exit
+	static MemoryAccounting * accounting = new MemoryAccounting();
+
+	return *accounting;
+}
+
+void MemoryAccounting::Counter::Add( const long long bytes )
+{
+	const long long value = current.fetch_add( bytes, std::memory_order_relaxed ) + bytes;
+	long long highest = peak.load( std::memory_order_relaxed );
+
+	while ( value > highest && !peak.compare_exchange_weak( highest, value, std::memory_order_relaxed ) )
+	{
+	}
+}
+
+void MemoryAccounting::Allocate( const MemoryTag tag, const MemoryDomain domain, const size_t bytes )
+{
+	counters_[static_cast<int>( tag )][static_cast<int>( domain )].Add( static_cast<long long>( bytes ) );
+	totals_[static_cast<int>( domain )].Add( static_cast<long long>( bytes ) );
+}
+
+void MemoryAccounting::Release( const MemoryTag tag, const MemoryDomain domain, const size_t bytes )
+{
+	counters_[static_cast<int>( tag )][static_cast<int>( domain )].Add( -static_cast<long long>( bytes ) );
+	totals_[static_cast<int>( domain )].Add( -static_cast<long long>( bytes ) );
+}
+
+long long MemoryAccounting::current( const MemoryTag tag, const MemoryDomain domain ) const
+{
+	return counters_[static_cast<int>( tag )][static_cast<int>( domain )].current.load( std::memory_order_relaxed );
+}
+
+long long MemoryAccounting::peak( const MemoryTag tag, const MemoryDomain domain ) const
+{
+	return counters_[static_cast<int>( tag )][static_cast<int>( domain )].peak.load( std::memory_order_relaxed );
+}
+
+long long MemoryAccounting::total( const MemoryDomain domain ) const
+{
+	return totals_[static_cast<int>( domain )].current.load( std::memory_order_relaxed );
+}
+
+long long MemoryAccounting::total_peak( const MemoryDomain domain ) const
+{
+	return totals_[static_cast<int>( domain )].peak.load( std::memory_order_relaxed );
+}
+
+const char * MemoryAccounting::name( const MemoryTag tag )
+{
+	switch ( tag )
+	{
+	case MemoryTag::LOADER: return "Loader";
+	case MemoryTag::GEOMETRY: return "Geometry";
+	case MemoryTag::TEXTURES: return "Textures";
+	case MemoryTag::FRAMEBUFFERS: return "Framebuffers";
+	case MemoryTag::DIAGNOSTICS: return "Diagnostics";
+	default: return "Unknown";
+	}
+}
+
+void MemoryAccounting::Report() const
+{
+	const double MB = 1.0 / ( 1024.0 * 1024.0 );
+
+	printf( "Memory (MB)      host   peak   device   peak\n" );
+
+	for ( int i = 0; i < static_cast<int>( MemoryTag::COUNT ); ++i )
+	{
+		const MemoryTag tag = static_cast<MemoryTag>( i );
+
+		printf( "%-12s %8.1f %6.1f %8.1f %6.1f\n", name( tag ),
+			current( tag, MemoryDomain::HOST ) * MB, peak( tag, MemoryDomain::HOST ) * MB,
+			current( tag, MemoryDomain::DEVICE ) * MB, peak( tag, MemoryDomain::DEVICE ) * MB );
+	}
+
+	printf( "%-12s %8.1f %6.1f %8.1f %6.1f\n", "Total",
+		total( MemoryDomain::HOST ) * MB, total_peak( MemoryDomain::HOST ) * MB,
+		total( MemoryDomain::DEVICE ) * MB, total_peak( MemoryDomain::DEVICE ) * MB );
+}
+
+bool MemoryAccounting::SaveCsv( const std::string & file_name ) const
+{
+	FILE * file = fopen( file_name.c_str(), "wt" );
+
+	if ( !file )
+	{
+		printf( "Unable to open '%s'.\n", file_name.c_str() );
+
+		return false;
+	}
+
+	fprintf( file, "subsystem,host_bytes,host_peak_bytes,device_bytes,device_peak_bytes\n" );
+
+	for ( int i = 0; i < static_cast<int>( MemoryTag::COUNT ); ++i )
+	{
+		const MemoryTag tag = static_cast<MemoryTag>( i );
+
+		fprintf( file, "\"%s\",%lld,%lld,%lld,%lld\n", name( tag ), current( tag, MemoryDomain::HOST ), peak( tag, MemoryDomain::HOST ),
+			current( tag, MemoryDomain::DEVICE ), peak( tag, MemoryDomain::DEVICE ) );
+	}
+
+	fprintf( file, "\"Total\",%lld,%lld,%lld,%lld\n", total( MemoryDomain::HOST ), total_peak( MemoryDomain::HOST ),
+		total( MemoryDomain::DEVICE ), total_peak( MemoryDomain::DEVICE ) );
+
+	fclose( file );
+	printf( "Memory accounting saved to '%s'.\n", file_name.c_str() );
+
+	return true;
+}
+
+MemoryCharge::MemoryCharge( const MemoryTag tag, const MemoryDomain domain, const size_t bytes ) : tag_( tag ), domain_( domain )
+{
+	Resize( bytes );
+}
+
+MemoryCharge::MemoryCharge( MemoryCharge && other ) : tag_( other.tag_ ), domain_( other.domain_ ), bytes_( other.bytes_ )
+{
+	other.bytes_ = 0;
+}
+
+MemoryCharge::~MemoryCharge()
+{
+	Resize( 0 );
+}
+
+void MemoryCharge::Resize( const size_t bytes )
+{
+	if ( bytes > bytes_ )
+	{
+		MemoryAccounting::Instance().Allocate( tag_, domain_, bytes - bytes_ );
+	}
+	else if ( bytes < bytes_ )
+	{
+		MemoryAccounting::Instance().Release( tag_, domain_, bytes_ - bytes );
+	}
+
+	bytes_ = bytes;
+}
+
+size_t MemoryCharge::bytes() const
+{
+	return bytes_;
+}
+
+MemoryTag MemoryCharge::tag() const
+{
+	return tag_;
+}
@@ -0,0 +1,90 @@
+#ifndef MEMORY_ACCOUNTING_H_
+#define MEMORY_ACCOUNTING_H_
+
+/* subsystems the memory is charged to */
+enum class MemoryTag : int
+{
+	LOADER = 0, // the file buffers and the attribute arrays of the OBJ loader, released when the file is parsed
+	GEOMETRY, // the triangles of the surfaces, the vertex, normal, texture coordinate and material buffers, the lights and the emitters
+	TEXTURES, // the decoded levels, the tiled copies and the blocks of the host textures, the uploaded textures and the environment CDFs
+	FRAMEBUFFERS, // the frames handed to the UI, the accumulated and the preview images, the per-pixel buffers of the launches
+	DIAGNOSTICS, // the chunks of the trace events
+	COUNT
+};
+
+enum class MemoryDomain : int
+{
+	HOST = 0,
+	DEVICE, // the OptiX buffers by their sizes as created, the driver may allocate more
+	COUNT
+};
+
+/*! \class MemoryAccounting
+\brief Process-wide current and peak bytes of the subsystems, on the host and on the device.
+
+Only the large allocations are charged by their owners, so the totals are a lower bound of the memory used by the process.
+The peak of a total is the highest sum reached at once, it may be lower than the sum of the peaks of the subsystems.
+*/
+class MemoryAccounting
+{
+public:
+	static MemoryAccounting & Instance();
+
+	void Allocate( const MemoryTag tag, const MemoryDomain domain, const size_t bytes );
+	void Release( const MemoryTag tag, const MemoryDomain domain, const size_t bytes );
+
+	long long current( const MemoryTag tag, const MemoryDomain domain ) const;
+	long long peak( const MemoryTag tag, const MemoryDomain domain ) const;
+	long long total( const MemoryDomain domain ) const;
+	long long total_peak( const MemoryDomain domain ) const;
+
+	static const char * name( const MemoryTag tag );
+
+	/* prints the current and the peak bytes of all subsystems */
+	void Report() const;
+	/* writes the current and the peak bytes, one subsystem per line and the totals last */
+	bool SaveCsv( const std::string & file_name ) const;
+
+private:
+	struct Counter
+	{
+		std::atomic<long long> current{ 0 };
+		std::atomic<long long> peak{ 0 };
+
+		void Add( const long long bytes );
+	};
+
+	MemoryAccounting() = default;
+	MemoryAccounting( const MemoryAccounting & ) = delete;
+	MemoryAccounting & operator=( const MemoryAccounting & ) = delete;
+
+	Counter counters_[static_cast<int>( MemoryTag::COUNT )][static_cast<int>( MemoryDomain::COUNT )];
+	Counter totals_[static_cast<int>( MemoryDomain::COUNT )];
+};
+
+/*! \class MemoryCharge
+\brief Bytes charged to a subsystem by their owner, resized together with the allocation and released by the destructor.
+*/
+class MemoryCharge
+{
+public:
+	MemoryCharge( const MemoryTag tag, const MemoryDomain domain = MemoryDomain::HOST, const size_t bytes = 0 );
+	MemoryCharge( MemoryCharge && other );
+	~MemoryCharge();
+
+	/* charges the new size instead of the previous one */
+	void Resize( const size_t bytes );
+	size_t bytes() const;
+	MemoryTag tag() const;
+
+private:
+	MemoryTag tag_;
+	MemoryDomain domain_;
+	size_t bytes_{ 0 };
+
+	MemoryCharge( const MemoryCharge & ) = delete;
+	MemoryCharge & operator=( const MemoryCharge & ) = delete;
+	MemoryCharge & operator=( MemoryCharge && ) = delete;
+};
+
+#endif
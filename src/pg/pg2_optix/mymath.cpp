@@ -14,3 +14,100 @@ unsigned long long QuickHash( const BYTE * data, const size_t length, unsigned l
 
 	return mix ^ ( mix << 37 );
 }
+
+static const unsigned long long kPrime1 = 11400714785074694791ULL;
+static const unsigned long long kPrime2 = 14029467366897019727ULL;
+static const unsigned long long kPrime3 = 1609587929392839161ULL;
+static const unsigned long long kPrime4 = 9650029242287828579ULL;
+static const unsigned long long kPrime5 = 2870177450012600261ULL;
+
+static inline unsigned long long RotateLeft( const unsigned long long x, const int r )
+{
+	return ( x << r ) | ( x >> ( 64 - r ) );
+}
+
+static inline unsigned long long Load64( const BYTE * p )
+{
+	unsigned long long v;
+	memcpy( &v, p, sizeof( v ) );
+	return v;
+}
+
+static inline unsigned long long HashRound( unsigned long long acc, const unsigned long long input )
+{
+	acc += input * kPrime2;
+	acc = RotateLeft( acc, 31 );
+	return acc * kPrime1;
+}
+
+static inline unsigned long long HashMerge( unsigned long long acc, const unsigned long long lane )
+{
+	acc ^= HashRound( 0, lane );
+	return acc * kPrime1 + kPrime4;
+}
+
+unsigned long long FastHash( const BYTE * data, const size_t length, const unsigned long long seed )
+{
+	const BYTE * p = data;
+	const BYTE * const end = data + length;
+	unsigned long long h;
+
+	if ( length >= 32 )
+	{
+		// the lanes do not depend on each other, the multiplications overlap
+		unsigned long long v1 = seed + kPrime1 + kPrime2;
+		unsigned long long v2 = seed + kPrime2;
+		unsigned long long v3 = seed;
+		unsigned long long v4 = seed - kPrime1;
+
+		for ( ; p + 32 <= end; p += 32 )
+		{
+			v1 = HashRound( v1, Load64( p ) );
+			v2 = HashRound( v2, Load64( p + 8 ) );
+			v3 = HashRound( v3, Load64( p + 16 ) );
+			v4 = HashRound( v4, Load64( p + 24 ) );
+		}
+
+		h = RotateLeft( v1, 1 ) + RotateLeft( v2, 7 ) + RotateLeft( v3, 12 ) + RotateLeft( v4, 18 );
+		h = HashMerge( h, v1 );
+		h = HashMerge( h, v2 );
+		h = HashMerge( h, v3 );
+		h = HashMerge( h, v4 );
+	}
+	else
+	{
+		h = seed + kPrime5;
+	}
+
+	h += static_cast<unsigned long long>( length );
+
+	for ( ; p + 8 <= end; p += 8 )
+	{
+		h ^= HashRound( 0, Load64( p ) );
+		h = RotateLeft( h, 27 ) * kPrime1 + kPrime4;
+	}
+
+	if ( p + 4 <= end )
+	{
+		unsigned int v;
+		memcpy( &v, p, sizeof( v ) );
+		h ^= static_cast<unsigned long long>( v ) * kPrime1;
+		h = RotateLeft( h, 23 ) * kPrime2 + kPrime3;
+		p += 4;
+	}
+
+	for ( ; p < end; ++p )
+	{
+		h ^= ( *p ) * kPrime5;
+		h = RotateLeft( h, 11 ) * kPrime1;
+	}
+
+	// final avalanche
+	h ^= h >> 33;
+	h *= kPrime2;
+	h ^= h >> 29;
+	h *= kPrime3;
+	h ^= h >> 32;
+
+	return h;
+}
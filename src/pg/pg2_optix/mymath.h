@@ -53,5 +53,7 @@ inline Vector3 reflect( const Vector3 & v, const Vector3 & n )
 }
 
 unsigned long long QuickHash( const BYTE * data, const size_t length, unsigned long long mix = 0 );
+/* 64-bit hash with four independent 8 byte lanes per step (the xxHash64 construction), several times faster than QuickHash on long buffers */
+unsigned long long FastHash( const BYTE * data, const size_t length, const unsigned long long seed = 0 );
 
 #endif
@@ -8,6 +8,8 @@ http://en.wikipedia.org/wiki/Wavefront_.obj_file
 #include "utils.h"
 #include "surface.h"
 #include "mymath.h"
+#include "trace.h"
+#include "memoryaccounting.h"
 
 bool MaterialExists( std::vector<Material *> & materials, char * material_name )
 {
@@ -22,24 +24,6 @@ bool MaterialExists( std::vector<Material *> & materials, char * material_name )
 	return false;
 }
 
-Texture * TextureProxy(const std::string & full_name, std::map<std::string, Texture*> & already_loaded_textures,
-	const int flip = -1, const bool single_channel = false )
-{
-	std::map<std::string, Texture*>::iterator already_loaded_texture = already_loaded_textures.find(full_name);
-	Texture * texture = NULL;
-	if (already_loaded_texture != already_loaded_textures.end())
-	{
-		texture = already_loaded_texture->second;
-	}
-	else
-	{
-		texture = new Texture( full_name.c_str() );// , flip, single_channel);
-		already_loaded_textures[full_name] = texture;
-	}
-
-	return texture;
-}
-
 /*! \fn LoadMTL( const char * file_name, const char * path, std::vector<Material *> & materials )
 \brief Nate materily z MTL souboru \a file_name.
 Soubor \a file_name se mus nachzet v cest \a path. Naten materily budou vrceny pes pole \a materials.
@@ -49,6 +33,8 @@ Soubor \a file_name se mus
 */
 int LoadMTL( const char * file_name, const char * path, std::vector<Material *> & materials )
 {
+	TRACE_SCOPE( "LoadMTL" );
+
 	// oteven soouboru
 	FILE * file = fopen( file_name, "rt" );
 	if ( file == NULL )
@@ -62,6 +48,7 @@ int LoadMTL( const char * file_name, const char * path, std::vector<Material *>
 	size_t file_size = static_cast<size_t>( GetFileSize64( file_name ) );	
 	char * buffer = new char[file_size + 1]; // +1 protoe budeme za posledn naten byte dvat NULL
 	char * buffer_backup = new char[file_size + 1];
+	MemoryCharge buffers( MemoryTag::LOADER, MemoryDomain::HOST, 2 * ( file_size + 1 ) );
 
 	printf( "Loading materials from '%s' (%0.1f KB)...\n", file_name, file_size / 1024.0f );
 
@@ -75,6 +62,9 @@ int LoadMTL( const char * file_name, const char * path, std::vector<Material *>
 		fclose( file );
 		file = NULL;
 
+		SAFE_DELETE_ARRAY( buffer_backup );
+		SAFE_DELETE_ARRAY( buffer );
+
 		return -1;
 	}	
 
@@ -95,8 +85,6 @@ int LoadMTL( const char * file_name, const char * path, std::vector<Material *>
 	const char delim[] = "\n";
 	char * line = strtok( buffer, delim );
 
-	std::map<std::string, Texture*> already_loaded_textures;
-
 	Material * material = NULL;
 
 	int nextMaterialIndex = 0;
@@ -156,37 +144,37 @@ int LoadMTL( const char * file_name, const char * path, std::vector<Material *>
 				{					
 					sscanf( tmp, "%*s %s", image_file_name );
 					std::string full_name = std::string( path ).append( image_file_name );
-					material->set_texture( Material::kDiffuseMapSlot, TextureProxy( full_name, already_loaded_textures ) );
+					material->set_texture( Material::kDiffuseMapSlot, full_name );
 				}
 				else if ( strstr( tmp, "map_Ks" ) == tmp ) // specular map
 				{					
 					sscanf( tmp, "%*s %s", image_file_name );
 					std::string full_name = std::string( path ).append( image_file_name );
-					material->set_texture( Material::kSpecularMapSlot, TextureProxy( full_name, already_loaded_textures ) );
+					material->set_texture( Material::kSpecularMapSlot, full_name );
 				}
 				else if ( strstr( tmp, "map_bump" ) == tmp ) // normal map
 				{					
 					sscanf( tmp, "%*s %s", image_file_name );
 					std::string full_name = std::string(path).append(image_file_name);
-					material->set_texture( Material::kNormalMapSlot, TextureProxy( full_name, already_loaded_textures ) );
+					material->set_texture( Material::kNormalMapSlot, full_name );
 				}
 				else if ( strstr( tmp, "map_D" ) == tmp ) // opacity map
 				{					
 					sscanf( tmp, "%*s %s", image_file_name );
 					std::string full_name = std::string(path).append(image_file_name);
-					material->set_texture( Material::kOpacityMapSlot, TextureProxy( full_name, already_loaded_textures, -1, true ) );
+					material->set_texture( Material::kOpacityMapSlot, full_name );
 				}
 				else if ( strstr( tmp, "map_Pr" ) == tmp ) // roughness map
 				{
 					sscanf( tmp, "%*s %s", image_file_name );
 					std::string full_name = std::string( path ).append( image_file_name );
-					material->set_texture( Material::kRoughnessMapSlot, TextureProxy( full_name, already_loaded_textures, -1, true ) );
+					material->set_texture( Material::kRoughnessMapSlot, full_name );
 				}
 				else if ( strstr( tmp, "map_Pm" ) == tmp ) // metallicness map
 				{
 					sscanf( tmp, "%*s %s", image_file_name );
 					std::string full_name = std::string( path ).append( image_file_name );
-					material->set_texture( Material::kMetallicnessMapSlot, TextureProxy( full_name, already_loaded_textures, -1, true ) );
+					material->set_texture( Material::kMetallicnessMapSlot, full_name );
 				}
 				else if ( strstr( tmp, "shader" ) == tmp ) // used shader
 				{
@@ -223,6 +211,7 @@ int LoadMTL( const char * file_name, const char * path, std::vector<Material *>
 	//memcpy( buffer, buffer_backup, file_size + 1 ); // obnoven bufferu po innosti strtok
 	SAFE_DELETE_ARRAY( buffer_backup );
 	SAFE_DELETE_ARRAY( buffer );	
+	buffers.Resize( 0 );
 
 	printf( "\n" );
 
@@ -232,6 +221,8 @@ int LoadMTL( const char * file_name, const char * path, std::vector<Material *>
 int LoadOBJ( const char * file_name, std::vector<Surface *> & surfaces, std::vector<Material *> & materials,
 	const bool flip_yz , const Vector3 default_color )
 {
+	TRACE_SCOPE( "LoadOBJ" );
+
 	// oteven soouboru
 	FILE * file = fopen( file_name, "rt" );
 	if ( file == NULL )
@@ -253,6 +244,7 @@ int LoadOBJ( const char * file_name, std::vector<Surface *> & surfaces, std::vec
 	/*const long long*/size_t file_size = static_cast<size_t>( GetFileSize64( file_name ) );
 	char * buffer = new char[file_size + 1]; // +1 protoe budeme za posledn naten byte dvat NULL
 	char * buffer_backup = new char[file_size + 1];	
+	MemoryCharge buffers( MemoryTag::LOADER, MemoryDomain::HOST, 2 * ( file_size + 1 ) );
 
 	printf( "Loading model from '%s' (%0.1f MB)...\n", file_name, file_size / sqr( 1024.0f ) );
 
@@ -266,6 +258,9 @@ int LoadOBJ( const char * file_name, std::vector<Surface *> & surfaces, std::vec
 		fclose( file );
 		file = NULL;
 
+		SAFE_DELETE_ARRAY( buffer_backup );
+		SAFE_DELETE_ARRAY( buffer );
+
 		return -1;
 	}	
 
@@ -306,11 +301,15 @@ int LoadOBJ( const char * file_name, std::vector<Surface *> & surfaces, std::vec
 
 	memcpy( buffer, buffer_backup, file_size + 1 ); // obnoven bufferu po innosti strtok
 
+	const auto t0 = std::chrono::high_resolution_clock::now();
+
 	for ( int i = 0; i < static_cast<int>( material_libraries.size() ); ++i )
 	{		
 		LoadMTL( material_libraries[i].c_str(), path, materials );
 	}
 
+	const auto t1 = std::chrono::high_resolution_clock::now();
+
 	std::vector<Vector3> vertices; // cel jeden soubor
 	std::vector<Vector3> per_vertex_normals;
 	std::vector<Coord2f> texture_coords;	
@@ -433,6 +432,17 @@ int LoadOBJ( const char * file_name, std::vector<Surface *> & surfaces, std::vec
 			{
 				sscanf( line, "%*s %s", &material_name );
 				//printf( "Material name: %s\n", material_name );						
+
+				// the MTL only names the textures, the maps sampled by the device programs of the used materials
+				// are decoded on the worker threads while the rest of the geometry is parsed
+				for ( Material * material : materials )
+				{
+					if ( material->name().compare( material_name ) == 0 )
+					{
+						material->RequestTextures( Material::kShaderMapSlots );
+						break;
+					}
+				}
 			}
 			break;
 
@@ -539,14 +549,23 @@ int LoadOBJ( const char * file_name, std::vector<Surface *> & surfaces, std::vec
 		}
 	}
 
+	// the attribute arrays and the face array of the largest group keep their capacity until the return, they peak together with the buffers
+	MemoryCharge arrays( MemoryTag::LOADER, MemoryDomain::HOST, ( vertices.capacity() + per_vertex_normals.capacity() ) * sizeof( Vector3 ) +
+		texture_coords.capacity() * sizeof( Coord2f ) + face_vertices.capacity() * sizeof( Vertex ) );
+
 	texture_coords.clear();
 	per_vertex_normals.clear();
 	vertices.clear();	
 
 	SAFE_DELETE_ARRAY( buffer_backup );
 	SAFE_DELETE_ARRAY( buffer );	
+	buffers.Resize( 0 );
+
+	const auto t2 = std::chrono::high_resolution_clock::now();
 
-	printf( "\nDone.\n\n");
+	printf( "\nDone.\n" );
+	printf( "Materials parsed in %0.1f ms, geometry in %0.1f ms, the used textures are decoded in the background.\n\n",
+		std::chrono::duration<double, std::milli>( t1 - t0 ).count(), std::chrono::duration<double, std::milli>( t2 - t1 ).count() );
 
 	return no_surfaces;
 }
@@ -1,206 +1,724 @@
-#include "optixtutorial.h"
-
-struct IntersectionInfo
-{
-	optix::float3 normal;
-	optix::float2 texcoord;
-	optix::float3 intersectionPoint;
-	optix::float3 vectorToLight;
-};
-
-rtBuffer<optix::float3, 1> normal_buffer;
-rtBuffer<optix::float2, 1> texcoord_buffer;
-rtBuffer<optix::uchar4, 2> output_buffer;
-
-rtDeclareVariable( optix::float3, diffuse, , "diffuse" );rtDeclareVariable(optix::float3, specular, , "specular");rtDeclareVariable(optix::float3, ambient, , "ambient");rtDeclareVariable(float, shininess, , "shininess");rtDeclareVariable(int, tex_diffuse_id, , "diffuse texture id");
-
-rtDeclareVariable( rtObject, top_object, , );
-rtDeclareVariable( uint2, launch_dim, rtLaunchDim, );
-rtDeclareVariable( uint2, launch_index, rtLaunchIndex, );
-rtDeclareVariable( PerRayData_radiance, ray_data, rtPayload, );
-rtDeclareVariable( PerRayData_shadow, shadow_ray_data, rtPayload, );
-rtDeclareVariable( float2, barycentrics, attribute rtTriangleBarycentrics, );
-rtDeclareVariable(optix::Ray, ray, rtCurrentRay, "current ray");
-rtDeclareVariable(IntersectionInfo, hitInfo, attribute attributes, "Intersection info");
-rtDeclareVariable(optix::float3, view_from, , );
-rtDeclareVariable(optix::Matrix3x3, M_c_w, , "camera to worldspace transformation matrix" );
-rtDeclareVariable(float, focal_length, , "focal length in pixels" );
-
-
-RT_PROGRAM void attribute_program( void )
-{
-	const optix::float3 lightPossition = optix::make_float3(50, 0, 120);
-	const optix::float2 barycentrics = rtGetTriangleBarycentrics();
-	const unsigned int index = rtGetPrimitiveIndex();
-	const optix::float3 n0 = normal_buffer[index * 3 + 0];
-	const optix::float3 n1 = normal_buffer[index * 3 + 1];
-	const optix::float3 n2 = normal_buffer[index * 3 + 2];
-
-	const optix::float2 t0 = texcoord_buffer[index * 3 + 0];
-	const optix::float2 t1 = texcoord_buffer[index * 3 + 1];
-	const optix::float2 t2 = texcoord_buffer[index * 3 + 2];
-
-	hitInfo.normal = optix::normalize(n1 * barycentrics.x + n2 * barycentrics.y + n0 * (1.0f - barycentrics.x - barycentrics.y));
-	hitInfo.texcoord = t1 * barycentrics.x + t2 * barycentrics.y + t0 * (1.0f - barycentrics.x - barycentrics.y);
-
-	if (optix::dot(ray.direction, hitInfo.normal) > 0) {
-		hitInfo.normal *= -1;
-	}
-
-	hitInfo.intersectionPoint = optix::make_float3(ray.origin.x + ray.tmax * ray.direction.x,
-									ray.origin.y + ray.tmax * ray.direction.y,
-									ray.origin.z + ray.tmax * ray.direction.z);
-
-	hitInfo.vectorToLight = optix::normalize(lightPossition - hitInfo.intersectionPoint);
-
-}
-
-RT_PROGRAM void primary_ray( void )
-{
-	PerRayData_radiance prd;
-	curandState_t state;
-	prd.state = &state;
-	curand_init(launch_index.x + launch_dim.x * launch_index.y, 0, 0, prd.state);
-	int ANTI_ALIASING_SAMPLES = 8;
-	int NO_SAMPLES = 8;
-
-	optix::float3 resultColor = optix::make_float3(0.0f, 0.0f, 0.0f);
-	for (int i = 0; i < ANTI_ALIASING_SAMPLES; i++)
-	{
-		float randomX = curand_uniform(prd.state);
-		float randomY = curand_uniform(prd.state);
-
-		const optix::float3 d_c = make_float3(launch_index.x - launch_dim.x * 0.5f + randomX, 
-											  output_buffer.size().y * 0.5f - launch_index.y + randomY, 
-											  -focal_length);
-
-		const optix::float3 d_w = optix::normalize(M_c_w * d_c);
-		optix::Ray ray(view_from, d_w, 0, 0.01f);
-
-		optix::float3 ambientColor = optix::make_float3(0.0f, 0.0f, 0.0f);
-		for (int j = 0; j < NO_SAMPLES; j++) {
-			rtTrace(top_object, ray, prd);
-			ambientColor += prd.result;
-		}
-		ambientColor /= NO_SAMPLES;
-		resultColor += ambientColor;
-	}
-	resultColor /=  ANTI_ALIASING_SAMPLES;
-	output_buffer[launch_index] = optix::make_uchar4(resultColor.x*255.0f, resultColor.y*255.0f, resultColor.z*255.0f, 255 );
-}
-
-RT_PROGRAM void closest_hit_normal_shader( void )
-{
-	optix::float3 normal = hitInfo.normal;
-	ray_data.result = optix::make_float3((normal.x + 1) / 2, (normal.y + 1) / 2, (normal.z + 1) / 2);
-}
-
-RT_PROGRAM void closest_hit_lambert_shader(void)
-{
-	float normalLigthScalarProduct = optix::dot(hitInfo.vectorToLight, hitInfo.normal);
-	ray_data.result = getDiffuseColor() * normalLigthScalarProduct * getAmbientColor();
-}
-
-RT_PROGRAM void closest_hit_phong_shader(void)
-{
-	float normalLigthScalarProduct = optix::dot(hitInfo.vectorToLight, hitInfo.normal);
-
-	optix::float3 lr = 2 * (normalLigthScalarProduct)* hitInfo.normal - hitInfo.vectorToLight;
-	
-	//optix::float3 reflectedColor = reflect();
-
-	ray_data.result = ambient + (getDiffuseColor() * normalLigthScalarProduct) + specular * pow(/*reflectedColor.x **/ optix::clamp(optix::dot(-ray.direction, lr), 0.0f, 1.0f), shininess);
-	
-	ray_data.result = ray_data.result * getAmbientColor();
-}
-
-RT_PROGRAM void closest_hit_glass_shader(void)
-{
-}
-
-RT_PROGRAM void closest_hit_pbr_shader(void)
-{
-}
-
-RT_PROGRAM void closest_hit_mirror_shader(void)
-{
-}
-
-RT_PROGRAM void any_hit(void)
-{
-	shadow_ray_data.visible.x = 0;
-	rtTerminateRay();
-}
-
-RT_PROGRAM void miss_program( void )
-{
-	ray_data.result = optix::make_float3( 0.0f, 0.0f, 0.0f );
-}
-
-RT_PROGRAM void exception( void )
-{
-	const unsigned int code = rtGetExceptionCode();
-	rtPrintf( "Exception 0x%X at (%d, %d)\n", code, launch_index.x, launch_index.y );
-	rtPrintExceptionDetails();
-	output_buffer[launch_index] = uchar4{ 255, 0, 255, 0 };
-}__device__ optix::float3 sampleHemisphere(optix::float3 normal, curandState_t* state, float& pdf) {
-	float randomU = curand_uniform(state);
-	float randomV = curand_uniform(state);
-
-	float x = cosf(2 * CUDART_PI_F * randomU) * sqrtf(1 - randomV);
-	float y = sinf(2 * CUDART_PI_F * randomU) * sqrtf(1 - randomV);
-	float z = sqrtf(randomV);
-
-	optix::float3 O1 = optix::normalize(orthogonal(normal));
-	optix::float3 O2 = optix::normalize(optix::cross(normal, O1));
-
-	optix::Matrix3x3 transformationMatrix = optix::make_matrix3x3(optix::Matrix<4, 4>::fromBasis(O1, O2, normal, optix::make_float3(0.0f, 0.0f, 0.0f) ));
-
-	optix::float3 omegai = optix::make_float3(x, y, z);
-
-	omegai = optix::normalize(transformationMatrix * omegai);
-
-	pdf = optix::dot(normal, omegai) / CUDART_PI_F;
-
-	return omegai;}__device__ optix::float3 orthogonal(const optix::float3 & v)
-{
-	return (abs(v.x) > abs(v.z)) ? optix::make_float3(-v.y, v.x, 0.0f) : optix::make_float3(0.0f, -v.z, v.y);
-}
-
-__device__ optix::float3 getAmbientColor()
-{
-	float pdf = 0;
-	optix::float3 omegai = sampleHemisphere(hitInfo.normal, ray_data.state, pdf);
-
-	optix::Ray ray(hitInfo.intersectionPoint, omegai, 1, 0.01f);
-	PerRayData_shadow shadow_ray;
-	shadow_ray.visible.x = 1;
-	rtTrace(top_object, ray, shadow_ray);
-
-	optix::float3 whiteColor = optix::make_float3(1, 1, 1);
-	return whiteColor * optix::dot(hitInfo.normal, omegai) * shadow_ray.visible.x / CUDART_PI_F / pdf;
-}
-
-__device__ optix::float3 getDiffuseColor()
-{
-	optix::float3 color;
-	if (tex_diffuse_id != -1) {
-		const optix::float4 value = optix::rtTex2D<optix::float4>(tex_diffuse_id, hitInfo.texcoord.x, 1 - hitInfo.texcoord.y);
-		color = optix::make_float3(value.x, value.y, value.z);
-	}
-	else {
-		color = diffuse;
-	}
-
-	return color;
-}
-
-__device__ optix::float3 reflect()
-{
-	PerRayData_radiance prd;
-	optix::float3 reflected = 2 * (hitInfo.normal * ray.direction) * hitInfo.normal - ray.direction;	
-	optix::Ray ray(ray.origin, reflected, 0, 0.01f);
-	rtTrace(top_object, ray, prd);
-	return ray_data.result;
-}
-
+#include "optixtutorial.h"
+
+struct IntersectionInfo
+{
+	optix::float3 normal;
+	optix::float2 texcoord;
+	optix::float3 intersectionPoint;
+	int frontFace; // the ray hits the side the geometric normal points to
+	float texcoordDensity; // texture space length of a unit length on the triangle
+};
+
+rtBuffer<optix::float3, 1> normal_buffer;
+rtBuffer<optix::float2, 1> texcoord_buffer;
+rtBuffer<float, 1> texcoord_density_buffer; // one value per triangle
+rtBuffer<optix::float4, 2> output_buffer; // linear radiance, tonemapped on the host
+#if defined( RAY_STATS )
+rtBuffer<RayStats, 2> ray_stats_buffer; // rays of the frame, the launches of the frame after the first one add theirs
+#endif
+rtBuffer<Light, 1> lights;
+rtBuffer<Emitter, 1> emitters;
+rtBuffer<AliasEntry, 1> emitter_table;
+rtBuffer<Reservoir, 2> reservoirs;
+rtBuffer<Reservoir, 2> reservoirs_history;
+rtBuffer<GBufferSample, 2> gbuffer;
+rtBuffer<float, 1> env_marginal;
+rtBuffer<float, 1> env_conditional;
+
+rtDeclareVariable( optix::float3, diffuse, , "diffuse" );
+rtDeclareVariable(optix::float3, specular, , "specular");
+rtDeclareVariable(optix::float3, ambient, , "ambient");
+rtDeclareVariable(optix::float3, emission, , "emission");
+rtDeclareVariable(float, shininess, , "shininess");
+rtDeclareVariable(float, ior, , "index of refraction");
+rtDeclareVariable(float, roughness, , "roughness");
+rtDeclareVariable(float, metallicness, , "metallicness");
+
+rtDeclareVariable(int, tex_diffuse_id, , "diffuse texture id");
+rtDeclareVariable(int, tex_roughness_id, , "roughness texture id");
+rtDeclareVariable(int, tex_metallicness_id, , "metallicness texture id");
+
+rtDeclareVariable( rtObject, top_object, , );
+rtDeclareVariable( uint2, launch_dim, rtLaunchDim, );
+rtDeclareVariable( uint2, launch_index, rtLaunchIndex, );
+rtDeclareVariable( PerRayData_radiance, ray_data, rtPayload, );
+rtDeclareVariable( PerRayData_shadow, shadow_ray_data, rtPayload, );
+rtDeclareVariable( GBufferSample, gbuffer_data, rtPayload, );
+rtDeclareVariable( float2, barycentrics, attribute rtTriangleBarycentrics, );
+rtDeclareVariable(optix::Ray, ray, rtCurrentRay, "current ray");
+rtDeclareVariable(IntersectionInfo, hitInfo, attribute attributes, "Intersection info");
+rtDeclareVariable(optix::float3, view_from, , );
+rtDeclareVariable(optix::Matrix3x3, M_c_w, , "camera to worldspace transformation matrix" );
+rtDeclareVariable(float, focal_length, , "focal length in pixels" );
+rtDeclareVariable(unsigned int, light_samples, , "maximum number of shadow rays per hit" );
+rtDeclareVariable(int, emitter_sampling, , "sample emissive triangles explicitly instead of the hemisphere" );
+rtDeclareVariable(float, emitter_pdf_scale, , "reciprocal sum of the emitter sampling weights" );
+rtDeclareVariable(unsigned int, restir_candidates, , "number of light candidates resampled per pixel" );
+rtDeclareVariable(int, restir_temporal, , "merge the reservoirs of the previous frame" );
+rtDeclareVariable(unsigned int, restir_spatial, , "number of neighbouring reservoirs merged per pixel" );
+rtDeclareVariable(unsigned int, frame_index, , "index of the rendered frame" );
+rtDeclareVariable(int, env_map_id, , "environment map texture id, -1 for no map" );
+rtDeclareVariable(int, env_sampling, , "importance sample the environment map instead of the uniform hemisphere sampling" );
+rtDeclareVariable(int, max_depth, , "maximum number of path segments" );
+rtDeclareVariable(int, rr_depth, , "number of path segments before the Russian roulette starts" );
+rtDeclareVariable(int, samples_per_pixel, , "number of paths per pixel" );
+rtDeclareVariable(float, pass_weight, , "weight of the launch in the running mean of the passes of the frame" );
+
+/* maximum distance of the neighbouring pixels in the spatial reuse (px) */
+#define RESTIR_SPATIAL_RADIUS 30.0f
+/* the history is capped to this multiple of the candidate count so stale samples fade out */
+#define RESTIR_HISTORY_LIMIT 20.0f
+
+/* traces a shadow ray towards the light and reports whether the light is visible */
+struct ShadowRayVisibility
+{
+	RayStats * stats; // counts the traced and the occluded rays when set
+
+	__device__ ShadowRayVisibility( RayStats * stats = nullptr ) : stats( stats ) { }
+
+	__device__ bool operator()( const optix::float3 & p, const optix::float3 & omega_l, const float distance ) const
+	{
+		PerRayData_shadow shadow_ray;
+		shadow_ray.visible.x = 1;
+		optix::Ray shadow( p, omega_l, 1, 0.01f, distance - 0.01f );
+		rtTrace( top_object, shadow, shadow_ray );
+
+		RAY_STATS_COUNT( stats, shadow );
+		if ( !shadow_ray.visible.x ) RAY_STATS_COUNT( stats, shadow_occluded );
+
+		return shadow_ray.visible.x != 0;
+	}
+};
+
+/* uniform random numbers for the shared sampling code */
+struct CurandRng
+{
+	curandState_t * state;
+
+	__device__ float operator()() const
+	{
+		return curand_uniform( state );
+	}
+};
+
+/* direct illumination from the lights buffer, evaluated only by the closest hit programs that need it */
+template <class Brdf> __device__ optix::float3 getDirectLighting( const Brdf & brdf )
+{
+	const unsigned int no_lights = static_cast<unsigned int>( lights.size() );
+
+	if ( no_lights == 0 )
+	{
+		return optix::make_float3( 0.0f, 0.0f, 0.0f );
+	}
+
+	return EvaluateDirectLighting( &lights[0], no_lights, light_samples, curand_uniform( ray_data.state ),
+		curand_uniform( ray_data.state ), hitInfo.intersectionPoint, hitInfo.normal, brdf, ShadowRayVisibility( RAY_STATS_OF( ray_data ) ) );
+}
+
+/* next event estimation of the emissive triangles, without it the emitters are found by the BSDF sampled paths only */
+template <class Brdf> __device__ optix::float3 getEmittedLighting( const Brdf & brdf )
+{
+	const unsigned int no_emitters = static_cast<unsigned int>( emitters.size() );
+
+	if ( no_emitters == 0 || !emitter_sampling )
+	{
+		return optix::make_float3( 0.0f, 0.0f, 0.0f );
+	}
+
+	const float u0 = curand_uniform( ray_data.state );
+	const float u1 = curand_uniform( ray_data.state );
+	const float u2 = curand_uniform( ray_data.state );
+	const float u3 = curand_uniform( ray_data.state );
+
+	return EvaluateEmitters( &emitters[0], &emitter_table[0], no_emitters, u0, u1, u2, u3,
+		hitInfo.intersectionPoint, hitInfo.normal, brdf, ShadowRayVisibility( RAY_STATS_OF( ray_data ) ), BsdfMis<Brdf>{ &brdf } );
+}
+
+/* linear radiance of the environment map in the given direction */
+__device__ optix::float3 environmentRadiance( const optix::float3 & direction )
+{
+	if ( env_map_id == -1 )
+	{
+		return optix::make_float3( 0.0f, 0.0f, 0.0f );
+	}
+
+	const optix::float2 uv = EnvironmentUV( direction );
+	const optix::float4 value = optix::rtTex2D<optix::float4>( env_map_id, uv.x, uv.y );
+
+	return optix::make_float3( value.x, value.y, value.z );
+}
+
+struct EnvironmentLookup
+{
+	__device__ optix::float3 operator()( const optix::float3 & omega ) const
+	{
+		return environmentRadiance( omega );
+	}
+};
+
+/* explicit sampling of the environment map at the point p, weighted by mis against the BSDF sampled paths hitting the map */
+template <class Brdf, class Mis = NoMis> __device__ optix::float3 environmentLighting( const optix::float3 & p, const optix::float3 & normal,
+	const Brdf & brdf, curandState_t * state, RayStats * stats = nullptr, const Mis & mis = Mis() )
+{
+	if ( env_map_id == -1 )
+	{
+		return optix::make_float3( 0.0f, 0.0f, 0.0f );
+	}
+
+	const int height = static_cast<int>( env_marginal.size() ) - 1;
+	const int width = static_cast<int>( env_conditional.size() ) / height - 1;
+	const float u0 = curand_uniform( state );
+	const float u1 = curand_uniform( state );
+
+	return EvaluateEnvironment( &env_marginal[0], &env_conditional[0], width, height, env_sampling != 0, u0, u1,
+		p, normal, brdf, ShadowRayVisibility( stats ), EnvironmentLookup(), mis );
+}
+
+template <class Brdf> __device__ optix::float3 getEnvironmentLighting( const Brdf & brdf )
+{
+	return environmentLighting( hitInfo.intersectionPoint, hitInfo.normal, brdf, ray_data.state, RAY_STATS_OF( ray_data ), BsdfMis<Brdf>{ &brdf } );
+}
+
+/* density of the explicit environment sampling generating the direction omega */
+__device__ float environmentPdf( const optix::float3 & omega )
+{
+	const int height = static_cast<int>( env_marginal.size() ) - 1;
+	const int width = static_cast<int>( env_conditional.size() ) / height - 1;
+
+	return EnvironmentSamplingPdf( &env_marginal[0], &env_conditional[0], width, height, env_sampling != 0, omega );
+}
+
+/* traces a single segment of the path, the closest hit and miss programs update the payload */
+struct RadianceTrace
+{
+	__device__ void operator()( PerRayData_radiance & prd ) const
+	{
+		optix::Ray segment( prd.origin, prd.direction, 0, 0.01f );
+		rtTrace( top_object, segment, prd );
+	}
+};
+
+/* adds the emitted and the directly sampled light of the current hit to the path */
+template <class Brdf> __device__ void shadeHit( const Brdf & brdf, const optix::float3 & albedo )
+{
+	if ( ray_data.depth == 0 || ray_data.specular || !emitter_sampling )
+	{
+		ray_data.result += ray_data.throughput * emission;
+	}
+	else
+	{
+		// the emitters hit by the BSDF sampled segments share the estimate with the next event estimation
+		const optix::float3 d = hitInfo.intersectionPoint - ray_data.origin;
+		const float light_pdf = EmitterPdf( emission, emitter_pdf_scale, optix::dot( d, d ), fabsf( optix::dot( hitInfo.normal, ray.direction ) ) );
+		ray_data.result += ray_data.throughput * emission * PowerHeuristic( ray_data.pdf, light_pdf );
+	}
+
+	ray_data.result += ray_data.throughput * ( getDirectLighting( brdf ) + getEmittedLighting( brdf ) + getEnvironmentLighting( brdf ) );
+
+	if ( ray_data.depth == 0 )
+	{
+		ray_data.result += ray_data.throughput * albedo * ambient * getAmbientColor();
+	}
+}
+
+/* samples the continuation of the path by the BSDF */
+template <class Brdf> __device__ void continueByBrdf( const Brdf & brdf )
+{
+	const float u0 = curand_uniform( ray_data.state );
+	const float u1 = curand_uniform( ray_data.state );
+	const float u2 = curand_uniform( ray_data.state );
+	optix::float3 omega_i, weight;
+	float pdf = 0.0f;
+
+	if ( brdf.Sample( u0, u1, u2, omega_i, weight, pdf ) )
+	{
+		ContinuePath( ray_data, hitInfo.intersectionPoint, omega_i, weight, pdf );
+	}
+	else
+	{
+		ray_data.done = 1;
+	}
+}
+
+/* 64-bit seed of the pixel and the frame, the key keeps the frame index in the upper half, so unlike a 32-bit product
+it never wraps around, and the splitmix64 finalizer is a bijection, so no two pixels or frames of a stream share a seed */
+__device__ unsigned long long pixelSeed( const unsigned int stream )
+{
+	unsigned long long z = ( static_cast<unsigned long long>( frame_index ) << 32 ) | ( launch_index.x + launch_dim.x * launch_index.y );
+	z += 0x9e3779b97f4a7c15ull * ( stream + 1ull );
+	z = ( z ^ ( z >> 30 ) ) * 0xbf58476d1ce4e5b9ull;
+	z = ( z ^ ( z >> 27 ) ) * 0x94d049bb133111ebull;
+
+	return z ^ ( z >> 31 );
+}
+
+__device__ optix::Ray cameraRay( const float dx, const float dy )
+{
+	const optix::float3 d_c = make_float3( launch_index.x - launch_dim.x * 0.5f + dx,
+		launch_dim.y * 0.5f - launch_index.y + dy,
+		-focal_length );
+
+	return optix::Ray( view_from, optix::normalize( M_c_w * d_c ), 0, 0.01f );
+}
+
+/* the shared reservoir code works with plain pointers, empty buffers cannot be indexed */
+__device__ const Light * lightsData()
+{
+	return ( lights.size() > 0 ) ? &lights[0] : nullptr;
+}
+
+__device__ const Emitter * emittersData()
+{
+	return ( emitters.size() > 0 ) ? &emitters[0] : nullptr;
+}
+
+__device__ const AliasEntry * emitterTableData()
+{
+	return ( emitter_table.size() > 0 ) ? &emitter_table[0] : nullptr;
+}
+
+__device__ PhongBrdf gbufferBrdf( const GBufferSample & g )
+{
+	PhongBrdf brdf;
+	brdf.albedo = g.albedo;
+	brdf.specular = g.specular;
+	brdf.shininess = g.shininess;
+	brdf.normal = g.normal;
+	brdf.omega_o = g.omega_o;
+
+	return brdf;
+}
+
+__device__ float gbufferTargetPdf( const GBufferSample & g, const PhongBrdf & brdf, const LightCandidate & x )
+{
+	return TargetPdf( lightsData(), static_cast<unsigned int>( lights.size() ), emittersData(), x, g.position, g.normal, brdf );
+}
+
+
+RT_PROGRAM void attribute_program( void )
+{
+	const optix::float2 barycentrics = rtGetTriangleBarycentrics();
+	const unsigned int index = rtGetPrimitiveIndex();
+	const optix::float3 n0 = normal_buffer[index * 3 + 0];
+	const optix::float3 n1 = normal_buffer[index * 3 + 1];
+	const optix::float3 n2 = normal_buffer[index * 3 + 2];
+
+	const optix::float2 t0 = texcoord_buffer[index * 3 + 0];
+	const optix::float2 t1 = texcoord_buffer[index * 3 + 1];
+	const optix::float2 t2 = texcoord_buffer[index * 3 + 2];
+
+	hitInfo.normal = optix::normalize(n1 * barycentrics.x + n2 * barycentrics.y + n0 * (1.0f - barycentrics.x - barycentrics.y));
+	hitInfo.texcoord = t1 * barycentrics.x + t2 * barycentrics.y + t0 * (1.0f - barycentrics.x - barycentrics.y);
+	hitInfo.texcoordDensity = texcoord_density_buffer[index];
+
+	// the interpolated normal decides whether the ray enters or leaves the closed objects (glass)
+	hitInfo.frontFace = optix::dot(ray.direction, hitInfo.normal) <= 0;
+
+	if (!hitInfo.frontFace) {
+		hitInfo.normal *= -1;
+	}
+
+	hitInfo.intersectionPoint = optix::make_float3(ray.origin.x + ray.tmax * ray.direction.x,
+									ray.origin.y + ray.tmax * ray.direction.y,
+									ray.origin.z + ray.tmax * ray.direction.z);
+}
+
+RT_PROGRAM void primary_ray( void )
+{
+	PerRayData_radiance prd;
+	curandState_t state;
+	prd.state = &state;
+	curand_init(pixelSeed(0), 0, 0, prd.state);
+	CurandRng rng = { prd.state };
+#if defined( RAY_STATS )
+	RayStats rays;
+	ResetRayStats(rays);
+#endif
+
+	// every sample is a whole path traced iteratively, the trace depth stays at two (segment and shadow ray)
+	optix::float3 resultColor = optix::make_float3(0.0f, 0.0f, 0.0f);
+	for (int i = 0; i < samples_per_pixel; i++)
+	{
+		float randomX = curand_uniform(prd.state);
+		float randomY = curand_uniform(prd.state);
+
+		const optix::Ray ray = cameraRay(randomX, randomY);
+
+		// the camera ray cone spans a single pixel
+		BeginPath(prd, ray.origin, ray.direction, 1.0f / focal_length);
+		resultColor += TracePath(prd, RadianceTrace(), max_depth, rr_depth, rng);
+#if defined( RAY_STATS )
+		AddRayStats(rays, prd.stats);
+#endif
+	}
+	resultColor /= samples_per_pixel;
+
+	// a frame may be split into several sample passes, the first one overwrites the previous frame
+	if (pass_weight < 1.0f)
+	{
+		const optix::float4 mean = output_buffer[launch_index];
+		resultColor = optix::make_float3(mean.x, mean.y, mean.z) + (resultColor - optix::make_float3(mean.x, mean.y, mean.z)) * pass_weight;
+	}
+	output_buffer[launch_index] = optix::make_float4(resultColor, 1.0f);
+#if defined( RAY_STATS )
+	if (pass_weight < 1.0f) AddRayStats(rays, ray_stats_buffer[launch_index]);
+	ray_stats_buffer[launch_index] = rays;
+#endif
+}
+
+/* first ReSTIR pass, traces the primary ray into the G-buffer and resamples the light candidates with the temporal reuse */
+RT_PROGRAM void restir_initial( void )
+{
+	curandState_t state;
+	curand_init( pixelSeed( 1 ), 0, 0, &state );
+	CurandRng rng = { &state };
+	RayStats stats;
+	ResetRayStats( stats );
+
+	GBufferSample g;
+	g.hit = 0;
+	g.depth = 0.0f;
+	g.emission = optix::make_float3( 0.0f, 0.0f, 0.0f );
+	optix::Ray primary = cameraRay( 0.5f, 0.5f );
+	primary.ray_type = 2;
+	rtTrace( top_object, primary, g );
+	gbuffer[launch_index] = g;
+	RAY_STATS_COUNT( &stats, radiance );
+	if ( !g.hit ) RAY_STATS_COUNT( &stats, radiance_misses );
+
+	Reservoir r;
+	ResetReservoir( r );
+
+	if ( g.hit )
+	{
+		const PhongBrdf brdf = gbufferBrdf( g );
+		const unsigned int no_lights = static_cast<unsigned int>( lights.size() );
+
+		r = GenerateReservoir( lightsData(), no_lights, emittersData(), emitterTableData(),
+			static_cast<unsigned int>( emitters.size() ), restir_candidates, g.position, g.normal, brdf, rng );
+
+		// visibility reuse, occluded samples are not handed over to the neighbours and to the next frame
+		optix::float3 omega_l, contribution;
+		float distance = 0.0f;
+
+		if ( r.W > 0.0f && ( !EvaluateLightCandidate( lightsData(), no_lights, emittersData(), r.y, g.position, g.normal, brdf,
+			omega_l, distance, contribution ) || !ShadowRayVisibility( &stats )( g.position, omega_l, distance ) ) )
+		{
+			r.W = 0.0f;
+		}
+
+		if ( restir_temporal )
+		{
+			Reservoir history = reservoirs_history[launch_index];
+			history.M = fminf( history.M, RESTIR_HISTORY_LIMIT * restir_candidates );
+
+			Reservoir s;
+			ResetReservoir( s );
+			float p_hat_s = 0.0f;
+
+			float p_hat = gbufferTargetPdf( g, brdf, r.y );
+			if ( MergeReservoir( s, r, p_hat, curand_uniform( &state ) ) ) p_hat_s = p_hat;
+
+			p_hat = gbufferTargetPdf( g, brdf, history.y );
+			if ( MergeReservoir( s, history, p_hat, curand_uniform( &state ) ) ) p_hat_s = p_hat;
+
+			FinalizeReservoir( s, p_hat_s );
+			r = s;
+		}
+	}
+
+	reservoirs[launch_index] = r;
+#if defined( RAY_STATS )
+	ray_stats_buffer[launch_index] = stats;
+#endif
+}
+
+/* second ReSTIR pass, merges the reservoirs of similar neighbours and shades the pixel with a single shadow ray */
+RT_PROGRAM void restir_spatial( void )
+{
+	curandState_t state;
+	curand_init( pixelSeed( 2 ), 0, 0, &state );
+	RayStats stats;
+	ResetRayStats( stats );
+
+	const GBufferSample g = gbuffer[launch_index];
+	Reservoir r = reservoirs[launch_index];
+	optix::float3 result = g.emission; // the environment map for the missed pixels
+
+	if ( g.hit )
+	{
+		const PhongBrdf brdf = gbufferBrdf( g );
+
+		if ( restir_spatial > 0 )
+		{
+			Reservoir s;
+			ResetReservoir( s );
+			float p_hat_s = 0.0f;
+
+			float p_hat = gbufferTargetPdf( g, brdf, r.y );
+			if ( MergeReservoir( s, r, p_hat, curand_uniform( &state ) ) ) p_hat_s = p_hat;
+
+			for ( unsigned int i = 0; i < restir_spatial; ++i )
+			{
+				const float radius = RESTIR_SPATIAL_RADIUS * sqrtf( curand_uniform( &state ) );
+				const float phi = 2.0f * CUDART_PI_F * curand_uniform( &state );
+				const int x = static_cast<int>( launch_index.x + radius * cosf( phi ) );
+				const int y = static_cast<int>( launch_index.y + radius * sinf( phi ) );
+
+				if ( x < 0 || y < 0 || x >= static_cast<int>( launch_dim.x ) || y >= static_cast<int>( launch_dim.y ) )
+				{
+					continue;
+				}
+
+				const optix::uint2 q = optix::make_uint2( x, y );
+				const GBufferSample & g_q = gbuffer[q];
+
+				// reservoirs of different surfaces would bias the estimate
+				if ( !g_q.hit || optix::dot( g_q.normal, g.normal ) < 0.9f || fabsf( g_q.depth - g.depth ) > 0.1f * g.depth )
+				{
+					continue;
+				}
+
+				const Reservoir r_q = reservoirs[q];
+				p_hat = gbufferTargetPdf( g, brdf, r_q.y );
+				if ( MergeReservoir( s, r_q, p_hat, curand_uniform( &state ) ) ) p_hat_s = p_hat;
+			}
+
+			FinalizeReservoir( s, p_hat_s );
+			r = s;
+		}
+
+		// the environment map is sampled separately, it is not a part of the reservoirs
+		result += environmentLighting( g.position, g.normal, brdf, &state, &stats );
+
+		optix::float3 omega_l, contribution;
+		float distance = 0.0f;
+
+		if ( r.W > 0.0f && EvaluateLightCandidate( lightsData(), static_cast<unsigned int>( lights.size() ), emittersData(), r.y,
+			g.position, g.normal, brdf, omega_l, distance, contribution ) && ShadowRayVisibility( &stats )( g.position, omega_l, distance ) )
+		{
+			result += contribution * r.W;
+		}
+	}
+
+	reservoirs_history[launch_index] = r;
+
+	output_buffer[launch_index] = optix::make_float4( result, 1.0f );
+#if defined( RAY_STATS )
+	AddRayStats( stats, ray_stats_buffer[launch_index] );
+	ray_stats_buffer[launch_index] = stats;
+#endif
+}
+
+/* texture space width of the ray cone of the path at the current hit */
+__device__ float radianceFootprint()
+{
+	return RayConeFootprint( ray_data.cone_width + ray_data.cone_spread * ray.tmax, optix::dot( hitInfo.normal, ray.direction ), hitInfo.texcoordDensity );
+}
+
+/* stores the primary hit for the ReSTIR passes */
+__device__ void writeGBuffer( const optix::float3 & specular_color, const float exponent )
+{
+	gbuffer_data.position = hitInfo.intersectionPoint;
+	gbuffer_data.depth = ray.tmax;
+	gbuffer_data.normal = hitInfo.normal;
+	gbuffer_data.hit = 1;
+	gbuffer_data.albedo = getDiffuseColor( RayConeFootprint( ray.tmax / focal_length, optix::dot( hitInfo.normal, ray.direction ), hitInfo.texcoordDensity ) );
+	gbuffer_data.shininess = exponent;
+	gbuffer_data.specular = specular_color;
+	gbuffer_data.emission = emission;
+	gbuffer_data.omega_o = -ray.direction;
+}
+
+RT_PROGRAM void closest_hit_gbuffer_lambert( void )
+{
+	writeGBuffer( optix::make_float3( 0.0f, 0.0f, 0.0f ), 1.0f );
+}
+
+RT_PROGRAM void closest_hit_gbuffer_phong( void )
+{
+	writeGBuffer( specular, shininess );
+}
+
+RT_PROGRAM void closest_hit_normal_shader( void )
+{
+	optix::float3 normal = hitInfo.normal;
+	ray_data.result += ray_data.throughput * optix::make_float3((normal.x + 1) / 2, (normal.y + 1) / 2, (normal.z + 1) / 2);
+	ray_data.done = 1;
+}
+
+RT_PROGRAM void closest_hit_lambert_shader(void)
+{
+	LambertBrdf brdf;
+	brdf.albedo = getDiffuseColor(radianceFootprint());
+	brdf.normal = hitInfo.normal;
+
+	shadeHit(brdf, brdf.albedo);
+	continueByBrdf(brdf);
+}
+
+RT_PROGRAM void closest_hit_phong_shader(void)
+{
+	PhongBrdf brdf;
+	brdf.albedo = getDiffuseColor(radianceFootprint());
+	brdf.specular = specular;
+	brdf.shininess = shininess;
+	brdf.normal = hitInfo.normal;
+	brdf.omega_o = -ray.direction;
+
+	shadeHit(brdf, brdf.albedo);
+	continueByBrdf(brdf);
+}
+
+RT_PROGRAM void closest_hit_glass_shader(void)
+{
+	// delta BSDFs can not be sampled by the lights, the emission is picked up by the next segment instead
+	ray_data.result += ray_data.throughput * emission;
+
+	const optix::float3 omega_i = SampleDielectric(ray.direction, hitInfo.normal, hitInfo.frontFace != 0, ior, curand_uniform(ray_data.state));
+	ContinuePath(ray_data, hitInfo.intersectionPoint, omega_i, optix::make_float3(1.0f, 1.0f, 1.0f), 0.0f);
+}
+
+RT_PROGRAM void closest_hit_pbr_shader(void)
+{
+	GgxBrdf brdf;
+	const float footprint = radianceFootprint();
+	brdf.base_color = getDiffuseColor(footprint);
+	brdf.roughness = getRoughness(footprint);
+	brdf.metallic = getMetallicness(footprint);
+	brdf.normal = hitInfo.normal;
+	brdf.omega_o = -ray.direction;
+
+	shadeHit(brdf, brdf.base_color);
+	continueByBrdf(brdf);
+}
+
+RT_PROGRAM void closest_hit_mirror_shader(void)
+{
+	ray_data.result += ray_data.throughput * emission;
+
+	const optix::float3 omega_i = ReflectDirection(-ray.direction, hitInfo.normal);
+	ContinuePath(ray_data, hitInfo.intersectionPoint, omega_i, specular, 0.0f);
+}
+
+RT_PROGRAM void any_hit(void)
+{
+	shadow_ray_data.visible.x = 0;
+	rtTerminateRay();
+}
+
+RT_PROGRAM void miss_program( void )
+{
+	if ( ray_data.depth == 0 || ray_data.specular )
+	{
+		ray_data.result += ray_data.throughput * environmentRadiance( ray.direction );
+	}
+	else if ( env_map_id != -1 )
+	{
+		// the map is also sampled explicitly at the hits, both estimates are combined by mis
+		ray_data.result += ray_data.throughput * environmentRadiance( ray.direction ) * PowerHeuristic( ray_data.pdf, environmentPdf( ray.direction ) );
+	}
+
+	ray_data.done = 1;
+	RAY_STATS_COUNT( RAY_STATS_OF( ray_data ), radiance_misses );
+}
+
+RT_PROGRAM void miss_gbuffer( void )
+{
+	gbuffer_data.hit = 0;
+	gbuffer_data.depth = 0.0f;
+	gbuffer_data.emission = environmentRadiance( ray.direction );
+}
+
+RT_PROGRAM void exception( void )
+{
+	const unsigned int code = rtGetExceptionCode();
+	rtPrintf( "Exception 0x%X at (%d, %d)\n", code, launch_index.x, launch_index.y );
+	rtPrintExceptionDetails();
+	output_buffer[launch_index] = optix::make_float4( 1.0f, 0.0f, 1.0f, 0.0f );
+}
+
+
+__device__ optix::float3 sampleHemisphere(optix::float3 normal, curandState_t* state, float& pdf) {
+	float randomU = curand_uniform(state);
+	float randomV = curand_uniform(state);
+
+	float x = cosf(2 * CUDART_PI_F * randomU) * sqrtf(1 - randomV);
+	float y = sinf(2 * CUDART_PI_F * randomU) * sqrtf(1 - randomV);
+	float z = sqrtf(randomV);
+
+	optix::float3 O1 = optix::normalize(orthogonal(normal));
+	optix::float3 O2 = optix::normalize(optix::cross(normal, O1));
+
+	optix::Matrix3x3 transformationMatrix = optix::make_matrix3x3(optix::Matrix<4, 4>::fromBasis(O1, O2, normal, optix::make_float3(0.0f, 0.0f, 0.0f) ));
+
+	optix::float3 omegai = optix::make_float3(x, y, z);
+
+	omegai = optix::normalize(transformationMatrix * omegai);
+
+	pdf = optix::dot(normal, omegai) / CUDART_PI_F;
+
+	return omegai;
+}
+
+__device__ optix::float3 orthogonal(const optix::float3 & v)
+{
+	return (abs(v.x) > abs(v.z)) ? optix::make_float3(-v.y, v.x, 0.0f) : optix::make_float3(0.0f, -v.z, v.y);
+}
+
+__device__ optix::float3 getAmbientColor()
+{
+	float pdf = 0;
+	optix::float3 omegai = sampleHemisphere(hitInfo.normal, ray_data.state, pdf);
+
+	optix::Ray ray(hitInfo.intersectionPoint, omegai, 1, 0.01f);
+	PerRayData_shadow shadow_ray;
+	shadow_ray.visible.x = 1;
+	rtTrace(top_object, ray, shadow_ray);
+	RAY_STATS_COUNT(RAY_STATS_OF(ray_data), shadow);
+	if (!shadow_ray.visible.x) RAY_STATS_COUNT(RAY_STATS_OF(ray_data), shadow_occluded);
+
+	optix::float3 whiteColor = optix::make_float3(1, 1, 1);
+	return whiteColor * optix::dot(hitInfo.normal, omegai) * shadow_ray.visible.x / CUDART_PI_F / pdf;
+}
+
+/* samples the mip pyramid, the isotropic gradients select the level of the ray cone footprint */
+__device__ optix::float4 sampleMaterialTexture(const int id, const float footprint)
+{
+	return optix::rtTex2DGrad<optix::float4>(id, hitInfo.texcoord.x, 1 - hitInfo.texcoord.y,
+		optix::make_float2(footprint, 0.0f), optix::make_float2(0.0f, footprint));
+}
+
+__device__ optix::float3 getDiffuseColor(const float footprint)
+{
+	optix::float3 color;
+	if (tex_diffuse_id != -1) {
+		const optix::float4 value = sampleMaterialTexture(tex_diffuse_id, footprint);
+		color = optix::make_float3(value.x, value.y, value.z);
+	}
+	else {
+		color = diffuse;
+	}
+
+	return color;
+}
+
+__device__ float getRoughness(const float footprint)
+{
+	if (tex_roughness_id != -1) {
+		return sampleMaterialTexture(tex_roughness_id, footprint).x;
+	}
+
+	return roughness;
+}
+
+__device__ float getMetallicness(const float footprint)
+{
+	if (tex_metallicness_id != -1) {
+		return sampleMaterialTexture(tex_metallicness_id, footprint).x;
+	}
+
+	return metallicness;
+}
+
+
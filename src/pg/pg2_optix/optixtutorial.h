@@ -5,20 +5,36 @@
 #include <optix_world.h>
 #include <curand_kernel.h>
 #include "math_constants.h"
+#include "light.h"
+#include "emitters.h"
+#include "reservoir.h"
+#include "environment.h"
+#include "pathtracer.h"
 
 __device__ optix::float3 sampleHemisphere(optix::float3 normal, curandState_t* state, float& pdf);
 __device__ optix::float3 orthogonal(const optix::float3 & v);
 __device__ optix::float3 getAmbientColor();
-__device__ optix::float3 getDiffuseColor();
-__device__ optix::float3 reflect();
+__device__ optix::float3 getDiffuseColor(const float footprint);
+__device__ float getRoughness(const float footprint);
+__device__ float getMetallicness(const float footprint);
 
+/* radiance ray payload, the members up to stats match PathState */
 struct PerRayData_radiance
 {
 	optix::float3 result;
-	float  importance;
+	optix::float3 throughput;
+	optix::float3 origin;
+	optix::float3 direction;
 	int depth;
+	int done;
+	int specular;
+	float pdf;
+	float cone_width;
+	float cone_spread;
+#if defined( RAY_STATS )
+	RayStats stats;
+#endif
 	curandState_t* state;
-
 };
 
 struct PerRayData_shadow
@@ -0,0 +1,109 @@
+#ifndef PATH_TRACER_H_
+#define PATH_TRACER_H_
+
+#include "bsdf.h"
+#include "raycone.h"
+#include "raystats.h"
+
+/*! \struct PathState
+\brief State of a path carried between the bounces.
+
+The radiance ray payload of the device code has the same members, so TracePath works with both.
+The closest hit programs add the emitted and the directly sampled light weighted by \a throughput
+to \a result and either end the path or set its continuation with ContinuePath.
+*/
+struct PathState
+{
+	optix::float3 result; /*!< Radiance gathered so far. */
+	optix::float3 throughput; /*!< Product of the BSDF weights along the path. */
+	optix::float3 origin; /*!< Origin of the next segment. */
+	optix::float3 direction; /*!< Direction of the next segment. */
+	int depth; /*!< Index of the traced segment, zero for the camera ray. */
+	int done; /*!< Non-zero when the path has ended. */
+	int specular; /*!< Non-zero when the last bounce was a delta reflection or refraction. */
+	float pdf; /*!< Solid angle density of the last sampled direction, the lights hit by the path are weighted by it. */
+	float cone_width; /*!< Width of the ray cone at the origin of the segment, selects the texture LOD. */
+	float cone_spread; /*!< Spread angle of the ray cone. */
+#if defined( RAY_STATS )
+	RayStats stats; /*!< Rays traced for the path including the shadow rays. */
+#endif
+};
+
+/* cone_spread is the angle of the camera ray cone, about the pixel size over the focal length */
+template <class Path>
+RT_HOSTDEVICE inline void BeginPath( Path & path, const optix::float3 & origin, const optix::float3 & direction, const float cone_spread = 0.0f )
+{
+	path.result = optix::make_float3( 0.0f );
+	path.throughput = optix::make_float3( 1.0f );
+	path.origin = origin;
+	path.direction = direction;
+	path.depth = 0;
+	path.done = 0;
+	path.specular = 0;
+	path.pdf = 0.0f;
+	path.cone_width = 0.0f;
+	path.cone_spread = cone_spread;
+#if defined( RAY_STATS )
+	ResetRayStats( path.stats );
+#endif
+}
+
+/* sets the next segment of the path, weight is the BSDF times the cosine over the pdf of the sampled direction,
+the pdf is zero for the delta bounces */
+template <class Path>
+RT_HOSTDEVICE inline void ContinuePath( Path & path, const optix::float3 & origin, const optix::float3 & direction,
+	const optix::float3 & weight, const float pdf )
+{
+	path.throughput *= weight;
+	path.cone_width += path.cone_spread * optix::length( origin - path.origin );
+	path.cone_spread = RayConeSpread( path.cone_spread, pdf );
+	path.origin = origin;
+	path.direction = direction;
+	path.specular = ( pdf > 0.0f ) ? 0 : 1;
+	path.pdf = pdf;
+	path.done = ( fmaxf( path.throughput.x, fmaxf( path.throughput.y, path.throughput.z ) ) <= 0.0f ) ? 1 : 0;
+}
+
+/* Russian roulette never keeps a path with a probability higher than this */
+#define RUSSIAN_ROULETTE_MAX_PROBABILITY 0.95f
+
+/*! \fn optix::float3 TracePath( Path & path, const Trace & trace, const int max_depth, const int rr_depth, Rng & rng )
+\brief Iterative path tracing loop, the stack does not grow with the number of bounces.
+
+\param trace functor tracing the segment ( path.origin, path.direction ) and shading its hit or miss.
+\param max_depth maximum number of segments, one means the direct lighting only.
+\param rr_depth number of segments after which the Russian roulette may terminate the path.
+\param rng functor returning uniformly distributed numbers in [0, 1).
+*/
+template <class Path, class Trace, class Rng>
+RT_HOSTDEVICE inline optix::float3 TracePath( Path & path, const Trace & trace, const int max_depth, const int rr_depth, Rng & rng )
+{
+	for ( path.depth = 0; path.depth < max_depth; ++path.depth )
+	{
+		trace( path );
+		RAY_STATS_COUNT( RAY_STATS_OF( path ), radiance );
+
+		if ( path.done )
+		{
+			break;
+		}
+
+		if ( path.depth + 1 >= rr_depth )
+		{
+			// the survivors are reweighted so the estimate stays unbiased
+			const float q = fminf( RUSSIAN_ROULETTE_MAX_PROBABILITY,
+				fmaxf( path.throughput.x, fmaxf( path.throughput.y, path.throughput.z ) ) );
+
+			if ( rng() >= q )
+			{
+				break;
+			}
+
+			path.throughput /= q;
+		}
+	}
+
+	return path.result;
+}
+
+#endif
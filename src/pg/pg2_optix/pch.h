@@ -12,9 +12,16 @@
 #include <mutex>
 #include <thread>
 #include <atomic>
+#include <future>
+#include <condition_variable>
+#include <queue>
+#include <functional>
 #include <tchar.h>
 #include <vector>
 #include <map>
+#include <set>
+#include <list>
+#include <algorithm>
 #include <random>
 #define _USE_MATH_DEFINES
 #include <math.h>
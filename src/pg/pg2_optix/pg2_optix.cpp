@@ -1,10 +1,23 @@
 #include "pch.h"
 #include "tutorials.h"
 
-int main()
+int main( int argc, char * argv[] )
 {
 	printf( "PG2, (c)2019 Tomas Fabian\n\n" );
 
+	// any option starts the headless batch renderer
+	if ( argc > 1 )
+	{
+		BatchSettings settings;
+
+		if ( !ParseBatchSettings( argc, argv, settings ) )
+		{
+			return EXIT_FAILURE;
+		}
+
+		return ( settings.bench.empty() ) ? render_batch( settings ) : run_benchmarks( settings );
+	}
+
 	//return tutorial_1();
 	return tutorial_2( "../../../data/6887_allied_avenger_gi.obj" );
 }
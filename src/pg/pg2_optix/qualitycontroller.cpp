@@ -0,0 +1,122 @@
+#include "pch.h"
+#include "qualitycontroller.h"
+#include "mymath.h"
+
+/* the camera counts as moving for this long after its last change, the key repeat does not flip the quality */
+static const std::chrono::milliseconds kMotionHold( 150 );
+/* weight of a new measurement in the smoothed times */
+static const float kSmoothing = 0.3f;
+
+void QualityController::Configure( const bool enabled, const float target_ms, const int full_spp )
+{
+	enabled_ = enabled;
+	target_ms_ = target_ms;
+	full_spp_ = max( 1, full_spp );
+}
+
+void QualityController::Next( const bool moved, const int width, const int height )
+{
+	const auto now = std::chrono::high_resolution_clock::now();
+
+	if ( moved )
+	{
+		last_motion_ = now;
+	}
+
+	moving_ = enabled_ && ( moved || now - last_motion_ < kMotionHold );
+
+	if ( !moving_ )
+	{
+		// the accumulation continues at the full resolution, the first frames after a stop stay short
+		scale_ = 1;
+		spp_ = ( enabled_ ) ? min( full_spp_, max( 1, spp_ * 2 ) ) : full_spp_;
+	}
+	else if ( ms_per_sample_ <= 0.0f )
+	{
+		scale_ = 2;
+		spp_ = 1;
+	}
+	else
+	{
+		const double pixels = double( width ) * height;
+		const double samples = max( 0.0, double( target_ms_ - other_ms_ ) ) / ms_per_sample_;
+
+		spp_ = static_cast<int>( min( double( full_spp_ ), max( 1.0, samples / pixels ) ) );
+		scale_ = ( samples < pixels ) ? min( PREVIEW_MAX_SCALE, static_cast<int>( ceil( sqrt( pixels / max( samples, 1.0 ) ) ) ) ) : 1;
+	}
+
+	work_ = size_t( ( width + scale_ - 1 ) / scale_ ) * ( ( height + scale_ - 1 ) / scale_ ) * spp_;
+}
+
+void QualityController::Update( const float launch_ms, const float other_ms )
+{
+	if ( work_ > 0 )
+	{
+		const float cost = launch_ms / work_;
+		ms_per_sample_ = ( ms_per_sample_ > 0.0f ) ? ms_per_sample_ + ( cost - ms_per_sample_ ) * kSmoothing : cost;
+	}
+
+	other_ms_ += ( other_ms - other_ms_ ) * kSmoothing;
+	frame_ms_ += ( launch_ms + other_ms - frame_ms_ ) * kSmoothing;
+}
+
+int QualityController::scale() const
+{
+	return scale_;
+}
+
+int QualityController::spp() const
+{
+	return spp_;
+}
+
+bool QualityController::moving() const
+{
+	return moving_;
+}
+
+float QualityController::frame_ms() const
+{
+	return frame_ms_;
+}
+
+float QualityController::target_ms() const
+{
+	return target_ms_;
+}
+
+void QualityController::Upscale( const optix::float4 * src, const int stride, const int width, const int height,
+	optix::float4 * dst, const int dst_width, const int dst_height )
+{
+	const float sx = float( width ) / dst_width;
+	const float sy = float( height ) / dst_height;
+
+	#pragma omp parallel for schedule( dynamic, 16 )
+	for ( int y = 0; y < dst_height; ++y )
+	{
+		const float v = max( 0.0f, ( y + 0.5f ) * sy - 0.5f );
+		const int y0 = min( static_cast<int>( v ), height - 1 );
+		const int y1 = min( y0 + 1, height - 1 );
+		const float fy = v - y0;
+
+		for ( int x = 0; x < dst_width; ++x )
+		{
+			const float u = max( 0.0f, ( x + 0.5f ) * sx - 0.5f );
+			const int x0 = min( static_cast<int>( u ), width - 1 );
+			const int x1 = min( x0 + 1, width - 1 );
+			const float fx = u - x0;
+
+			const optix::float4 & p00 = src[size_t( y0 ) * stride + x0];
+			const optix::float4 & p01 = src[size_t( y0 ) * stride + x1];
+			const optix::float4 & p10 = src[size_t( y1 ) * stride + x0];
+			const optix::float4 & p11 = src[size_t( y1 ) * stride + x1];
+			const float w00 = ( 1.0f - fx ) * ( 1.0f - fy ), w01 = fx * ( 1.0f - fy ), w10 = ( 1.0f - fx ) * fy, w11 = fx * fy;
+
+			optix::float4 & p = dst[size_t( y ) * dst_width + x];
+			p.x = p00.x * w00 + p01.x * w01 + p10.x * w10 + p11.x * w11;
+			p.y = p00.y * w00 + p01.y * w01 + p10.y * w10 + p11.y * w11;
+			p.z = p00.z * w00 + p01.z * w01 + p10.z * w10 + p11.z * w11;
+			p.w = p00.w * w00 + p01.w * w01 + p10.w * w10 + p11.w * w11;
+		}
+	}
+}
@@ -0,0 +1,58 @@
+#ifndef QUALITY_CONTROLLER_H_
+#define QUALITY_CONTROLLER_H_
+
+#include <optixu/optixu_math_namespace.h>
+
+/* the largest resolution divisor of the preview */
+#define PREVIEW_MAX_SCALE 8
+
+/*! \class QualityController
+\brief Picks the resolution and the samples per pixel of the next frame to keep the camera motion interactive.
+
+While the camera moves, the launch time is modelled as the cost of a sample times the number of samples of the frame,
+the rest of the frame ( readback, upscaling and tonemapping ) as a constant. The samples are dropped first,
+then the resolution, until the predicted frame time meets the target. Once the camera stops the resolution
+returns to the full one and the samples double every frame up to the requested count.
+*/
+class QualityController
+{
+public:
+	/* target_ms is the frame time aimed at while moving, disabling the controller renders every frame in full quality */
+	void Configure( const bool enabled, const float target_ms, const int full_spp );
+
+	/* chooses the quality of the frame about to be rendered, moved tells that the camera changed since the last frame */
+	void Next( const bool moved, const int width, const int height );
+	/* feeds back the measured times of the frame chosen by Next */
+	void Update( const float launch_ms, const float other_ms );
+
+	/* resolution divisor of the frame, one for the full resolution */
+	int scale() const;
+	int spp() const;
+	/* the camera moved recently */
+	bool moving() const;
+	/* smoothed time of the frames measured by Update */
+	float frame_ms() const;
+	float target_ms() const;
+
+	/* bilinearly stretches the width x height pixels in the top left corner of src with the given row stride
+	to the whole dst of dst_width x dst_height pixels */
+	static void Upscale( const optix::float4 * src, const int stride, const int width, const int height,
+		optix::float4 * dst, const int dst_width, const int dst_height );
+
+private:
+	bool enabled_{ true };
+	float target_ms_{ 33.3f };
+	int full_spp_{ 1 };
+
+	int scale_{ 1 };
+	int spp_{ 1 };
+	size_t work_{ 0 }; // samples of the chosen frame
+	std::chrono::high_resolution_clock::time_point last_motion_;
+	bool moving_{ false };
+
+	float ms_per_sample_{ 0.0f }; // smoothed launch cost, zero until the first preview frame is measured
+	float other_ms_{ 0.0f };
+	float frame_ms_{ 0.0f };
+};
+
+#endif
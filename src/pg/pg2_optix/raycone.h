@@ -0,0 +1,51 @@
+#ifndef RAY_CONE_H_
+#define RAY_CONE_H_
+
+#include <optixu/optixu_math_namespace.h>
+
+/* ray cones (Akenine-Moller et al. 2019) select the texture LOD, a path carries the width of its cone
+at the origin of the current segment and the spread angle, the width grows by spread * t along the segment */
+
+/* the grazing hits would select the coarsest level otherwise */
+#define RAY_CONE_MIN_COS 0.05f
+/* the spread after a rough bounce does not grow beyond this angle (rad) */
+#define RAY_CONE_MAX_SPREAD 1.0f
+
+/* square root of the ratio of the texture space and the world space area of the triangle,
+converts the lengths on the surface to the lengths in the texture space */
+RT_HOSTDEVICE inline float TexcoordDensity( const optix::float3 & p0, const optix::float3 & p1, const optix::float3 & p2,
+	const optix::float2 & t0, const optix::float2 & t1, const optix::float2 & t2 )
+{
+	const float world_area = optix::length( optix::cross( p1 - p0, p2 - p0 ) );
+	const float uv_area = fabsf( ( t1.x - t0.x ) * ( t2.y - t0.y ) - ( t2.x - t0.x ) * ( t1.y - t0.y ) );
+
+	return ( world_area > 0.0f ) ? sqrtf( uv_area / world_area ) : 0.0f;
+}
+
+/* width of the cone footprint in the texture space, cos_theta is the cosine between the surface normal and the ray */
+RT_HOSTDEVICE inline float RayConeFootprint( const float cone_width, const float cos_theta, const float texcoord_density )
+{
+	return cone_width / fmaxf( fabsf( cos_theta ), RAY_CONE_MIN_COS ) * texcoord_density;
+}
+
+/* spread of the cone after a bounce sampled with the solid angle density pdf, the cone covers the solid angle 1 / pdf,
+the delta bounces ( pdf zero ) keep the spread as the surface curvature is ignored */
+RT_HOSTDEVICE inline float RayConeSpread( const float spread, const float pdf )
+{
+	if ( pdf <= 0.0f )
+	{
+		return spread;
+	}
+
+	return fmaxf( spread, fminf( RAY_CONE_MAX_SPREAD, sqrtf( 1.0f / ( M_PIf * pdf ) ) ) );
+}
+
+/* mip level of the footprint, the same level the texture unit derives from the gradients ( footprint, 0 ) and ( 0, footprint ) */
+RT_HOSTDEVICE inline float TextureLod( const float footprint, const int width, const int height )
+{
+	const float texels = footprint * static_cast<float>( ( width > height ) ? width : height );
+
+	return ( texels > 1.0f ) ? log2f( texels ) : 0.0f;
+}
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef RAY_STATS_H_
+#define RAY_STATS_H_
+
+#include <optixu/optixu_math_namespace.h>
+
+/* the ray counters are compiled out of the device programs and the host tracers when RAY_STATS_DISABLED is defined */
+#if !defined( RAY_STATS_DISABLED )
+#define RAY_STATS
+#endif
+
+/*! \struct RayStats
+\brief Rays traced for a pixel by the device programs or for a path by the host tracer.
+
+The radiance rays include the G-buffer rays of ReSTIR, the shadow rays include the ambient occlusion rays.
+A shadow ray is occluded when the any-hit program terminated it.
+*/
+struct RayStats
+{
+	unsigned int radiance;
+	unsigned int radiance_misses;
+	unsigned int shadow;
+	unsigned int shadow_occluded;
+};
+
+RT_HOSTDEVICE inline void ResetRayStats( RayStats & stats )
+{
+	stats.radiance = 0;
+	stats.radiance_misses = 0;
+	stats.shadow = 0;
+	stats.shadow_occluded = 0;
+}
+
+RT_HOSTDEVICE inline void AddRayStats( RayStats & stats, const RayStats & other )
+{
+	stats.radiance += other.radiance;
+	stats.radiance_misses += other.radiance_misses;
+	stats.shadow += other.shadow;
+	stats.shadow_occluded += other.shadow_occluded;
+}
+
+/*! \struct FrameRayStats
+\brief Rays of all pixels of a frame, summed on the host from the per-pixel counters.
+*/
+struct FrameRayStats
+{
+	unsigned long long radiance{ 0 };
+	unsigned long long radiance_misses{ 0 };
+	unsigned long long shadow{ 0 };
+	unsigned long long shadow_occluded{ 0 };
+	int no_pixels{ 0 }; // launched
+	double seconds{ 0.0 }; // of the launches
+
+	unsigned long long rays() const
+	{
+		return radiance + shadow;
+	}
+
+	double rays_per_pixel() const
+	{
+		return ( no_pixels > 0 ) ? double( rays() ) / no_pixels : 0.0;
+	}
+
+	double mrays_per_second() const
+	{
+		return ( seconds > 0.0 ) ? rays() / seconds * 1e-6 : 0.0;
+	}
+
+	/* fraction of the radiance rays hitting the scene */
+	double hit_ratio() const
+	{
+		return ( radiance > 0 ) ? 1.0 - double( radiance_misses ) / radiance : 0.0;
+	}
+
+	double occluded_ratio() const
+	{
+		return ( shadow > 0 ) ? double( shadow_occluded ) / shadow : 0.0;
+	}
+};
+
+#if defined( RAY_STATS )
+/* increments the member of the RayStats pointed to by stats, a null pointer counts nothing */
+#define RAY_STATS_COUNT( stats, member ) do { if ( stats ) ++( stats )->member; } while ( false )
+/* the counters of a path state, a null pointer when the counters are compiled out */
+#define RAY_STATS_OF( path ) ( &( path ).stats )
+#else
+#define RAY_STATS_COUNT( stats, member ) do { } while ( false )
+#define RAY_STATS_OF( path ) static_cast<RayStats *>( nullptr )
+#endif
+
+#endif
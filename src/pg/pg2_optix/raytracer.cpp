@@ -1,370 +1,1301 @@
-#include "pch.h"
-#include "raytracer.h"
-#include "objloader.h"
-#include "tutorials.h"
-#include "mymath.h"
-#include "omp.h"
-
-void Raytracer::error_handler(RTresult code)
-{
-	if (code != RT_SUCCESS)
-	{
-		const char* error_string;
-		rtContextGetErrorString(context, code, &error_string);
-		printf(error_string);
-		throw std::runtime_error("RT_ERROR_UNKNOWN");
-	}
-}
-
-Raytracer::Raytracer( const int width, const int height, const float fov_y, const Vector3 view_from, const Vector3 view_at) : SimpleGuiDX11( width, height )
-{
-	InitDeviceAndScene();
-	camera = Camera(width, height, fov_y, view_from, view_at);
-	fov = fov_y;
-}
-
-Raytracer::~Raytracer()
-{
-	ReleaseDeviceAndScene();
-}
-
-int Raytracer::InitDeviceAndScene()
-{	
-	error_handler(rtContextCreate(&context));
-	error_handler(rtContextSetRayTypeCount(context, 2));
-	error_handler(rtContextSetEntryPointCount(context, 1));
-	error_handler(rtContextSetMaxTraceDepth(context, 3));
-
-	RTvariable output;
-	error_handler(rtContextDeclareVariable(context, "output_buffer", &output));
-	error_handler(rtBufferCreate(context, RT_BUFFER_OUTPUT, &outputBuffer));
-	error_handler(rtBufferSetFormat(outputBuffer, RT_FORMAT_UNSIGNED_BYTE4));
-	error_handler(rtBufferSetSize2D(outputBuffer, width(), height()));
-	error_handler(rtVariableSetObject(output, outputBuffer));
-
-	RTprogram primary_ray;
-	error_handler(rtProgramCreateFromPTXFile(context, "optixtutorial.ptx", "primary_ray", &primary_ray));
-	error_handler(rtContextSetRayGenerationProgram(context, 0, primary_ray));
-	error_handler(rtProgramValidate(primary_ray));
-
-	rtProgramDeclareVariable(primary_ray, "focal_length", &focal_length);
-	rtProgramDeclareVariable(primary_ray, "view_from", &view_from);
-	rtProgramDeclareVariable(primary_ray, "M_c_w", &M_c_w);
-
-	rtVariableSet3f(view_from, camera.view_from().x, camera.view_from().y, camera.view_from().z);
-	rtVariableSet1f(focal_length, camera.focalLength());
-	rtVariableSetMatrix3x3fv(M_c_w, 0, camera.M_c_w().data());
-
-	RTprogram exception;
-	error_handler(rtProgramCreateFromPTXFile(context, "optixtutorial.ptx", "exception", &exception));
-	error_handler(rtContextSetExceptionProgram(context, 0, exception));
-	error_handler(rtProgramValidate(exception));
-	error_handler(rtContextSetExceptionEnabled(context, RT_EXCEPTION_ALL, 1));
-
-	error_handler(rtContextSetPrintEnabled(context, 1));
-	error_handler(rtContextSetPrintBufferSize(context, 4096));
-
-	RTprogram miss_program;
-	error_handler(rtProgramCreateFromPTXFile(context, "optixtutorial.ptx", "miss_program", &miss_program));
-	error_handler(rtContextSetMissProgram(context, 0, miss_program));
-	error_handler(rtProgramValidate(miss_program));
-
-	return S_OK;
-}
-
-int Raytracer::ReleaseDeviceAndScene()
-{
-	error_handler(rtContextDestroy(context));
-	return S_OK;
-}
-
-int Raytracer::initGraph() {
-	error_handler(rtContextValidate(context));
-
-	return S_OK;
-}
-
-int Raytracer::get_image(BYTE * buffer) {
-	camera.updateFov(fov);
-	camera.recalculateMcw();
-	rtVariableSet3f(view_from, camera.view_from().x, camera.view_from().y, camera.view_from().z);
-	rtVariableSet1f(focal_length, camera.focalLength());
-	rtVariableSetMatrix3x3fv(M_c_w, 0, camera.M_c_w().data());
-
-	error_handler(rtContextLaunch2D(context, 0, width(), height()));
-	optix::uchar4 * data = nullptr;
-	error_handler(rtBufferMap(outputBuffer, (void**)(&data)));
-	memcpy(buffer, data, sizeof(optix::uchar4) * width() * height());
-	error_handler(rtBufferUnmap(outputBuffer));
-	return S_OK;
-}
-
-void Raytracer::LoadScene( const std::string file_name )
-{
-	const int no_surfaces = LoadOBJ( file_name.c_str(), surfaces_, materials_ );
-	
-	int no_triangles = 0;
-
-	for (auto surface : surfaces_)
-	{
-		no_triangles += surface->no_triangles();
-	}
-
-	RTgeometrytriangles geometry_triangles;
-	error_handler(rtGeometryTrianglesCreate(context, &geometry_triangles));
-	error_handler(rtGeometryTrianglesSetPrimitiveCount(geometry_triangles, no_triangles));
-
-	RTbuffer vertex_buffer;
-	error_handler(rtBufferCreate(context, RT_BUFFER_INPUT, &vertex_buffer));
-	error_handler(rtBufferSetFormat(vertex_buffer, RT_FORMAT_FLOAT3));
-	error_handler(rtBufferSetSize1D(vertex_buffer, no_triangles * 3));
-	
-	RTvariable normals;
-	rtContextDeclareVariable(context, "normal_buffer", &normals);
-	RTbuffer normal_buffer;
-	error_handler(rtBufferCreate(context, RT_BUFFER_INPUT, &normal_buffer));
-	error_handler(rtBufferSetFormat(normal_buffer, RT_FORMAT_FLOAT3));
-	error_handler(rtBufferSetSize1D(normal_buffer, no_triangles * 3));
-
-	RTvariable texcoords;
-	rtContextDeclareVariable(context, "texcoord_buffer", &texcoords);
-	RTbuffer texcoord_buffer;
-	error_handler(rtBufferCreate(context, RT_BUFFER_INPUT, &texcoord_buffer));
-	error_handler(rtBufferSetFormat(texcoord_buffer, RT_FORMAT_FLOAT2));
-	error_handler(rtBufferSetSize1D(texcoord_buffer, no_triangles * 3));
-
-	RTvariable materialIndices;
-	rtContextDeclareVariable(context, "material_buffer", &materialIndices);
-	RTbuffer material_buffer;
-	error_handler(rtBufferCreate(context, RT_BUFFER_INPUT, &material_buffer));
-	error_handler(rtBufferSetFormat(material_buffer, RT_FORMAT_UNSIGNED_BYTE));
-	error_handler(rtBufferSetSize1D(material_buffer, no_triangles));
-
-	optix::float3* vertexData = nullptr;
-	optix::float3* normalData = nullptr;
-	optix::uchar1* materialData = nullptr;
-	optix::float2* texcoordData = nullptr;
-
-	error_handler(rtBufferMap(vertex_buffer, (void**)(&vertexData)));
-	error_handler(rtBufferMap(normal_buffer, (void**)(&normalData)));
-	error_handler(rtBufferMap(material_buffer, (void**)(&materialData)));
-	error_handler(rtBufferMap(texcoord_buffer, (void**)(&texcoordData)));
-
-	// surfaces loop
-	int k = 0, l = 0;
-	for ( auto surface : surfaces_ )
-	{		
-		// triangles loop
-		for (int i = 0; i < surface->no_triangles(); ++i, ++l )
-		{
-			Triangle & triangle = surface->get_triangle( i );
-
-			materialData[l].x = (unsigned char)surface->get_material()->materialIndex;
-
-			// vertices loop
-			for ( int j = 0; j < 3; ++j, ++k )
-			{
-				const Vertex & vertex = triangle.vertex(j);
-				vertexData[k].x = vertex.position.x; 
-				vertexData[k].y = vertex.position.y;
-				vertexData[k].z = vertex.position.z;
-				//printf("%d \n", k);
-				normalData[k].x = vertex.normal.x;
-				normalData[k].y = vertex.normal.y;
-				normalData[k].z = vertex.normal.z;
-
-				texcoordData[k].x = vertex.texture_coords->u;
-				texcoordData[k].y = vertex.texture_coords->v;
-			} // end of vertices loop
-
-		} // end of triangles loop
-
-	} // end of surfaces loop
-
-	rtBufferUnmap(normal_buffer);
-	rtBufferUnmap(material_buffer);
-	rtBufferUnmap(vertex_buffer);
-	rtBufferUnmap(texcoord_buffer);
-
-	rtBufferValidate(texcoord_buffer);
-	rtVariableSetObject(texcoords, texcoord_buffer);
-
-	rtBufferValidate(normal_buffer);
-	rtVariableSetObject(normals, normal_buffer);
-
-	rtBufferValidate(material_buffer);
-	rtVariableSetObject(materialIndices, material_buffer);
-	rtBufferValidate(vertex_buffer);
-
-	error_handler(rtGeometryTrianglesSetMaterialCount(geometry_triangles, materials_.size()));
-	error_handler(rtGeometryTrianglesSetMaterialIndices(geometry_triangles, material_buffer, 0, sizeof(optix::uchar1), RT_FORMAT_UNSIGNED_BYTE));
-	error_handler(rtGeometryTrianglesSetVertices(geometry_triangles, no_triangles * 3, vertex_buffer, 0, sizeof(optix::float3), RT_FORMAT_FLOAT3));
-
-	RTprogram attribute_program;
-	error_handler(rtProgramCreateFromPTXFile(context, "optixtutorial.ptx", "attribute_program", &attribute_program));
-	error_handler(rtProgramValidate(attribute_program));
-	error_handler(rtGeometryTrianglesSetAttributeProgram(geometry_triangles, attribute_program));
-
-	error_handler(rtGeometryTrianglesValidate(geometry_triangles));
-
-	// geometry instance
-	RTgeometryinstance geometry_instance;
-	error_handler(rtGeometryInstanceCreate(context, &geometry_instance));
-	error_handler(rtGeometryInstanceSetGeometryTriangles(geometry_instance, geometry_triangles));
-	error_handler(rtGeometryInstanceSetMaterialCount(geometry_instance, materials_.size()));
-
-	RTprogram any_hit;
-	error_handler(rtProgramCreateFromPTXFile(context, "optixtutorial.ptx", "any_hit", &any_hit));
-	error_handler(rtProgramValidate(any_hit));
-
-	int next_tex_diffuse_id = 0;
-	for (Material* material : materials_) {
-		RTmaterial rtMaterial;
-		error_handler(rtMaterialCreate(context, &rtMaterial));
-		RTprogram closest_hit;
-		
-		switch (material->shader())
-		{
-			case Shader::NORMAL:
-				error_handler(rtProgramCreateFromPTXFile(context, "optixtutorial.ptx", "closest_hit_normal_shader", &closest_hit));
-				break;
-			case Shader::LAMBERT:
-				error_handler(rtProgramCreateFromPTXFile(context, "optixtutorial.ptx", "closest_hit_lambert_shader", &closest_hit));
-				break;
-			case Shader::PHONG:
-				error_handler(rtProgramCreateFromPTXFile(context, "optixtutorial.ptx", "closest_hit_phong_shader", &closest_hit));
-				break;
-			case Shader::MIRROR:
-				error_handler(rtProgramCreateFromPTXFile(context, "optixtutorial.ptx", "closest_hit_mirror_shader", &closest_hit));
-				break;
-			case Shader::GLASS:
-				error_handler(rtProgramCreateFromPTXFile(context, "optixtutorial.ptx", "closest_hit_glass_shader", &closest_hit));
-				break;
-			case Shader::PBR:
-				error_handler(rtProgramCreateFromPTXFile(context, "optixtutorial.ptx", "closest_hit_pbr_shader", &closest_hit));
-				break;
+#include "pch.h"
+#include "raytracer.h"
+#include "objloader.h"
+#include "tutorials.h"
+#include "mymath.h"
+#include "texturecache.h"
+#include "imagewriter.h"
+#include "omp.h"
+
+void Raytracer::error_handler(RTresult code)
+{
+	if (code != RT_SUCCESS)
+	{
+		const char* error_string;
+		rtContextGetErrorString(context, code, &error_string);
+		printf(error_string);
+		throw std::runtime_error("RT_ERROR_UNKNOWN");
+	}
+}
+
+Raytracer::Raytracer( const int width, const int height, const float fov_y, const Vector3 view_from, const Vector3 view_at, const bool headless ) :
+	SimpleGuiDX11( width, height, headless )
+{
+	InitDeviceAndScene();
+	camera = Camera(width, height, fov_y, view_from, view_at);
+	fov = fov_y;
+}
+
+Raytracer::~Raytracer()
+{
+	ReleaseDeviceAndScene();
+
+	if (environment_)
+	{
+		delete environment_;
+		environment_ = nullptr;
+	}
+}
+
+int Raytracer::InitDeviceAndScene()
+{	
+	TRACE_SCOPE("InitDeviceAndScene");
+	error_handler(rtContextCreate(&context));
+	error_handler(rtContextSetRayTypeCount(context, 3)); // radiance, shadow and G-buffer rays
+	error_handler(rtContextSetEntryPointCount(context, 3)); // primary_ray, restir_initial and restir_spatial
+	error_handler(rtContextSetMaxTraceDepth(context, 2)); // path segment and shadow ray, the path loop runs in the ray generation program
+
+	RTvariable output;
+	error_handler(rtContextDeclareVariable(context, "output_buffer", &output));
+	error_handler(rtBufferCreate(context, RT_BUFFER_INPUT_OUTPUT, &outputBuffer)); // the sample passes of a frame read the mean of the previous ones
+	error_handler(rtBufferSetFormat(outputBuffer, RT_FORMAT_FLOAT4));
+	error_handler(rtBufferSetSize2D(outputBuffer, width(), height()));
+	TrackDeviceBuffer(outputBuffer, MemoryTag::FRAMEBUFFERS);
+	error_handler(rtVariableSetObject(output, outputBuffer));
+
+#if defined( RAY_STATS )
+	// the sample passes and the second ReSTIR pass add their rays to the ones of the first launch
+	RTvariable ray_stats;
+	error_handler(rtContextDeclareVariable(context, "ray_stats_buffer", &ray_stats));
+	error_handler(rtBufferCreate(context, RT_BUFFER_INPUT_OUTPUT, &rayStatsBuffer));
+	error_handler(rtBufferSetFormat(rayStatsBuffer, RT_FORMAT_USER));
+	error_handler(rtBufferSetElementSize(rayStatsBuffer, sizeof(RayStats)));
+	error_handler(rtBufferSetSize2D(rayStatsBuffer, width(), height()));
+	TrackDeviceBuffer(rayStatsBuffer, MemoryTag::FRAMEBUFFERS);
+	error_handler(rtVariableSetObject(ray_stats, rayStatsBuffer));
+#endif
+
+	error_handler(rtContextDeclareVariable(context, "max_depth", &max_depth));
+	error_handler(rtContextDeclareVariable(context, "rr_depth", &rr_depth));
+	error_handler(rtContextDeclareVariable(context, "samples_per_pixel", &samples_per_pixel));
+	error_handler(rtContextDeclareVariable(context, "pass_weight", &pass_weight));
+	error_handler(rtVariableSet1i(max_depth, max_depth_));
+	error_handler(rtVariableSet1i(rr_depth, rr_depth_));
+	error_handler(rtVariableSet1i(samples_per_pixel, samples_per_pixel_));
+	error_handler(rtVariableSet1f(pass_weight, 1.0f));
+
+	lightsBuffer = CreateUserBuffer("lights", sizeof(Light), MemoryTag::GEOMETRY);
+	error_handler(rtContextDeclareVariable(context, "light_samples", &light_samples));
+	error_handler(rtVariableSet1ui(light_samples, max_shadow_rays_));
+
+	emittersBuffer = CreateUserBuffer("emitters", sizeof(Emitter), MemoryTag::GEOMETRY);
+	emitterTableBuffer = CreateUserBuffer("emitter_table", sizeof(AliasEntry), MemoryTag::GEOMETRY);
+	error_handler(rtContextDeclareVariable(context, "emitter_sampling", &emitter_sampling));
+	error_handler(rtVariableSet1i(emitter_sampling, emitter_sampling_));
+	error_handler(rtContextDeclareVariable(context, "emitter_pdf_scale", &emitter_pdf_scale));
+	error_handler(rtVariableSet1f(emitter_pdf_scale, 0.0f));
+
+	reservoirsBuffer = CreateFrameBuffer("reservoirs", sizeof(Reservoir));
+	reservoirsHistoryBuffer = CreateFrameBuffer("reservoirs_history", sizeof(Reservoir));
+	gbufferBuffer = CreateFrameBuffer("gbuffer", sizeof(GBufferSample));
+	error_handler(rtContextDeclareVariable(context, "restir_candidates", &restir_candidates));
+	error_handler(rtContextDeclareVariable(context, "restir_temporal", &restir_temporal));
+	error_handler(rtContextDeclareVariable(context, "restir_spatial", &restir_spatial));
+	error_handler(rtContextDeclareVariable(context, "frame_index", &frame_index));
+	error_handler(rtVariableSet1ui(restir_candidates, restir_candidates_));
+	error_handler(rtVariableSet1i(restir_temporal, 0));
+	error_handler(rtVariableSet1ui(restir_spatial, restir_spatial_));
+	error_handler(rtVariableSet1ui(frame_index, frame_));
+
+	envMarginalBuffer = CreateUserBuffer("env_marginal", sizeof(float), MemoryTag::TEXTURES);
+	envConditionalBuffer = CreateUserBuffer("env_conditional", sizeof(float), MemoryTag::TEXTURES);
+	error_handler(rtContextDeclareVariable(context, "env_map_id", &env_map_id));
+	error_handler(rtContextDeclareVariable(context, "env_sampling", &env_sampling));
+	error_handler(rtVariableSet1i(env_map_id, -1));
+	error_handler(rtVariableSet1i(env_sampling, env_importance_));
+
+	RTprogram primary_ray;
+	error_handler(rtProgramCreateFromPTXFile(context, "optixtutorial.ptx", "primary_ray", &primary_ray));
+	error_handler(rtContextSetRayGenerationProgram(context, 0, primary_ray));
+	error_handler(rtProgramValidate(primary_ray));
+
+	// the camera is shared by all entry points
+	error_handler(rtContextDeclareVariable(context, "focal_length", &focal_length));
+	error_handler(rtContextDeclareVariable(context, "view_from", &view_from));
+	error_handler(rtContextDeclareVariable(context, "M_c_w", &M_c_w));
+
+	CreateEntryPoint(1, "restir_initial");
+	CreateEntryPoint(2, "restir_spatial");
+
+	rtVariableSet3f(view_from, camera.view_from().x, camera.view_from().y, camera.view_from().z);
+	rtVariableSet1f(focal_length, camera.focalLength());
+	rtVariableSetMatrix3x3fv(M_c_w, 0, camera.M_c_w().data());
+
+	RTprogram exception;
+	error_handler(rtProgramCreateFromPTXFile(context, "optixtutorial.ptx", "exception", &exception));
+	for (unsigned int entry_point = 0; entry_point < 3; ++entry_point)
+	{
+		error_handler(rtContextSetExceptionProgram(context, entry_point, exception));
+	}
+	error_handler(rtProgramValidate(exception));
+	error_handler(rtContextSetExceptionEnabled(context, RT_EXCEPTION_ALL, 1));
+
+	error_handler(rtContextSetPrintEnabled(context, 1));
+	error_handler(rtContextSetPrintBufferSize(context, 4096));
+
+	RTprogram miss_program;
+	error_handler(rtProgramCreateFromPTXFile(context, "optixtutorial.ptx", "miss_program", &miss_program));
+	error_handler(rtContextSetMissProgram(context, 0, miss_program));
+	error_handler(rtProgramValidate(miss_program));
+
+	RTprogram miss_gbuffer;
+	error_handler(rtProgramCreateFromPTXFile(context, "optixtutorial.ptx", "miss_gbuffer", &miss_gbuffer));
+	error_handler(rtContextSetMissProgram(context, 2, miss_gbuffer));
+	error_handler(rtProgramValidate(miss_gbuffer));
+
+	return S_OK;
+}
+
+int Raytracer::ReleaseDeviceAndScene()
+{
+	error_handler(rtContextDestroy(context));
+	texture_buffers_.clear();
+	device_buffers_.clear();
+	texture_samplers_.clear();
+	return S_OK;
+}
+
+int Raytracer::initGraph() {
+	{
+		TRACE_SCOPE("rtContextValidate");
+		error_handler(rtContextValidate(context));
+	}
+
+	// the trace depth is fixed by the iterative path loop, the stack size is only the configured value, not the measured minimum
+	RTsize stack_size = 0;
+	unsigned int trace_depth = 0;
+	error_handler(rtContextGetStackSize(context, &stack_size));
+	error_handler(rtContextGetMaxTraceDepth(context, &trace_depth));
+	printf("Configured stack size %zu B, max trace depth %u for any path depth.\n", static_cast<size_t>(stack_size), trace_depth);
+
+	return S_OK;
+}
+
+int Raytracer::BuildGraph()
+{
+	TRACE_SCOPE("BuildGraph");
+	error_handler(rtContextLaunch2D(context, 0, 0, 0));
+
+	return S_OK;
+}
+
+int Raytracer::Render(const int spp)
+{
+	TRACE_SCOPE("Render");
+	// the camera does not move, the preview would only delay the first full resolution frame
+	preview_ = false;
+	sample_budget_ = std::max(1, spp);
+
+	const int frame_spp = samples_per_pixel_;
+	std::vector<BYTE> frame(size_t(width()) * height() * 4);
+	int no_frames = 0;
+
+	while (!converged())
+	{
+		// the last frame takes only the samples missing to the budget
+		samples_per_pixel_ = std::min(frame_spp, std::max(1, sample_budget_.load() - accumulated_samples_.load()));
+
+		if (get_image(frame.data()) == S_OK)
+		{
+			++no_frames;
+		}
+
+		printf("\rFrame %d, %d / %d spp", no_frames, accumulated_samples_.load(), sample_budget_.load());
+	}
+
+	printf("\n");
+	samples_per_pixel_ = frame_spp;
+
+	return no_frames;
+}
+
+bool Raytracer::SaveImage(const std::string & file_name)
+{
+	if (accumulator_.size() != size_t(width()) * height())
+	{
+		printf("No image rendered to be saved to '%s'.\n", file_name.c_str());
+
+		return false;
+	}
+
+	std::vector<BYTE> rgba(accumulator_.size() * 4);
+	tonemapper_.Configure(static_cast<Tonemap>(tonemap_), exposure_, gamma_);
+	tonemapper_.Apply(accumulator_.data(), rgba.data(), width(), height());
+
+	return ::SaveImage(file_name, accumulator_.data(), rgba.data(), width(), height());
+}
+
+int Raytracer::get_image(BYTE * buffer) {
+	TIME_STAGE("get_image");
+
+	// read before the parameters, a change made while they are set is caught by the next check
+	const unsigned int generation = generation_.load(std::memory_order_acquire);
+
+	camera.updateFov(fov);
+	camera.recalculateMcw();
+	rtVariableSet3f(view_from, camera.view_from().x, camera.view_from().y, camera.view_from().z);
+	rtVariableSet1f(focal_length, camera.focalLength());
+	rtVariableSetMatrix3x3fv(M_c_w, 0, camera.M_c_w().data());
+	rtVariableSet1ui(light_samples, max_shadow_rays_);
+	rtVariableSet1i(emitter_sampling, emitter_sampling_);
+	rtVariableSet1i(env_sampling, env_importance_);
+	rtVariableSet1i(max_depth, max_depth_);
+	rtVariableSet1i(rr_depth, rr_depth_);
+	rtVariableSet1i(samples_per_pixel, samples_per_pixel_);
+	rtVariableSet1f(pass_weight, 1.0f);
+
+	if (benchmark_depths_)
+	{
+		benchmark_depths_ = false;
+		BenchmarkPathDepths();
+	}
+
+	const bool camera_moved = CameraMoved();
+	const size_t no_pixels = size_t(width()) * height();
+
+	if (generation != accumulated_generation_ || accumulator_.size() != no_pixels)
+	{
+		accumulator_.assign(no_pixels, optix::make_float4(0.0f));
+		accumulator_memory_.Resize(accumulator_.capacity() * sizeof(optix::float4));
+		accumulated_samples_ = 0;
+		accumulated_generation_ = generation;
+	}
+
+	tonemapper_.Configure(static_cast<Tonemap>(tonemap_), exposure_, gamma_);
+
+	if (converged())
+	{
+		// only the display parameters changed, the accumulated image is tonemapped again
+		tonemapper_.Apply(accumulator_.data(), buffer, width(), height());
+		return S_OK;
+	}
+
+	// a moving camera gets a frame of lower resolution and fewer samples, the launch covers the top left corner of the buffers
+	quality_.Configure(preview_, target_frame_ms_, samples_per_pixel_);
+	quality_.Next(camera_moved, width(), height());
+	const int scale = quality_.scale();
+	const int frame_spp = quality_.spp();
+	const int launch_width = (width() + scale - 1) / scale;
+	const int launch_height = (height() + scale - 1) / scale;
+	rtVariableSet1f(focal_length, camera.focalLength() / scale);
+
+	const auto t0 = std::chrono::high_resolution_clock::now();
+
+	if (restir_)
+	{
+		// the history is reprojected trivially, so it is valid only for a still camera
+		rtVariableSet1ui(restir_candidates, restir_candidates_);
+		rtVariableSet1i(restir_temporal, restir_temporal_ && restir_history_valid_ && !camera_moved);
+		rtVariableSet1ui(restir_spatial, restir_spatial_);
+		rtVariableSet1ui(frame_index, frame_++);
+
+		{
+			TIME_STAGE("rtContextLaunch2D");
+			error_handler(rtContextLaunch2D(context, 1, launch_width, launch_height));
+		}
+
+		if (Cancelled(generation))
+		{
+			restir_history_valid_ = false;
+			return S_FALSE;
+		}
+
+		{
+			TIME_STAGE("rtContextLaunch2D");
+			error_handler(rtContextLaunch2D(context, 2, launch_width, launch_height));
+		}
+		restir_history_valid_ = scale == 1; // the reservoirs are indexed by the launch
+	}
+	else
+	{
+		// the frame is split into sample passes, a change made meanwhile abandons the rest of it
+		restir_history_valid_ = false;
+
+		for (int samples = 0; samples < frame_spp; )
+		{
+			if (samples > 0 && Cancelled(generation))
+			{
+				return S_FALSE;
+			}
+
+			const int pass = std::min(samples_per_pass_, frame_spp - samples);
+			rtVariableSet1i(samples_per_pixel, pass);
+			rtVariableSet1f(pass_weight, float(pass) / (samples + pass));
+			rtVariableSet1ui(frame_index, frame_++);
+
+			{
+				TIME_STAGE("rtContextLaunch2D");
+				error_handler(rtContextLaunch2D(context, 0, launch_width, launch_height));
+			}
+			samples += pass;
+		}
+	}
+
+	// the finished launches are displayed even when the image changed meanwhile, a continuous motion
+	// would cancel every frame otherwise
+	const auto t1 = std::chrono::high_resolution_clock::now();
+
+#if defined( RAY_STATS )
+	{
+		TIME_STAGE("Ray statistics");
+		ray_stats_ = ReadRayStats(launch_width, launch_height, std::chrono::duration<double>(t1 - t0).count());
+	}
+	if (log_ray_stats_) LogRayStats();
+#endif
+	optix::float4 * data = nullptr;
+	{
+		TIME_STAGE("rtBufferMap");
+		error_handler(rtBufferMap(outputBuffer, (void**)(&data)));
+	}
+
+	if (scale > 1)
+	{
+		// the preview is not accumulated, the next full resolution frame starts the image again
+		{
+			TIME_STAGE("Preview upscaling");
+			preview_image_.resize(no_pixels);
+			preview_image_memory_.Resize(preview_image_.capacity() * sizeof(optix::float4));
+			QualityController::Upscale(data, width(), launch_width, launch_height, preview_image_.data(), width(), height());
+		}
+		error_handler(rtBufferUnmap(outputBuffer));
+		{
+			TIME_STAGE("Tonemapping");
+			tonemapper_.Apply(preview_image_.data(), buffer, width(), height());
+		}
+		accumulated_samples_ = 0;
+		accumulated_generation_ = ~0u;
+		quality_.Update(std::chrono::duration<float, std::milli>(t1 - t0).count(),
+			std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - t1).count());
+		return S_OK;
+	}
+
+	// running mean weighted by the samples of the frames, the ReSTIR frames count as one sample
+	const int spp = (restir_) ? 1 : frame_spp;
+	const float weight = float(spp) / (accumulated_samples_ + spp);
+
+	{
+		TIME_STAGE("Accumulation");
+
+		#pragma omp parallel for
+		for (int i = 0; i < static_cast<int>(no_pixels); ++i)
+		{
+			optix::float4 & mean = accumulator_[i];
+			mean.x += (data[i].x - mean.x) * weight;
+			mean.y += (data[i].y - mean.y) * weight;
+			mean.z += (data[i].z - mean.z) * weight;
+			mean.w += (data[i].w - mean.w) * weight;
+		}
+	}
+
+	error_handler(rtBufferUnmap(outputBuffer));
+	accumulated_samples_ += spp;
+	{
+		TIME_STAGE("Tonemapping");
+		tonemapper_.Apply(accumulator_.data(), buffer, width(), height());
+	}
+	quality_.Update(std::chrono::duration<float, std::milli>(t1 - t0).count(),
+		std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - t1).count());
+	return S_OK;
+}
+
+bool Raytracer::Cancelled(const unsigned int generation)
+{
+	if (generation_.load(std::memory_order_acquire) == generation)
+	{
+		return false;
+	}
+
+	++cancelled_frames_;
+
+	return true;
+}
+
+bool Raytracer::converged() const
+{
+	const int budget = sample_budget_.load(std::memory_order_relaxed);
+
+	return budget > 0 && accumulated_samples_.load(std::memory_order_relaxed) >= budget &&
+		accumulated_generation_ == generation_.load(std::memory_order_acquire);
+}
+
+size_t Raytracer::readback_bytes() const
+{
+	// the float4 output buffer is copied to the host by rtBufferMap, the tonemapping writes the bytes of the frame
+	return size_t(width()) * height() * sizeof(optix::float4);
+}
+
+RTbuffer Raytracer::CreateUserBuffer(const char * name, const size_t element_size, const MemoryTag tag)
+{
+	RTvariable variable;
+	error_handler(rtContextDeclareVariable(context, name, &variable));
+	RTbuffer buffer;
+	error_handler(rtBufferCreate(context, RT_BUFFER_INPUT, &buffer));
+	error_handler(rtBufferSetFormat(buffer, RT_FORMAT_USER));
+	error_handler(rtBufferSetElementSize(buffer, element_size));
+	error_handler(rtBufferSetSize1D(buffer, 0));
+	error_handler(rtVariableSetObject(variable, buffer));
+	TrackDeviceBuffer(buffer, tag);
+
+	return buffer;
+}
+
+RTbuffer Raytracer::CreateFrameBuffer(const char * name, const size_t element_size)
+{
+	RTvariable variable;
+	error_handler(rtContextDeclareVariable(context, name, &variable));
+	RTbuffer buffer;
+	error_handler(rtBufferCreate(context, RT_BUFFER_INPUT_OUTPUT | RT_BUFFER_GPU_LOCAL, &buffer));
+	error_handler(rtBufferSetFormat(buffer, RT_FORMAT_USER));
+	error_handler(rtBufferSetElementSize(buffer, element_size));
+	error_handler(rtBufferSetSize2D(buffer, width(), height()));
+	error_handler(rtVariableSetObject(variable, buffer));
+	TrackDeviceBuffer(buffer, MemoryTag::FRAMEBUFFERS);
+
+	return buffer;
+}
+
+void Raytracer::TrackDeviceBuffer(RTbuffer buffer, const MemoryTag tag)
+{
+	RTsize element_size = 0;
+	unsigned int dimensionality = 0;
+	unsigned int no_levels = 0;
+	RTsize size[3] = { 1, 1, 1 };
+	error_handler(rtBufferGetElementSize(buffer, &element_size));
+	error_handler(rtBufferGetDimensionality(buffer, &dimensionality));
+	error_handler(rtBufferGetSizev(buffer, dimensionality, size));
+	error_handler(rtBufferGetMipLevelCount(buffer, &no_levels));
+
+	size_t bytes = size_t(size[0]) * size[1] * size[2] * element_size;
+
+	// the coarser levels of the textures
+	for (unsigned int level = 1; level < no_levels; ++level)
+	{
+		RTsize level_width = 0, level_height = 0;
+		error_handler(rtBufferGetMipLevelSize2D(buffer, level, &level_width, &level_height));
+		bytes += size_t(level_width) * level_height * element_size;
+	}
+
+	auto charge = device_buffers_.find(buffer);
+
+	if (charge == device_buffers_.end())
+	{
+		charge = device_buffers_.emplace(buffer, MemoryCharge(tag, MemoryDomain::DEVICE)).first;
+	}
+
+	charge->second.Resize(bytes);
+}
+
+void Raytracer::TrackDeviceBuffer(RTbuffer buffer)
+{
+	const auto charge = device_buffers_.find(buffer);
+
+	if (charge != device_buffers_.end())
+	{
+		TrackDeviceBuffer(buffer, charge->second.tag());
+	}
+}
+
+RTprogram Raytracer::CreateEntryPoint(const unsigned int entry_point, const char * name)
+{
+	TRACE_SCOPE("Program creation");
+	RTprogram program;
+	error_handler(rtProgramCreateFromPTXFile(context, "optixtutorial.ptx", name, &program));
+	error_handler(rtContextSetRayGenerationProgram(context, entry_point, program));
+	error_handler(rtProgramValidate(program));
+
+	return program;
+}
+
+bool Raytracer::CameraMoved()
+{
+	float state[13];
+	Matrix3x3 M = camera.M_c_w();
+	const Vector3 from = camera.view_from();
+	memcpy(state, M.data(), sizeof(float) * 9);
+	state[9] = from.x;
+	state[10] = from.y;
+	state[11] = from.z;
+	state[12] = fov;
+
+	const bool moved = memcmp(state, last_camera_, sizeof(state)) != 0;
+	memcpy(last_camera_, state, sizeof(state));
+
+	return moved;
+}
+
+void Raytracer::DetectChanges()
+{
+	const Vector3 from = camera.view_from();
+	const Vector3 at = camera.view_at();
+	const Vector3 up = camera.up();
+	const float render_state[] = { from.x, from.y, from.z, at.x, at.y, at.z, up.x, up.y, up.z, fov,
+		float(max_shadow_rays_), float(samples_per_pixel_), float(max_depth_), float(rr_depth_),
+		float(emitter_sampling_), float(env_importance_), float(restir_), float(restir_temporal_),
+		float(restir_candidates_), float(restir_spatial_) };
+	static_assert(sizeof(render_state) == sizeof(last_render_state_), "render state size");
+	const float display_state[] = { gamma_, float(tonemap_), exposure_ };
+
+	if (memcmp(render_state, last_render_state_, sizeof(render_state)) != 0)
+	{
+		memcpy(last_render_state_, render_state, sizeof(render_state));
+		Invalidate();
+	}
+
+	if (memcmp(display_state, last_display_state_, sizeof(display_state)) != 0)
+	{
+		memcpy(last_display_state_, display_state, sizeof(display_state));
+		Invalidate(false);
+	}
+}
+
+int Raytracer::ShadowRaysPerPixel() const
+{
+	if (restir_)
+	{
+		return 2 + (environment_ ? 1 : 0); // visibility reuse of the initial sample, the final shading and the environment sample
+	}
+
+	// primary_ray shades every vertex of a path with the light subset, one emitter sample and one environment sample,
+	// the camera hits add one ambient occlusion ray, the count below is for the camera hits only
+	const int per_hit = std::min<int>(static_cast<int>(lights_.size()), max_shadow_rays_) +
+		((emitter_sampling_ && emitters_.size() > 0) ? 1 : 0) + (environment_ ? 1 : 0) + 1;
+
+	return samples_per_pixel_ * per_hit;
+}
+
+void Raytracer::SetLights( const std::vector<Light> & lights )
+{
+	lights_ = lights;
+	UploadUserBuffer(lightsBuffer, lights_);
+	restir_history_valid_ = false; // the reservoirs refer to the lights by index
+	Invalidate();
+}
+
+FrameRayStats Raytracer::ReadRayStats(const int launch_width, const int launch_height, const double seconds)
+{
+	FrameRayStats frame;
+	frame.no_pixels = launch_width * launch_height;
+	frame.seconds = seconds;
+
+#if defined( RAY_STATS )
+	RayStats * stats = nullptr;
+	error_handler(rtBufferMap(rayStatsBuffer, (void**)(&stats)));
+
+	unsigned long long radiance = 0, radiance_misses = 0, shadow = 0, shadow_occluded = 0;
+
+	// the smaller launches of the preview cover the top left corner of the buffer
+	#pragma omp parallel for reduction(+ : radiance, radiance_misses, shadow, shadow_occluded)
+	for (int y = 0; y < launch_height; ++y)
+	{
+		const RayStats * row = stats + size_t(y) * width();
+
+		for (int x = 0; x < launch_width; ++x)
+		{
+			radiance += row[x].radiance;
+			radiance_misses += row[x].radiance_misses;
+			shadow += row[x].shadow;
+			shadow_occluded += row[x].shadow_occluded;
+		}
+	}
+
+	error_handler(rtBufferUnmap(rayStatsBuffer));
+
+	frame.radiance = radiance;
+	frame.radiance_misses = radiance_misses;
+	frame.shadow = shadow;
+	frame.shadow_occluded = shadow_occluded;
+#endif
+
+	return frame;
+}
+
+void Raytracer::LogRayStats() const
+{
+	const FrameRayStats & stats = ray_stats_;
+
+	printf("Frame %u: %0.1f rays/pixel (%llu radiance, %llu shadow), %0.1f Mrays/s in %0.2f ms, hit ratio %0.3f, shadow rays occluded %0.3f\n",
+		frame_, stats.rays_per_pixel(), stats.radiance, stats.shadow, stats.mrays_per_second(), stats.seconds * 1e+3,
+		stats.hit_ratio(), stats.occluded_ratio());
+}
+
+void Raytracer::BenchmarkPathDepths( const int no_depths )
+{
+	for (int depth = 1; depth <= no_depths; ++depth)
+	{
+		error_handler(rtVariableSet1i(max_depth, depth));
+
+		const auto t0 = std::chrono::high_resolution_clock::now();
+		error_handler(rtContextLaunch2D(context, 0, width(), height()));
+		const auto t1 = std::chrono::high_resolution_clock::now();
+		const FrameRayStats stats = ReadRayStats(width(), height(), std::chrono::duration<double>(t1 - t0).count());
+
+		printf("Path depth %2d: %7.1f ms, %6.1f rays/pixel, %7.1f Mrays/s\n", depth, stats.seconds * 1e+3,
+			stats.rays_per_pixel(), stats.mrays_per_second());
+	}
+
+	error_handler(rtVariableSet1i(max_depth, max_depth_));
+}
+
+void Raytracer::SetEnvironment( const std::string file_name )
+{
+	TRACE_SCOPE("SetEnvironment");
+	EnvironmentMap * environment = new EnvironmentMap(file_name.c_str());
+
+	if (!environment->is_valid())
+	{
+		delete environment;
+		return;
+	}
+
+	if (environment_)
+	{
+		delete environment_;
+	}
+	environment_ = environment;
+
+	UploadUserBuffer(envMarginalBuffer, environment_->marginal());
+	UploadUserBuffer(envConditionalBuffer, environment_->conditional());
+
+	// LDR maps are kept in bytes and linearized by the sampler
+	Texture * texture = environment_->texture();
+	const bool hdr = texture->pixel_size() >= 12;
+	RTbuffer texture_buffer = CreateTextureBuffer(texture);
+
+	RTtexturesampler textureSampler;
+	error_handler(rtTextureSamplerCreate(context, &textureSampler));
+	error_handler(rtTextureSamplerSetWrapMode(textureSampler, 0, RT_WRAP_REPEAT));
+	error_handler(rtTextureSamplerSetWrapMode(textureSampler, 1, RT_WRAP_CLAMP_TO_EDGE));
+	error_handler(rtTextureSamplerSetFilteringModes(textureSampler, RT_FILTER_LINEAR, RT_FILTER_LINEAR, RT_FILTER_NONE));
+	error_handler(rtTextureSamplerSetIndexingMode(textureSampler, RT_TEXTURE_INDEX_NORMALIZED_COORDINATES));
+	error_handler(rtTextureSamplerSetReadMode(textureSampler, hdr ? RT_TEXTURE_READ_ELEMENT_TYPE : RT_TEXTURE_READ_NORMALIZED_FLOAT_SRGB));
+	error_handler(rtTextureSamplerSetMaxAnisotropy(textureSampler, 1.0f));
+	error_handler(rtTextureSamplerSetMipLevelCount(textureSampler, 1));
+	error_handler(rtTextureSamplerSetArraySize(textureSampler, 1));
+	error_handler(rtTextureSamplerSetBuffer(textureSampler, 0, 0, texture_buffer));
+	error_handler(rtTextureSamplerValidate(textureSampler));
+
+	int texture_id = -1;
+	error_handler(rtTextureSamplerGetId(textureSampler, &texture_id));
+	error_handler(rtVariableSet1i(env_map_id, texture_id));
+
+	ReportTextureMemory();
+	Invalidate();
+}
+
+RTbuffer Raytracer::CreateTextureBuffer(Texture * texture)
+{
+	const int pixel_size = texture->pixel_size();
+	const bool hdr = pixel_size >= 12;
+	const int no_levels = texture->no_levels();
+
+	RTbuffer texture_buffer;
+	error_handler(rtBufferCreate(context, RT_BUFFER_INPUT, &texture_buffer));
+	error_handler(rtBufferSetFormat(texture_buffer, hdr ? RT_FORMAT_FLOAT4 : RT_FORMAT_UNSIGNED_BYTE4));
+	error_handler(rtBufferSetSize2D(texture_buffer, texture->width(), texture->height()));
+	error_handler(rtBufferSetMipLevelCount(texture_buffer, no_levels));
+	TrackDeviceBuffer(texture_buffer, MemoryTag::TEXTURES); // the float4 HDR textures are charged 16 bytes a texel
+
+	for (int level = 0; level < no_levels; ++level)
+	{
+		const int width = texture->width(level);
+		const int height = texture->height(level);
+		const int scan_width = texture->scan_width(level);
+		const BYTE * level_data = texture->data(level);
+
+		void * data = nullptr;
+		error_handler(rtBufferMapEx(texture_buffer, RT_BUFFER_MAP_WRITE_DISCARD, level, nullptr, &data));
+
+		if (texture->compression() != TextureCompression::NONE)
+		{
+			texture->DecodeLevel(level, static_cast<BYTE *>(data));
+			error_handler(rtBufferUnmapEx(texture_buffer, level));
+			continue;
+		}
+
+		#pragma omp parallel for schedule(static)
+		for (int y = 0; y < height; ++y)
+		{
+			const BYTE * row = level_data + y * scan_width;
+
+			if (hdr)
+			{
+				const float * bgr = reinterpret_cast<const float *>(row);
+				optix::float4 * texels = static_cast<optix::float4 *>(data) + size_t(y) * width;
+
+				for (int x = 0; x < width; ++x)
+				{
+					texels[x] = optix::make_float4(bgr[3 * x + 2], bgr[3 * x + 1], bgr[3 * x], 1.0f);
+				}
+			}
+			else
+			{
+				SwizzleBgr8ToRgba8(row, pixel_size, width, static_cast<BYTE *>(data) + size_t(y) * width * 4);
+			}
+		}
+
+		error_handler(rtBufferUnmapEx(texture_buffer, level));
+	}
+
+	++no_textures_;
+	texture_bytes_ += DeviceTextureBytes(texture);
+	texture_float4_bytes_ += size_t(texture->width()) * texture->height() * sizeof(optix::float4);
+
+	return texture_buffer;
+}
+
+size_t Raytracer::DeviceTextureBytes(Texture * texture) const
+{
+	const size_t texel_size = (texture->pixel_size() >= 12) ? sizeof(optix::float4) : sizeof(optix::uchar4);
+	size_t bytes = 0;
+
+	for (int level = 0; level < texture->no_levels(); ++level)
+	{
+		bytes += size_t(texture->width(level)) * texture->height(level) * texel_size;
+	}
+
+	return bytes;
+}
+
+void Raytracer::ReportTextureMemory() const
+{
+	printf("Textures: %d, %0.1f MB on the device (%0.1f MB as float4), %d samplers shared, %0.1f MB not uploaded again.\n",
+		no_textures_, texture_bytes_ / (1024.0 * 1024.0), texture_float4_bytes_ / (1024.0 * 1024.0),
+		shared_samplers_, shared_texture_bytes_ / (1024.0 * 1024.0));
+}
+
+void Raytracer::CompressTextures()
+{
+	compress_textures_ = true;
+
+	const size_t resident_bytes = TextureCache::Instance().resident_bytes();
+
+	const std::pair<char, TextureCompression> slots[] = { { Material::kDiffuseMapSlot, TextureCompression::BC1 },
+		{ Material::kRoughnessMapSlot, TextureCompression::BC4 }, { Material::kMetallicnessMapSlot, TextureCompression::BC4 } };
+
+	// the textures of the unused materials are not loaded just to be compressed
+	std::set<Material *> used_materials;
+
+	for (auto surface : surfaces_)
+	{
+		if (surface->get_material()) used_materials.insert(surface->get_material());
+	}
+
+	for (auto material : used_materials)
+	{
+		for (const auto & slot : slots)
+		{
+			const TexturePin texture(material->texture(slot.first));
+
+			if (texture)
+			{
+				texture->Compress(slot.second);
+				TextureCache::Instance().Acquire(texture.get()); // refreshes the resident size
+			}
+		}
+	}
+
+	printf("Host textures: %0.1f MB before, %0.1f MB after the block compression.\n",
+		resident_bytes / (1024.0 * 1024.0), TextureCache::Instance().resident_bytes() / (1024.0 * 1024.0));
+}
+
+int Raytracer::CreateMaterialTexture(Texture * texture, const bool srgb)
+{
+	TRACE_SCOPE("CreateMaterialTexture");
+	if (texture == NULL) {
+		return -1;
+	}
+
+	// the background loads do not evict the texture while it is uploaded
+	const TexturePin pin(texture);
+
+	// the materials sharing a texture share its sampler as well, the read mode is a part of the sampler
+	const auto key = std::make_pair(texture, srgb);
+	const auto sampler = texture_samplers_.find(key);
+
+	if (sampler != texture_samplers_.end())
+	{
+		++shared_samplers_;
+		shared_texture_bytes_ += DeviceTextureBytes(texture);
+
+		return sampler->second;
+	}
+
+	const bool hdr = texture->pixel_size() >= 12;
+	texture->BuildMipmaps(srgb);
+
+	if (compress_textures_)
+	{
+		texture->Compress(srgb ? TextureCompression::BC1 : TextureCompression::BC4);
+	}
+
+	TextureCache::Instance().Acquire(texture); // the mip levels and the blocks count to the resident memory
+
+	RTbuffer texture_buffer;
+	const auto buffer = texture_buffers_.find(texture);
+
+	if (buffer != texture_buffers_.end())
+	{
+		shared_texture_bytes_ += DeviceTextureBytes(texture);
+		texture_buffer = buffer->second;
+	}
+	else
+	{
+		texture_buffer = CreateTextureBuffer(texture);
+		texture_buffers_[texture] = texture_buffer;
+	}
+
+	// the mip level is chosen by the ray cone gradients in sampleMaterialTexture
+	RTtexturesampler textureSampler;
+	error_handler(rtTextureSamplerCreate(context, &textureSampler));
+	error_handler(rtTextureSamplerSetWrapMode(textureSampler, 0, RT_WRAP_REPEAT));
+	error_handler(rtTextureSamplerSetWrapMode(textureSampler, 1, RT_WRAP_REPEAT));
+	error_handler(rtTextureSamplerSetFilteringModes(textureSampler, RT_FILTER_LINEAR, RT_FILTER_LINEAR, RT_FILTER_LINEAR));
+	error_handler(rtTextureSamplerSetIndexingMode(textureSampler, RT_TEXTURE_INDEX_NORMALIZED_COORDINATES));
+	error_handler(rtTextureSamplerSetReadMode(textureSampler, hdr ? RT_TEXTURE_READ_ELEMENT_TYPE :
+		(srgb ? RT_TEXTURE_READ_NORMALIZED_FLOAT_SRGB : RT_TEXTURE_READ_NORMALIZED_FLOAT)));
+	error_handler(rtTextureSamplerSetMaxAnisotropy(textureSampler, 1.0f));
+	error_handler(rtTextureSamplerSetArraySize(textureSampler, 1));
+	error_handler(rtTextureSamplerSetBuffer(textureSampler, 0, 0, texture_buffer));
+	error_handler(rtTextureSamplerValidate(textureSampler));
+
+	int texture_id = -1;
+	error_handler(rtTextureSamplerGetId(textureSampler, &texture_id));
+	texture_samplers_[key] = texture_id;
+
+	return texture_id;
+}
+
+void Raytracer::LoadScene( const std::string file_name )
+{
+	TRACE_SCOPE("LoadScene");
+	const double decode_seconds = TextureCache::Instance().decode_seconds();
+	const auto t0 = std::chrono::high_resolution_clock::now();
+
+	const int no_surfaces = LoadOBJ( file_name.c_str(), surfaces_, materials_ );
+
+	const auto t1 = std::chrono::high_resolution_clock::now();
+
+	TRACE_BEGIN("Geometry buffers");
+	emitters_.Build(surfaces_);
+	UploadUserBuffer(emittersBuffer, emitters_.emitters());
+	UploadUserBuffer(emitterTableBuffer, emitters_.table());
+	error_handler(rtVariableSet1f(emitter_pdf_scale, emitters_.pdf_scale()));
+	restir_history_valid_ = false;
+	
+	int no_triangles = 0;
+
+	for (auto surface : surfaces_)
+	{
+		no_triangles += surface->no_triangles();
+	}
+
+	RTgeometrytriangles geometry_triangles;
+	error_handler(rtGeometryTrianglesCreate(context, &geometry_triangles));
+	error_handler(rtGeometryTrianglesSetPrimitiveCount(geometry_triangles, no_triangles));
+
+	RTbuffer vertex_buffer;
+	error_handler(rtBufferCreate(context, RT_BUFFER_INPUT, &vertex_buffer));
+	error_handler(rtBufferSetFormat(vertex_buffer, RT_FORMAT_FLOAT3));
+	error_handler(rtBufferSetSize1D(vertex_buffer, no_triangles * 3));
+	TrackDeviceBuffer(vertex_buffer, MemoryTag::GEOMETRY);
+	
+	RTvariable normals;
+	rtContextDeclareVariable(context, "normal_buffer", &normals);
+	RTbuffer normal_buffer;
+	error_handler(rtBufferCreate(context, RT_BUFFER_INPUT, &normal_buffer));
+	error_handler(rtBufferSetFormat(normal_buffer, RT_FORMAT_FLOAT3));
+	error_handler(rtBufferSetSize1D(normal_buffer, no_triangles * 3));
+	TrackDeviceBuffer(normal_buffer, MemoryTag::GEOMETRY);
+
+	RTvariable texcoords;
+	rtContextDeclareVariable(context, "texcoord_buffer", &texcoords);
+	RTbuffer texcoord_buffer;
+	error_handler(rtBufferCreate(context, RT_BUFFER_INPUT, &texcoord_buffer));
+	error_handler(rtBufferSetFormat(texcoord_buffer, RT_FORMAT_FLOAT2));
+	error_handler(rtBufferSetSize1D(texcoord_buffer, no_triangles * 3));
+	TrackDeviceBuffer(texcoord_buffer, MemoryTag::GEOMETRY);
+
+	RTvariable texcoordDensities;
+	rtContextDeclareVariable(context, "texcoord_density_buffer", &texcoordDensities);
+	RTbuffer texcoord_density_buffer;
+	error_handler(rtBufferCreate(context, RT_BUFFER_INPUT, &texcoord_density_buffer));
+	error_handler(rtBufferSetFormat(texcoord_density_buffer, RT_FORMAT_FLOAT));
+	error_handler(rtBufferSetSize1D(texcoord_density_buffer, no_triangles));
+	TrackDeviceBuffer(texcoord_density_buffer, MemoryTag::GEOMETRY);
+
+	RTvariable materialIndices;
+	rtContextDeclareVariable(context, "material_buffer", &materialIndices);
+	RTbuffer material_buffer;
+	error_handler(rtBufferCreate(context, RT_BUFFER_INPUT, &material_buffer));
+	error_handler(rtBufferSetFormat(material_buffer, RT_FORMAT_UNSIGNED_BYTE));
+	error_handler(rtBufferSetSize1D(material_buffer, no_triangles));
+	TrackDeviceBuffer(material_buffer, MemoryTag::GEOMETRY);
+
+	optix::float3* vertexData = nullptr;
+	optix::float3* normalData = nullptr;
+	optix::uchar1* materialData = nullptr;
+	optix::float2* texcoordData = nullptr;
+	float* texcoordDensityData = nullptr;
+
+	error_handler(rtBufferMap(vertex_buffer, (void**)(&vertexData)));
+	error_handler(rtBufferMap(normal_buffer, (void**)(&normalData)));
+	error_handler(rtBufferMap(material_buffer, (void**)(&materialData)));
+	error_handler(rtBufferMap(texcoord_buffer, (void**)(&texcoordData)));
+	error_handler(rtBufferMap(texcoord_density_buffer, (void**)(&texcoordDensityData)));
+
+	// surfaces loop
+	int k = 0, l = 0;
+	for ( auto surface : surfaces_ )
+	{		
+		// triangles loop
+		for (int i = 0; i < surface->no_triangles(); ++i, ++l )
+		{
+			Triangle & triangle = surface->get_triangle( i );
+
+			materialData[l].x = (unsigned char)surface->get_material()->materialIndex;
+
+			// vertices loop
+			for ( int j = 0; j < 3; ++j, ++k )
+			{
+				const Vertex & vertex = triangle.vertex(j);
+				vertexData[k].x = vertex.position.x; 
+				vertexData[k].y = vertex.position.y;
+				vertexData[k].z = vertex.position.z;
+				//printf("%d \n", k);
+				normalData[k].x = vertex.normal.x;
+				normalData[k].y = vertex.normal.y;
+				normalData[k].z = vertex.normal.z;
+
+				texcoordData[k].x = vertex.texture_coords->u;
+				texcoordData[k].y = vertex.texture_coords->v;
+			} // end of vertices loop
+
+			// the ray cones convert their width on the surface to the texture space by this ratio
+			texcoordDensityData[l] = TexcoordDensity(vertexData[k - 3], vertexData[k - 2], vertexData[k - 1],
+				texcoordData[k - 3], texcoordData[k - 2], texcoordData[k - 1]);
+
+		} // end of triangles loop
+
+	} // end of surfaces loop
+
+	rtBufferUnmap(normal_buffer);
+	rtBufferUnmap(material_buffer);
+	rtBufferUnmap(vertex_buffer);
+	rtBufferUnmap(texcoord_buffer);
+	rtBufferUnmap(texcoord_density_buffer);
+
+	rtBufferValidate(texcoord_buffer);
+	rtVariableSetObject(texcoords, texcoord_buffer);
+
+	rtBufferValidate(texcoord_density_buffer);
+	rtVariableSetObject(texcoordDensities, texcoord_density_buffer);
+
+	rtBufferValidate(normal_buffer);
+	rtVariableSetObject(normals, normal_buffer);
+
+	rtBufferValidate(material_buffer);
+	rtVariableSetObject(materialIndices, material_buffer);
+	rtBufferValidate(vertex_buffer);
+
+	error_handler(rtGeometryTrianglesSetMaterialCount(geometry_triangles, materials_.size()));
+	error_handler(rtGeometryTrianglesSetMaterialIndices(geometry_triangles, material_buffer, 0, sizeof(optix::uchar1), RT_FORMAT_UNSIGNED_BYTE));
+	error_handler(rtGeometryTrianglesSetVertices(geometry_triangles, no_triangles * 3, vertex_buffer, 0, sizeof(optix::float3), RT_FORMAT_FLOAT3));
+
+	RTprogram attribute_program;
+	error_handler(rtProgramCreateFromPTXFile(context, "optixtutorial.ptx", "attribute_program", &attribute_program));
+	error_handler(rtProgramValidate(attribute_program));
+	error_handler(rtGeometryTrianglesSetAttributeProgram(geometry_triangles, attribute_program));
+
+	error_handler(rtGeometryTrianglesValidate(geometry_triangles));
+	TRACE_END("Geometry buffers");
+
+	// geometry instance
+	RTgeometryinstance geometry_instance;
+	error_handler(rtGeometryInstanceCreate(context, &geometry_instance));
+	error_handler(rtGeometryInstanceSetGeometryTriangles(geometry_instance, geometry_triangles));
+	error_handler(rtGeometryInstanceSetMaterialCount(geometry_instance, materials_.size()));
+
+	RTprogram any_hit;
+	error_handler(rtProgramCreateFromPTXFile(context, "optixtutorial.ptx", "any_hit", &any_hit));
+	error_handler(rtProgramValidate(any_hit));
+
+	// ReSTIR shades every material either as Lambertian or as Phong surface
+	RTprogram closest_hit_gbuffer_lambert, closest_hit_gbuffer_phong;
+	error_handler(rtProgramCreateFromPTXFile(context, "optixtutorial.ptx", "closest_hit_gbuffer_lambert", &closest_hit_gbuffer_lambert));
+	error_handler(rtProgramValidate(closest_hit_gbuffer_lambert));
+	error_handler(rtProgramCreateFromPTXFile(context, "optixtutorial.ptx", "closest_hit_gbuffer_phong", &closest_hit_gbuffer_phong));
+	error_handler(rtProgramValidate(closest_hit_gbuffer_phong));
+
+	int next_tex_diffuse_id = 0;
+	// the textures decoded during the parsing and the geometry upload have to be ready now
+	const auto t2 = std::chrono::high_resolution_clock::now();
+
+	TRACE_BEGIN("Texture wait");
+	for (Material* material : materials_) {
+		material->ResolveTextures();
+	}
+	TRACE_END("Texture wait");
+
+	const auto t3 = std::chrono::high_resolution_clock::now();
+
+	// the materials no surface refers to never load their textures
+	std::set<Material *> used_materials;
+
+	for (auto surface : surfaces_) {
+		used_materials.insert(surface->get_material());
+	}
+
+	const double parse_ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+	const double wait_ms = std::chrono::duration<double, std::milli>(t3 - t2).count();
+	const double decode_ms = (TextureCache::Instance().decode_seconds() - decode_seconds) * 1e3;
+
+	printf("Scene load: parsing %0.1f ms, texture decoding %0.1f ms of CPU time on %d threads overlapped with it, waited %0.1f ms for the textures.\n",
+		parse_ms, decode_ms, TextureCache::Instance().no_decode_threads(), wait_ms);
+	printf("Scene load: %0.1f ms until the textures were ready, %0.1f ms with the textures decoded serially after the parsing.\n",
+		std::chrono::duration<double, std::milli>(t3 - t0).count(), std::chrono::duration<double, std::milli>(t2 - t0).count() + decode_ms);
+
+	TRACE_BEGIN("Materials and textures upload");
+	for (Material* material : materials_) {
+		const bool used = used_materials.count(material) > 0;
+		RTmaterial rtMaterial;
+		error_handler(rtMaterialCreate(context, &rtMaterial));
+		RTprogram closest_hit;
+		
+		switch (material->shader())
+		{
+			case Shader::NORMAL:
+				error_handler(rtProgramCreateFromPTXFile(context, "optixtutorial.ptx", "closest_hit_normal_shader", &closest_hit));
+				break;
+			case Shader::LAMBERT:
+				error_handler(rtProgramCreateFromPTXFile(context, "optixtutorial.ptx", "closest_hit_lambert_shader", &closest_hit));
+				break;
+			case Shader::PHONG:
+				error_handler(rtProgramCreateFromPTXFile(context, "optixtutorial.ptx", "closest_hit_phong_shader", &closest_hit));
+				break;
+			case Shader::MIRROR:
+				error_handler(rtProgramCreateFromPTXFile(context, "optixtutorial.ptx", "closest_hit_mirror_shader", &closest_hit));
+				break;
+			case Shader::GLASS:
+				error_handler(rtProgramCreateFromPTXFile(context, "optixtutorial.ptx", "closest_hit_glass_shader", &closest_hit));
+				break;
+			case Shader::PBR:
+				error_handler(rtProgramCreateFromPTXFile(context, "optixtutorial.ptx", "closest_hit_pbr_shader", &closest_hit));
+				break;
 			default:
 				error_handler(rtProgramCreateFromPTXFile(context, "optixtutorial.ptx", "closest_hit_normal_shader", &closest_hit));
-				break;
-		}
-
-		error_handler(createAndSetMaterialColorVariable(rtMaterial, "diffuse", material->diffuse()));
-		error_handler(createAndSetMaterialColorVariable(rtMaterial, "specular", material->specular()));
-		error_handler(createAndSetMaterialColorVariable(rtMaterial, "ambient", material->ambient()));
-		error_handler(createAndSetMaterialScalarVariable(rtMaterial, "shininess", material->shininess));
-
-		RTvariable tex_diffuse_id;
-		rtMaterialDeclareVariable(rtMaterial, "tex_diffuse_id", &tex_diffuse_id);
-
-		if (material->texture(material->kDiffuseMapSlot) != NULL) {
-			RTtexturesampler textureSampler;
-			rtTextureSamplerCreate(context, &textureSampler);
-			int texture_id;
-			rtTextureSamplerGetId(textureSampler, &texture_id);
-			
-			optix::float4* textureData = nullptr;
-
-			rtVariableSet1i(tex_diffuse_id, texture_id);
-			Texture* texture = material->texture(material->kDiffuseMapSlot);
-			RTbuffer texture_buffer;
-			error_handler(rtBufferCreate(context, RT_BUFFER_INPUT, &texture_buffer));
-			error_handler(rtBufferSetFormat(texture_buffer, RT_FORMAT_FLOAT4));
-			error_handler(rtBufferSetSize2D(texture_buffer, texture->width(), texture->height()));
-			error_handler(rtBufferMap(texture_buffer, (void**)(&textureData)));
-			
-			for (int i = 0; i < (texture->height() * texture->width()); i++) {
-				textureData[i] = optix::make_float4(texture->getData()[3 * i + 2] / 255.0f, texture->getData()[3 * i + 1] / 255.0f, texture->getData()[3*i] / 255.0f, 1);
-			}
-
-			/*for (int i = 0; i < texture->height() * texture->width(); i++) {
-				printf("%f %d %f %f\n", textureData[i].x, textureData[i].y, textureData[i].z, textureData[i].w);
-			}*/
-
-			rtTextureSamplerSetReadMode(textureSampler, RT_TEXTURE_READ_NORMALIZED_FLOAT);
-
-			error_handler(rtBufferUnmap(texture_buffer));
-			error_handler(rtTextureSamplerSetBuffer(textureSampler, 0, 0, texture_buffer));
-			error_handler(rtTextureSamplerValidate(textureSampler));
-		}
-		else {
-			rtVariableSet1i(tex_diffuse_id, -1);
-		}
-
-		error_handler(rtProgramValidate(closest_hit));
-		error_handler(rtMaterialSetClosestHitProgram(rtMaterial, 0, closest_hit));
-		error_handler(rtMaterialSetAnyHitProgram(rtMaterial, 1, any_hit));
-		error_handler(rtMaterialValidate(rtMaterial));
-
-		error_handler(rtGeometryInstanceSetMaterial(geometry_instance, material->materialIndex, rtMaterial));
-	}
-	error_handler(rtGeometryInstanceValidate(geometry_instance));
-
-	// acceleration structure
-	RTacceleration sbvh;
-	error_handler(rtAccelerationCreate(context, &sbvh));
-	error_handler(rtAccelerationSetBuilder(sbvh, "Sbvh"));
-	error_handler(rtAccelerationValidate(sbvh));
-
-	// geometry group
-	RTgeometrygroup geometry_group;
-	error_handler(rtGeometryGroupCreate(context, &geometry_group));
-	error_handler(rtGeometryGroupSetAcceleration(geometry_group, sbvh));
-	error_handler(rtGeometryGroupSetChildCount(geometry_group, 1));
-	error_handler(rtGeometryGroupSetChild(geometry_group, 0, geometry_instance));
-	error_handler(rtGeometryGroupValidate(geometry_group));
-
-	RTvariable top_object;
-	error_handler(rtContextDeclareVariable(context, "top_object", &top_object));
-	error_handler(rtVariableSetObject(top_object, geometry_group));
-}
-
-int Raytracer::Ui()
-{
-	static float f = 0.0f;
-	static int counter = 0;
-
-	ImGui::Begin( "Ray Tracer Params" );
-	
-	ImGui::Text( "Surfaces = %d", surfaces_.size() );
-	ImGui::Text( "Materials = %d", materials_.size() );
-	ImGui::Separator();
-	ImGui::Checkbox( "Vsync", &vsync_ );
-	ImGui::Checkbox( "Unify normals", &unify_normals_ );	
-
-	ImGui::SliderFloat( "gamma", &gamma_, 0.1f, 5.0f );
-	ImGui::SliderFloat("fov", &fov, 0.1f, 5.0f);
-	ImGui::SliderFloat("Mouse sensitivity", &mouseSensitivity, 0.1f, 100.0f);
-	ImGui::SliderInt("'Speed", &speed, 0, 10);
-
-	bool arrowUpPressed = GetKeyState(VK_UP) & 0x8000 ? true : false;
-	bool arrowDownPressed = GetKeyState(VK_DOWN) & 0x8000 ? true : false;
-	bool arrowLeftPressed = GetKeyState(VK_LEFT) & 0x8000 ? true : false;
-	bool arrowRightPressed = GetKeyState(VK_RIGHT) & 0x8000 ? true : false;
-	bool wPressed = GetKeyState('W') & 0x8000 ? true : false;
-	bool aPressed = GetKeyState('A') & 0x8000 ? true : false;
-	bool sPressed = GetKeyState('S') & 0x8000 ? true : false;
-	bool dPressed = GetKeyState('D') & 0x8000 ? true : false;
-	bool zPressed = GetKeyState('Z') & 0x8000 ? true : false;
-	bool cPressed = GetKeyState('C') & 0x8000 ? true : false;
-
-	float time = ImGui::GetIO().DeltaTime * 60;
-
-	double frameStep = speed * time;
-
-	if (arrowUpPressed) camera.moveForward(frameStep);
-	if (arrowDownPressed) camera.moveForward(-frameStep);
-	if (arrowRightPressed) camera.moveRight(frameStep);
-	if (arrowLeftPressed) camera.moveRight(-frameStep);
-	if (dPressed) camera.rotateRight(frameStep);
-	if (aPressed) camera.rotateRight(-frameStep);
-	if (sPressed) camera.rotateUp(frameStep);
-	if (wPressed) camera.rotateUp(-frameStep);
-	if (cPressed) camera.rollRight(frameStep);
-	if (zPressed) camera.rollRight(-frameStep);
-
-	//printf("%f %f %f \n", camera.view_from().x, camera.view_from().y, camera.view_from().z);
-
-	ImGui::Text( "Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate );
-	ImGui::End();
-	return 0;
-}
+				break;
+		}
+
+		error_handler(createAndSetMaterialColorVariable(rtMaterial, "diffuse", material->diffuse()));
+		error_handler(createAndSetMaterialColorVariable(rtMaterial, "specular", material->specular()));
+		error_handler(createAndSetMaterialColorVariable(rtMaterial, "ambient", material->ambient()));
+		error_handler(createAndSetMaterialColorVariable(rtMaterial, "emission", material->emission()));
+		error_handler(createAndSetMaterialScalarVariable(rtMaterial, "shininess", material->shininess));
+		error_handler(createAndSetMaterialScalarVariable(rtMaterial, "ior", material->ior));
+		error_handler(createAndSetMaterialScalarVariable(rtMaterial, "roughness", material->roughness_));
+		error_handler(createAndSetMaterialScalarVariable(rtMaterial, "metallicness", material->metallicness));
+
+		RTvariable tex_diffuse_id;
+		rtMaterialDeclareVariable(rtMaterial, "tex_diffuse_id", &tex_diffuse_id);
+		rtVariableSet1i(tex_diffuse_id, CreateMaterialTexture(used ? material->texture(material->kDiffuseMapSlot) : nullptr, true));
+
+		RTvariable tex_roughness_id;
+		rtMaterialDeclareVariable(rtMaterial, "tex_roughness_id", &tex_roughness_id);
+		rtVariableSet1i(tex_roughness_id, CreateMaterialTexture(used ? material->texture(material->kRoughnessMapSlot) : nullptr, false));
+
+		RTvariable tex_metallicness_id;
+		rtMaterialDeclareVariable(rtMaterial, "tex_metallicness_id", &tex_metallicness_id);
+		rtVariableSet1i(tex_metallicness_id, CreateMaterialTexture(used ? material->texture(material->kMetallicnessMapSlot) : nullptr, false));
+
+		error_handler(rtProgramValidate(closest_hit));
+		error_handler(rtMaterialSetClosestHitProgram(rtMaterial, 0, closest_hit));
+		error_handler(rtMaterialSetAnyHitProgram(rtMaterial, 1, any_hit));
+		error_handler(rtMaterialSetClosestHitProgram(rtMaterial, 2,
+			(material->shader() == Shader::PHONG) ? closest_hit_gbuffer_phong : closest_hit_gbuffer_lambert));
+		error_handler(rtMaterialValidate(rtMaterial));
+
+		error_handler(rtGeometryInstanceSetMaterial(geometry_instance, material->materialIndex, rtMaterial));
+	}
+	error_handler(rtGeometryInstanceValidate(geometry_instance));
+	TRACE_END("Materials and textures upload");
+	ReportTextureMemory();
+	TextureCache::Instance().Report();
+
+	// acceleration structure, it is built by the first launch
+	TRACE_SCOPE("Acceleration setup");
+	RTacceleration sbvh;
+	error_handler(rtAccelerationCreate(context, &sbvh));
+	error_handler(rtAccelerationSetBuilder(sbvh, "Sbvh"));
+	error_handler(rtAccelerationValidate(sbvh));
+
+	// geometry group
+	RTgeometrygroup geometry_group;
+	error_handler(rtGeometryGroupCreate(context, &geometry_group));
+	error_handler(rtGeometryGroupSetAcceleration(geometry_group, sbvh));
+	error_handler(rtGeometryGroupSetChildCount(geometry_group, 1));
+	error_handler(rtGeometryGroupSetChild(geometry_group, 0, geometry_instance));
+	error_handler(rtGeometryGroupValidate(geometry_group));
+
+	RTvariable top_object;
+	error_handler(rtContextDeclareVariable(context, "top_object", &top_object));
+	error_handler(rtVariableSetObject(top_object, geometry_group));
+	Invalidate();
+}
+
+int Raytracer::Ui()
+{
+	static float f = 0.0f;
+	static int counter = 0;
+
+	ImGui::Begin( "Ray Tracer Params" );
+	
+	ImGui::Text( "Surfaces = %d", surfaces_.size() );
+	ImGui::Text( "Materials = %d", materials_.size() );
+	ImGui::Text( "Lights = %d", lights_.size() );
+	ImGui::Text( "Emissive triangles = %d", emitters_.size() );
+	ImGui::Text( "Textures = %d, %0.1f MB (%0.1f MB as float4)", no_textures_,
+		texture_bytes_ / ( 1024.0 * 1024.0 ), texture_float4_bytes_ / ( 1024.0 * 1024.0 ) );
+	ImGui::Separator();
+	ImGui::Checkbox( "Vsync", &vsync_ );
+	bool triple_buffering = triple_buffering_.load();
+	if ( ImGui::Checkbox( "Triple-buffered frames", &triple_buffering ) ) triple_buffering_.store( triple_buffering );
+	ImGui::Text( "Frame handoff: stall %0.3f ms, latency %0.1f ms", handoff_stall_ms_.load(), frame_latency_ms_ );
+	ImGui::Text( "Producer frame %0.1f ms, copies %0.1f MB + upload %0.1f MB", producer_frame_ms_.load(), producer_copy_mb_.load(), upload_copy_mb_ );
+	ImGui::Checkbox( "Unify normals", &unify_normals_ );	
+	ImGui::Checkbox( "Emitter sampling (NEE)", &emitter_sampling_ );
+	ImGui::Checkbox( "ReSTIR direct lighting", &restir_ );
+	ImGui::Checkbox( "ReSTIR temporal reuse", &restir_temporal_ );
+	ImGui::Checkbox( "Environment importance sampling", &env_importance_ );
+
+	ImGui::SliderFloat( "gamma", &gamma_, 0.1f, 5.0f );
+	ImGui::Combo( "Tonemapping", &tonemap_, "Clamp\0Reinhard\0ACES\0" );
+	ImGui::SliderFloat( "Exposure (EV)", &exposure_, -8.0f, 8.0f );
+	if ( ImGui::Button( "Texture cache" ) ) TextureCache::Instance().Report();
+	int texture_budget = static_cast<int>( TextureCache::Instance().budget() >> 20 );
+	if ( ImGui::SliderInt( "Host texture budget (MB)", &texture_budget, 0, 8192 ) ) TextureCache::Instance().set_budget( size_t( texture_budget ) << 20 );
+	ImGui::Text( "Resident host textures = %0.1f MB", TextureCache::Instance().resident_bytes() / ( 1024.0 * 1024.0 ) );
+	if ( ImGui::Button( "Block-compress textures (BC1/BC4)" ) ) CompressTextures();
+	ImGui::SliderFloat("fov", &fov, 0.1f, 5.0f);
+	ImGui::SliderFloat("Mouse sensitivity", &mouseSensitivity, 0.1f, 100.0f);
+	ImGui::SliderInt("'Speed", &speed, 0, 10);
+	ImGui::SliderInt("Shadow rays / hit", &max_shadow_rays_, 1, 64);
+	ImGui::SliderInt("Samples / pixel", &samples_per_pixel_, 1, 64);
+	ImGui::SliderInt("Samples / pass", &samples_per_pass_, 1, 64);
+	ImGui::Checkbox("Interactive preview", &preview_);
+	ImGui::SliderFloat("Preview target frame (ms)", &target_frame_ms_, 5.0f, 200.0f);
+	ImGui::Text("Frame %0.1f ms (renderer %0.1f ms), target %0.1f ms, %s 1/%d resolution, %d spp", producer_frame_ms_.load(),
+		quality_.frame_ms(), quality_.target_ms(), (quality_.moving()) ? "moving" : "still", quality_.scale(), quality_.spp());
+	ImGui::SliderInt("Max path depth", &max_depth_, 1, 64);
+	ImGui::SliderInt("Russian roulette depth", &rr_depth_, 1, 16);
+	if ( ImGui::Button( "Benchmark path depths 1-16" ) ) benchmark_depths_ = true;
+	ImGui::SliderInt("ReSTIR candidates", &restir_candidates_, 1, 64);
+	ImGui::SliderInt("ReSTIR spatial neighbours", &restir_spatial_, 0, 16);
+	ImGui::Text( "Shadow rays / pixel = %d", ShadowRaysPerPixel() );
+#if defined( RAY_STATS )
+	ImGui::Text( "Rays / pixel %0.1f, %0.1f Mrays/s, hit ratio %0.3f, shadow occluded %0.3f", ray_stats_.rays_per_pixel(),
+		ray_stats_.mrays_per_second(), ray_stats_.hit_ratio(), ray_stats_.occluded_ratio() );
+	ImGui::Checkbox( "Log ray statistics", &log_ray_stats_ );
+#endif
+	int sample_budget = sample_budget_.load();
+	if ( ImGui::SliderInt( "Sample budget / pixel (0 = none)", &sample_budget, 0, 16384 ) )
+	{
+		sample_budget_.store( sample_budget );
+		Invalidate( false ); // resumes the idle producer when the budget grows
+	}
+	ImGui::Text( "Input to new frame %0.1f ms, %d frames cancelled", input_latency_ms_.load(), cancelled_frames_ );
+	ImGui::Text( "Accumulated samples / pixel = %d%s", accumulated_samples_.load(), ( producer_idle_.load() ) ? " (idle)" : "" );
+	ImGui::Text( "CPU %0.1f %%, renderer busy %0.1f %%, UI redraws %0.1f / s", cpu_utilization_, renderer_utilization_, ui_redraws_ );
+
+	bool arrowUpPressed = GetKeyState(VK_UP) & 0x8000 ? true : false;
+	bool arrowDownPressed = GetKeyState(VK_DOWN) & 0x8000 ? true : false;
+	bool arrowLeftPressed = GetKeyState(VK_LEFT) & 0x8000 ? true : false;
+	bool arrowRightPressed = GetKeyState(VK_RIGHT) & 0x8000 ? true : false;
+	bool wPressed = GetKeyState('W') & 0x8000 ? true : false;
+	bool aPressed = GetKeyState('A') & 0x8000 ? true : false;
+	bool sPressed = GetKeyState('S') & 0x8000 ? true : false;
+	bool dPressed = GetKeyState('D') & 0x8000 ? true : false;
+	bool zPressed = GetKeyState('Z') & 0x8000 ? true : false;
+	bool cPressed = GetKeyState('C') & 0x8000 ? true : false;
+
+	float time = ImGui::GetIO().DeltaTime * 60;
+
+	double frameStep = speed * time;
+
+	if (arrowUpPressed) camera.moveForward(frameStep);
+	if (arrowDownPressed) camera.moveForward(-frameStep);
+	if (arrowRightPressed) camera.moveRight(frameStep);
+	if (arrowLeftPressed) camera.moveRight(-frameStep);
+	if (dPressed) camera.rotateRight(frameStep);
+	if (aPressed) camera.rotateRight(-frameStep);
+	if (sPressed) camera.rotateUp(frameStep);
+	if (wPressed) camera.rotateUp(-frameStep);
+	if (cPressed) camera.rollRight(frameStep);
+	if (zPressed) camera.rollRight(-frameStep);
+
+	//printf("%f %f %f \n", camera.view_from().x, camera.view_from().y, camera.view_from().z);
+
+	DetectChanges();
+
+	ImGui::Text( "Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate );
+
+	bool tracing = Tracer::Instance().enabled();
+	if ( ImGui::Checkbox( "Trace events", &tracing ) ) Tracer::Instance().set_enabled( tracing );
+	ImGui::SameLine();
+	if ( ImGui::Button( "Save trace" ) ) Tracer::Instance().Save( "trace.json" );
+
+	if ( ImGui::CollapsingHeader( "Memory (MB)" ) )
+	{
+		const MemoryAccounting & memory = MemoryAccounting::Instance();
+		const double MB = 1.0 / ( 1024.0 * 1024.0 );
+		ImGui::Columns( 5 );
+		ImGui::Text( "Subsystem" ); ImGui::NextColumn();
+		ImGui::Text( "host" ); ImGui::NextColumn();
+		ImGui::Text( "peak" ); ImGui::NextColumn();
+		ImGui::Text( "device" ); ImGui::NextColumn();
+		ImGui::Text( "peak" ); ImGui::NextColumn();
+		ImGui::Separator();
+		for ( int i = 0; i < static_cast<int>( MemoryTag::COUNT ); ++i )
+		{
+			const MemoryTag tag = static_cast<MemoryTag>( i );
+			ImGui::Text( "%s", MemoryAccounting::name( tag ) ); ImGui::NextColumn();
+			ImGui::Text( "%0.1f", memory.current( tag, MemoryDomain::HOST ) * MB ); ImGui::NextColumn();
+			ImGui::Text( "%0.1f", memory.peak( tag, MemoryDomain::HOST ) * MB ); ImGui::NextColumn();
+			ImGui::Text( "%0.1f", memory.current( tag, MemoryDomain::DEVICE ) * MB ); ImGui::NextColumn();
+			ImGui::Text( "%0.1f", memory.peak( tag, MemoryDomain::DEVICE ) * MB ); ImGui::NextColumn();
+		}
+		ImGui::Separator();
+		ImGui::Text( "Total" ); ImGui::NextColumn();
+		ImGui::Text( "%0.1f", memory.total( MemoryDomain::HOST ) * MB ); ImGui::NextColumn();
+		ImGui::Text( "%0.1f", memory.total_peak( MemoryDomain::HOST ) * MB ); ImGui::NextColumn();
+		ImGui::Text( "%0.1f", memory.total( MemoryDomain::DEVICE ) * MB ); ImGui::NextColumn();
+		ImGui::Text( "%0.1f", memory.total_peak( MemoryDomain::DEVICE ) * MB ); ImGui::NextColumn();
+		ImGui::Columns( 1 );
+		if ( ImGui::Button( "Save memory CSV" ) ) memory.SaveCsv( "memory.csv" );
+	}
+	if ( ImGui::CollapsingHeader( "Stage timings (ms)" ) )
+	{
+		ImGui::Columns( 5 );
+		ImGui::Text( "Stage" ); ImGui::NextColumn();
+		ImGui::Text( "min" ); ImGui::NextColumn();
+		ImGui::Text( "mean" ); ImGui::NextColumn();
+		ImGui::Text( "p95" ); ImGui::NextColumn();
+		ImGui::Text( "max" ); ImGui::NextColumn();
+		ImGui::Separator();
+		for ( const auto & stats : StageTimings::Instance().Snapshot() )
+		{
+			ImGui::Text( "%s", stats.name.c_str() ); ImGui::NextColumn();
+			ImGui::Text( "%0.3f", stats.min ); ImGui::NextColumn();
+			ImGui::Text( "%0.3f", stats.mean ); ImGui::NextColumn();
+			ImGui::Text( "%0.3f", stats.p95 ); ImGui::NextColumn();
+			ImGui::Text( "%0.3f", stats.max ); ImGui::NextColumn();
+		}
+		ImGui::Columns( 1 );
+		if ( ImGui::Button( "Save CSV" ) ) StageTimings::Instance().SaveCsv( "stage_timings.csv" );
+		ImGui::SameLine();
+		if ( ImGui::Button( "Save JSON" ) ) StageTimings::Instance().SaveJson( "stage_timings.json" );
+		ImGui::SameLine();
+		if ( ImGui::Button( "Reset" ) ) StageTimings::Instance().Reset();
+	}
+	ImGui::End();
+	return 0;
+}
@@ -6,6 +6,16 @@
 #include "surface.h"
 #include "camera.h"
 #include "utils.h"
+#include "light.h"
+#include "emitters.h"
+#include "reservoir.h"
+#include "environment.h"
+#include "tonemapping.h"
+#include "colorkernels.h"
+#include "raycone.h"
+#include "raystats.h"
+#include "qualitycontroller.h"
+#include "stagetimer.h"
 
 /*! \class Raytracer
 \brief General ray tracer class.
@@ -17,15 +27,30 @@
 class Raytracer : public SimpleGuiDX11
 {
 public:
-	Raytracer( const int width, const int height, const float fov_y, const Vector3 view_from, const Vector3 view_at);
+	Raytracer( const int width, const int height, const float fov_y, const Vector3 view_from, const Vector3 view_at, const bool headless = false );
 	~Raytracer();
 
 	int InitDeviceAndScene();
 	int initGraph();
+	/* compiles the programs and builds the acceleration structures by an empty launch, the first frame does it otherwise */
+	int BuildGraph();
 	int get_image(BYTE * buffer) override;
+	size_t readback_bytes() const override;
+	bool converged() const override;
 	int ReleaseDeviceAndScene();
 
 	void LoadScene( const std::string file_name );
+	void SetLights( const std::vector<Light> & lights );
+	/* loads an equirectangular (HDR) map lighting the scene from the infinity */
+	void SetEnvironment( const std::string file_name );
+	/* renders a frame for every maximum path depth in [1, no_depths] and prints the time and Mrays/s */
+	void BenchmarkPathDepths( const int no_depths = 16 );
+	/* prints the ray counts, Mrays/s and the hit ratio of the last frame */
+	void LogRayStats() const;
+	/* accumulates frames at the full resolution until the image has spp samples per pixel, returns the number of frames */
+	int Render( const int spp );
+	/* writes the accumulated image, PPM and PNG are tonemapped by the current settings, EXR gets the linear radiance */
+	bool SaveImage( const std::string & file_name );
 	int Ui();
 
 private:	
@@ -37,11 +62,130 @@ private:
 	RTvariable focal_length;
 	RTvariable view_from;
 	RTvariable M_c_w;
+	RTvariable light_samples;
+	RTbuffer lightsBuffer = { 0 };
+
+	std::vector<Light> lights_;
+	int max_shadow_rays_{ 8 }; // upper bound of shadow rays traced per hit, longer light lists are subsampled
+
+	EmitterTable emitters_;
+	RTbuffer emittersBuffer = { 0 };
+	RTbuffer emitterTableBuffer = { 0 };
+	RTvariable emitter_sampling;
+	bool emitter_sampling_{ true }; // next event estimation of emissive triangles, hemisphere sampling otherwise
+	RTvariable emitter_pdf_scale;
+
+	RTbuffer reservoirsBuffer = { 0 };
+	RTbuffer reservoirsHistoryBuffer = { 0 };
+	RTbuffer gbufferBuffer = { 0 };
+	RTvariable restir_candidates;
+	RTvariable restir_temporal;
+	RTvariable restir_spatial;
+	RTvariable frame_index;
+	bool restir_{ false }; // resampled direct lighting with two shadow rays per pixel instead of the primary_ray entry point
+	bool restir_temporal_{ true };
+	int restir_candidates_{ 32 };
+	int restir_spatial_{ 4 };
+	bool restir_history_valid_{ false }; // the history reservoirs belong to the current camera and lights
+	unsigned int frame_{ 0 };
+	float last_camera_[13]{}; // M_c_w, view_from and fov of the previous frame
+
+	EnvironmentMap * environment_{ nullptr };
+	RTbuffer envMarginalBuffer = { 0 };
+	RTbuffer envConditionalBuffer = { 0 };
+	RTvariable env_map_id;
+	RTvariable env_sampling;
+	bool env_importance_{ true }; // sample the environment map by its luminance, uniform hemisphere otherwise
+
+	RTbuffer rayStatsBuffer = { 0 };
+	FrameRayStats ray_stats_; // of the last frame, read by the Ui without a lock
+	bool log_ray_stats_{ false }; // prints the statistics of every frame
+	RTvariable max_depth;
+	RTvariable rr_depth;
+	RTvariable samples_per_pixel;
+	int max_depth_{ 4 }; // maximum number of path segments, one means the direct lighting only
+	int rr_depth_{ 3 }; // number of segments before the Russian roulette starts
+	int samples_per_pixel_{ 16 };
+	RTvariable pass_weight;
+	int samples_per_pass_{ 4 }; // the frame can be cancelled between the launches of this many samples
+	int cancelled_frames_{ 0 };
+
+	QualityController quality_; // producer thread only, the Ui reads the figures without a lock
+	bool preview_{ true }; // lower resolution and samples while the camera moves
+	float target_frame_ms_{ 33.3f };
+	std::vector<optix::float4> preview_image_; // the preview upscaled to the window
+	MemoryCharge preview_image_memory_{ MemoryTag::FRAMEBUFFERS };
+	bool benchmark_depths_{ false }; // requested by the Ui, run by the next get_image
+
+	std::vector<optix::float4> accumulator_; // running mean of the frames rendered since the last change
+	MemoryCharge accumulator_memory_{ MemoryTag::FRAMEBUFFERS };
+	std::atomic<int> accumulated_samples_{ 0 }; // per pixel
+	unsigned int accumulated_generation_{ ~0u };
+	std::atomic<int> sample_budget_{ 1024 }; // per pixel, the producer idles once the image has them, zero means no limit
+	float last_render_state_[20]{}; // parameters of the launches, a change restarts the accumulation
+	float last_display_state_[3]{}; // parameters of the tonemapping, a change redisplays the accumulated image
+
+	std::map<Texture *, RTbuffer> texture_buffers_; // uploaded textures, shared by the samplers of the context
+	std::map<RTbuffer, MemoryCharge> device_buffers_; // sizes of the buffers of the context as created, released with the context
+	std::map<std::pair<Texture *, bool>, int> texture_samplers_; // sampler ids by the texture and the sRGB read mode
+	int shared_samplers_{ 0 }; // material slots that reused a sampler
+	size_t shared_texture_bytes_{ 0 }; // device memory not allocated again thanks to the sharing
+	int no_textures_{ 0 };
+	size_t texture_bytes_{ 0 }; // device memory of the uploaded textures
+	size_t texture_float4_bytes_{ 0 }; // the same textures expanded to float4
+	bool compress_textures_{ false }; // the host copies of the material textures are stored as BC1 ( color ) and BC4 ( roughness, metallic )
+
+	Tonemapper tonemapper_;
+	int tonemap_{ static_cast<int>( Tonemap::ACES ) };
+	float exposure_{ 0.0f }; // stops
 
 	Camera camera;
 	float fov;
 
 	bool unify_normals_{ true };
 	void error_handler(RTresult code);
+
+	RTbuffer CreateUserBuffer(const char * name, const size_t element_size, const MemoryTag tag);
+	/* per-pixel buffer of the launch size living on the device only */
+	RTbuffer CreateFrameBuffer(const char * name, const size_t element_size);
+	/* charges the size of all levels of the buffer to the tag on the device, a buffer charged before is charged its new size,
+	the overload without the tag ignores the buffers not charged yet */
+	void TrackDeviceBuffer(RTbuffer buffer, const MemoryTag tag);
+	void TrackDeviceBuffer(RTbuffer buffer);
+	RTprogram CreateEntryPoint(const unsigned int entry_point, const char * name);
+	/* uploads the texture as RGBA bytes, HDR images as float4, the rows are converted in parallel,
+	the block compressed textures are decoded */
+	RTbuffer CreateTextureBuffer(Texture * texture);
+	/* device memory of all mip levels of the uploaded texture */
+	size_t DeviceTextureBytes(Texture * texture) const;
+	void ReportTextureMemory() const;
+	/* uploads the material texture and returns its sampler id, -1 for no texture,
+	srgb textures are linearized by the sampler, the other ones are read as normalized floats,
+	the textures shared by several materials are uploaded once */
+	int CreateMaterialTexture(Texture * texture, const bool srgb);
+	/* block-compresses the host copies of the textures sampled by the device programs, the textures of the next scenes as well */
+	void CompressTextures();
+	bool CameraMoved();
+	/* true when the image was invalidated since the frame of the generation started, counts the abandoned frames */
+	bool Cancelled(const unsigned int generation);
+	/* compares the render and display parameters with their values from the previous call and invalidates the image */
+	void DetectChanges();
+	int ShadowRaysPerPixel() const;
+	/* sums the per-pixel ray counters of the launch, the counts stay zero when RAY_STATS is not defined */
+	FrameRayStats ReadRayStats(const int launch_width, const int launch_height, const double seconds);
+	/* resizes the RT_FORMAT_USER buffer and copies the items into it */
+	template <class T> void UploadUserBuffer(RTbuffer buffer, const std::vector<T> & items)
+	{
+		error_handler(rtBufferSetSize1D(buffer, items.size()));
+		TrackDeviceBuffer(buffer);
+
+		if (items.size() > 0)
+		{
+			void * data = nullptr;
+			error_handler(rtBufferMap(buffer, &data));
+			memcpy(data, items.data(), sizeof(T) * items.size());
+			error_handler(rtBufferUnmap(buffer));
+		}
+	}
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,403 @@
+#include "pch.h"
+#include "referencetracer.h"
+
+/* traces a shadow ray with the reference tracer */
+struct ReferenceVisibility
+{
+	const ReferenceTracer * tracer;
+	RayStats * stats{ nullptr }; // counts the traced and the occluded rays when set
+
+	bool operator()( const optix::float3 & p, const optix::float3 & omega_l, const float distance ) const
+	{
+		const bool occluded = tracer->Occluded( p, omega_l, 0.01f, distance - 0.01f );
+
+		RAY_STATS_COUNT( stats, shadow );
+		if ( occluded ) RAY_STATS_COUNT( stats, shadow_occluded );
+
+		return !occluded;
+	}
+};
+
+/* uniform random numbers for the shared sampling code */
+struct ReferenceRng
+{
+	std::mt19937 * generator;
+	std::uniform_real_distribution<float> distribution{ 0.0f, 1.0f };
+
+	float operator()()
+	{
+		return distribution( *generator );
+	}
+};
+
+ReferenceTracer::ReferenceTracer( std::vector<Surface *> & surfaces )
+{
+	for ( auto surface : surfaces )
+	{
+		for ( int i = 0; i < surface->no_triangles(); ++i )
+		{
+			Triangle & triangle = surface->get_triangle( i );
+
+			for ( int j = 0; j < 3; ++j )
+			{
+				const Vertex vertex = triangle.vertex( j );
+				vertices_.push_back( optix::make_float3( vertex.position.x, vertex.position.y, vertex.position.z ) );
+				normals_.push_back( optix::make_float3( vertex.normal.x, vertex.normal.y, vertex.normal.z ) );
+				texcoords_.push_back( optix::make_float2( vertex.texture_coords->u, vertex.texture_coords->v ) );
+			}
+
+			const size_t j = vertices_.size() - 3;
+			texcoord_densities_.push_back( TexcoordDensity( vertices_[j], vertices_[j + 1], vertices_[j + 2],
+				texcoords_[j], texcoords_[j + 1], texcoords_[j + 2] ) );
+			materials_.push_back( surface->get_material() );
+		}
+	}
+
+	// pinned once, the texel queries of the paths do not lock the texture cache
+	std::map<Material *, int> indices;
+
+	for ( auto material : materials_ )
+	{
+		auto index = indices.find( material );
+
+		if ( index == indices.end() )
+		{
+			index = indices.emplace( material, static_cast<int>( material_pins_.size() ) ).first;
+			material_pins_.push_back( MaterialPins{ TexturePin( ( material ) ? material->texture( Material::kDiffuseMapSlot ) : nullptr ),
+				TexturePin( ( material ) ? material->texture( Material::kRoughnessMapSlot ) : nullptr ) } );
+		}
+
+		pin_indices_.push_back( index->second );
+	}
+}
+
+int ReferenceTracer::no_triangles() const
+{
+	return static_cast<int>( materials_.size() );
+}
+
+/* Moller-Trumbore ray-triangle intersection */
+bool ReferenceTracer::IntersectTriangle( const int i, const optix::float3 & origin, const optix::float3 & direction,
+	float & t, float & b1, float & b2 ) const
+{
+	const optix::float3 & v0 = vertices_[i * 3 + 0];
+	const optix::float3 e1 = vertices_[i * 3 + 1] - v0;
+	const optix::float3 e2 = vertices_[i * 3 + 2] - v0;
+
+	const optix::float3 p = optix::cross( direction, e2 );
+	const float det = optix::dot( e1, p );
+
+	if ( fabsf( det ) < 1e-12f )
+	{
+		return false;
+	}
+
+	const float inv_det = 1.0f / det;
+	const optix::float3 s = origin - v0;
+	b1 = optix::dot( s, p ) * inv_det;
+
+	if ( b1 < 0.0f || b1 > 1.0f )
+	{
+		return false;
+	}
+
+	const optix::float3 q = optix::cross( s, e1 );
+	b2 = optix::dot( direction, q ) * inv_det;
+
+	if ( b2 < 0.0f || b1 + b2 > 1.0f )
+	{
+		return false;
+	}
+
+	t = optix::dot( e2, q ) * inv_det;
+
+	return true;
+}
+
+bool ReferenceTracer::Intersect( const optix::float3 & origin, const optix::float3 & direction,
+	const float t_min, const float t_max, ReferenceHit & hit ) const
+{
+	float t_hit = t_max;
+	float b1_hit = 0.0f, b2_hit = 0.0f;
+	int closest = -1;
+
+	for ( int i = 0; i < no_triangles(); ++i )
+	{
+		float t, b1, b2;
+
+		if ( IntersectTriangle( i, origin, direction, t, b1, b2 ) && t > t_min && t < t_hit )
+		{
+			t_hit = t;
+			b1_hit = b1;
+			b2_hit = b2;
+			closest = i;
+		}
+	}
+
+	if ( closest < 0 )
+	{
+		return false;
+	}
+
+	const float b0 = 1.0f - b1_hit - b2_hit;
+
+	hit.t = t_hit;
+	hit.triangle = closest;
+	hit.position = origin + direction * t_hit;
+	// the same interpolation and normal unification as attribute_program
+	hit.normal = optix::normalize( normals_[closest * 3 + 1] * b1_hit + normals_[closest * 3 + 2] * b2_hit + normals_[closest * 3] * b0 );
+	hit.front_face = optix::dot( direction, hit.normal ) <= 0.0f;
+	if ( !hit.front_face )
+	{
+		hit.normal = -hit.normal;
+	}
+	hit.texcoord = texcoords_[closest * 3 + 1] * b1_hit + texcoords_[closest * 3 + 2] * b2_hit + texcoords_[closest * 3] * b0;
+	hit.texcoord_density = texcoord_densities_[closest];
+	hit.material = materials_[closest];
+	hit.pins = &material_pins_[pin_indices_[closest]];
+
+	return true;
+}
+
+bool ReferenceTracer::Occluded( const optix::float3 & origin, const optix::float3 & direction,
+	const float t_min, const float t_max ) const
+{
+	for ( int i = 0; i < no_triangles(); ++i )
+	{
+		float t, b1, b2;
+
+		if ( IntersectTriangle( i, origin, direction, t, b1, b2 ) && t > t_min && t < t_max )
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+optix::float3 ReferenceTracer::DirectLighting( const std::vector<Light> & lights, const unsigned int max_samples, const float u,
+	const float u_rr, const optix::float3 & p, const optix::float3 & n, const optix::float3 & albedo, RayStats * stats ) const
+{
+	if ( lights.empty() )
+	{
+		return optix::make_float3( 0.0f );
+	}
+
+	LambertBrdf brdf;
+	brdf.albedo = albedo;
+	brdf.normal = n;
+
+	ReferenceVisibility visibility;
+	visibility.tracer = this;
+	visibility.stats = stats;
+
+	return EvaluateDirectLighting( lights.data(), static_cast<unsigned int>( lights.size() ), max_samples, u, u_rr, p, n, brdf, visibility );
+}
+
+optix::float3 ReferenceTracer::EmittedLighting( const EmitterTable & emitters, const float u0, const float u1, const float u2, const float u3,
+	const optix::float3 & p, const optix::float3 & n, const optix::float3 & albedo, RayStats * stats ) const
+{
+	if ( emitters.size() == 0 )
+	{
+		return optix::make_float3( 0.0f );
+	}
+
+	LambertBrdf brdf;
+	brdf.albedo = albedo;
+	brdf.normal = n;
+
+	ReferenceVisibility visibility;
+	visibility.tracer = this;
+	visibility.stats = stats;
+
+	return EvaluateEmitters( emitters.emitters().data(), emitters.table().data(), emitters.size(), u0, u1, u2, u3, p, n, brdf, visibility );
+}
+
+optix::float3 ReferenceTracer::ResampledLighting( const std::vector<Light> & lights, const EmitterTable & emitters, const unsigned int no_candidates,
+	const optix::float3 & p, const optix::float3 & n, const optix::float3 & albedo, std::mt19937 & generator, RayStats * stats ) const
+{
+	LambertBrdf brdf;
+	brdf.albedo = albedo;
+	brdf.normal = n;
+
+	ReferenceRng rng;
+	rng.generator = &generator;
+
+	const unsigned int no_lights = static_cast<unsigned int>( lights.size() );
+	const Reservoir r = GenerateReservoir( lights.data(), no_lights, emitters.emitters().data(), emitters.table().data(),
+		emitters.size(), no_candidates, p, n, brdf, rng );
+
+	optix::float3 omega_l, contribution;
+	float distance = 0.0f;
+
+	if ( r.W <= 0.0f || !EvaluateLightCandidate( lights.data(), no_lights, emitters.emitters().data(), r.y, p, n, brdf,
+		omega_l, distance, contribution ) )
+	{
+		return optix::make_float3( 0.0f );
+	}
+
+	ReferenceVisibility visibility;
+	visibility.tracer = this;
+	visibility.stats = stats;
+
+	if ( !visibility( p, omega_l, distance ) )
+	{
+		return optix::make_float3( 0.0f );
+	}
+
+	return contribution * r.W;
+}
+
+/* host counterpart of the closest hit and miss programs of optixtutorial.cu */
+struct ReferencePathTrace
+{
+	const ReferenceTracer * tracer;
+	const std::vector<Light> * lights;
+	const EmitterTable * emitters;
+	ReferenceRng * rng;
+
+	template <class Brdf>
+	void Shade( PathState & path, const ReferenceHit & hit, const Brdf & brdf ) const
+	{
+		ReferenceVisibility visibility;
+		visibility.tracer = tracer;
+		visibility.stats = RAY_STATS_OF( path );
+
+		const Material * material = hit.material;
+		const optix::float3 emission = optix::make_float3( material->emission_.r, material->emission_.g, material->emission_.b );
+
+		if ( path.depth == 0 || path.specular || emitters->size() == 0 )
+		{
+			path.result += path.throughput * emission;
+		}
+		else
+		{
+			// the emitters hit by the BSDF sampled segments share the estimate with the next event estimation
+			const float light_pdf = EmitterPdf( emission, emitters->pdf_scale(), hit.t * hit.t, fabsf( optix::dot( hit.normal, path.direction ) ) );
+			path.result += path.throughput * emission * PowerHeuristic( path.pdf, light_pdf );
+		}
+
+		const float u = ( *rng )(), u_rr = ( *rng )();
+		optix::float3 direct = EvaluateDirectLighting( lights->data(), static_cast<unsigned int>( lights->size() ),
+			static_cast<unsigned int>( lights->size() ), u, u_rr, hit.position, hit.normal, brdf, visibility );
+
+		if ( emitters->size() > 0 )
+		{
+			const float u0 = ( *rng )(), u1 = ( *rng )(), u2 = ( *rng )(), u3 = ( *rng )();
+			direct += EvaluateEmitters( emitters->emitters().data(), emitters->table().data(), emitters->size(), u0, u1, u2, u3,
+				hit.position, hit.normal, brdf, visibility, BsdfMis<Brdf>{ &brdf } );
+		}
+
+		path.result += path.throughput * direct;
+
+		const float u0 = ( *rng )(), u1 = ( *rng )(), u2 = ( *rng )();
+		optix::float3 omega_i, weight;
+		float pdf = 0.0f;
+
+		if ( brdf.Sample( u0, u1, u2, omega_i, weight, pdf ) )
+		{
+			ContinuePath( path, hit.position, omega_i, weight, pdf );
+		}
+		else
+		{
+			path.done = 1;
+		}
+	}
+
+	void operator()( PathState & path ) const
+	{
+		ReferenceHit hit;
+
+		if ( !tracer->Intersect( path.origin, path.direction, 0.01f, 1e+16f, hit ) )
+		{
+			RAY_STATS_COUNT( RAY_STATS_OF( path ), radiance_misses );
+			path.done = 1;
+			return;
+		}
+
+		const Material * material = hit.material;
+		const Coord2f texcoord{ hit.texcoord.x, 1.0f - hit.texcoord.y };
+		const float footprint = RayConeFootprint( path.cone_width + path.cone_spread * hit.t, optix::dot( hit.normal, path.direction ),
+			hit.texcoord_density );
+		const Color3f diffuse = material->diffuse( hit.pins->diffuse, texcoord, footprint );
+		const Color3f specular = material->specular_;
+		const optix::float3 albedo = optix::make_float3( diffuse.r, diffuse.g, diffuse.b );
+
+		switch ( material->shader() )
+		{
+		case Shader::LAMBERT:
+			{
+				LambertBrdf brdf;
+				brdf.albedo = albedo;
+				brdf.normal = hit.normal;
+				Shade( path, hit, brdf );
+			}
+			break;
+
+		case Shader::PHONG:
+			{
+				PhongBrdf brdf;
+				brdf.albedo = albedo;
+				brdf.specular = optix::make_float3( specular.r, specular.g, specular.b );
+				brdf.shininess = material->shininess;
+				brdf.normal = hit.normal;
+				brdf.omega_o = -path.direction;
+				Shade( path, hit, brdf );
+			}
+			break;
+
+		case Shader::PBR:
+			{
+				GgxBrdf brdf;
+				brdf.base_color = albedo;
+				brdf.roughness = material->roughness( hit.pins->roughness, texcoord, footprint );
+				brdf.metallic = material->metallicness;
+				brdf.normal = hit.normal;
+				brdf.omega_o = -path.direction;
+				Shade( path, hit, brdf );
+			}
+			break;
+
+		case Shader::MIRROR:
+			path.result += path.throughput * optix::make_float3( material->emission_.r, material->emission_.g, material->emission_.b );
+			ContinuePath( path, hit.position, ReflectDirection( -path.direction, hit.normal ),
+				optix::make_float3( specular.r, specular.g, specular.b ), 0.0f );
+			break;
+
+		case Shader::GLASS:
+			path.result += path.throughput * optix::make_float3( material->emission_.r, material->emission_.g, material->emission_.b );
+			ContinuePath( path, hit.position, SampleDielectric( path.direction, hit.normal, hit.front_face, material->ior, ( *rng )() ),
+				optix::make_float3( 1.0f ), 0.0f );
+			break;
+
+		default:
+			path.result += path.throughput * optix::make_float3( material->emission_.r, material->emission_.g, material->emission_.b );
+			path.done = 1;
+			break;
+		}
+	}
+};
+
+optix::float3 ReferenceTracer::PathRadiance( const optix::float3 & origin, const optix::float3 & direction, const std::vector<Light> & lights,
+	const EmitterTable & emitters, const int max_depth, const int rr_depth, std::mt19937 & generator, RayStats * stats,
+	const float cone_spread ) const
+{
+	ReferenceRng rng;
+	rng.generator = &generator;
+
+	ReferencePathTrace trace;
+	trace.tracer = this;
+	trace.lights = &lights;
+	trace.emitters = &emitters;
+	trace.rng = &rng;
+
+	PathState path;
+	BeginPath( path, origin, direction, cone_spread );
+	const optix::float3 result = TracePath( path, trace, max_depth, rr_depth, rng );
+
+#if defined( RAY_STATS )
+	if ( stats ) AddRayStats( *stats, path.stats );
+#endif
+
+	return result;
+}
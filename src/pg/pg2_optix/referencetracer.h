@@ -0,0 +1,91 @@
+#ifndef REFERENCE_TRACER_H_
+#define REFERENCE_TRACER_H_
+
+#include "surface.h"
+#include "light.h"
+#include "emitters.h"
+#include "reservoir.h"
+#include "pathtracer.h"
+#include "texturecache.h"
+
+/*! \struct MaterialPins
+\brief Textures of a material sampled by the host shading, resident for the lifetime of the ReferenceTracer.
+*/
+struct MaterialPins
+{
+	TexturePin diffuse;
+	TexturePin roughness;
+};
+
+/*! \struct ReferenceHit
+\brief Intersection record of the host reference tracer.
+*/
+struct ReferenceHit
+{
+	float t{ 0.0f }; /*!< Ray parameter of the intersection. */
+	int triangle{ -1 }; /*!< Index of the intersected triangle. */
+	optix::float3 position; /*!< Intersection point (ws). */
+	optix::float3 normal; /*!< Interpolated shading normal facing the incoming ray. */
+	optix::float2 texcoord; /*!< Interpolated texture coordinates. */
+	float texcoord_density{ 0.0f }; /*!< Texture space length of a unit length on the triangle. */
+	bool front_face{ true }; /*!< The ray hits the side the interpolated normal points to. */
+	Material * material{ nullptr }; /*!< Material of the intersected triangle. */
+	const MaterialPins * pins{ nullptr }; /*!< Textures of the material, the texel queries do not lock the texture cache. */
+};
+
+/*! \class ReferenceTracer
+\brief Brute-force host ray tracer used as a reference for the device programs.
+
+Works on the same triangle soup that Raytracer::LoadScene uploads and shares the light
+evaluation code with optixtutorial.cu, so the shading can be checked on machines without
+an OptiX capable GPU. It is meant for small test scenes, there is no acceleration structure.
+*/
+class ReferenceTracer
+{
+public:
+	ReferenceTracer( std::vector<Surface *> & surfaces );
+
+	/* returns the closest intersection within ( t_min, t_max ) */
+	bool Intersect( const optix::float3 & origin, const optix::float3 & direction,
+		const float t_min, const float t_max, ReferenceHit & hit ) const;
+
+	/* returns true when anything is hit within ( t_min, t_max ) */
+	bool Occluded( const optix::float3 & origin, const optix::float3 & direction,
+		const float t_min, const float t_max ) const;
+
+	/* Lambertian direct lighting with the same light subsampling and shadow rays as the device code, the shadow rays are added to stats */
+	optix::float3 DirectLighting( const std::vector<Light> & lights, const unsigned int max_samples, const float u,
+		const float u_rr, const optix::float3 & p, const optix::float3 & n, const optix::float3 & albedo, RayStats * stats = nullptr ) const;
+
+	/* Lambertian single sample next event estimation of the emissive triangles, the same estimator as the device code */
+	optix::float3 EmittedLighting( const EmitterTable & emitters, const float u0, const float u1, const float u2, const float u3,
+		const optix::float3 & p, const optix::float3 & n, const optix::float3 & albedo, RayStats * stats = nullptr ) const;
+
+	/* Lambertian direct lighting resampled from the lights and emitters with a single shadow ray, the per-pixel part of the ReSTIR passes */
+	optix::float3 ResampledLighting( const std::vector<Light> & lights, const EmitterTable & emitters, const unsigned int no_candidates,
+		const optix::float3 & p, const optix::float3 & n, const optix::float3 & albedo, std::mt19937 & generator,
+		RayStats * stats = nullptr ) const;
+
+	/* single path traced by the same iterative loop as primary_ray, Lambert, Phong, PBR, mirror and glass materials are supported,
+	cone_spread is the angle of the camera ray cone selecting the texture LOD, zero samples the finest level, the rays of the path
+	are added to stats */
+	optix::float3 PathRadiance( const optix::float3 & origin, const optix::float3 & direction, const std::vector<Light> & lights,
+		const EmitterTable & emitters, const int max_depth, const int rr_depth, std::mt19937 & generator, RayStats * stats = nullptr,
+		const float cone_spread = 0.0f ) const;
+
+	int no_triangles() const;
+
+private:
+	bool IntersectTriangle( const int i, const optix::float3 & origin, const optix::float3 & direction,
+		float & t, float & b1, float & b2 ) const;
+
+	std::vector<optix::float3> vertices_; // three vertices per triangle
+	std::vector<optix::float3> normals_; // three normals per triangle
+	std::vector<optix::float2> texcoords_; // three texture coordinates per triangle
+	std::vector<float> texcoord_densities_; // one per triangle
+	std::vector<Material *> materials_; // one material per triangle
+	std::vector<MaterialPins> material_pins_; // one per material
+	std::vector<int> pin_indices_; // one index to material_pins_ per triangle
+};
+
+#endif
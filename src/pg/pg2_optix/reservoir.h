@@ -0,0 +1,245 @@
+#ifndef RESERVOIR_H_
+#define RESERVOIR_H_
+
+#include "light.h"
+#include "emitters.h"
+#include "bsdf.h"
+
+/*! \struct LightCandidate
+\brief Light sample used by the resampled importance sampling.
+
+Indices below the number of analytic lights refer to the lights buffer, the rest refer
+to the emitters buffer shifted by the number of lights, \a u and \a v then select the point
+on the emissive triangle.
+*/
+struct LightCandidate
+{
+	int light; /*!< Index of the light, negative for no light. */
+	float u; /*!< First coordinate of the point on an emitter. */
+	float v; /*!< Second coordinate of the point on an emitter. */
+};
+
+/*! \struct Reservoir
+\brief Weighted reservoir holding a single light sample (ReSTIR, Bitterli et al. 2020).
+*/
+struct Reservoir
+{
+	LightCandidate y; /*!< Selected sample. */
+	float w_sum; /*!< Sum of the resampling weights of all seen candidates. */
+	float M; /*!< Number of candidates seen so far. */
+	float W; /*!< Unbiased contribution weight of the selected sample. */
+};
+
+/*! \struct GBufferSample
+\brief Primary hit of a pixel stored between the ReSTIR passes.
+*/
+struct GBufferSample
+{
+	optix::float3 position; /*!< Hit point (ws). */
+	float depth; /*!< Distance from the camera, zero for a miss. */
+	optix::float3 normal; /*!< Shading normal facing the camera. */
+	int hit; /*!< Non-zero when the primary ray hit the scene. */
+	optix::float3 albedo; /*!< Diffuse color. */
+	float shininess; /*!< Phong exponent. */
+	optix::float3 specular; /*!< Specular color, zero for Lambertian surfaces. */
+	float pad;
+	optix::float3 emission; /*!< Emitted radiance of the hit surface. */
+	float pad2;
+	optix::float3 omega_o; /*!< Unit direction towards the camera. */
+	float pad3;
+};
+
+RT_HOSTDEVICE inline void ResetReservoir( Reservoir & r )
+{
+	r.y.light = -1;
+	r.y.u = r.y.v = 0.0f;
+	r.w_sum = 0.0f;
+	r.M = 0.0f;
+	r.W = 0.0f;
+}
+
+/* streams a candidate with the resampling weight w representing M samples into the reservoir, returns true if it was selected */
+RT_HOSTDEVICE inline bool UpdateReservoir( Reservoir & r, const LightCandidate & x, const float w, const float M, const float u )
+{
+	r.w_sum += w;
+	r.M += M;
+
+	if ( w > 0.0f && u * r.w_sum < w )
+	{
+		r.y = x;
+
+		return true;
+	}
+
+	return false;
+}
+
+/* computes the unbiased contribution weight W for the selected sample with the target pdf p_hat */
+RT_HOSTDEVICE inline void FinalizeReservoir( Reservoir & r, const float p_hat )
+{
+	r.W = ( p_hat > 0.0f && r.M > 0.0f ) ? r.w_sum / ( r.M * p_hat ) : 0.0f;
+}
+
+/* merges the finalized reservoir q whose sample has the target pdf p_hat at the receiving pixel */
+RT_HOSTDEVICE inline bool MergeReservoir( Reservoir & r, const Reservoir & q, const float p_hat, const float u )
+{
+	return UpdateReservoir( r, q.y, p_hat * q.W * q.M, q.M, u );
+}
+
+/* probability of picking an analytic light when both lights and emitters exist */
+#define ANALYTIC_LIGHT_PROBABILITY 0.5f
+
+/*! \fn bool SampleLightCandidate( const unsigned int no_lights, const Emitter * emitters, const AliasEntry * table,
+	const unsigned int no_emitters, const float u0, const float u1, const float u2, const float u3, LightCandidate & x, float & pdf )
+\brief Draws a candidate from the source distribution, analytic lights uniformly and emitters by power and area.
+\param pdf source pdf of the candidate, discrete for analytic lights and per unit area for emitters.
+*/
+RT_HOSTDEVICE inline bool SampleLightCandidate( const unsigned int no_lights, const Emitter * emitters, const AliasEntry * table,
+	const unsigned int no_emitters, float u0, const float u1, const float u2, const float u3, LightCandidate & x, float & pdf )
+{
+	float q = ( no_emitters == 0 ) ? 1.0f : ( ( no_lights == 0 ) ? 0.0f : ANALYTIC_LIGHT_PROBABILITY );
+
+	if ( u0 < q )
+	{
+		u0 /= q;
+		unsigned int i = static_cast<unsigned int>( u0 * no_lights );
+		if ( i >= no_lights ) i = no_lights - 1;
+
+		x.light = static_cast<int>( i );
+		x.u = x.v = 0.0f;
+		pdf = q / no_lights;
+
+		return true;
+	}
+
+	if ( no_emitters == 0 )
+	{
+		return false;
+	}
+
+	u0 = ( u0 - q ) / ( 1.0f - q );
+	const unsigned int i = SampleAlias( table, no_emitters, u0, u1 );
+
+	x.light = static_cast<int>( no_lights + i );
+	x.u = u2;
+	x.v = u3;
+	pdf = ( 1.0f - q ) * emitters[i].pdf / emitters[i].area;
+
+	return true;
+}
+
+/*! \fn bool EvaluateLightCandidate( const Light * lights, const unsigned int no_lights, const Emitter * emitters, const LightCandidate & x,
+	const optix::float3 & p, const optix::float3 & normal, const Bsdf & bsdf, optix::float3 & omega_l, float & distance, optix::float3 & contribution )
+\brief Unshadowed contribution of the candidate to the point p.
+
+For emitters the geometry term with the emitter cosine is included, so the contribution is per unit area
+and matches the measure of the source pdf of SampleLightCandidate.
+*/
+template <class Bsdf>
+RT_HOSTDEVICE inline bool EvaluateLightCandidate( const Light * lights, const unsigned int no_lights, const Emitter * emitters,
+	const LightCandidate & x, const optix::float3 & p, const optix::float3 & normal, const Bsdf & bsdf,
+	optix::float3 & omega_l, float & distance, optix::float3 & contribution )
+{
+	if ( x.light < 0 )
+	{
+		return false;
+	}
+
+	optix::float3 radiance;
+
+	if ( static_cast<unsigned int>( x.light ) < no_lights )
+	{
+		if ( !Illuminate( lights[x.light], p, omega_l, distance, radiance ) )
+		{
+			return false;
+		}
+	}
+	else
+	{
+		const Emitter & emitter = emitters[x.light - no_lights];
+		const optix::float3 d = SampleTriangle( emitter, x.u, x.v ) - p;
+		const float sqr_distance = optix::dot( d, d );
+
+		if ( sqr_distance <= 0.0f )
+		{
+			return false;
+		}
+
+		distance = sqrtf( sqr_distance );
+		omega_l = d / distance;
+		const float cos_l = fabsf( optix::dot( optix::normalize( optix::cross( emitter.e1, emitter.e2 ) ), omega_l ) );
+		radiance = emitter.emission * ( cos_l / sqr_distance );
+	}
+
+	if ( optix::dot( normal, omega_l ) <= 0.0f )
+	{
+		return false;
+	}
+
+	contribution = bsdf( omega_l ) * radiance;
+
+	return true;
+}
+
+/* target pdf of the candidate at the point p, the luminance of the unshadowed contribution */
+template <class Bsdf>
+RT_HOSTDEVICE inline float TargetPdf( const Light * lights, const unsigned int no_lights, const Emitter * emitters,
+	const LightCandidate & x, const optix::float3 & p, const optix::float3 & normal, const Bsdf & bsdf )
+{
+	optix::float3 omega_l, contribution;
+	float distance;
+
+	if ( !EvaluateLightCandidate( lights, no_lights, emitters, x, p, normal, bsdf, omega_l, distance, contribution ) )
+	{
+		return 0.0f;
+	}
+
+	return Luminance( contribution );
+}
+
+/*! \fn Reservoir GenerateReservoir( const Light * lights, const unsigned int no_lights, const Emitter * emitters, const AliasEntry * table,
+	const unsigned int no_emitters, const unsigned int no_candidates, const optix::float3 & p, const optix::float3 & normal, const Bsdf & bsdf, Rng & rng )
+\brief Resampled importance sampling of \a no_candidates light candidates into a finalized reservoir.
+\param rng functor returning uniformly distributed numbers in [0, 1).
+*/
+template <class Bsdf, class Rng>
+RT_HOSTDEVICE inline Reservoir GenerateReservoir( const Light * lights, const unsigned int no_lights, const Emitter * emitters,
+	const AliasEntry * table, const unsigned int no_emitters, const unsigned int no_candidates,
+	const optix::float3 & p, const optix::float3 & normal, const Bsdf & bsdf, Rng & rng )
+{
+	Reservoir r;
+	ResetReservoir( r );
+
+	if ( no_lights + no_emitters == 0 )
+	{
+		return r;
+	}
+
+	float p_hat_y = 0.0f;
+
+	for ( unsigned int i = 0; i < no_candidates; ++i )
+	{
+		LightCandidate x;
+		float pdf = 0.0f;
+		const float u0 = rng(), u1 = rng(), u2 = rng(), u3 = rng();
+
+		if ( !SampleLightCandidate( no_lights, emitters, table, no_emitters, u0, u1, u2, u3, x, pdf ) || pdf <= 0.0f )
+		{
+			r.M += 1.0f;
+			continue;
+		}
+
+		const float p_hat = TargetPdf( lights, no_lights, emitters, x, p, normal, bsdf );
+
+		if ( UpdateReservoir( r, x, p_hat / pdf, 1.0f, rng() ) )
+		{
+			p_hat_y = p_hat;
+		}
+	}
+
+	FinalizeReservoir( r, p_hat_y );
+
+	return r;
+}
+
+#endif
@@ -3,11 +3,16 @@
 #include "freeimage.h"
 #include "mymath.h"
 
-SimpleGuiDX11::SimpleGuiDX11( const int width, const int height)
+SimpleGuiDX11::SimpleGuiDX11( const int width, const int height, const bool headless )
 {
 	width_ = width;
 	height_ = height;
-	Init();
+	headless_ = headless;
+
+	if ( !headless_ )
+	{
+		Init();
+	}
 }
 
 int SimpleGuiDX11::Init()
@@ -47,6 +52,9 @@ int SimpleGuiDX11::Init()
 	//ImGui::StyleColorsClassic();
 
 	tex_data_ = new BYTE[width_ * height_ * 4 * sizeof( BYTE )];
+	tex_data_memory_.Resize( size_t( width_ ) * height_ * 4 );
+	frames_.reset( new TripleBuffer( size_t( width_ ) * height_ * 4 ) );
+	frame_event_ = CreateEvent( nullptr, FALSE, FALSE, nullptr );
 	CreateTexture();
 	return 0;
 }
@@ -57,10 +65,16 @@ SimpleGuiDX11::~SimpleGuiDX11()
 	 
 	delete[] tex_data_;
 	tex_data_ = nullptr;
+	tex_data_memory_.Resize( 0 );
 }
 
 int SimpleGuiDX11::Cleanup()
 {
+	if ( headless_ )
+	{
+		return 0;
+	}
+
 	ImGui_ImplDX11_Shutdown();
 	ImGui_ImplWin32_Shutdown();
 	ImGui::DestroyContext();
@@ -69,6 +83,12 @@ int SimpleGuiDX11::Cleanup()
 	DestroyWindow( hwnd_ );
 	UnregisterClass( _T( "ImGui Example" ), wc_.hInstance );
 
+	if ( frame_event_ )
+	{
+		CloseHandle( frame_event_ );
+		frame_event_ = nullptr;
+	}
+
 	return 0;
 }
 
@@ -87,6 +107,55 @@ int SimpleGuiDX11::get_image(BYTE * buffer) {
 	return 0;
 }
 
+size_t SimpleGuiDX11::readback_bytes() const
+{
+	return 0;
+}
+
+bool SimpleGuiDX11::converged() const
+{
+	return false;
+}
+
+void SimpleGuiDX11::Invalidate( const bool restart )
+{
+	{
+		std::lock_guard<std::mutex> lock( state_lock_ );
+
+		if ( restart )
+		{
+			generation_.fetch_add( 1, std::memory_order_release );
+		}
+
+		wake_ = true;
+	}
+
+	long long none = 0;
+	input_time_.compare_exchange_strong( none, std::chrono::high_resolution_clock::now().time_since_epoch().count() );
+
+	state_changed_.notify_one();
+}
+
+/* copies the rows to the mapped texture whose rows may be padded */
+static size_t CopyToTexture( const D3D11_MAPPED_SUBRESOURCE & mapped, const BYTE * src, const int width, const int height )
+{
+	const size_t row_size = size_t( width ) * 4;
+
+	if ( mapped.RowPitch == row_size )
+	{
+		memcpy( mapped.pData, src, row_size * height );
+	}
+	else
+	{
+		for ( int y = 0; y < height; ++y )
+		{
+			memcpy( static_cast<BYTE *>( mapped.pData ) + size_t( y ) * mapped.RowPitch, src + y * row_size, row_size );
+		}
+	}
+
+	return row_size * height;
+}
+
 
 template <class T> inline void update( T & oldsample, const T newsample, const int no_samples )
 {		
@@ -95,51 +164,143 @@ template <class T> inline void update( T & oldsample, const T newsample, const i
 
 void SimpleGuiDX11::Producer()
 {
-	FIBITMAP * dib = FreeImage_AllocateT( FIT_BITMAP, width_, height_, 32 );
-	BYTE * local_data = ( BYTE * )FreeImage_GetBits( dib );	
+	// the frame is rendered here only when it is handed over by the copy to tex_data_
 	const int no_subpixels = width_ * height_ * 4;
-	float * local_accumulator = new float[no_subpixels];
-	memset( local_accumulator, 0, no_subpixels * sizeof( float ) );	
+	std::vector<BYTE> local_data( no_subpixels );
+	const MemoryCharge local_data_memory( MemoryTag::FRAMEBUFFERS, MemoryDomain::HOST, local_data.size() );
 
 	float t = 0.0f; // time
 	auto t0 = std::chrono::high_resolution_clock::now();
 	int frame = 0;
+	int no_inputs = 0;
+
+	TRACE_THREAD_NAME( "Producer" );
 
 	// refinenment loop
 	while ( !finish_request_.load( std::memory_order_acquire ) )
 	{
+		{
+			// the final image is not rendered again until something changes
+			std::unique_lock<std::mutex> lock( state_lock_ );
+
+			if ( !wake_ && converged() )
+			{
+				TRACE_SCOPE( "Producer idle" );
+				producer_idle_.store( true, std::memory_order_relaxed );
+				state_changed_.wait( lock, [this] { return wake_ || finish_request_.load( std::memory_order_acquire ); } );
+				producer_idle_.store( false, std::memory_order_relaxed );
+				t0 = std::chrono::high_resolution_clock::now(); // the idle time is not a part of the animation
+			}
+
+			wake_ = false;
+		}
+
+		if ( finish_request_.load( std::memory_order_acquire ) )
+		{
+			break;
+		}
+
 		auto t1 = std::chrono::high_resolution_clock::now();
 		std::chrono::duration<float> dt = t1 - t0;
 		//printf( "# %d in %0.1f ms\n", frame, dt.count() * 1e+3 );
 		t += dt.count();
 		t0 = t1;
 
-		get_image(local_data);
+		// the triple buffer lets the renderer write straight to the buffer the UI thread takes next
+		const bool triple_buffering = triple_buffering_.load( std::memory_order_relaxed );
+		long long input = input_time_.load( std::memory_order_acquire ); // the frame answers the inputs made before it started
+
+		const int result = get_image( ( triple_buffering ) ? frames_->back() : local_data.data() );
+		const auto t2 = std::chrono::high_resolution_clock::now();
+
+		producer_busy_us_.fetch_add( std::chrono::duration_cast<std::chrono::microseconds>( t2 - t1 ).count(), std::memory_order_relaxed );
+
+		if ( result == S_FALSE )
+		{
+			continue; // abandoned, the next frame starts at once
+		}
+
 		// compute rendering
 		frame++; // frame finished
-		
+
+		size_t copied = readback_bytes();
+
 		//if ( samples % 1000 == 0 )
+		if ( triple_buffering )
+		{
+			TIME_STAGE( "Frame handoff" );
+			frames_->Publish();
+		}
+		else
 		{
+			TIME_STAGE( "Frame handoff" );
+
 			// write rendering results
 			{
 				std::lock_guard<std::mutex> lock( tex_data_lock_ );
-				memcpy( tex_data_, local_data, no_subpixels * sizeof( BYTE ) );
+				memcpy( tex_data_, local_data.data(), no_subpixels * sizeof( BYTE ) );
+				tex_data_time_ = t2;
+				copied += no_subpixels * sizeof( BYTE );
 			} // lock release
 
 			repaint_request_.store( true, std::memory_order_release );
 		}
+
+		SetEvent( frame_event_ );
+
+		const auto t3 = std::chrono::high_resolution_clock::now();
+		const int window = min( frame, 60 );
+
+		if ( input != 0 && input_time_.compare_exchange_strong( input, 0 ) )
+		{
+			const std::chrono::high_resolution_clock::time_point t_input{ std::chrono::high_resolution_clock::duration( input ) };
+			float latency = input_latency_ms_.load( std::memory_order_relaxed );
+			update( latency, std::chrono::duration<float, std::milli>( t3 - t_input ).count(), min( ++no_inputs, 60 ) );
+			input_latency_ms_.store( latency, std::memory_order_relaxed );
+		}
+
+		float stall = handoff_stall_ms_.load( std::memory_order_relaxed );
+		update( stall, std::chrono::duration<float, std::milli>( t3 - t2 ).count(), window );
+		handoff_stall_ms_.store( stall, std::memory_order_relaxed );
+
+		float frame_ms = producer_frame_ms_.load( std::memory_order_relaxed );
+		update( frame_ms, std::chrono::duration<float, std::milli>( t3 - t1 ).count(), window );
+		producer_frame_ms_.store( frame_ms, std::memory_order_relaxed );
+
+		producer_copy_mb_.store( copied / ( 1024.0f * 1024.0f ), std::memory_order_relaxed );
 	}
+}
+
+void SimpleGuiDX11::MeasureUtilization( const bool redrawn )
+{
+	const auto t = std::chrono::high_resolution_clock::now();
+	const double seconds = std::chrono::duration<double>( t - utilization_t0_ ).count();
+
+	utilization_redraws_ += ( redrawn ) ? 1 : 0;
 
-	if ( dib )
+	if ( seconds < 1.0 )
 	{
-		FreeImage_FlipVertical( dib );
-		FreeImage_Unload( dib );
-		dib = nullptr;
-		local_data = nullptr;
+		return;
 	}
 
-	delete[] local_accumulator;
-	local_accumulator = nullptr;
+	FILETIME creation, exit, kernel, user;
+	GetProcessTimes( GetCurrentProcess(), &creation, &exit, &kernel, &user );
+	const unsigned long long cpu = ( ( unsigned long long )kernel.dwHighDateTime << 32 | kernel.dwLowDateTime ) +
+		( ( unsigned long long )user.dwHighDateTime << 32 | user.dwLowDateTime );
+	const long long busy = producer_busy_us_.load( std::memory_order_relaxed );
+
+	if ( utilization_cpu0_ > 0 )
+	{
+		// the producer time is spent mostly waiting for the device, so it stands for the GPU load as well
+		cpu_utilization_ = float( 100.0 * ( cpu - utilization_cpu0_ ) * 1e-7 / seconds / max( 1u, std::thread::hardware_concurrency() ) );
+		renderer_utilization_ = float( 100.0 * ( busy - utilization_busy0_ ) * 1e-6 / seconds );
+		ui_redraws_ = float( utilization_redraws_ / seconds );
+	}
+
+	utilization_t0_ = t;
+	utilization_cpu0_ = cpu;
+	utilization_busy0_ = busy;
+	utilization_redraws_ = 0;
 }
 
 int SimpleGuiDX11::width() const
@@ -154,6 +315,11 @@ int SimpleGuiDX11::height() const
 
 int SimpleGuiDX11::MainLoop()
 {
+	if ( headless_ )
+	{
+		return -1;
+	}
+
 	// start image producing threads
 	std::thread producer_thread( &SimpleGuiDX11::Producer, this );
 	BOOL r = SetThreadPriority( producer_thread.native_handle(), THREAD_PRIORITY_BELOW_NORMAL );
@@ -162,6 +328,9 @@ int SimpleGuiDX11::MainLoop()
 	MSG msg;
 	ZeroMemory( &msg, sizeof( msg ) );
 
+	int no_displayed = 0;
+	int redraws = 2; // Dear ImGui settles the hover and the focus states in the frames following an input
+
 	while ( msg.message != WM_QUIT )
 	{
 		// Poll and handle messages (inputs, window resize, etc.)
@@ -173,31 +342,74 @@ int SimpleGuiDX11::MainLoop()
 		{
 			TranslateMessage( &msg );
 			DispatchMessage( &msg );
+			redraws = 2;
 			continue;
 		}
 
+		// the window is redrawn only for an input or a new frame
+		const bool triple_buffering = triple_buffering_.load( std::memory_order_relaxed );
+		const bool new_frame = ( triple_buffering ) ? frames_->Acquire() : repaint_request_.load( std::memory_order_acquire );
+
+		if ( !new_frame && redraws == 0 )
+		{
+			MeasureUtilization( false );
+
+			if ( MsgWaitForMultipleObjects( 1, &frame_event_, FALSE, 500, QS_ALLINPUT ) == WAIT_TIMEOUT )
+			{
+				redraws = 1; // refreshes the statistics
+			}
+
+			continue;
+		}
+
+		redraws = max( 0, redraws - 1 );
+		MeasureUtilization( true );
+
 		// Start the Dear ImGui frame
 		ImGui_ImplDX11_NewFrame();
 		ImGui_ImplWin32_NewFrame();
 		ImGui::NewFrame();
 
-		Ui();
+		{
+			TIME_STAGE( "Ui" );
+			Ui();
+		}
 
-		// TODO do this only when needed, i.e. tex_data_ changed
-		if ( repaint_request_.load( std::memory_order_acquire ) )
+		if ( new_frame )
 		{			
+			TIME_STAGE( "Texture upload" );
 			D3D11_MAPPED_SUBRESOURCE mapped;
 			ZeroMemory( &mapped, sizeof( mapped ) );
 			HRESULT hr = g_pd3dDeviceContext->Map( tex_id_, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped ); // D3D11_MAP_WRITE, D3D11_MAP_WRITE_DISCARD
 
+			std::chrono::high_resolution_clock::time_point rendered;
+
+			size_t copied = 0;
+
+			if ( triple_buffering )
+			{
+				// the front buffer belongs to this thread until the next Acquire, it is the only copy of the frame
+				copied = CopyToTexture( mapped, frames_->front(), width_, height_ );
+				rendered = frames_->front_time();
+			}
+			else
 			{
 				std::lock_guard<std::mutex> lock( tex_data_lock_ );
-				memcpy( mapped.pData, tex_data_, mapped.RowPitch * height_ );
+				copied = CopyToTexture( mapped, tex_data_, width_, height_ );
+				rendered = tex_data_time_;
 			}
+
+			upload_copy_mb_ = copied / ( 1024.0f * 1024.0f );
 			
 			g_pd3dDeviceContext->Unmap( tex_id_, 0 );
 
-			repaint_request_.store( false, std::memory_order_release );
+			if ( !triple_buffering )
+			{
+				repaint_request_.store( false, std::memory_order_release );
+			}
+
+			update( frame_latency_ms_, std::chrono::duration<float, std::milli>( std::chrono::high_resolution_clock::now() - rendered ).count(),
+				min( ++no_displayed, 60 ) );
 		}
 
 		ImGui::Begin( "Image", 0, ImGuiWindowFlags_NoMove);
@@ -206,16 +418,23 @@ int SimpleGuiDX11::MainLoop()
 
 		//ImGui_ImplDX11_RenderDrawData()
 		// Rendering
-		ImGui::Render();
-		g_pd3dDeviceContext->OMSetRenderTargets( 1, &g_mainRenderTargetView, NULL );
-		const FLOAT clear_color[4] = { 0.45f, 0.55f, 0.60f, 1.00f };		
-		g_pd3dDeviceContext->ClearRenderTargetView( g_mainRenderTargetView, ( float* )&clear_color );
-		ImGui_ImplDX11_RenderDrawData( ImGui::GetDrawData() );
+		{
+			TIME_STAGE( "ImGui render" );
+			ImGui::Render();
+			g_pd3dDeviceContext->OMSetRenderTargets( 1, &g_mainRenderTargetView, NULL );
+			const FLOAT clear_color[4] = { 0.45f, 0.55f, 0.60f, 1.00f };		
+			g_pd3dDeviceContext->ClearRenderTargetView( g_mainRenderTargetView, ( float* )&clear_color );
+			ImGui_ImplDX11_RenderDrawData( ImGui::GetDrawData() );
+		}
 		
-		g_pSwapChain->Present( ( ( vsync_ ) ? 1 : 0 ), 0 ); // present with or without vsync
+		{
+			TIME_STAGE( "Present" );
+			g_pSwapChain->Present( ( ( vsync_ ) ? 1 : 0 ), 0 ); // present with or without vsync
+		}
 	}
 
 	finish_request_.store( true, std::memory_order_release );
+	Invalidate( false ); // wakes the idle producer
 	producer_thread.join();
 
 	return 0;
@@ -5,12 +5,16 @@
 #pragma once
 #include "simpleguidx11.h"
 #include "structs.h"
+#include "triplebuffer.h"
+#include "stagetimer.h"
+#include "memoryaccounting.h"
 #include "imgui_internal.h"
 
 class SimpleGuiDX11
 {
 public:	
-	SimpleGuiDX11( const int width, const int height );	
+	/* a headless instance creates no window and no DX11 device, the frames are only rendered by get_image */
+	SimpleGuiDX11( const int width, const int height, const bool headless = false );	
 	~SimpleGuiDX11();		
 	
 	int MainLoop();	
@@ -31,10 +35,19 @@ protected:
 	virtual int Ui();
 	virtual Color3f get_pixel( const int x, const int y, const float t = 0.0f );
 	virtual int get_image(BYTE * buffer);
+	/* bytes get_image reads back from the device per frame */
+	virtual size_t readback_bytes() const;
 
 
 	void Producer();
 
+	/* marks the image dirty and wakes the producer, restart discards the accumulated samples,
+	otherwise the producer only continues or displays the image again ( tonemapping, sample budget ) */
+	void Invalidate( const bool restart = true );
+	/* the producer waits for Invalidate instead of rendering the final image again,
+	get_image returns S_FALSE when it abandoned a frame invalidated meanwhile, the frame is not displayed */
+	virtual bool converged() const;
+
 	int width() const;
 	int height() const;
 	ImRect imageRect;
@@ -43,6 +56,21 @@ protected:
 	float gamma_{ 2.4f };
 	float mouseSensitivity = { 0.5 };
 	int speed = { 5 };
+
+	std::atomic<bool> triple_buffering_{ true }; // lock-free frame handoff, the mutex guarded copy to tex_data_ otherwise
+	std::atomic<float> handoff_stall_ms_{ 0.0f }; // producer time spent by passing a frame to the UI thread
+	float frame_latency_ms_{ 0.0f }; // from the end of the rendering to the texture upload, UI thread only
+	std::atomic<float> producer_frame_ms_{ 0.0f }; // get_image and the handoff
+	std::atomic<float> producer_copy_mb_{ 0.0f }; // device readback and host copies of a produced frame
+	float upload_copy_mb_{ 0.0f }; // host copy of a displayed frame to the texture, UI thread only
+
+	std::atomic<unsigned int> generation_{ 0 }; // bumped by every change restarting the image
+	std::atomic<bool> producer_idle_{ false };
+	std::atomic<float> input_latency_ms_{ 0.0f }; // from the first Invalidate to the publication of a frame rendered after it
+	float cpu_utilization_{ 0.0f }; // percent of all cores used by the process in the last window, UI thread only
+	float renderer_utilization_{ 0.0f }; // percent of the last window spent in get_image
+	float ui_redraws_{ 0.0f }; // UI frames per second in the last window
+	bool headless_{ false };
 private:	
 	WNDCLASSEX wc_;
 	HWND hwnd_;
@@ -57,7 +85,24 @@ private:
 	int width_{ 800 };
 	int height_{ 600 };
 	BYTE * tex_data_{ nullptr }; // DXGI_FORMAT_R8G8B8A8_UNORM
+	MemoryCharge tex_data_memory_{ MemoryTag::FRAMEBUFFERS };
 	std::mutex tex_data_lock_;		
+	std::chrono::high_resolution_clock::time_point tex_data_time_; // when the frame in tex_data_ was rendered
+	std::unique_ptr<TripleBuffer> frames_; // DXGI_FORMAT_R8G8B8A8_UNORM
+
+	std::mutex state_lock_;
+	std::condition_variable state_changed_;
+	bool wake_{ false }; // guarded by state_lock_
+	HANDLE frame_event_{ nullptr }; // signaled by the producer for every new frame, the idle UI thread waits for it
+	std::atomic<long long> producer_busy_us_{ 0 };
+	std::atomic<long long> input_time_{ 0 }; // high_resolution_clock ticks of the oldest Invalidate not answered by a frame, zero for none
+
+	/* updates the utilization once per second */
+	void MeasureUtilization( const bool redrawn );
+	std::chrono::high_resolution_clock::time_point utilization_t0_;
+	unsigned long long utilization_cpu0_{ 0 }; // process time in 100 ns units
+	long long utilization_busy0_{ 0 };
+	int utilization_redraws_{ 0 };
 		
 	// https://stackoverflow.com/questions/44685403/do-i-need-stdatomicbool-or-is-pod-bool-good-enough	
 	std::atomic<bool> finish_request_{ false };	
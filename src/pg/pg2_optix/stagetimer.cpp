@@ -0,0 +1,167 @@
+#include "pch.h"
+#include "stagetimer.h"
+#include "mymath.h"
+
+StageTimings & StageTimings::Instance()
+{
+	static StageTimings timings;
+
+	return timings;
+}
+
+StageTimings::Stage * StageTimings::Find( const char * name )
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+
+	for ( auto & stage : stages_ )
+	{
+		if ( stage.name == name )
+		{
+			return &stage;
+		}
+	}
+
+	stages_.emplace_back();
+	stages_.back().name = name;
+
+	return &stages_.back();
+}
+
+void StageTimings::Record( Stage * stage, const float ms )
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+
+	stage->samples[stage->next] = ms;
+	stage->next = ( stage->next + 1 ) % STAGE_TIMER_HISTORY;
+	++stage->count;
+}
+
+StageStats StageTimings::Statistics( const Stage & stage )
+{
+	StageStats stats{ stage.name, static_cast<int>( min( stage.count, static_cast<long long>( STAGE_TIMER_HISTORY ) ) ), stage.count,
+		0.0f, 0.0f, 0.0f, 0.0f };
+
+	if ( stats.count == 0 )
+	{
+		return stats;
+	}
+
+	std::vector<float> samples( stage.samples, stage.samples + stats.count );
+	std::sort( samples.begin(), samples.end() );
+
+	double sum = 0.0;
+
+	for ( const float sample : samples )
+	{
+		sum += sample;
+	}
+
+	stats.min = samples.front();
+	stats.mean = static_cast<float>( sum / stats.count );
+	stats.p95 = samples[min( stats.count - 1, static_cast<int>( ceil( 0.95 * stats.count ) ) - 1 )];
+	stats.max = samples.back();
+
+	return stats;
+}
+
+std::vector<StageStats> StageTimings::Snapshot() const
+{
+	std::vector<Stage> stages;
+
+	{
+		// the statistics are computed outside the lock, the timed threads are not held up by the sorting
+		std::lock_guard<std::mutex> lock( mutex_ );
+		stages.assign( stages_.begin(), stages_.end() );
+	}
+
+	std::vector<StageStats> snapshot;
+
+	for ( const auto & stage : stages )
+	{
+		snapshot.push_back( Statistics( stage ) );
+	}
+
+	return snapshot;
+}
+
+void StageTimings::Reset()
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+
+	for ( auto & stage : stages_ )
+	{
+		stage.next = 0;
+		stage.count = 0;
+	}
+}
+
+bool StageTimings::SaveCsv( const std::string & file_name ) const
+{
+	FILE * file = fopen( file_name.c_str(), "wt" );
+
+	if ( !file )
+	{
+		printf( "Unable to open '%s'.\n", file_name.c_str() );
+
+		return false;
+	}
+
+	fprintf( file, "stage,count,total,min_ms,mean_ms,p95_ms,max_ms\n" );
+
+	for ( const auto & stats : Snapshot() )
+	{
+		fprintf( file, "\"%s\",%d,%lld,%0.4f,%0.4f,%0.4f,%0.4f\n", stats.name.c_str(), stats.count, stats.total_count,
+			stats.min, stats.mean, stats.p95, stats.max );
+	}
+
+	fclose( file );
+	printf( "Stage timings saved to '%s'.\n", file_name.c_str() );
+
+	return true;
+}
+
+bool StageTimings::SaveJson( const std::string & file_name ) const
+{
+	std::vector<Stage> stages;
+
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		stages.assign( stages_.begin(), stages_.end() );
+	}
+
+	FILE * file = fopen( file_name.c_str(), "wt" );
+
+	if ( !file )
+	{
+		printf( "Unable to open '%s'.\n", file_name.c_str() );
+
+		return false;
+	}
+
+	fprintf( file, "{\n\t\"history\": %d,\n\t\"stages\": [", STAGE_TIMER_HISTORY );
+
+	for ( size_t i = 0; i < stages.size(); ++i )
+	{
+		const Stage & stage = stages[i];
+		const StageStats stats = Statistics( stage );
+
+		fprintf( file, "%s\n\t\t{ \"name\": \"%s\", \"count\": %d, \"total\": %lld, \"min_ms\": %0.4f, \"mean_ms\": %0.4f, \"p95_ms\": %0.4f, \"max_ms\": %0.4f,\n\t\t\"samples_ms\": [",
+			( i > 0 ) ? "," : "", stats.name.c_str(), stats.count, stats.total_count, stats.min, stats.mean, stats.p95, stats.max );
+
+		// the ring buffer is unrolled from the oldest sample
+		const int first = ( stage.count > STAGE_TIMER_HISTORY ) ? stage.next : 0;
+
+		for ( int j = 0; j < stats.count; ++j )
+		{
+			fprintf( file, "%s%0.4f", ( j > 0 ) ? ", " : "", stage.samples[( first + j ) % STAGE_TIMER_HISTORY] );
+		}
+
+		fprintf( file, "] }" );
+	}
+
+	fprintf( file, "\n\t]\n}\n" );
+	fclose( file );
+	printf( "Stage timings saved to '%s'.\n", file_name.c_str() );
+
+	return true;
+}
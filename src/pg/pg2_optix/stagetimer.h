@@ -0,0 +1,101 @@
+#ifndef STAGE_TIMER_H_
+#define STAGE_TIMER_H_
+
+#include "trace.h"
+
+/* the timers compile to nothing when STAGE_TIMING_DISABLED is defined */
+#if !defined( STAGE_TIMING_DISABLED )
+#define STAGE_TIMING
+#endif
+
+/* number of the latest samples the statistics of a stage are computed from */
+#define STAGE_TIMER_HISTORY 256
+
+/* statistics of the samples kept for a stage ( ms ) */
+struct StageStats
+{
+	std::string name;
+	int count; // samples in the history
+	long long total_count; // samples recorded since the start
+	float min;
+	float mean;
+	float p95;
+	float max;
+};
+
+/*! \class StageTimings
+\brief Process-wide registry of the timed stages of the producer and the UI thread.
+
+Every stage keeps the durations of its latest STAGE_TIMER_HISTORY executions in a ring buffer,
+the statistics are computed from a copy when they are requested.
+*/
+class StageTimings
+{
+public:
+	struct Stage
+	{
+		std::string name;
+		float samples[STAGE_TIMER_HISTORY]; // ms
+		int next{ 0 };
+		long long count{ 0 };
+	};
+
+	static StageTimings & Instance();
+
+	/* returns the stage of the given name, it is created by the first call, the pointer stays valid */
+	Stage * Find( const char * name );
+	void Record( Stage * stage, const float ms );
+
+	/* statistics of all stages in the order of their creation */
+	std::vector<StageStats> Snapshot() const;
+	/* drops the samples, the stages stay */
+	void Reset();
+
+	/* writes the statistics, one stage per line */
+	bool SaveCsv( const std::string & file_name ) const;
+	/* writes the statistics and the samples of the history of every stage, the oldest first */
+	bool SaveJson( const std::string & file_name ) const;
+
+private:
+	StageTimings() = default;
+	StageTimings( const StageTimings & ) = delete;
+	StageTimings & operator=( const StageTimings & ) = delete;
+
+	static StageStats Statistics( const Stage & stage );
+
+	mutable std::mutex mutex_;
+	std::list<Stage> stages_; // the elements do not move
+};
+
+/*! \class ScopedStageTimer
+\brief Records the time from its construction to its destruction to a stage.
+*/
+class ScopedStageTimer
+{
+public:
+	ScopedStageTimer( StageTimings::Stage * stage ) : stage_( stage ), t0_( std::chrono::high_resolution_clock::now() ) { }
+
+	~ScopedStageTimer()
+	{
+		StageTimings::Instance().Record( stage_, std::chrono::duration<float, std::milli>( std::chrono::high_resolution_clock::now() - t0_ ).count() );
+	}
+
+private:
+	StageTimings::Stage * stage_;
+	std::chrono::high_resolution_clock::time_point t0_;
+};
+
+/* times the rest of the enclosing scope, the stage is looked up once per call site, the scope is traced as well */
+#if defined( STAGE_TIMING )
+#define STAGE_TIMER_CONCAT_( a, b ) a##b
+#define STAGE_TIMER_NAME_( line ) STAGE_TIMER_CONCAT_( stage_timer_, line )
+#define STAGE_TIMER_SCOPE_( line ) STAGE_TIMER_CONCAT_( stage_timer_scope_, line )
+#define TIME_STAGE( name ) \
+	static StageTimings::Stage * const STAGE_TIMER_NAME_( __LINE__ ) = StageTimings::Instance().Find( name ); \
+	ScopedStageTimer STAGE_TIMER_SCOPE_( __LINE__ )( STAGE_TIMER_NAME_( __LINE__ ) ); \
+	TRACE_SCOPE( name )
+#else
+#define TIME_STAGE( name ) TRACE_SCOPE( name )
+#endif
+
+#endif
@@ -1,5 +1,6 @@
 #include "pch.h"
 #include "surface.h"
+#include "memoryaccounting.h"
 
 Surface * BuildSurface( const std::string & name, std::vector<Vertex> & face_vertices )
 {
@@ -35,6 +36,7 @@ Surface::Surface( const std::string & name, const int n )
 
 	n_ = n;
 	triangles_ = new Triangle[n_];
+	MemoryAccounting::Instance().Allocate( MemoryTag::GEOMETRY, MemoryDomain::HOST, sizeof( Triangle ) * n_ ); // three full vertices each
 }
 
 Surface::~Surface()
@@ -43,6 +45,7 @@ Surface::~Surface()
 	{
 		delete[] triangles_;
 		triangles_ = nullptr;
+		MemoryAccounting::Instance().Release( MemoryTag::GEOMETRY, MemoryDomain::HOST, sizeof( Triangle ) * n_ );
 	}
 	n_ = 0;
 }
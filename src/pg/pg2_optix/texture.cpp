@@ -1,9 +1,27 @@
 #include "pch.h"
 #include "texture.h"
 #include "mymath.h"
+#include "colorkernels.h"
+#include "raycone.h"
+#include "blockcompression.h"
+#include "trace.h"
+#include "omp.h"
+#include <unordered_set>
 
-Texture::Texture( const char * file_name )
+#ifdef COLOR_KERNELS_SSE2
+#include <xmmintrin.h>
+#endif
+
+Texture::Texture( const char * file_name ) : file_name_( file_name )
+{
+	Decode();
+}
+
+void Texture::Decode()
 {
+	TRACE_SCOPE( "Texture decode" );
+	const char * file_name = file_name_.c_str();
+
 	// image format
 	FREE_IMAGE_FORMAT fif = FIF_UNKNOWN;
 	// pointer to the image, once loaded
@@ -33,9 +51,58 @@ Texture::Texture( const char * file_name )
 			width_ = int( FreeImage_GetWidth( dib ) );
 			height_ = int( FreeImage_GetHeight( dib ) );
 
+			const FREE_IMAGE_TYPE image_type = FreeImage_GetImageType( dib );
+
+			if ( ( image_type == FIT_RGBF || image_type == FIT_RGBAF ) && ( width_ != 0 ) && ( height_ != 0 ) )
+			{
+				// float images can not be converted to raw bits, they are stored as BGR floats top-down the same way
+				if ( image_type == FIT_RGBAF )
+				{
+					FIBITMAP * rgbf = FreeImage_ConvertToRGBF( dib );
+
+					if ( rgbf )
+					{
+						FreeImage_Unload( dib );
+						dib = rgbf;
+					}
+				}
+
+				const int channels = ( FreeImage_GetImageType( dib ) == FIT_RGBAF ) ? 4 : 3;
+
+				pixel_size_ = 3 * sizeof( float );
+				scan_width_ = width_ * pixel_size_;
+				data_ = new BYTE[scan_width_ * height_];
+
+				for ( int y = 0; y < height_; ++y )
+				{
+					SwizzleRgbfToBgrf( reinterpret_cast<const float *>( FreeImage_GetScanLine( dib, height_ - 1 - y ) ), channels, width_,
+						reinterpret_cast<float *>( data_ + y * scan_width_ ) );
+				}
+			}
 			// if each of these is ok
-			if ( ( width_ != 0 ) && ( height_ != 0 ) )
+			else if ( ( width_ != 0 ) && ( height_ != 0 ) )
 			{				
+				// the texels are stored as gray, BGR or BGRA bytes, the 16-bit channels, the palettes and the packed formats are converted
+				if ( image_type != FIT_BITMAP )
+				{
+					if ( FIBITMAP * standard = FreeImage_ConvertToStandardType( dib, TRUE ) )
+					{
+						FreeImage_Unload( dib );
+						dib = standard;
+					}
+				}
+
+				const unsigned bpp = FreeImage_GetBPP( dib );
+
+				if ( !( bpp == 8 && FreeImage_GetColorType( dib ) == FIC_MINISBLACK ) && bpp != 24 && bpp != 32 )
+				{
+					if ( FIBITMAP * bgr = FreeImage_ConvertTo24Bits( dib ) )
+					{
+						FreeImage_Unload( dib );
+						dib = bgr;
+					}
+				}
+
 				// texture loaded
 				scan_width_ = FreeImage_GetPitch( dib ); // in bytes
 				pixel_size_ = FreeImage_GetBPP( dib ) / 8; // in bytes				
@@ -49,6 +116,8 @@ Texture::Texture( const char * file_name )
 		}
 	}
 
+	memory_.Resize( resident_bytes() );
+
 	if ( data_ )
 	{
 		printf( "Texture '%s' (%d x %d px, %d bpp, %0.1f MB) loaded.\n",
@@ -73,9 +142,92 @@ Texture::~Texture()
 		scan_width_ = 0;
 		pixel_size_ = 0;
 	}
+
+	mips_.clear();
+	tiled_.clear();
+}
+
+void Texture::Unload()
+{
+	delete[] data_;
+	data_ = nullptr;
+
+	// the size stays valid for the LOD selection and the reports
+	std::vector<MipLevel>().swap( mips_ );
+	std::vector<TiledLevel>().swap( tiled_ );
+	std::vector<std::vector<BYTE>>().swap( blocks_ );
+	memory_.Resize( 0 );
+}
+
+bool Texture::Reload()
+{
+	if ( resident() )
+	{
+		return true;
+	}
+
+	Decode();
+
+	if ( data_ && mipmapped_ )
+	{
+		BuildMipmaps( mip_srgb_ );
+	}
+
+	if ( data_ && compression_ != TextureCompression::NONE )
+	{
+		const TextureCompression compression = compression_;
+		compression_ = TextureCompression::NONE;
+		Compress( compression );
+
+		return resident();
+	}
+
+	if ( data_ && layout_ == TexelLayout::TILED )
+	{
+		BuildTiles();
+	}
+
+	return data_ != nullptr;
+}
+
+bool Texture::resident() const
+{
+	return data_ != nullptr || !blocks_.empty();
 }
 
-Color3f Texture::texel( const float u, const float v, const bool linearize ) const
+bool Texture::pinned() const
+{
+	return pins_.load( std::memory_order_acquire ) > 0;
+}
+
+size_t Texture::resident_bytes() const
+{
+	size_t bytes = ( data_ ) ? size_t( scan_width_ ) * height_ : 0;
+
+	for ( const MipLevel & level : mips_ )
+	{
+		bytes += level.data.size();
+	}
+
+	for ( const TiledLevel & level : tiled_ )
+	{
+		bytes += level.data.size();
+	}
+
+	for ( const std::vector<BYTE> & level : blocks_ )
+	{
+		bytes += level.size();
+	}
+
+	return bytes;
+}
+
+const std::string & Texture::file_name() const
+{
+	return file_name_;
+}
+
+Color3f Texture::texel( const float u, const float v, const bool linearize, const float lod ) const
 {
 	//assert( ( u >= 0.0f && u <= 1.0f ) && ( v >= 0.0f && v <= 1.0f ) );
 	
@@ -91,43 +243,340 @@ Color3f Texture::texel( const float u, const float v, const bool linearize ) con
 	
 	return Color3f{ r, g, b }.linear();*/
 
-	// bilinear interpolation	
-	const float x = u * width_;
-	const float y = v * height_;
+	if ( lod <= 0.0f || mips_.empty() )
+	{
+		return Bilinear( 0, u, v, linearize );
+	}
+
+	// trilinear interpolation between the two nearest levels
+	const int last = no_levels() - 1;
+	const int level = min( last, int( lod ) );
+	const float k = ( level < last ) ? lod - level : 0.0f;
+
+	if ( k <= 0.0f )
+	{
+		return Bilinear( level, u, v, linearize );
+	}
+
+	return Bilinear( level, u, v, linearize ) * ( 1 - k ) + Bilinear( level + 1, u, v, linearize ) * k;
+}
+
+/* spreads the bits of the coordinate within a tile to the even bits of the Z-order index */
+static inline int SpreadBits( const int v )
+{
+	static const int table[16] = { 0x00, 0x01, 0x04, 0x05, 0x10, 0x11, 0x14, 0x15, 0x40, 0x41, 0x44, 0x45, 0x50, 0x51, 0x54, 0x55 };
 
-	const int x0 = max( 0, min( width_ - 1, int( x ) ) );
-	const int y0 = max( 0, min( height_ - 1, int( y ) ) );
+	return table[v & 0xf];
+}
+
+inline const BYTE * Texture::LevelData( const int level ) const
+{
+	return ( layout_ == TexelLayout::ROW_MAJOR ) ? data( level ) : tiled_[level].data.data();
+}
+
+inline size_t Texture::RowOffset( const int level, const int y ) const
+{
+	if ( layout_ == TexelLayout::ROW_MAJOR )
+	{
+		return size_t( y ) * scan_width( level );
+	}
+
+	const size_t tile_row = size_t( y >> TEXTURE_TILE_BITS ) * tiled_[level].tiles_x;
+
+	return ( ( tile_row << ( 2 * TEXTURE_TILE_BITS ) ) + ( SpreadBits( y & ( ( 1 << TEXTURE_TILE_BITS ) - 1 ) ) << 1 ) ) * pixel_size_;
+}
+
+inline size_t Texture::ColumnOffset( const int x ) const
+{
+	if ( layout_ == TexelLayout::ROW_MAJOR )
+	{
+		return size_t( x ) * pixel_size_;
+	}
+
+	return ( ( size_t( x >> TEXTURE_TILE_BITS ) << ( 2 * TEXTURE_TILE_BITS ) ) + SpreadBits( x & ( ( 1 << TEXTURE_TILE_BITS ) - 1 ) ) ) * pixel_size_;
+}
+
+Color3f Texture::Bilinear( const int level, const float u, const float v, const bool linearize ) const
+{
+	const int width = this->width( level );
+	const int height = this->height( level );
+
+	const float x = u * width;
+	const float y = v * height;
+
+	const int x0 = max( 0, min( width - 1, int( x ) ) );
+	const int y0 = max( 0, min( height - 1, int( y ) ) );
 	
-	const int x1 = min( width_ - 1, x0 + 1 );
-	const int y1 = min( height_ - 1, y0 + 1 );
+	const int x1 = min( width - 1, x0 + 1 );
+	const int y1 = min( height - 1, y0 + 1 );
 	
-	BYTE * p1 = &data_[y0 * scan_width_ + x0 * pixel_size_];
-	BYTE * p2 = &data_[y0 * scan_width_ + x1 * pixel_size_];
-	BYTE * p3 = &data_[y1 * scan_width_ + x0 * pixel_size_];
-	BYTE * p4 = &data_[y1 * scan_width_ + x1 * pixel_size_];
+	const BYTE * p1, * p2, * p3, * p4;
+	BYTE decoded[4][3];
+
+	if ( compression_ != TextureCompression::NONE )
+	{
+		FetchBlockTexel( level, x0, y0, decoded[0] );
+		FetchBlockTexel( level, x1, y0, decoded[1] );
+		FetchBlockTexel( level, x0, y1, decoded[2] );
+		FetchBlockTexel( level, x1, y1, decoded[3] );
+
+		p1 = decoded[0];
+		p2 = decoded[1];
+		p3 = decoded[2];
+		p4 = decoded[3];
+	}
+	else
+	{
+		const BYTE * data = LevelData( level );
+		const size_t row0 = RowOffset( level, y0 ), row1 = RowOffset( level, y1 );
+		const size_t column0 = ColumnOffset( x0 ), column1 = ColumnOffset( x1 );
+
+		p1 = data + row0 + column0;
+		p2 = data + row0 + column1;
+		p3 = data + row1 + column0;
+		p4 = data + row1 + column1;
+	}
 
 	const float kx = x - x0;
 	const float ky = y - y0;
+	// the channels of the gray images are the same byte, the decoded blocks are always BGR
+	const int g = ( compression_ != TextureCompression::NONE ) ? 1 : min( 1, pixel_size_ - 1 );
+	const int r = ( compression_ != TextureCompression::NONE ) ? 2 : min( 2, pixel_size_ - 1 );
+
+	if ( pixel_size_ < 12 && linearize )
+	{
+		// the texels are decoded by the table before the interpolation, the same way the hardware sRGB read does
+		const float * table = SrgbToLinearTable();
+		auto decode = [table, g, r]( const BYTE * p ) { return Color3f{ table[p[r]], table[p[g]], table[p[0]] }; };
 
-	if ( pixel_size_ < 12 )
+		return decode( p1 ) * ( 1 - kx ) * ( 1 - ky ) + decode( p2 ) * kx * ( 1 - ky ) +
+			decode( p3 ) * ( 1 - kx ) * ky + decode( p4 ) * kx * ky;
+	}
+	else if ( pixel_size_ < 12 )
 	{
-		Color3f texel = ( Color3f::make_from_bgr<BYTE>( p1 ) * ( 1 - kx ) * ( 1 - ky ) +
-			Color3f::make_from_bgr<BYTE>( p2 ) * kx * ( 1 - ky ) +
-			Color3f::make_from_bgr<BYTE>( p3 ) * ( 1 - kx ) * ky +
-			Color3f::make_from_bgr<BYTE>( p4 ) * kx * ky ) *
-			( 1.0f / 255.0f );
-		if ( linearize )
-			return texel.linear();
-		else
-			return texel;
+		auto decode = [g, r]( const BYTE * p ) { return Color3f{ float( p[r] ), float( p[g] ), float( p[0] ) }; };
+
+		return ( decode( p1 ) * ( 1 - kx ) * ( 1 - ky ) + decode( p2 ) * kx * ( 1 - ky ) +
+			decode( p3 ) * ( 1 - kx ) * ky + decode( p4 ) * kx * ky ) * ( 1.0f / 255.0f );
 	}
 	else
 	{
-		return ( Color3f::make_from_bgr<float>( p1 ) * ( 1 - kx ) * ( 1 - ky ) +
-			Color3f::make_from_bgr<float>( p2 ) * kx * ( 1 - ky ) +
-			Color3f::make_from_bgr<float>( p3 ) * ( 1 - kx ) * ky +
-			Color3f::make_from_bgr<float>( p4 ) * kx * ky );		
+		auto decode = []( const BYTE * p )
+		{
+			const float * bgr = reinterpret_cast<const float *>( p );
+			return Color3f{ bgr[2], bgr[1], bgr[0] };
+		};
+
+		return decode( p1 ) * ( 1 - kx ) * ( 1 - ky ) + decode( p2 ) * kx * ( 1 - ky ) +
+			decode( p3 ) * ( 1 - kx ) * ky + decode( p4 ) * kx * ky;
+	}
+}
+
+void Texture::FetchBlockTexel( const int level, const int x, const int y, BYTE * bgr ) const
+{
+	const int blocks_x = ( width( level ) + BC_BLOCK_SIZE - 1 ) / BC_BLOCK_SIZE;
+	const BYTE * block = blocks_[level].data() + ( size_t( y / BC_BLOCK_SIZE ) * blocks_x + x / BC_BLOCK_SIZE ) * BC_BLOCK_BYTES;
+	const int i = ( y % BC_BLOCK_SIZE ) * BC_BLOCK_SIZE + x % BC_BLOCK_SIZE;
+
+	if ( compression_ == TextureCompression::BC1 )
+	{
+		DecodeBC1Texel( block, i, bgr );
+	}
+	else
+	{
+		bgr[0] = bgr[1] = bgr[2] = DecodeBC4Texel( block, i );
+	}
+}
+
+void Texture::texels( const Coord2f * uv, const int count, const bool linearize, Color3f * out, const float lod ) const
+{
+#ifdef COLOR_KERNELS_SSE2
+	// far enough ahead to hide the memory latency of the random lookups
+	const int distance = 8;
+	const int level = ( lod <= 0.0f || mips_.empty() ) ? 0 : min( no_levels() - 1, int( lod ) );
+	const int width = this->width( level );
+	const int height = this->height( level );
+	// the blocks are small enough to stay in the cache
+	const BYTE * data = ( compression_ == TextureCompression::NONE ) ? LevelData( level ) : nullptr;
+
+	for ( int i = 0; i < count; ++i )
+	{
+		if ( i + distance < count && data )
+		{
+			// the opposite corners of the bilinear quad, the other two taps share a cache line with one of them mostly
+			const int x = max( 0, min( width - 1, int( uv[i + distance].u * width ) ) );
+			const int y = max( 0, min( height - 1, int( uv[i + distance].v * height ) ) );
+			_mm_prefetch( reinterpret_cast<const char *>( data + RowOffset( level, y ) + ColumnOffset( x ) ), _MM_HINT_T0 );
+			_mm_prefetch( reinterpret_cast<const char *>( data + RowOffset( level, min( height - 1, y + 1 ) ) +
+				ColumnOffset( min( width - 1, x + 1 ) ) ), _MM_HINT_T0 );
+		}
+
+		out[i] = texel( uv[i].u, uv[i].v, linearize, lod );
+	}
+#else
+	for ( int i = 0; i < count; ++i )
+	{
+		out[i] = texel( uv[i].u, uv[i].v, linearize, lod );
+	}
+#endif
+}
+
+void Texture::SetLayout( const TexelLayout layout )
+{
+	if ( layout == TexelLayout::TILED && tiled_.empty() )
+	{
+		BuildTiles();
+	}
+
+	layout_ = ( tiled_.empty() ) ? TexelLayout::ROW_MAJOR : layout;
+}
+
+TexelLayout Texture::layout() const
+{
+	return layout_;
+}
+
+void Texture::BuildTiles()
+{
+	if ( !data_ )
+	{
+		return;
 	}
+
+	const int tile_size = 1 << TEXTURE_TILE_BITS;
+	size_t bytes = 0;
+
+	// the offsets are computed for the tiled layout while copying
+	const TexelLayout layout = layout_;
+	layout_ = TexelLayout::TILED;
+	tiled_.resize( no_levels() );
+
+	for ( int level = 0; level < no_levels(); ++level )
+	{
+		const int width = this->width( level );
+		const int height = this->height( level );
+		const int scan_width = this->scan_width( level );
+		const BYTE * src = data( level );
+
+		// the partial tiles at the right and the bottom edge are padded
+		TiledLevel & tiled = tiled_[level];
+		tiled.tiles_x = ( width + tile_size - 1 ) >> TEXTURE_TILE_BITS;
+		const int tiles_y = ( height + tile_size - 1 ) >> TEXTURE_TILE_BITS;
+		tiled.data.assign( size_t( tiled.tiles_x ) * tiles_y * tile_size * tile_size * pixel_size_, 0 );
+
+		#pragma omp parallel for schedule( static )
+		for ( int y = 0; y < height; ++y )
+		{
+			for ( int x = 0; x < width; ++x )
+			{
+				BYTE * dst = tiled.data.data() + RowOffset( level, y ) + ColumnOffset( x );
+				memcpy( dst, src + y * scan_width + x * pixel_size_, pixel_size_ );
+			}
+		}
+
+		bytes += tiled.data.size();
+	}
+
+	layout_ = layout;
+	memory_.Resize( resident_bytes() );
+
+	printf( "Tiled layout (%d x %d texel tiles, %d levels, %0.1f MB) built.\n", tile_size, tile_size, no_levels(),
+		bytes / ( 1024.0f * 1024.0f ) );
+}
+
+void Texture::ReportLayouts( const int no_samples )
+{
+	if ( !data_ || no_samples <= 0 )
+	{
+		return;
+	}
+
+	const TexelLayout original_layout = layout_;
+	SetLayout( TexelLayout::TILED );
+
+	std::mt19937 generator( 0 );
+	std::uniform_real_distribution<float> uniform( 0.0f, 1.0f );
+
+	// uniformly random coordinates and a scan over a grid rotated by 30 degrees with four texels between the samples
+	std::vector<Coord2f> random( no_samples ), rotated( no_samples );
+
+	for ( auto & uv : random )
+	{
+		uv = Coord2f{ uniform( generator ), uniform( generator ) };
+	}
+
+	const int scan = 1024;
+	const float step = 4.0f / max( width_, height_ );
+	const float c = cosf( float( M_PI ) / 6.0f ), s = sinf( float( M_PI ) / 6.0f );
+
+	for ( int i = 0; i < no_samples; ++i )
+	{
+		const float a = ( i % scan ) * step, b = ( i / scan ) * step;
+		const float u = c * a - s * b, v = s * a + c * b;
+		rotated[i] = Coord2f{ u - floorf( u ), v - floorf( v ) };
+	}
+
+	std::vector<Color3f> result( no_samples ), reference( no_samples );
+
+	// best of three runs, ns per sample
+	auto time = [&]( const std::vector<Coord2f> & uv, const bool batch )
+	{
+		double best = 0.0;
+
+		for ( int run = 0; run < 3; ++run )
+		{
+			const auto t0 = std::chrono::high_resolution_clock::now();
+
+			if ( batch )
+			{
+				texels( uv.data(), no_samples, true, result.data() );
+			}
+			else
+			{
+				for ( int i = 0; i < no_samples; ++i )
+				{
+					result[i] = texel( uv[i].u, uv[i].v, true );
+				}
+			}
+
+			const auto t1 = std::chrono::high_resolution_clock::now();
+			const double ns = std::chrono::duration<double, std::nano>( t1 - t0 ).count() / no_samples;
+			best = ( run == 0 ) ? ns : min( best, ns );
+		}
+
+		return best;
+	};
+
+	printf( "Texel layouts (%d x %d px, %d bpp), %d samples, ns/sample for texel and texels (batch):\n",
+		width_, height_, pixel_size_ * 8, no_samples );
+
+	const std::vector<Coord2f> * patterns[] = { &random, &rotated };
+	const char * names[] = { "random", "rotated minified" };
+
+	for ( int p = 0; p < 2; ++p )
+	{
+		layout_ = TexelLayout::ROW_MAJOR;
+		const double row_major = time( *patterns[p], false );
+		const double row_major_batch = time( *patterns[p], true );
+		reference = result;
+
+		layout_ = TexelLayout::TILED;
+		const double tiled = time( *patterns[p], false );
+		const double tiled_batch = time( *patterns[p], true );
+
+		float max_difference = 0.0f;
+
+		for ( int i = 0; i < no_samples; ++i )
+		{
+			max_difference = max( max_difference, max( fabsf( result[i].r - reference[i].r ),
+				max( fabsf( result[i].g - reference[i].g ), fabsf( result[i].b - reference[i].b ) ) ) );
+		}
+
+		printf( "  %-16s row-major %6.1f / %6.1f, tiled %6.1f / %6.1f (%s)\n", names[p], row_major, row_major_batch,
+			tiled, tiled_batch, ( max_difference == 0.0f ) ? "identical" : "MISMATCH" );
+	}
+
+	SetLayout( original_layout );
 }
 
 int Texture::width() const
@@ -140,7 +589,500 @@ int Texture::height() const
 	return height_;
 }
 
+int Texture::pixel_size() const
+{
+	return pixel_size_;
+}
+
 BYTE * Texture::getData() {
 	return data_;
 }
 
+int Texture::no_levels() const
+{
+	return static_cast<int>( mips_.size() ) + 1;
+}
+
+int Texture::width( const int level ) const
+{
+	return ( level == 0 ) ? width_ : mips_[level - 1].width;
+}
+
+int Texture::height( const int level ) const
+{
+	return ( level == 0 ) ? height_ : mips_[level - 1].height;
+}
+
+int Texture::scan_width( const int level ) const
+{
+	return ( level == 0 ) ? scan_width_ : mips_[level - 1].scan_width;
+}
+
+const BYTE * Texture::data( const int level ) const
+{
+	return ( level == 0 ) ? data_ : mips_[level - 1].data.data();
+}
+
+void Texture::BuildMipmaps( const bool srgb )
+{
+	if ( !data_ || !mips_.empty() )
+	{
+		return;
+	}
+
+	TRACE_SCOPE( "Texture mipmaps" );
+
+	// a reloaded texture gets the same pyramid again
+	mipmapped_ = true;
+	mip_srgb_ = srgb;
+
+	const auto t0 = std::chrono::high_resolution_clock::now();
+
+	static const std::vector<BYTE> encode = []()
+	{
+		std::vector<BYTE> table( SRGB_ENCODE_TABLE_SIZE );
+		BuildSrgbEncodeTable( 2.4f, table.data() );
+		return table;
+	}();
+	const float * decode = SrgbToLinearTable();
+
+	const bool hdr = pixel_size_ >= 12;
+	// alpha and the non-color textures are averaged as they are
+	const int srgb_channels = ( srgb && !hdr ) ? min( pixel_size_, 3 ) : 0;
+
+	int width = width_;
+	int height = height_;
+	int scan_width = scan_width_;
+	const BYTE * src = data_;
+	size_t bytes = 0;
+
+	while ( width > 1 || height > 1 )
+	{
+		MipLevel level;
+		level.width = max( 1, width / 2 );
+		level.height = max( 1, height / 2 );
+		level.scan_width = level.width * pixel_size_;
+		level.data.resize( size_t( level.scan_width ) * level.height );
+		BYTE * dst = level.data.data();
+
+		#pragma omp parallel for schedule( static )
+		for ( int y = 0; y < level.height; ++y )
+		{
+			// the last row and column of the odd sizes are repeated
+			const BYTE * row0 = src + min( height - 1, 2 * y ) * scan_width;
+			const BYTE * row1 = src + min( height - 1, 2 * y + 1 ) * scan_width;
+			BYTE * out = dst + y * level.scan_width;
+
+			for ( int x = 0; x < level.width; ++x, out += pixel_size_ )
+			{
+				const int xa = min( width - 1, 2 * x ) * pixel_size_;
+				const int xb = min( width - 1, 2 * x + 1 ) * pixel_size_;
+				const BYTE * p[4] = { row0 + xa, row0 + xb, row1 + xa, row1 + xb };
+
+				if ( hdr )
+				{
+					for ( int c = 0; c < 3; ++c )
+					{
+						float sum = 0.0f;
+						for ( int i = 0; i < 4; ++i ) sum += reinterpret_cast<const float *>( p[i] )[c];
+						reinterpret_cast<float *>( out )[c] = 0.25f * sum;
+					}
+				}
+				else
+				{
+					for ( int c = 0; c < pixel_size_; ++c )
+					{
+						if ( c < srgb_channels )
+						{
+							const float linear = 0.25f * ( decode[p[0][c]] + decode[p[1][c]] + decode[p[2][c]] + decode[p[3][c]] );
+							out[c] = encode[static_cast<int>( linear * ( SRGB_LUT_SIZE - 1 ) + 0.5f )];
+						}
+						else
+						{
+							out[c] = static_cast<BYTE>( ( p[0][c] + p[1][c] + p[2][c] + p[3][c] + 2 ) / 4 );
+						}
+					}
+				}
+			}
+		}
+
+		bytes += level.data.size();
+		mips_.push_back( std::move( level ) );
+
+		width = mips_.back().width;
+		height = mips_.back().height;
+		scan_width = mips_.back().scan_width;
+		src = mips_.back().data.data();
+	}
+
+	// the tiled copies have to cover the new levels
+	if ( !tiled_.empty() )
+	{
+		BuildTiles();
+	}
+
+	memory_.Resize( resident_bytes() );
+
+	const auto t1 = std::chrono::high_resolution_clock::now();
+
+	printf( "Mipmaps (%d levels, %0.1f MB) built in %0.1f ms.\n", no_levels(), bytes / ( 1024.0f * 1024.0f ),
+		std::chrono::duration<float, std::milli>( t1 - t0 ).count() );
+}
+
+void Texture::Compress( const TextureCompression compression )
+{
+	if ( !data_ || compression == TextureCompression::NONE || compression_ != TextureCompression::NONE || pixel_size_ >= 12 )
+	{
+		return;
+	}
+
+	TRACE_SCOPE( "Texture compression" );
+
+	const auto t0 = std::chrono::high_resolution_clock::now();
+
+	const size_t raw_bytes = resident_bytes();
+	const bool bc1 = compression == TextureCompression::BC1;
+	// the channels of the gray images are the same byte
+	const int g = min( 1, pixel_size_ - 1 );
+	const int r = min( 2, pixel_size_ - 1 );
+	size_t no_texels = 0;
+
+	blocks_.resize( no_levels() );
+
+	for ( int level = 0; level < no_levels(); ++level )
+	{
+		const int width = this->width( level );
+		const int height = this->height( level );
+		const int scan_width = this->scan_width( level );
+		const int blocks_x = ( width + BC_BLOCK_SIZE - 1 ) / BC_BLOCK_SIZE;
+		const int blocks_y = ( height + BC_BLOCK_SIZE - 1 ) / BC_BLOCK_SIZE;
+		const BYTE * src = data( level );
+
+		blocks_[level].resize( size_t( blocks_x ) * blocks_y * BC_BLOCK_BYTES );
+		BYTE * dst = blocks_[level].data();
+
+		#pragma omp parallel for schedule( dynamic, 4 )
+		for ( int by = 0; by < blocks_y; ++by )
+		{
+			BYTE texels[16 * 3];
+
+			for ( int bx = 0; bx < blocks_x; ++bx )
+			{
+				// the last row and column of the partial blocks are repeated
+				for ( int i = 0; i < 16; ++i )
+				{
+					const int x = min( width - 1, bx * BC_BLOCK_SIZE + i % BC_BLOCK_SIZE );
+					const int y = min( height - 1, by * BC_BLOCK_SIZE + i / BC_BLOCK_SIZE );
+					const BYTE * p = src + size_t( y ) * scan_width + x * pixel_size_;
+
+					if ( bc1 )
+					{
+						texels[3 * i] = p[0];
+						texels[3 * i + 1] = p[g];
+						texels[3 * i + 2] = p[r];
+					}
+					else
+					{
+						texels[i] = p[r];
+					}
+				}
+
+				BYTE * block = dst + ( size_t( by ) * blocks_x + bx ) * BC_BLOCK_BYTES;
+
+				if ( bc1 )
+				{
+					EncodeBC1( texels, block );
+				}
+				else
+				{
+					EncodeBC4( texels, block );
+				}
+			}
+		}
+
+		no_texels += size_t( width ) * height;
+	}
+
+	const auto t1 = std::chrono::high_resolution_clock::now();
+
+	compression_ = compression;
+
+	// error of the first level against the texels
+	double squared_error = 0.0;
+
+	#pragma omp parallel for reduction( +: squared_error ) schedule( static )
+	for ( int y = 0; y < height_; ++y )
+	{
+		for ( int x = 0; x < width_; ++x )
+		{
+			const BYTE * p = data_ + size_t( y ) * scan_width_ + x * pixel_size_;
+			BYTE bgr[3];
+			FetchBlockTexel( 0, x, y, bgr );
+
+			if ( bc1 )
+			{
+				squared_error += sqr( double( bgr[0] - p[0] ) ) + sqr( double( bgr[1] - p[g] ) ) + sqr( double( bgr[2] - p[r] ) );
+			}
+			else
+			{
+				squared_error += sqr( double( bgr[2] - p[r] ) );
+			}
+		}
+	}
+
+	const double mse = squared_error / ( double( width_ ) * height_ * ( bc1 ? 3 : 1 ) );
+	const double psnr = ( mse > 0.0 ) ? 10.0 * log10( 255.0 * 255.0 / mse ) : 99.0;
+
+	memory_.Resize( resident_bytes() ); // the blocks and the texels peak together
+
+	delete[] data_;
+	data_ = nullptr;
+
+	for ( MipLevel & level : mips_ )
+	{
+		std::vector<BYTE>().swap( level.data );
+	}
+
+	// the blocks keep the 4x4 texel locality themselves
+	std::vector<TiledLevel>().swap( tiled_ );
+	layout_ = TexelLayout::ROW_MAJOR;
+
+	const size_t compressed_bytes = resident_bytes();
+	memory_.Resize( compressed_bytes );
+	const double seconds = std::chrono::duration<double>( t1 - t0 ).count();
+
+	printf( "Texture '%s' %s: %d levels, %0.1f MB -> %0.2f MB (%0.1f:1), encoded at %0.1f Mtexels/s on %d threads, PSNR %0.1f dB.\n",
+		file_name_.c_str(), bc1 ? "BC1" : "BC4", no_levels(), raw_bytes / ( 1024.0 * 1024.0 ), compressed_bytes / ( 1024.0 * 1024.0 ),
+		double( raw_bytes ) / max( size_t( 1 ), compressed_bytes ), no_texels * 1e-6 / max( seconds, 1e-9 ), omp_get_max_threads(), psnr );
+}
+
+TextureCompression Texture::compression() const
+{
+	return compression_;
+}
+
+void Texture::DecodeLevel( const int level, BYTE * rgba ) const
+{
+	const int width = this->width( level );
+	const int height = this->height( level );
+
+	if ( compression_ == TextureCompression::NONE )
+	{
+		#pragma omp parallel for schedule( static )
+		for ( int y = 0; y < height; ++y )
+		{
+			SwizzleBgr8ToRgba8( data( level ) + size_t( y ) * scan_width( level ), pixel_size_, width, rgba + size_t( y ) * width * 4 );
+		}
+
+		return;
+	}
+
+	const int blocks_x = ( width + BC_BLOCK_SIZE - 1 ) / BC_BLOCK_SIZE;
+	const int blocks_y = ( height + BC_BLOCK_SIZE - 1 ) / BC_BLOCK_SIZE;
+
+	#pragma omp parallel for schedule( static )
+	for ( int by = 0; by < blocks_y; ++by )
+	{
+		BYTE texels[16 * 3];
+		BYTE values[16];
+
+		for ( int bx = 0; bx < blocks_x; ++bx )
+		{
+			const BYTE * block = blocks_[level].data() + ( size_t( by ) * blocks_x + bx ) * BC_BLOCK_BYTES;
+
+			if ( compression_ == TextureCompression::BC1 )
+			{
+				DecodeBC1( block, texels );
+			}
+			else
+			{
+				DecodeBC4( block, values );
+
+				for ( int i = 0; i < 16; ++i )
+				{
+					texels[3 * i] = texels[3 * i + 1] = texels[3 * i + 2] = values[i];
+				}
+			}
+
+			for ( int i = 0; i < 16; ++i )
+			{
+				const int x = bx * BC_BLOCK_SIZE + i % BC_BLOCK_SIZE;
+				const int y = by * BC_BLOCK_SIZE + i / BC_BLOCK_SIZE;
+
+				if ( x < width && y < height )
+				{
+					BYTE * out = rgba + ( size_t( y ) * width + x ) * 4;
+					out[0] = texels[3 * i + 2];
+					out[1] = texels[3 * i + 1];
+					out[2] = texels[3 * i];
+					out[3] = 255;
+				}
+			}
+		}
+	}
+}
+
+void Texture::ReportLod( const bool linearize, const int spp ) const
+{
+	if ( !data_ || spp <= 0 )
+	{
+		return;
+	}
+
+	// camera one unit above an infinite plane tiled by the texture every four units, looking slightly down to the horizon
+	const int image_width = 512;
+	const int image_height = 256;
+	const float focal_length = image_height * 0.5f / tanf( float( M_PI ) / 6.0f );
+	const float pitch = float( M_PI ) / 12.0f;
+	const float tiling = 0.25f;
+	const int reference_spp = 64;
+
+	std::mt19937 generator( 0 );
+	std::uniform_real_distribution<float> uniform( 0.0f, 1.0f );
+
+	struct Fetch { float u, v, lod; };
+
+	// texture coordinates and the ray cone lod of a jittered camera ray, false for the rays missing the plane
+	auto fetch = [&]( const int px, const int py, Fetch & f )
+	{
+		const float dx = px + uniform( generator ) - image_width * 0.5f;
+		const float dy = image_height * 0.5f - py - uniform( generator );
+		const float dz = -focal_length;
+		const float inv_length = 1.0f / sqrtf( dx * dx + dy * dy + dz * dz );
+		// pitch rotation around the x axis
+		const float y = ( dy * cosf( pitch ) + dz * sinf( pitch ) ) * inv_length;
+		const float z = ( -dy * sinf( pitch ) + dz * cosf( pitch ) ) * inv_length;
+		const float x = dx * inv_length;
+
+		if ( y >= -1e-3f )
+		{
+			return false;
+		}
+
+		const float t = 1.0f / -y;
+		const float u = t * x * tiling;
+		const float v = t * z * tiling;
+
+		f.u = u - floorf( u );
+		f.v = v - floorf( v );
+		f.lod = TextureLod( RayConeFootprint( t / focal_length, y, tiling ), width_, height_ );
+
+		return true;
+	};
+
+	auto luminance = []( const Color3f & c ) { return 0.2126f * c.r + 0.7152f * c.g + 0.0722f * c.b; };
+
+	// supersampled finest level as the reference
+	std::vector<float> reference( image_width * image_height, -1.0f );
+
+	for ( int py = 0; py < image_height; ++py )
+	{
+		for ( int px = 0; px < image_width; ++px )
+		{
+			double sum = 0.0;
+			int hits = 0;
+			Fetch f;
+
+			for ( int s = 0; s < reference_spp; ++s )
+			{
+				if ( fetch( px, py, f ) )
+				{
+					sum += luminance( texel( f.u, f.v, linearize ) );
+					++hits;
+				}
+			}
+
+			if ( hits > 0 ) reference[py * image_width + px] = static_cast<float>( sum / hits );
+		}
+	}
+
+	// renders the plane at spp with or without the lod, counts the distinct cache lines of the nearest texels of the finer level
+	auto render = [&]( const bool use_lod, std::vector<float> & image, std::unordered_set<size_t> & lines, double & ns, size_t & no_fetches )
+	{
+		std::vector<Fetch> fetches;
+		std::vector<int> pixels;
+
+		for ( int py = 0; py < image_height; ++py )
+		{
+			for ( int px = 0; px < image_width; ++px )
+			{
+				Fetch f;
+
+				for ( int s = 0; s < spp; ++s )
+				{
+					if ( fetch( px, py, f ) )
+					{
+						if ( !use_lod ) f.lod = 0.0f;
+						fetches.push_back( f );
+						pixels.push_back( py * image_width + px );
+					}
+				}
+			}
+		}
+
+		for ( const Fetch & f : fetches )
+		{
+			const int level = min( no_levels() - 1, int( f.lod ) );
+			const int x = min( width( level ) - 1, int( f.u * width( level ) ) );
+			const int y = min( height( level ) - 1, int( f.v * height( level ) ) );
+			lines.insert( reinterpret_cast<size_t>( data( level ) + y * scan_width( level ) + x * pixel_size_ ) >> 6 );
+		}
+
+		image.assign( image_width * image_height, 0.0f );
+		std::vector<int> counts( image_width * image_height, 0 );
+
+		const auto t0 = std::chrono::high_resolution_clock::now();
+
+		for ( size_t i = 0; i < fetches.size(); ++i )
+		{
+			image[pixels[i]] += luminance( texel( fetches[i].u, fetches[i].v, linearize, fetches[i].lod ) );
+			++counts[pixels[i]];
+		}
+
+		const auto t1 = std::chrono::high_resolution_clock::now();
+
+		for ( int i = 0; i < image_width * image_height; ++i )
+		{
+			image[i] = ( counts[i] > 0 ) ? image[i] / counts[i] : -1.0f;
+		}
+
+		ns += std::chrono::duration<double, std::nano>( t1 - t0 ).count();
+		no_fetches += fetches.size();
+	};
+
+	printf( "Texture LOD (%d x %d px, %d levels), %d x %d px ground plane, %d spp:\n", width_, height_, no_levels(),
+		image_width, image_height, spp );
+
+	for ( int use_lod = 0; use_lod <= 1; ++use_lod )
+	{
+		// the noise is the difference of two independent renders, the bias is the error of their mean to the reference
+		std::vector<float> image_a, image_b;
+		std::unordered_set<size_t> lines;
+		double ns = 0.0;
+		size_t no_fetches = 0;
+
+		render( use_lod != 0, image_a, lines, ns, no_fetches );
+		render( use_lod != 0, image_b, lines, ns, no_fetches );
+
+		double sqr_noise = 0.0, sqr_bias = 0.0;
+		int no_pixels = 0;
+
+		for ( int i = 0; i < image_width * image_height; ++i )
+		{
+			if ( image_a[i] >= 0.0f && image_b[i] >= 0.0f && reference[i] >= 0.0f )
+			{
+				const double d = image_a[i] - image_b[i];
+				const double e = 0.5 * ( image_a[i] + image_b[i] ) - reference[i];
+				sqr_noise += 0.5 * d * d;
+				sqr_bias += e * e;
+				++no_pixels;
+			}
+		}
+
+		no_pixels = max( 1, no_pixels );
+
+		printf( "  %s: %0.2f MB of distinct cache lines, %0.1f ns/fetch, noise %0.4f, RMS difference to the %d spp finest level %0.4f\n",
+			use_lod ? "ray cone LOD" : "finest level", lines.size() * 64.0 / ( 1024.0 * 1024.0 ),
+			( no_fetches > 0 ) ? ns / no_fetches : 0.0, sqrt( sqr_noise / no_pixels ), reference_spp, sqrt( sqr_bias / no_pixels ) );
+	}
+}
@@ -3,10 +3,31 @@
 
 #include "freeimage.h"
 #include "structs.h"
+#include "memoryaccounting.h"
+
+/* the tiled layout stores 2^TEXTURE_TILE_BITS x 2^TEXTURE_TILE_BITS texel tiles, the texels of a tile are in the Z-order */
+#define TEXTURE_TILE_BITS 4
+
+/* memory layout of the texels sampled by Texture::texel, the mip levels and getData stay row-major for the upload */
+enum class TexelLayout : int
+{
+	ROW_MAJOR = 0,
+	TILED = 1
+};
+
+/* block compressed storage of the texels, BC1 for the colors and BC4 for the single channel maps ( the red channel ) */
+enum class TextureCompression : int
+{
+	NONE = 0,
+	BC1 = 1,
+	BC4 = 2
+};
 
 /*! \class Texture
 \brief Single texture stored in original byte format (srgb is expected).
 
+The 8-bit gray images keep a single byte per texel, the other byte images are stored as BGR or BGRA.
+
 \author Tom Fabin
 \version 0.95
 \date 2012-2018
@@ -17,19 +38,97 @@ public:
 	Texture( const char * file_name );
 	~Texture();
 
-	/* returns interpolated texel in linear format */
-	Color3f texel( const float u, const float v, const bool linearize ) const;
+	/* returns interpolated texel in linear format, a positive lod blends the two nearest mip levels */
+	Color3f texel( const float u, const float v, const bool linearize, const float lod = 0.0f ) const;
+	/* samples count texture coordinates at once, the taps of the following samples are prefetched */
+	void texels( const Coord2f * uv, const int count, const bool linearize, Color3f * out, const float lod = 0.0f ) const;
+
+	/* the tiled copy of all levels is built on the first switch, it needs about the same memory as the row-major data */
+	void SetLayout( const TexelLayout layout );
+	TexelLayout layout() const;
+	/* prints the random and the rotated minified sampling speed of both layouts */
+	void ReportLayouts( const int no_samples = 1 << 21 );
+
+	/* builds the mip pyramid with a 2x2 box filter, the colors of srgb textures are averaged in the linear space,
+	the rows of each level are filtered in parallel */
+	void BuildMipmaps( const bool srgb );
+	/* prints the fetched bytes, the time and the noise of a textured ground plane with and without the ray cone LOD at equal spp */
+	void ReportLod( const bool linearize, const int spp = 4 ) const;
 
 	int width() const;
 	int height() const;
+	int pixel_size() const; // 12 bytes for float (HDR) images
 	int scan_width_{ 0 }; // size of image row (bytes)
 	BYTE * getData();
+
+	int no_levels() const; // one without the mip pyramid
+	int width( const int level ) const;
+	int height( const int level ) const;
+	int scan_width( const int level ) const;
+	const BYTE * data( const int level ) const;
+
+	/* encodes all levels to 4x4 blocks in parallel and releases the texels, build the mip pyramid before,
+	the float textures stay uncompressed, prints the compression ratio, the encode speed and the PSNR of the first level */
+	void Compress( const TextureCompression compression );
+	TextureCompression compression() const;
+	/* writes the level as RGBA bytes with width( level ) texels per row, the blocks are decoded in parallel */
+	void DecodeLevel( const int level, BYTE * rgba ) const;
+
+	/* releases the image data of all levels, the size and the format stay valid */
+	void Unload();
+	/* decodes the file again after Unload including the mip pyramid and the tiled copy the texture had before */
+	bool Reload();
+	bool resident() const;
+	size_t resident_bytes() const; // all levels and the tiled copy, zero after Unload
+	/* the data stays resident while any TexturePin holds the texture, only the holder of the pin may read the texels without the lock of TextureCache */
+	bool pinned() const;
+	const std::string & file_name() const;
 private:	
 	int width_{ 0 }; // image width (px)
 	int height_{ 0 }; // image height (px)
 	int pixel_size_{ 0 }; // size of each pixel (bytes)
 
-	BYTE * data_{ nullptr }; // image data in BGR format
+	BYTE * data_{ nullptr }; // image data in BGR format, float BGR for HDR images
+	std::string file_name_;
+	bool mipmapped_{ false }; // BuildMipmaps was called, with the mip_srgb_ argument
+	bool mip_srgb_{ false };
+
+	TextureCompression compression_{ TextureCompression::NONE };
+	std::vector<std::vector<BYTE>> blocks_; // all levels of the compressed texture, the rows of the blocks are stored row-major
+
+	struct MipLevel
+	{
+		int width;
+		int height;
+		int scan_width; // bytes
+		std::vector<BYTE> data; // the same format as data_
+	};
+
+	std::vector<MipLevel> mips_; // levels 1 and coarser, level 0 is data_
+
+	struct TiledLevel
+	{
+		int tiles_x; // number of tiles in a row
+		std::vector<BYTE> data;
+	};
+
+	TexelLayout layout_{ TexelLayout::ROW_MAJOR };
+	std::vector<TiledLevel> tiled_; // all levels including the first one, empty until the tiled layout is used
+
+	MemoryCharge memory_{ MemoryTag::TEXTURES }; // resident_bytes, updated by every change of the data
+	std::atomic<int> pins_{ 0 }; // changed by TextureCache under its lock
+	friend class TextureCache;
+
+	void Decode();
+	void BuildTiles();
+	/* the address of the texel ( x, y ) is LevelData + RowOffset( y ) + ColumnOffset( x ) in both layouts,
+	the Z-order interleaves the bits of x and y so it splits to the two parts as well */
+	const BYTE * LevelData( const int level ) const;
+	size_t RowOffset( const int level, const int y ) const;
+	size_t ColumnOffset( const int x ) const;
+	/* BGR bytes of the texel of the compressed level */
+	void FetchBlockTexel( const int level, const int x, const int y, BYTE * bgr ) const;
+	Color3f Bilinear( const int level, const float u, const float v, const bool linearize ) const;
 
 	Texture( const Texture & ) = delete;
 	Texture & operator=( const Texture & ) = delete;
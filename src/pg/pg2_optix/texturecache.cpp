@@ -0,0 +1,407 @@
+#include "pch.h"
+#include "texturecache.h"
+#include "utils.h"
+#include "mymath.h"
+#include "trace.h"
+
+/* decoded image data of the first level */
+static size_t TextureBytes( Texture * texture )
+{
+	return ( texture && texture->getData() ) ? size_t( texture->scan_width_ ) * texture->height() : 0;
+}
+
+TextureCache & TextureCache::Instance()
+{
+	static TextureCache cache;
+
+	return cache;
+}
+
+TextureCache::~TextureCache()
+{
+	Clear();
+}
+
+Texture * TextureCache::Load( const std::string & file_name )
+{
+	TRACE_SCOPE( "TextureCache::Load" );
+
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		++requests_;
+
+		auto texture = by_name_.find( file_name );
+
+		if ( texture != by_name_.end() )
+		{
+			++name_hits_;
+			saved_bytes_ += TextureBytes( texture->second );
+
+			return texture->second;
+		}
+	}
+
+	// the content hash finds the same image under another path
+	std::vector<BYTE> content;
+	FILE * file = fopen( file_name.c_str(), "rb" );
+
+	if ( file )
+	{
+		content.resize( static_cast<size_t>( max( 0LL, GetFileSize64( file_name.c_str() ) ) ) );
+		content.resize( fread( content.data(), 1, content.size(), file ) );
+		fclose( file );
+	}
+
+	const auto t0 = std::chrono::high_resolution_clock::now();
+	const unsigned long long hash = FastHash( content.data(), content.size() );
+	const auto t1 = std::chrono::high_resolution_clock::now();
+
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		hashed_bytes_ += content.size();
+		hash_seconds_ += std::chrono::duration<double>( t1 - t0 ).count();
+
+		auto texture = by_hash_.find( hash );
+
+		if ( !content.empty() && texture != by_hash_.end() )
+		{
+			++content_hits_;
+			saved_bytes_ += TextureBytes( texture->second );
+			by_name_[file_name] = texture->second;
+
+			return texture->second;
+		}
+	}
+
+	Texture * texture = new Texture( file_name.c_str() );
+
+	std::lock_guard<std::mutex> lock( mutex_ );
+
+	if ( content.empty() || !texture->getData() )
+	{
+		// the materials keep the empty texture the same way as before, it is not shared by the content
+		invalid_.push_back( texture );
+		by_name_[file_name] = texture;
+
+		return texture;
+	}
+
+	auto loaded = by_hash_.find( hash );
+
+	if ( loaded != by_hash_.end() )
+	{
+		// another thread decoded the same content meanwhile
+		delete texture;
+		++content_hits_;
+		saved_bytes_ += TextureBytes( loaded->second );
+		by_name_[file_name] = loaded->second;
+
+		return loaded->second;
+	}
+
+	by_hash_[hash] = texture;
+	by_name_[file_name] = texture;
+	decoded_bytes_ += TextureBytes( texture );
+	++residency_misses_;
+	MakeResident( texture );
+	Evict( texture );
+
+	return texture;
+}
+
+Texture * TextureCache::Acquire( Texture * texture )
+{
+	if ( !texture )
+	{
+		return nullptr;
+	}
+
+	std::lock_guard<std::mutex> lock( mutex_ );
+
+	const bool resident = resident_.find( texture ) != resident_.end();
+
+	if ( !resident && evicted_.find( texture ) == evicted_.end() )
+	{
+		return texture; // not loaded by the registry or the file could not be decoded
+	}
+
+	++residency_requests_;
+
+	if ( !resident )
+	{
+		// decoded inside the lock, the other threads rather wait than decode the same file
+		++residency_misses_;
+
+		if ( !texture->Reload() )
+		{
+			return texture;
+		}
+
+		evicted_.erase( texture );
+	}
+
+	MakeResident( texture );
+	Evict( texture );
+
+	return texture;
+}
+
+Texture * TextureCache::Pin( Texture * texture )
+{
+	if ( !texture )
+	{
+		return nullptr;
+	}
+
+	// pinned before it is made resident, so Acquire does not evict it again over the budget
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		texture->pins_.fetch_add( 1, std::memory_order_release );
+	}
+
+	return Acquire( texture );
+}
+
+void TextureCache::Unpin( Texture * texture )
+{
+	if ( !texture )
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock( mutex_ );
+
+	if ( texture->pins_.fetch_sub( 1, std::memory_order_release ) == 1 )
+	{
+		Evict( nullptr );
+	}
+}
+
+void TextureCache::MakeResident( Texture * texture )
+{
+	const size_t bytes = texture->resident_bytes();
+	auto resident = resident_.find( texture );
+
+	if ( resident == resident_.end() )
+	{
+		lru_.push_front( texture );
+		resident_[texture] = Resident{ lru_.begin(), bytes };
+		resident_bytes_ += bytes;
+	}
+	else
+	{
+		// the mip pyramid or the tiled copy may have been built since the last use
+		lru_.splice( lru_.begin(), lru_, resident->second.position );
+		resident_bytes_ += bytes - resident->second.bytes;
+		resident->second.bytes = bytes;
+	}
+
+	peak_resident_bytes_ = max( peak_resident_bytes_, resident_bytes_ );
+}
+
+void TextureCache::Evict( const Texture * keep )
+{
+	auto position = lru_.end();
+
+	while ( budget_ > 0 && resident_bytes_ > budget_ && position != lru_.begin() )
+	{
+		Texture * texture = *--position;
+
+		if ( texture == keep || texture->pinned() )
+		{
+			continue;
+		}
+
+		resident_bytes_ -= resident_[texture].bytes;
+		resident_.erase( texture );
+		position = lru_.erase( position );
+
+		texture->Unload();
+		evicted_.insert( texture );
+		++evictions_;
+	}
+}
+
+void TextureCache::set_budget( const size_t bytes )
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+
+	budget_ = bytes;
+
+	if ( !lru_.empty() )
+	{
+		Evict( lru_.front() );
+	}
+}
+
+size_t TextureCache::budget() const
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+
+	return budget_;
+}
+
+size_t TextureCache::resident_bytes() const
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+
+	return resident_bytes_;
+}
+
+std::shared_future<Texture *> TextureCache::LoadAsync( const std::string & file_name )
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+
+	auto pending = pending_.find( file_name );
+
+	if ( pending != pending_.end() )
+	{
+		++requests_;
+		++name_hits_;
+
+		return pending->second;
+	}
+
+	if ( !pool_ )
+	{
+		// the calling thread keeps parsing the scene meanwhile
+		pool_.reset( new ThreadPool( max( 1, static_cast<int>( std::thread::hardware_concurrency() ) - 1 ) ) );
+	}
+
+	std::shared_future<Texture *> texture = pool_->Submit( [this, file_name]()
+	{
+		const auto t0 = std::chrono::high_resolution_clock::now();
+		Texture * texture = Load( file_name );
+		const auto t1 = std::chrono::high_resolution_clock::now();
+
+		std::lock_guard<std::mutex> lock( mutex_ );
+		decode_seconds_ += std::chrono::duration<double>( t1 - t0 ).count();
+
+		return texture;
+	} ).share();
+
+	pending_[file_name] = texture;
+
+	return texture;
+}
+
+double TextureCache::decode_seconds() const
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+
+	return decode_seconds_;
+}
+
+int TextureCache::no_decode_threads() const
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+
+	return ( pool_ ) ? pool_->no_threads() : 0;
+}
+
+void TextureCache::Report( const bool hash_benchmark ) const
+{
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+
+		const int hits = name_hits_ + content_hits_;
+
+		printf( "Texture cache: %d requests, %d path hits, %d content hits (hit rate %0.1f %%), %d unique textures.\n",
+			requests_, name_hits_, content_hits_, ( requests_ > 0 ) ? 100.0 * hits / requests_ : 0.0, static_cast<int>( by_hash_.size() ) );
+		printf( "Texture cache: %0.1f MB decoded, %0.1f MB not decoded again, %0.1f MB of files hashed at %0.2f GB/s.\n",
+			decoded_bytes_ / ( 1024.0 * 1024.0 ), saved_bytes_ / ( 1024.0 * 1024.0 ), hashed_bytes_ / ( 1024.0 * 1024.0 ),
+			( hash_seconds_ > 0.0 ) ? hashed_bytes_ * 1e-9 / hash_seconds_ : 0.0 );
+		printf( "Texture residency: %d requests, %d misses, %d evictions, %d of %d textures resident, %0.1f MB (peak %0.1f MB) of %0.1f MB budget.\n",
+			residency_requests_, residency_misses_, evictions_, static_cast<int>( resident_.size() ), static_cast<int>( by_hash_.size() ),
+			resident_bytes_ / ( 1024.0 * 1024.0 ), peak_resident_bytes_ / ( 1024.0 * 1024.0 ), budget_ / ( 1024.0 * 1024.0 ) );
+	}
+
+	if ( !hash_benchmark )
+	{
+		return;
+	}
+
+	// hash speed on a buffer larger than the caches
+	std::vector<BYTE> buffer( 64 << 20 );
+
+	for ( size_t i = 0; i < buffer.size(); ++i )
+	{
+		buffer[i] = static_cast<BYTE>( ( i * 2654435761u ) >> 13 );
+	}
+
+	const auto t0 = std::chrono::high_resolution_clock::now();
+	const unsigned long long quick = QuickHash( buffer.data(), buffer.size() );
+	const auto t1 = std::chrono::high_resolution_clock::now();
+	const unsigned long long fast = FastHash( buffer.data(), buffer.size() );
+	const auto t2 = std::chrono::high_resolution_clock::now();
+
+	const double gb = buffer.size() * 1e-9;
+
+	printf( "Hash speed: FastHash %0.2f GB/s, QuickHash %0.2f GB/s (%llx, %llx).\n",
+		gb / std::chrono::duration<double>( t2 - t1 ).count(), gb / std::chrono::duration<double>( t1 - t0 ).count(), fast, quick );
+}
+
+void TextureCache::Clear()
+{
+	std::map<std::string, std::shared_future<Texture *>> pending;
+
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		pending.swap( pending_ );
+	}
+
+	// the queued loads lock the registry when they finish
+	for ( auto & texture : pending )
+	{
+		texture.second.wait();
+	}
+
+	std::lock_guard<std::mutex> lock( mutex_ );
+
+	for ( auto & texture : by_hash_ )
+	{
+		delete texture.second;
+	}
+
+	for ( auto texture : invalid_ )
+	{
+		delete texture;
+	}
+
+	by_hash_.clear();
+	by_name_.clear();
+	invalid_.clear();
+	lru_.clear();
+	resident_.clear();
+	evicted_.clear();
+	resident_bytes_ = 0;
+}
+
+TexturePin::TexturePin( Texture * texture ) : texture_( TextureCache::Instance().Pin( texture ) )
+{
+}
+
+TexturePin::TexturePin( TexturePin && other ) : texture_( other.texture_ )
+{
+	other.texture_ = nullptr;
+}
+
+TexturePin::~TexturePin()
+{
+	TextureCache::Instance().Unpin( texture_ );
+}
+
+Texture * TexturePin::get() const
+{
+	return texture_;
+}
+
+Texture * TexturePin::operator->() const
+{
+	return texture_;
+}
+
+TexturePin::operator bool() const
+{
+	return texture_ != nullptr;
+}
@@ -0,0 +1,119 @@
+#ifndef TEXTURE_CACHE_H_
+#define TEXTURE_CACHE_H_
+
+#include "texture.h"
+#include "threadpool.h"
+
+/*! \class TextureCache
+\brief Process-wide registry of the loaded textures.
+
+The textures are keyed by the hash of the image file content, so the same image referenced from
+several MTL libraries, materials or scenes, even under different paths, is decoded only once.
+The registry owns the textures, they live until Clear is called. Their decoded image data is kept under
+a memory budget, the least recently used textures release the data and decode the file again when acquired.
+The pinned textures are never evicted, the budget may be exceeded while they are pinned.
+*/
+class TextureCache
+{
+public:
+	static TextureCache & Instance();
+
+	/* returns the shared texture with the content of the file, a texture without data when the file can not be read,
+	the file is decoded outside the lock so several threads may load different files at once */
+	Texture * Load( const std::string & file_name );
+	/* queues the decoding of the file on the worker threads and returns at once, the same file requested again
+	while it is still being decoded gets the same future */
+	std::shared_future<Texture *> LoadAsync( const std::string & file_name );
+
+	/* makes an evicted texture resident again and marks it as the most recently used one, the other textures
+	may be evicted to keep the budget, so their data must not be used while another thread acquires a texture,
+	the textures not loaded by the registry are returned as they are */
+	Texture * Acquire( Texture * texture );
+	/* acquires the texture and keeps it resident until the matching Unpin, the pins are counted, see TexturePin */
+	Texture * Pin( Texture * texture );
+	/* the last unpin lets the texture be evicted again, the textures over the budget are evicted at once */
+	void Unpin( Texture * texture );
+	/* limits the decoded image data of all textures including the mip levels, zero means no limit */
+	void set_budget( const size_t bytes );
+	size_t budget() const;
+	size_t resident_bytes() const;
+
+	/* time spent by loading the textures summed over all threads, it keeps growing over the scenes */
+	double decode_seconds() const;
+	int no_decode_threads() const;
+
+	/* prints the hit rates and the memory saved by the sharing, optionally compares the speed of FastHash and QuickHash */
+	void Report( const bool hash_benchmark = false ) const;
+	/* waits for the queued loads and deletes all textures, the pointers returned by Load become invalid */
+	void Clear();
+
+	~TextureCache();
+
+private:
+	TextureCache() = default;
+	TextureCache( const TextureCache & ) = delete;
+	TextureCache & operator=( const TextureCache & ) = delete;
+
+	mutable std::mutex mutex_;
+	std::map<std::string, Texture *> by_name_; // file names already seen, they are not hashed again
+	std::map<unsigned long long, Texture *> by_hash_; // owns the textures
+	std::vector<Texture *> invalid_; // the files that could not be decoded, kept to be deleted by Clear
+	std::map<std::string, std::shared_future<Texture *>> pending_; // loads queued by LoadAsync
+	std::unique_ptr<ThreadPool> pool_; // created by the first LoadAsync
+
+	struct Resident
+	{
+		std::list<Texture *>::iterator position; // in lru_
+		size_t bytes; // resident_bytes of the texture when it was used last time
+	};
+
+	std::list<Texture *> lru_; // the resident textures, the most recently used first
+	std::map<Texture *, Resident> resident_;
+	std::set<Texture *> evicted_; // the textures that can be decoded again
+	size_t budget_{ size_t( 1024 ) << 20 };
+	size_t resident_bytes_{ 0 };
+	size_t peak_resident_bytes_{ 0 };
+	int residency_requests_{ 0 };
+	int residency_misses_{ 0 }; // files decoded, the first loads and the reloads after the eviction
+	int evictions_{ 0 };
+
+	/* the mutex has to be locked */
+	void MakeResident( Texture * texture );
+	/* evicts the least recently used textures over the budget except the kept and the pinned ones */
+	void Evict( const Texture * keep );
+
+	int requests_{ 0 };
+	int name_hits_{ 0 };
+	int content_hits_{ 0 };
+	size_t decoded_bytes_{ 0 }; // decoded image data of the unique textures
+	size_t saved_bytes_{ 0 }; // decoded image data of the textures shared instead of loaded again
+	size_t hashed_bytes_{ 0 };
+	double hash_seconds_{ 0.0 };
+	double decode_seconds_{ 0.0 };
+};
+
+/*! \class TexturePin
+\brief Keeps the texture resident from the construction to the destruction, the texels are read without locking the cache.
+
+Pin the textures once per frame or per use, e.g. for the lifetime of the ReferenceTracer, not per texel.
+*/
+class TexturePin
+{
+public:
+	TexturePin( Texture * texture = nullptr );
+	TexturePin( TexturePin && other );
+	~TexturePin();
+
+	Texture * get() const;
+	Texture * operator->() const;
+	explicit operator bool() const;
+
+private:
+	Texture * texture_;
+
+	TexturePin( const TexturePin & ) = delete;
+	TexturePin & operator=( const TexturePin & ) = delete;
+	TexturePin & operator=( TexturePin && ) = delete;
+};
+
+#endif
@@ -0,0 +1,56 @@
+#include "pch.h"
+#include "threadpool.h"
+#include "trace.h"
+
+ThreadPool::ThreadPool( const int no_threads )
+{
+	for ( int i = 0; i < no_threads; ++i )
+	{
+		workers_.emplace_back( &ThreadPool::Worker, this );
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		stop_ = true;
+	}
+
+	condition_.notify_all();
+
+	for ( auto & worker : workers_ )
+	{
+		worker.join();
+	}
+}
+
+int ThreadPool::no_threads() const
+{
+	return static_cast<int>( workers_.size() );
+}
+
+void ThreadPool::Worker()
+{
+	TRACE_THREAD_NAME( "Thread pool" );
+
+	for ( ;; )
+	{
+		std::function<void()> task;
+
+		{
+			std::unique_lock<std::mutex> lock( mutex_ );
+			condition_.wait( lock, [this] { return stop_ || !tasks_.empty(); } );
+
+			if ( tasks_.empty() )
+			{
+				return; // stopped and drained
+			}
+
+			task = std::move( tasks_.front() );
+			tasks_.pop();
+		}
+
+		task();
+	}
+}
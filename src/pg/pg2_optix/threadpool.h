@@ -0,0 +1,48 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+/*! \class ThreadPool
+\brief Fixed set of worker threads running the submitted tasks in the order of submission.
+
+The destructor finishes all queued tasks before it joins the workers.
+*/
+class ThreadPool
+{
+public:
+	ThreadPool( const int no_threads );
+	~ThreadPool();
+
+	/* queues the task, the returned future holds its result or the exception it threw */
+	template <class F> auto Submit( F task ) -> std::future<decltype( task() )>
+	{
+		using R = decltype( task() );
+
+		auto packaged = std::make_shared<std::packaged_task<R()>>( std::move( task ) );
+		std::future<R> result = packaged->get_future();
+
+		{
+			std::lock_guard<std::mutex> lock( mutex_ );
+			tasks_.push( [packaged]() { ( *packaged )(); } );
+		}
+
+		condition_.notify_one();
+
+		return result;
+	}
+
+	int no_threads() const;
+
+private:
+	ThreadPool( const ThreadPool & ) = delete;
+	ThreadPool & operator=( const ThreadPool & ) = delete;
+
+	void Worker();
+
+	std::vector<std::thread> workers_;
+	std::queue<std::function<void()>> tasks_;
+	std::mutex mutex_;
+	std::condition_variable condition_;
+	bool stop_{ false };
+};
+
+#endif
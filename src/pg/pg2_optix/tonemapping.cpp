@@ -0,0 +1,168 @@
+#include "pch.h"
+#include "tonemapping.h"
+#include "structs.h"
+#include "mymath.h"
+
+#if defined( COLOR_KERNELS_AVX2 )
+#include <immintrin.h>
+#elif defined( COLOR_KERNELS_SSE2 )
+#include <emmintrin.h>
+#endif
+
+/* scalar versions of the operators, ACES is the fit of the RRT and ODT curves by K. Narkowicz */
+static inline float TonemapValue( const float x, const Tonemap tonemap )
+{
+	switch ( tonemap )
+	{
+	case Tonemap::REINHARD:
+		return x / ( 1.0f + x );
+
+	case Tonemap::ACES:
+		return ( x * ( 2.51f * x + 0.03f ) ) / ( x * ( 2.43f * x + 0.59f ) + 0.14f );
+
+	default:
+		return x;
+	}
+}
+
+Tonemapper::Tonemapper()
+{
+	Configure( Tonemap::CLAMP, 0.0f, 2.4f );
+}
+
+void Tonemapper::Configure( const Tonemap tonemap, const float exposure, const float gamma )
+{
+	tonemap_ = tonemap;
+	scale_ = powf( 2.0f, exposure );
+
+	if ( gamma != gamma_ )
+	{
+		gamma_ = gamma;
+		BuildSrgbEncodeTable( gamma_, lut_ );
+	}
+}
+
+void Tonemapper::ApplyRows( const optix::float4 * hdr, BYTE * rgba, const int width, const int y0, const int y1 ) const
+{
+	if ( tonemap_ == Tonemap::CLAMP && scale_ == 1.0f )
+	{
+		// the encoding clamps on its own
+		ConvertFloat4ToSrgb8( hdr + y0 * width, ( y1 - y0 ) * width, lut_, rgba + y0 * width * 4 );
+
+		return;
+	}
+
+	// the tonemapped row stays in the cache until it is encoded
+	thread_local std::vector<optix::float4> row;
+	row.resize( width );
+
+	for ( int y = y0; y < y1; ++y )
+	{
+		const optix::float4 * src = hdr + y * width;
+		int x = 0;
+
+#ifdef COLOR_KERNELS_SSE2
+		const __m128 scale = _mm_set1_ps( scale_ );
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps( 1.0f );
+		const __m128 a = _mm_set1_ps( 2.51f ), b = _mm_set1_ps( 0.03f );
+		const __m128 c = _mm_set1_ps( 2.43f ), d = _mm_set1_ps( 0.59f ), e = _mm_set1_ps( 0.14f );
+
+		for ( ; x < width; ++x )
+		{
+			__m128 v = _mm_max_ps( _mm_mul_ps( _mm_loadu_ps( &src[x].x ), scale ), zero );
+
+			if ( tonemap_ == Tonemap::REINHARD )
+			{
+				v = _mm_div_ps( v, _mm_add_ps( one, v ) );
+			}
+			else if ( tonemap_ == Tonemap::ACES )
+			{
+				v = _mm_div_ps( _mm_mul_ps( v, _mm_add_ps( _mm_mul_ps( a, v ), b ) ),
+					_mm_add_ps( _mm_mul_ps( v, _mm_add_ps( _mm_mul_ps( c, v ), d ) ), e ) );
+			}
+
+			_mm_storeu_ps( &row[x].x, v );
+		}
+#endif
+
+		for ( ; x < width; ++x )
+		{
+			row[x] = optix::make_float4( TonemapValue( max( 0.0f, src[x].x * scale_ ), tonemap_ ),
+				TonemapValue( max( 0.0f, src[x].y * scale_ ), tonemap_ ),
+				TonemapValue( max( 0.0f, src[x].z * scale_ ), tonemap_ ), 1.0f );
+		}
+
+		ConvertFloat4ToSrgb8( row.data(), width, lut_, rgba + y * width * 4 );
+	}
+}
+
+void Tonemapper::Apply( const optix::float4 * hdr, BYTE * rgba, const int width, const int height ) const
+{
+	#pragma omp parallel for schedule( static )
+	for ( int y = 0; y < height; ++y )
+	{
+		ApplyRows( hdr, rgba, width, y, y + 1 );
+	}
+}
+
+void Tonemapper::ApplyReference( const optix::float4 * hdr, BYTE * rgba, const int width, const int height ) const
+{
+	for ( int i = 0; i < width * height; ++i )
+	{
+		const float rgb[3] = { hdr[i].x, hdr[i].y, hdr[i].z };
+
+		for ( int j = 0; j < 3; ++j )
+		{
+			const float v = TonemapValue( max( 0.0f, rgb[j] * scale_ ), tonemap_ );
+			rgba[i * 4 + j] = static_cast<BYTE>( c_srgb( v, gamma_ ) * 255.0f + 0.5f );
+		}
+
+		rgba[i * 4 + 3] = 255;
+	}
+}
+
+void Tonemapper::Benchmark( const int width, const int height, const int no_frames ) const
+{
+	const int no_pixels = width * height;
+	std::vector<optix::float4> hdr( no_pixels );
+	std::vector<BYTE> reference( no_pixels * 4 );
+	std::vector<BYTE> rgba( no_pixels * 4 );
+
+	// radiance spanning several orders of magnitude
+	std::mt19937 generator( 0 );
+	std::uniform_real_distribution<float> uniform( -8.0f, 4.0f );
+
+	for ( auto & v : hdr )
+	{
+		v = optix::make_float4( powf( 2.0f, uniform( generator ) ), powf( 2.0f, uniform( generator ) ), powf( 2.0f, uniform( generator ) ), 1.0f );
+	}
+
+	auto time = [&]( auto && body )
+	{
+		const auto t0 = std::chrono::high_resolution_clock::now();
+
+		for ( int i = 0; i < no_frames; ++i )
+		{
+			body();
+		}
+
+		const auto t1 = std::chrono::high_resolution_clock::now();
+
+		return std::chrono::duration<double, std::milli>( t1 - t0 ).count() / no_frames;
+	};
+
+	const double t_reference = time( [&]() { ApplyReference( hdr.data(), reference.data(), width, height ); } );
+	const double t_single = time( [&]() { ApplyRows( hdr.data(), rgba.data(), width, 0, height ); } );
+	const double t_parallel = time( [&]() { Apply( hdr.data(), rgba.data(), width, height ); } );
+
+	int max_error = 0;
+
+	for ( int i = 0; i < no_pixels * 4; ++i )
+	{
+		max_error = max( max_error, abs( int( rgba[i] ) - int( reference[i] ) ) );
+	}
+
+	printf( "Tonemapping %d x %d px: powf %0.2f ms, LUT %0.2f ms, LUT parallel %0.2f ms/frame, max difference %d/255.\n",
+		width, height, t_reference, t_single, t_parallel, max_error );
+}
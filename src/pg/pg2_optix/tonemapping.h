@@ -0,0 +1,42 @@
+#ifndef TONEMAPPING_H_
+#define TONEMAPPING_H_
+
+#include <optixu/optixu_math_namespace.h>
+#include "colorkernels.h"
+
+/* operators compressing the linear radiance into the displayable range */
+enum class Tonemap : int { CLAMP = 0, REINHARD = 1, ACES = 2 };
+
+/*! \class Tonemapper
+\brief Converts the float radiance framebuffer to the 8-bit sRGB image shown in the window.
+
+The exposure and the tonemapping operator are evaluated four channels at a time with SSE,
+the sRGB encoding is done by ConvertFloat4ToSrgb8, the rows are split among the OpenMP threads.
+*/
+class Tonemapper
+{
+public:
+	Tonemapper();
+
+	/* the lookup table is rebuilt only when the gamma changes, exposure is in stops */
+	void Configure( const Tonemap tonemap, const float exposure, const float gamma );
+
+	/* tonemaps width x height RGBA pixels of linear radiance into RGBA bytes */
+	void Apply( const optix::float4 * hdr, BYTE * rgba, const int width, const int height ) const;
+
+	/* single pixel reference with powf, used by the benchmark to check the fast path */
+	void ApplyReference( const optix::float4 * hdr, BYTE * rgba, const int width, const int height ) const;
+
+	/* prints ms/frame of the reference, the single-threaded and the parallel path for the given resolution */
+	void Benchmark( const int width = 3840, const int height = 2160, const int no_frames = 10 ) const;
+
+private:
+	void ApplyRows( const optix::float4 * hdr, BYTE * rgba, const int width, const int y0, const int y1 ) const;
+
+	Tonemap tonemap_{ Tonemap::CLAMP };
+	float scale_{ 1.0f }; // 2^exposure
+	float gamma_{ 0.0f };
+	BYTE lut_[SRGB_ENCODE_TABLE_SIZE]; // sRGB bytes of the linear values i / ( SRGB_LUT_SIZE - 1 )
+};
+
+#endif
@@ -0,0 +1,198 @@
+#include "pch.h"
+#include "trace.h"
+#include "memoryaccounting.h"
+
+Tracer & Tracer::Instance()
+{
+	// never destroyed, the threads still running during the exit may record events
+	static Tracer * tracer = new Tracer();
+
+	return *tracer;
+}
+
+Tracer::Tracer() : t0_( std::chrono::high_resolution_clock::now() )
+{
+}
+
+void Tracer::set_enabled( const bool enabled )
+{
+	enabled_.store( enabled, std::memory_order_relaxed );
+}
+
+Tracer::ThreadBuffer * Tracer::Buffer()
+{
+	thread_local ThreadBuffer * buffer = nullptr;
+
+	if ( !buffer )
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+
+		buffers_.emplace_back();
+		buffer = &buffers_.back();
+		buffer->id = static_cast<int>( buffers_.size() );
+		buffer->head = buffer->tail = new Chunk();
+		buffer->no_chunks = 1;
+		MemoryAccounting::Instance().Allocate( MemoryTag::DIAGNOSTICS, MemoryDomain::HOST, sizeof( Chunk ) );
+	}
+
+	return buffer;
+}
+
+void Tracer::Record( const char * name, const char phase )
+{
+	const long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::high_resolution_clock::now() - t0_ ).count();
+	ThreadBuffer * buffer = Buffer();
+	Chunk * chunk = buffer->tail;
+	int count = chunk->count.load( std::memory_order_relaxed );
+
+	if ( count == kChunkEvents )
+	{
+		chunk = NextChunk( buffer );
+		count = 0;
+	}
+
+	chunk->events[count] = Event{ name, ns, phase };
+	chunk->count.store( count + 1, std::memory_order_release ); // the reader sees the event complete
+}
+
+Tracer::Chunk * Tracer::NextChunk( ThreadBuffer * buffer )
+{
+	Chunk * next = nullptr;
+
+	if ( buffer->no_chunks < kMaxChunks )
+	{
+		next = new Chunk();
+		++buffer->no_chunks;
+		MemoryAccounting::Instance().Allocate( MemoryTag::DIAGNOSTICS, MemoryDomain::HOST, sizeof( Chunk ) );
+	}
+	else
+	{
+		// Save reads the chunks under the lock, the oldest one is not reused while it is being written out
+		std::lock_guard<std::mutex> lock( mutex_ );
+
+		next = buffer->head;
+		buffer->head = next->next.load( std::memory_order_relaxed );
+		buffer->overwritten += next->count.load( std::memory_order_relaxed );
+		next->count.store( 0, std::memory_order_relaxed );
+		next->next.store( nullptr, std::memory_order_relaxed );
+	}
+
+	buffer->tail->next.store( next, std::memory_order_release );
+	buffer->tail = next;
+
+	return next;
+}
+
+void Tracer::NameThread( const char * name )
+{
+	Buffer()->name.store( name, std::memory_order_release );
+}
+
+/* the names are literals from the code, only the characters JSON needs escaped are expected */
+static void WriteJsonString( FILE * file, const char * s )
+{
+	fputc( '"', file );
+
+	for ( ; *s; ++s )
+	{
+		if ( *s == '"' || *s == '\\' )
+		{
+			fputc( '\\', file );
+		}
+
+		fputc( *s, file );
+	}
+
+	fputc( '"', file );
+}
+
+bool Tracer::Save( const std::string & file_name ) const
+{
+	FILE * file = fopen( file_name.c_str(), "wt" );
+
+	if ( !file )
+	{
+		printf( "Unable to open '%s'.\n", file_name.c_str() );
+
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock( mutex_ );
+
+	fprintf( file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+
+	const unsigned long pid = static_cast<unsigned long>( GetCurrentProcessId() );
+	const long long now = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::high_resolution_clock::now() - t0_ ).count();
+	size_t no_events = 0;
+	long long no_overwritten = 0;
+	bool first = true;
+
+	const auto write_event = [&]( const char * name, const char phase, const long long ns, const int tid )
+	{
+		fprintf( file, "%s{\"name\":", ( first ) ? "" : ",\n" );
+		WriteJsonString( file, name );
+		fprintf( file, ",\"ph\":\"%c\",\"ts\":%0.3f,\"pid\":%lu,\"tid\":%d}", phase, ns * 1e-3, pid, tid );
+		first = false;
+		++no_events;
+	};
+
+	for ( const auto & buffer : buffers_ )
+	{
+		const char * name = buffer.name.load( std::memory_order_acquire );
+
+		if ( name )
+		{
+			fprintf( file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%lu,\"tid\":%d,\"args\":{\"name\":", ( first ) ? "" : ",\n", pid, buffer.id );
+			WriteJsonString( file, name );
+			fprintf( file, "}}" );
+			first = false;
+		}
+
+		// the begins of the scopes open at this point of the buffer
+		std::vector<const char *> open;
+
+		// the owner thread may keep appending, only the events published by the counts are read
+		for ( const Chunk * chunk = buffer.head; chunk; chunk = chunk->next.load( std::memory_order_acquire ) )
+		{
+			const int count = chunk->count.load( std::memory_order_acquire );
+
+			for ( int i = 0; i < count; ++i )
+			{
+				const Event & event = chunk->events[i];
+
+				if ( event.phase == 'B' )
+				{
+					open.push_back( event.name );
+				}
+				else if ( event.phase == 'E' )
+				{
+					if ( open.empty() )
+					{
+						continue; // its begin was overwritten
+					}
+
+					open.pop_back();
+				}
+
+				write_event( event.name, event.phase, event.ns, buffer.id );
+			}
+		}
+
+		while ( !open.empty() )
+		{
+			write_event( open.back(), 'E', now, buffer.id );
+			open.pop_back();
+		}
+
+		no_overwritten += buffer.overwritten;
+	}
+
+	fprintf( file, "\n]}\n" );
+	fclose( file );
+
+	printf( "Trace of %llu events from %d threads saved to '%s'", static_cast<unsigned long long>( no_events ),
+		static_cast<int>( buffers_.size() ), file_name.c_str() );
+	printf( ( no_overwritten > 0 ) ? ", %lld older events overwritten by the full buffers.\n" : ".\n", no_overwritten );
+
+	return true;
+}
@@ -0,0 +1,127 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+/* the trace macros compile to nothing when TRACE_DISABLED is defined */
+#if !defined( TRACE_DISABLED )
+#define TRACE_EVENTS
+#endif
+
+/*! \class Tracer
+\brief Timeline of the begin and end events of the traced scopes, saved in the Chrome trace event format.
+
+Every thread appends its events to its own buffer made of fixed chunks, the writer only publishes the number
+of events written to a chunk. A full buffer is a ring, its oldest chunk is reused for the new events under the lock
+once per chunk, so a long session keeps the latest events in a bounded memory charged to MemoryTag::DIAGNOSTICS.
+The buffers outlive their threads, so the events of the finished thread pool workers are saved as well.
+The event names have to be string literals. The trace opens in chrome://tracing or in the Perfetto UI,
+the scopes of a thread nest by their begin and end events, Save balances the scopes cut by the ring.
+*/
+class Tracer
+{
+public:
+	static Tracer & Instance();
+
+	/* the scopes entered while the tracer is disabled are not recorded */
+	void set_enabled( const bool enabled );
+	bool enabled() const
+	{
+		return enabled_.load( std::memory_order_relaxed );
+	}
+
+	/* phase is 'B' for the begin of a scope and 'E' for its end */
+	void Record( const char * name, const char phase );
+	/* names the calling thread in the trace, the name has to be a string literal */
+	void NameThread( const char * name );
+
+	/* writes all recorded events, the recording continues, the ends whose begins were overwritten are skipped
+	and the scopes still open are ended at the time of the save */
+	bool Save( const std::string & file_name ) const;
+
+private:
+	static const int kChunkEvents = 4096;
+	static const int kMaxChunks = 32; // per thread, about 3 MB, the oldest chunk is overwritten then
+
+	struct Event
+	{
+		const char * name;
+		long long ns; // since the tracer was created
+		char phase;
+	};
+
+	struct Chunk
+	{
+		Event events[kChunkEvents];
+		std::atomic<int> count{ 0 }; // events written by the owner thread
+		std::atomic<Chunk *> next{ nullptr };
+	};
+
+	struct ThreadBuffer
+	{
+		int id;
+		std::atomic<const char *> name{ nullptr };
+		Chunk * head{ nullptr }; // moved by the owner thread under the lock when the oldest chunk is reused
+		Chunk * tail{ nullptr }; // owner thread only
+		int no_chunks{ 0 }; // owner thread only
+		long long overwritten{ 0 }; // events of the reused chunks, guarded by the lock
+	};
+
+	Tracer();
+	Tracer( const Tracer & ) = delete;
+	Tracer & operator=( const Tracer & ) = delete;
+
+	/* the buffer of the calling thread, registered by its first event */
+	ThreadBuffer * Buffer();
+	/* a new chunk appended to the buffer, or its oldest chunk moved to the end when the buffer is full */
+	Chunk * NextChunk( ThreadBuffer * buffer );
+
+	std::atomic<bool> enabled_{ true };
+	const std::chrono::high_resolution_clock::time_point t0_;
+
+	mutable std::mutex mutex_; // guards the list and the reuse of the chunks, taken once per thread and chunk and by Save
+	std::list<ThreadBuffer> buffers_;
+};
+
+/*! \class TraceScope
+\brief Records the begin event of a scope when constructed and its end event when destroyed.
+*/
+class TraceScope
+{
+public:
+	TraceScope( const char * name ) : name_( ( Tracer::Instance().enabled() ) ? name : nullptr )
+	{
+		if ( name_ )
+		{
+			Tracer::Instance().Record( name_, 'B' );
+		}
+	}
+
+	~TraceScope()
+	{
+		// the end is recorded even when the tracer was disabled meanwhile, the begin would stay open otherwise
+		if ( name_ )
+		{
+			Tracer::Instance().Record( name_, 'E' );
+		}
+	}
+
+private:
+	const char * name_;
+};
+
+#if defined( TRACE_EVENTS )
+#define TRACE_CONCAT_( a, b ) a##b
+#define TRACE_SCOPE_NAME_( line ) TRACE_CONCAT_( trace_scope_, line )
+/* traces the rest of the enclosing scope */
+#define TRACE_SCOPE( name ) TraceScope TRACE_SCOPE_NAME_( __LINE__ )( name )
+/* delimit a phase of a long function, a phase begun while the tracer was enabled has to end while it still is */
+#define TRACE_BEGIN( name ) do { if ( Tracer::Instance().enabled() ) Tracer::Instance().Record( name, 'B' ); } while ( false )
+#define TRACE_END( name ) do { if ( Tracer::Instance().enabled() ) Tracer::Instance().Record( name, 'E' ); } while ( false )
+#define TRACE_THREAD_NAME( name ) Tracer::Instance().NameThread( name )
+#else
+#define TRACE_SCOPE( name )
+#define TRACE_BEGIN( name )
+#define TRACE_END( name )
+#define TRACE_THREAD_NAME( name )
+#endif
+
+#endif
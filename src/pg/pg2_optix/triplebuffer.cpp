@@ -0,0 +1,146 @@
+#include "pch.h"
+#include "triplebuffer.h"
+#include "mymath.h"
+
+TripleBuffer::TripleBuffer( const size_t size )
+{
+	for ( auto & buffer : buffers_ )
+	{
+		buffer.resize( size );
+	}
+
+	memory_.Resize( 3 * size );
+}
+
+BYTE * TripleBuffer::back()
+{
+	return buffers_[back_].data();
+}
+
+void TripleBuffer::Publish()
+{
+	times_[back_] = std::chrono::high_resolution_clock::now();
+	// release makes the frame visible to the consumer, acquire makes the returned buffer free to be overwritten
+	back_ = middle_.exchange( back_ | kFresh, std::memory_order_acq_rel ) & kIndexMask;
+}
+
+bool TripleBuffer::Acquire()
+{
+	if ( ( middle_.load( std::memory_order_relaxed ) & kFresh ) == 0 )
+	{
+		return false;
+	}
+
+	front_ = middle_.exchange( front_, std::memory_order_acq_rel ) & kIndexMask;
+
+	return true;
+}
+
+const BYTE * TripleBuffer::front() const
+{
+	return buffers_[front_].data();
+}
+
+std::chrono::high_resolution_clock::time_point TripleBuffer::front_time() const
+{
+	return times_[front_];
+}
+
+size_t TripleBuffer::size() const
+{
+	return buffers_[0].size();
+}
+
+void ReportFrameHandoff( const int width, const int height, const int no_frames )
+{
+	typedef std::chrono::high_resolution_clock clock;
+
+	const size_t size = size_t( width ) * height * 4;
+	const auto display_interval = std::chrono::microseconds( 16667 );
+	const auto render_time = std::chrono::milliseconds( 8 );
+
+	for ( int triple = 0; triple < 2; ++triple )
+	{
+		std::vector<BYTE> local( size ), shared( size ), display( size );
+		std::mutex shared_lock;
+		clock::time_point shared_time;
+		bool shared_fresh = false;
+		TripleBuffer frames( size );
+		std::atomic<bool> done{ false };
+
+		double stall = 0.0, max_stall = 0.0;
+
+		std::thread producer( [&]()
+		{
+			for ( int frame = 0; frame < no_frames; ++frame )
+			{
+				// the device renders the frame meanwhile, then the tonemapping writes every byte of it
+				std::this_thread::sleep_for( render_time );
+				BYTE * target = ( triple ) ? frames.back() : local.data();
+				memset( target, frame & 0xff, size );
+
+				const auto t0 = clock::now();
+
+				if ( triple )
+				{
+					frames.Publish();
+				}
+				else
+				{
+					std::lock_guard<std::mutex> lock( shared_lock );
+					memcpy( shared.data(), local.data(), size );
+					shared_time = t0; // the latency counts from the end of the rendering in both cases
+					shared_fresh = true;
+				}
+
+				const double ms = std::chrono::duration<double, std::milli>( clock::now() - t0 ).count();
+				stall += ms;
+				max_stall = max( max_stall, ms );
+			}
+
+			done.store( true, std::memory_order_release );
+		} );
+
+		// the consumer uploads the latest frame once per display refresh
+		double latency = 0.0;
+		int displayed = 0;
+		auto next = clock::now();
+
+		while ( !done.load( std::memory_order_acquire ) )
+		{
+			next += display_interval;
+			std::this_thread::sleep_until( next );
+
+			clock::time_point published;
+
+			if ( triple )
+			{
+				if ( !frames.Acquire() ) continue;
+				memcpy( display.data(), frames.front(), size );
+				published = frames.front_time();
+			}
+			else
+			{
+				std::lock_guard<std::mutex> lock( shared_lock );
+				if ( !shared_fresh ) continue;
+				memcpy( display.data(), shared.data(), size );
+				published = shared_time;
+				shared_fresh = false;
+			}
+
+			latency += std::chrono::duration<double, std::milli>( clock::now() - published ).count();
+			++displayed;
+		}
+
+		producer.join();
+
+		// the mutex path copies every produced frame once more before the display copy
+		const double copied = ( ( triple ) ? 0.0 : double( size ) * no_frames ) + double( size ) * displayed;
+
+		printf( "Frame handoff %s (%d x %d): producer stall %0.3f ms per frame (max %0.2f ms), latency %0.2f ms, %d of %d frames displayed.\n",
+			( triple ) ? "triple buffer" : "mutex copy", width, height, stall / no_frames, max_stall,
+			( displayed > 0 ) ? latency / displayed : 0.0, displayed, no_frames );
+		printf( "Frame handoff %s: %0.1f MB copied per displayed frame.\n", ( triple ) ? "triple buffer" : "mutex copy",
+			copied / ( 1024.0 * 1024.0 ) / max( 1, displayed ) );
+	}
+}
@@ -0,0 +1,53 @@
+#ifndef TRIPLE_BUFFER_H_
+#define TRIPLE_BUFFER_H_
+
+#include "memoryaccounting.h"
+
+/*! \class TripleBuffer
+\brief Lock-free exchange of the frames between a single producer and a single consumer.
+
+The producer renders into the back buffer and publishes it by swapping it with the middle buffer,
+the consumer swaps its front buffer with the middle one when a newer frame was published.
+Neither side waits for the other, the consumer always gets the latest complete frame and the frames
+it did not manage to display are dropped.
+*/
+class TripleBuffer
+{
+public:
+	TripleBuffer( const size_t size );
+
+	/* the buffer owned by the producer */
+	BYTE * back();
+	/* makes the back buffer the latest frame, stamps it with the current time */
+	void Publish();
+
+	/* takes the latest published frame if there is a new one, returns false otherwise and the front buffer stays */
+	bool Acquire();
+	/* the buffer owned by the consumer */
+	const BYTE * front() const;
+	/* when the front frame was published */
+	std::chrono::high_resolution_clock::time_point front_time() const;
+
+	size_t size() const;
+
+private:
+	static const int kIndexMask = 3;
+	static const int kFresh = 4; // the middle buffer holds a frame the consumer has not taken yet
+
+	std::vector<BYTE> buffers_[3];
+	std::chrono::high_resolution_clock::time_point times_[3];
+	MemoryCharge memory_{ MemoryTag::FRAMEBUFFERS };
+
+	int back_{ 0 };
+	std::atomic<int> middle_{ 1 };
+	int front_{ 2 };
+
+	TripleBuffer( const TripleBuffer & ) = delete;
+	TripleBuffer & operator=( const TripleBuffer & ) = delete;
+};
+
+/* passes frames of the given size rendered in 8 ms from a producer thread to a consumer polling at 60 Hz, once through
+a mutex guarded copy and once through the triple buffer, prints the producer stall time and the frame latency */
+void ReportFrameHandoff( const int width = 3840, const int height = 2160, const int no_frames = 240 );
+
+#endif
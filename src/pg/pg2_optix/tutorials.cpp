@@ -1,6 +1,10 @@
 #include "pch.h"
 #include "raytracer.h"
 #include "mymath.h"
+#include "trace.h"
+#include "triplebuffer.h"
+#include "texturecache.h"
+#include "imagewriter.h"
 
 /* OptiX error reporting function */
 void error_handler( RTresult code )
@@ -177,13 +181,227 @@ int tutorial_1()
 }
 
 /* a simple example showing how to display a bitmap with traced image at intaractive frame rates */
-int tutorial_2( const std::string file_name )
+int tutorial_2( const std::string file_name, const std::string environment_file_name )
 {
+	TRACE_THREAD_NAME( "Main" );
+	TRACE_BEGIN( "Startup" );
 	Raytracer raytracer(640, 480, deg2rad(45.0), Vector3(175, -140, 130), Vector3(0, 0, 35));
 	raytracer.InitDeviceAndScene();
 	raytracer.LoadScene( file_name );
+	// radiant intensity chosen so that the point light roughly matches the former unlit N.L shading at the model
+	raytracer.SetLights( { MakePointLight( optix::make_float3( 50.0f, 0.0f, 120.0f ), optix::make_float3( 3.0e+4f ) ) } );
+	if ( !environment_file_name.empty() )
+	{
+		raytracer.SetEnvironment( environment_file_name );
+	}
 	raytracer.initGraph();
+	TRACE_END( "Startup" );
 	raytracer.MainLoop();
 
+	// the scene and the device buffers are still allocated, the peaks cover the whole session
+	MemoryAccounting::Instance().Report();
+	MemoryAccounting::Instance().SaveCsv( "memory.csv" );
+
+	return EXIT_SUCCESS;
+}
+
+static void PrintBatchUsage()
+{
+	printf( "Usage: pg2_optix [options]\n"
+		"  --scene file.obj      scene to render\n"
+		"  --env file.exr        environment map\n"
+		"  --output file         image to write, .ppm, .png or .exr\n"
+		"  --size width height   resolution (px)\n"
+		"  --fov degrees         vertical field of view\n"
+		"  --from x y z          camera position\n"
+		"  --at x y z            camera target\n"
+		"  --spp n               samples per pixel\n"
+		"  --timings file.json   saves the stage timings\n"
+		"  --trace file.json     saves the Chrome trace\n"
+		"  --bench names         runs the comma separated benchmarks instead of the render, all or\n"
+		"                        handoff, tonemap, colors, ggx, lod, layouts, cache\n"
+		"  --texture file        texture of the lod, layouts and cache benchmarks\n"
+		"Without options the interactive viewer is started.\n" );
+}
+
+bool ParseBatchSettings( const int argc, const char * const argv[], BatchSettings & settings )
+{
+	for ( int i = 1; i < argc; ++i )
+	{
+		const std::string option = argv[i];
+		// the number of values following the option
+		const int no_values = ( option == "--size" ) ? 2 : ( ( option == "--from" || option == "--at" ) ? 3 : 1 );
+
+		if ( i + no_values >= argc )
+		{
+			printf( "Missing value of '%s'.\n", option.c_str() );
+			PrintBatchUsage();
+
+			return false;
+		}
+
+		const char * const * values = argv + i + 1;
+
+		if ( option == "--scene" ) settings.scene = values[0];
+		else if ( option == "--env" ) settings.environment = values[0];
+		else if ( option == "--output" ) settings.output = values[0];
+		else if ( option == "--size" )
+		{
+			settings.width = atoi( values[0] );
+			settings.height = atoi( values[1] );
+		}
+		else if ( option == "--fov" ) settings.fov_y = static_cast<float>( atof( values[0] ) );
+		else if ( option == "--from" ) settings.view_from = Vector3( float( atof( values[0] ) ), float( atof( values[1] ) ), float( atof( values[2] ) ) );
+		else if ( option == "--at" ) settings.view_at = Vector3( float( atof( values[0] ) ), float( atof( values[1] ) ), float( atof( values[2] ) ) );
+		else if ( option == "--spp" ) settings.spp = atoi( values[0] );
+		else if ( option == "--timings" ) settings.timings = values[0];
+		else if ( option == "--trace" ) settings.trace = values[0];
+		else if ( option == "--bench" ) settings.bench = values[0];
+		else if ( option == "--texture" ) settings.texture = values[0];
+		else
+		{
+			printf( "Unknown option '%s'.\n", option.c_str() );
+			PrintBatchUsage();
+
+			return false;
+		}
+
+		i += no_values;
+	}
+
+	if ( settings.width <= 0 || settings.height <= 0 || settings.spp <= 0 )
+	{
+		printf( "The size and the samples per pixel have to be positive.\n" );
+
+		return false;
+	}
+
+	// checked before the scene is loaded, SaveImage would reject the file only after the render
+	if ( !IsSavableImage( settings.output ) )
+	{
+		printf( "Unknown image format of '%s', use .ppm, .png or .exr.\n", settings.output.c_str() );
+
+		return false;
+	}
+
+	return true;
+}
+
+int render_batch( const BatchSettings & settings )
+{
+	typedef std::chrono::high_resolution_clock clock;
+	TRACE_THREAD_NAME( "Main" );
+
+	const auto t0 = clock::now();
+	// the constructor creates the context, no window is opened
+	Raytracer raytracer( settings.width, settings.height, deg2rad( settings.fov_y ), settings.view_from, settings.view_at, true );
+	raytracer.LoadScene( settings.scene );
+	raytracer.SetLights( { MakePointLight( optix::make_float3( 50.0f, 0.0f, 120.0f ), optix::make_float3( 3.0e+4f ) ) } );
+	if ( !settings.environment.empty() )
+	{
+		raytracer.SetEnvironment( settings.environment );
+	}
+
+	const auto t1 = clock::now();
+	raytracer.initGraph();
+	raytracer.BuildGraph();
+
+	const auto t2 = clock::now();
+	const int no_frames = raytracer.Render( settings.spp );
+
+	const auto t3 = clock::now();
+	const bool saved = raytracer.SaveImage( settings.output );
+
+	const auto t4 = clock::now();
+	const double render_seconds = std::chrono::duration<double>( t3 - t2 ).count();
+
+	printf( "Load %0.1f ms, build %0.1f ms, render %0.1f ms (%d frames, %0.2f Msamples/s), write %0.1f ms.\n",
+		std::chrono::duration<double, std::milli>( t1 - t0 ).count(), std::chrono::duration<double, std::milli>( t2 - t1 ).count(),
+		render_seconds * 1e+3, no_frames, double( settings.width ) * settings.height * settings.spp * 1e-6 / std::max( render_seconds, 1e-9 ),
+		std::chrono::duration<double, std::milli>( t4 - t3 ).count() );
+	raytracer.LogRayStats();
+	MemoryAccounting::Instance().Report();
+
+	if ( !settings.timings.empty() )
+	{
+		StageTimings::Instance().SaveJson( settings.timings );
+	}
+
+	if ( !settings.trace.empty() )
+	{
+		Tracer::Instance().Save( settings.trace );
+	}
+
+	return ( saved ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int run_benchmarks( const BatchSettings & settings )
+{
+	static const char * const kNames[] = { "handoff", "tonemap", "colors", "ggx", "lod", "layouts", "cache" };
+
+	std::vector<std::string> names;
+	size_t first = 0;
+
+	while ( first <= settings.bench.size() )
+	{
+		const size_t last = std::min( settings.bench.find( ',', first ), settings.bench.size() );
+		names.push_back( settings.bench.substr( first, last - first ) );
+		first = last + 1;
+	}
+
+	if ( names.size() == 1 && names.front() == "all" )
+	{
+		names.assign( std::begin( kNames ), std::end( kNames ) );
+	}
+
+	for ( const std::string & name : names )
+	{
+		if ( std::find( std::begin( kNames ), std::end( kNames ), name ) == std::end( kNames ) )
+		{
+			printf( "Unknown benchmark '%s'.\n", name.c_str() );
+			PrintBatchUsage();
+
+			return EXIT_FAILURE;
+		}
+	}
+
+	TRACE_THREAD_NAME( "Main" );
+	Texture * texture = nullptr;
+
+	for ( const std::string & name : names )
+	{
+		printf( "--- %s ---\n", name.c_str() );
+
+		if ( name == "handoff" ) ReportFrameHandoff();
+		else if ( name == "tonemap" )
+		{
+			// the default operator of the viewer
+			Tonemapper tonemapper;
+			tonemapper.Configure( Tonemap::ACES, 0.0f, 2.4f );
+			tonemapper.Benchmark();
+		}
+		else if ( name == "colors" ) ReportColorKernels();
+		else if ( name == "ggx" ) ReportGgxConvergence( 1 << 14 );
+		else
+		{
+			// the texture benchmarks share the texture loaded by the first of them, a missing file gives an empty texture
+			if ( !texture )
+			{
+				texture = TextureCache::Instance().Load( settings.texture );
+			}
+
+			if ( !texture->getData() )
+			{
+				printf( "Unable to load the texture '%s'.\n", settings.texture.c_str() );
+
+				return EXIT_FAILURE;
+			}
+
+			if ( name == "lod" ) texture->ReportLod( true );
+			else if ( name == "layouts" ) texture->ReportLayouts();
+			else TextureCache::Instance().Report( true );
+		}
+	}
+
 	return EXIT_SUCCESS;
 }
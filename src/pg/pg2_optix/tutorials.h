@@ -1,9 +1,36 @@
 #ifndef TUTORIALS_H_
 #define TUTORIALS_H_
 
+#include "vector3.h"
+
 void error_handler( RTresult code );
 
 int tutorial_1();
-int tutorial_2( const std::string file_name );
+int tutorial_2( const std::string file_name, const std::string environment_file_name = "" );
+
+/* parameters of the headless batch renderer, the defaults are the scene and the camera of tutorial_2 */
+struct BatchSettings
+{
+	std::string scene{ "../../../data/6887_allied_avenger_gi.obj" };
+	std::string environment;
+	std::string output{ "render.png" }; // .ppm, .png or .exr
+	int width{ 640 };
+	int height{ 480 };
+	float fov_y{ 45.0f }; // degrees
+	Vector3 view_from{ 175, -140, 130 };
+	Vector3 view_at{ 0, 0, 35 };
+	int spp{ 256 };
+	std::string timings; // the stage timings are saved as JSON when given
+	std::string trace; // the Chrome trace is saved when given
+	std::string bench; // comma separated benchmarks run instead of the render, see PrintBatchUsage
+	std::string texture{ "../../../data/4150p04.jpg" }; // the texture of the texture benchmarks
+};
+
+/* reads the command line options, prints the usage and returns false for an unknown option or a missing value */
+bool ParseBatchSettings( const int argc, const char * const argv[], BatchSettings & settings );
+/* renders the scene without a window, writes the image, prints the load, build and render times and exits */
+int render_batch( const BatchSettings & settings );
+/* runs the host benchmarks without a window, they take seconds and would stall the interactive viewer */
+int run_benchmarks( const BatchSettings & settings );
 
 #endif
\ No newline at end of file
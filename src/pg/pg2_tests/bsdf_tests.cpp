@@ -0,0 +1,326 @@
+#include "pch.h"
+#include "tests.h"
+#include "emitters.h"
+
+/* GGX surface of the tests, the same base colour and the view at 60 deg as ReportGgxConvergence */
+static GgxBrdf MakeGgxBrdf( const float roughness, const float metallic )
+{
+	GgxBrdf brdf;
+	brdf.base_color = optix::make_float3( 0.9f, 0.6f, 0.3f );
+	brdf.roughness = roughness;
+	brdf.metallic = metallic;
+	brdf.normal = optix::make_float3( 0.0f, 0.0f, 1.0f );
+	brdf.omega_o = optix::make_float3( sinf( float( M_PI ) / 3.0f ), 0.0f, cosf( float( M_PI ) / 3.0f ) );
+
+	return brdf;
+}
+
+/* chi-square statistic of the observed bin counts against the expected ones,
+the bins expecting less than five samples are pooled into a single bin */
+static double PooledChiSquare( const std::vector<int> & observed, const std::vector<double> & expected, int & dof )
+{
+	double chi_square = 0.0;
+	double pooled_observed = 0.0, pooled_expected = 0.0;
+	dof = -1;
+
+	for ( size_t i = 0; i < observed.size(); ++i )
+	{
+		if ( expected[i] < 5.0 )
+		{
+			pooled_observed += observed[i];
+			pooled_expected += expected[i];
+		}
+		else
+		{
+			const double d = observed[i] - expected[i];
+			chi_square += d * d / expected[i];
+			++dof;
+		}
+	}
+
+	if ( pooled_expected > 0.0 )
+	{
+		const double d = pooled_observed - pooled_expected;
+		chi_square += d * d / pooled_expected;
+		++dof;
+	}
+	else
+	{
+		CHECK( pooled_observed == 0.0 );
+	}
+
+	return chi_square;
+}
+
+/* the directions generated by GgxBrdf::Sample, counted in the bins of cos( theta ) x phi, follow GgxBrdf::Pdf,
+the samples reflected below the horizon are rejected by Sample and have their own bin */
+TEST( GgxSamplingMatchesPdf )
+{
+	const int n_theta = 16, n_phi = 32, n_sub = 16;
+	const int no_samples = 1 << 20;
+	std::mt19937 generator( 43 );
+	std::uniform_real_distribution<float> uniform( 0.0f, 1.0f );
+
+	for ( const float roughness : { 0.3f, 1.0f } )
+	{
+		for ( const float metallic : { 0.0f, 1.0f } )
+		{
+			const GgxBrdf brdf = MakeGgxBrdf( roughness, metallic );
+			std::vector<int> observed( n_theta * n_phi + 1, 0 );
+			int no_inconsistent = 0;
+
+			for ( int i = 0; i < no_samples; ++i )
+			{
+				const float u0 = uniform( generator ), u1 = uniform( generator ), u2 = uniform( generator );
+				optix::float3 omega_i, weight;
+				float pdf;
+
+				if ( !brdf.Sample( u0, u1, u2, omega_i, weight, pdf ) )
+				{
+					++observed[n_theta * n_phi];
+					continue;
+				}
+
+				// the weight is the BRDF times the cosine over the density returned with the sample
+				no_inconsistent += ( fabsf( Luminance( weight * pdf - brdf( omega_i ) ) ) > 1e-3f * Luminance( brdf( omega_i ) ) ) ? 1 : 0;
+
+				const float phi = atan2f( omega_i.y, omega_i.x ) + M_PIf;
+				const int x = std::min( n_phi - 1, std::max( 0, static_cast<int>( phi / ( 2.0f * M_PIf ) * n_phi ) ) );
+				const int y = std::min( n_theta - 1, std::max( 0, static_cast<int>( omega_i.z * n_theta ) ) );
+				++observed[y * n_phi + x];
+			}
+
+			CHECK( no_inconsistent == 0 );
+
+			// the expected counts integrate the pdf over the bins by the midpoint rule, dw = dcos( theta ) dphi
+			std::vector<double> expected( observed.size() );
+			double integral = 0.0;
+
+			for ( int y = 0; y < n_theta; ++y )
+			{
+				for ( int x = 0; x < n_phi; ++x )
+				{
+					double bin = 0.0;
+
+					for ( int j = 0; j < n_sub; ++j )
+					{
+						const float cos_theta = ( y + ( j + 0.5f ) / n_sub ) / n_theta;
+
+						for ( int k = 0; k < n_sub; ++k )
+						{
+							const float phi = ( x + ( k + 0.5f ) / n_sub ) / n_phi * 2.0f * M_PIf - M_PIf;
+							const float sin_theta = sqrtf( 1.0f - cos_theta * cos_theta );
+							bin += brdf.Pdf( optix::make_float3( sin_theta * cosf( phi ), sin_theta * sinf( phi ), cos_theta ) );
+						}
+					}
+
+					bin *= ( 1.0 / n_theta ) * ( 2.0 * M_PI / n_phi ) / ( n_sub * n_sub );
+					expected[y * n_phi + x] = no_samples * bin;
+					integral += bin;
+				}
+			}
+
+			// rough lobes at the grazing view lose a part of the visible normals below the horizon
+			CHECK( integral < 1.0 + 1e-3 );
+			expected[n_theta * n_phi] = no_samples * std::max( 0.0, 1.0 - integral );
+
+			int dof;
+			const double chi_square = PooledChiSquare( observed, expected, dof );
+
+			CHECK( chi_square < ChiSquareCritical( dof ) );
+		}
+	}
+}
+
+/* horizontal square light above the surface in the mirror direction of the view, split to two emissive triangles */
+struct TestLight
+{
+	static constexpr float kHeight = 1.0f;
+	static constexpr float kSize = 2.0f;
+
+	Emitter emitters[2];
+	std::vector<AliasEntry> table;
+	optix::float3 center;
+	float pdf_scale;
+
+	TestLight()
+	{
+		center = optix::make_float3( -tanf( float( M_PI ) / 3.0f ), 0.0f, kHeight );
+		const optix::float3 corner = center - optix::make_float3( 0.5f * kSize, 0.5f * kSize, 0.0f );
+		const optix::float3 ex = optix::make_float3( kSize, 0.0f, 0.0f );
+		const optix::float3 ey = optix::make_float3( 0.0f, kSize, 0.0f );
+
+		emitters[0] = Emitter{ corner, 0.5f * kSize * kSize, ex, 0.5f, ex + ey, 0.0f, optix::make_float3( 1.0f ), 0.0f };
+		emitters[1] = Emitter{ corner, 0.5f * kSize * kSize, ex + ey, 0.5f, ey, 0.0f, optix::make_float3( 1.0f ), 0.0f };
+		pdf_scale = 1.0f / BuildAliasTable( { emitters[0].area, emitters[1].area }, table );
+	}
+
+	/* the light seen from the origin in the direction omega, zero when the direction misses it */
+	optix::float3 Radiance( const optix::float3 & omega, float & pdf ) const
+	{
+		pdf = 0.0f;
+
+		if ( omega.z <= 0.0f )
+		{
+			return optix::make_float3( 0.0f );
+		}
+
+		const float t = kHeight / omega.z;
+		const optix::float3 x = omega * t;
+
+		if ( fabsf( x.x - center.x ) > 0.5f * kSize || fabsf( x.y - center.y ) > 0.5f * kSize )
+		{
+			return optix::make_float3( 0.0f );
+		}
+
+		pdf = EmitterPdf( emitters[0].emission, pdf_scale, t * t, omega.z );
+
+		return emitters[0].emission;
+	}
+};
+
+struct Unshadowed
+{
+	bool operator()( const optix::float3 &, const optix::float3 &, const float ) const
+	{
+		return true;
+	}
+};
+
+struct Estimate
+{
+	double mean;
+	double deviation; /*!< Standard deviation of a single sample. */
+};
+
+/* reflected radiance of the test light, the next event estimation alone or combined with the BSDF sampling by MIS */
+static Estimate EstimateLight( const GgxBrdf & brdf, const TestLight & light, const bool mis, const int no_samples, std::mt19937 & generator )
+{
+	std::uniform_real_distribution<float> uniform( 0.0f, 1.0f );
+	const optix::float3 p = optix::make_float3( 0.0f );
+	double sum = 0.0, sqr_sum = 0.0;
+
+	for ( int i = 0; i < no_samples; ++i )
+	{
+		const float u0 = uniform( generator ), u1 = uniform( generator ), u2 = uniform( generator ), u3 = uniform( generator );
+		optix::float3 value;
+
+		if ( mis )
+		{
+			value = EvaluateEmitters( light.emitters, light.table.data(), 2, u0, u1, u2, u3, p, brdf.normal, brdf, Unshadowed(),
+				BsdfMis<GgxBrdf>{ &brdf } );
+
+			optix::float3 omega_i, weight;
+			float pdf, light_pdf;
+
+			if ( brdf.Sample( uniform( generator ), uniform( generator ), uniform( generator ), omega_i, weight, pdf ) )
+			{
+				const optix::float3 radiance = light.Radiance( omega_i, light_pdf );
+				value += weight * radiance * PowerHeuristic( pdf, light_pdf );
+			}
+		}
+		else
+		{
+			value = EvaluateEmitters( light.emitters, light.table.data(), 2, u0, u1, u2, u3, p, brdf.normal, brdf, Unshadowed() );
+		}
+
+		const double y = Luminance( value );
+		sum += y;
+		sqr_sum += y * y;
+	}
+
+	const double mean = sum / no_samples;
+
+	return Estimate{ mean, sqrt( std::max( 0.0, sqr_sum / no_samples - mean * mean ) ) };
+}
+
+/* MIS of the light and the BSDF sampling converges to the same radiance as the next event estimation alone,
+the sharp lobes are found much more reliably by the BSDF sampling */
+TEST( GgxMisAgreesWithNee )
+{
+	const TestLight light;
+	const int no_samples = 1 << 20;
+	std::mt19937 generator( 47 );
+
+	for ( const float roughness : { 0.05f, 0.3f, 1.0f } )
+	{
+		for ( const float metallic : { 0.0f, 1.0f } )
+		{
+			const GgxBrdf brdf = MakeGgxBrdf( roughness, metallic );
+			const Estimate nee = EstimateLight( brdf, light, false, no_samples, generator );
+			const Estimate mis = EstimateLight( brdf, light, true, no_samples, generator );
+			const double error = sqrt( ( nee.deviation * nee.deviation + mis.deviation * mis.deviation ) / no_samples );
+
+			CHECK( mis.mean > 0.0 );
+			CHECK_NEAR( mis.mean, nee.mean, 4.0 * error + 1e-3 * nee.mean );
+
+			if ( roughness < 0.1f )
+			{
+				CHECK( mis.deviation < 0.25 * nee.deviation );
+			}
+		}
+	}
+}
+
+/* directional albedo of the surface under the uniform white sky, the BSDF sampling of GgxBrdf or the cosine sampling */
+static Estimate EstimateAlbedo( const GgxBrdf & brdf, const bool vndf, const int no_samples, std::mt19937 & generator )
+{
+	std::uniform_real_distribution<float> uniform( 0.0f, 1.0f );
+	double sum = 0.0, sqr_sum = 0.0;
+
+	for ( int i = 0; i < no_samples; ++i )
+	{
+		const float u0 = uniform( generator ), u1 = uniform( generator ), u2 = uniform( generator );
+		double y = 0.0;
+
+		if ( vndf )
+		{
+			optix::float3 omega_i, weight;
+			float pdf;
+			y = brdf.Sample( u0, u1, u2, omega_i, weight, pdf ) ? Luminance( weight ) : 0.0;
+		}
+		else
+		{
+			const optix::float3 omega_i = SampleCosineHemisphere( brdf.normal, u1, u2 );
+			const float pdf = fmaxf( 0.0f, omega_i.z ) * M_1_PIf;
+			y = ( pdf > 0.0f ) ? Luminance( brdf( omega_i ) ) / pdf : 0.0;
+		}
+
+		sum += y;
+		sqr_sum += y * y;
+	}
+
+	const double mean = sum / no_samples;
+
+	return Estimate{ mean, sqrt( std::max( 0.0, sqr_sum / no_samples - mean * mean ) ) };
+}
+
+/* at the same sample count the visible normal sampling of the glossy lobes has a lower error than the cosine sampling,
+the rough lobes are close to the cosine lobe and the cosine sampling may win there */
+TEST( GgxVndfBeatsCosineSampling )
+{
+	const int no_samples = 1 << 16;
+	std::mt19937 generator( 53 );
+
+	for ( const float roughness : { 0.05f, 0.1f, 0.3f, 0.6f, 1.0f } )
+	{
+		for ( const float metallic : { 0.0f, 1.0f } )
+		{
+			const GgxBrdf brdf = MakeGgxBrdf( roughness, metallic );
+			const Estimate vndf = EstimateAlbedo( brdf, true, no_samples, generator );
+			const Estimate cosine = EstimateAlbedo( brdf, false, no_samples, generator );
+
+			if ( roughness <= 0.3f )
+			{
+				CHECK( vndf.deviation < 0.5 * cosine.deviation );
+			}
+
+			// the cosine sampling rarely finds the sharp lobes, its estimate of the deviation is unreliable there
+			if ( roughness >= 0.3f )
+			{
+				const double error = sqrt( ( vndf.deviation * vndf.deviation + cosine.deviation * cosine.deviation ) / no_samples );
+				CHECK_NEAR( vndf.mean, cosine.mean, 4.0 * error );
+			}
+		}
+	}
+}
@@ -0,0 +1,218 @@
+#include "pch.h"
+#include "tests.h"
+#include "testscene.h"
+#include "emitters.h"
+#include <numeric>
+
+/* chi-square statistic of the observed bin counts against the expected ones, the bins expecting nothing must stay empty */
+static double ChiSquare( const std::vector<int> & observed, const std::vector<double> & expected, int & dof )
+{
+	double chi_square = 0.0;
+	dof = -1;
+
+	for ( size_t i = 0; i < observed.size(); ++i )
+	{
+		if ( expected[i] > 0.0 )
+		{
+			const double d = observed[i] - expected[i];
+			chi_square += d * d / expected[i];
+			++dof;
+		}
+		else
+		{
+			CHECK( observed[i] == 0 );
+		}
+	}
+
+	return chi_square;
+}
+
+TEST( AliasTableFrequencies )
+{
+	// weights spanning four orders of magnitude, a few empty bins and a single dominant one
+	std::mt19937 generator( 3 );
+	std::uniform_real_distribution<float> uniform( 0.0f, 1.0f );
+	std::vector<float> weights( 100 );
+
+	for ( size_t i = 0; i < weights.size(); ++i )
+	{
+		weights[i] = ( i % 17 == 5 ) ? 0.0f : powf( 10.0f, 4.0f * uniform( generator ) - 2.0f );
+	}
+	weights[42] = 500.0f;
+
+	std::vector<AliasEntry> table;
+	const float sum = BuildAliasTable( weights, table );
+
+	CHECK( table.size() == weights.size() );
+	CHECK_NEAR( sum, std::accumulate( weights.begin(), weights.end(), 0.0 ), 1e-3 * sum );
+
+	const int no_samples = 1 << 22;
+	std::vector<int> observed( weights.size(), 0 );
+
+	for ( int i = 0; i < no_samples; ++i )
+	{
+		const float u0 = uniform( generator ), u1 = uniform( generator );
+		++observed[SampleAlias( table.data(), static_cast<unsigned int>( table.size() ), u0, u1 )];
+	}
+
+	std::vector<double> expected( weights.size() );
+
+	for ( size_t i = 0; i < weights.size(); ++i )
+	{
+		expected[i] = double( no_samples ) * weights[i] / sum;
+	}
+
+	int dof;
+	const double chi_square = ChiSquare( observed, expected, dof );
+
+	CHECK( chi_square < ChiSquareCritical( dof ) );
+}
+
+/* horizontal rectangular emitters of the test, the cells split each of them to a grid */
+struct EmitterQuad
+{
+	float x, y, z; // corner
+	float width, height;
+	Color3f emission;
+};
+
+static const EmitterQuad kQuads[] = {
+	{ -1.0f, -1.0f, 2.0f, 2.0f, 2.0f, Color3f( 1.0f, 1.0f, 1.0f ) },
+	{ 2.0f, 0.0f, 3.0f, 1.0f, 3.0f, Color3f( 4.0f, 0.5f, 0.1f ) },
+	{ -3.0f, 1.0f, 1.5f, 0.5f, 0.5f, Color3f( 0.0f, 0.0f, 10.0f ) },
+	{ 0.0f, -4.0f, 1.0f, 3.0f, 1.0f, Color3f( 0.2f, 0.2f, 0.2f ) } };
+static const int kNoQuads = sizeof( kQuads ) / sizeof( kQuads[0] );
+static const int kCells = 4; // per side of a quad
+
+static void BuildEmitterScene( TestScene & scene )
+{
+	for ( const EmitterQuad & quad : kQuads )
+	{
+		scene.AddQuad( Vector3( quad.x, quad.y, quad.z ), Vector3( quad.width, 0.0f, 0.0f ), Vector3( 0.0f, quad.height, 0.0f ),
+			Color3f( 0.5f, 0.5f, 0.5f ), quad.emission );
+	}
+}
+
+/* the emitters are picked by area x luminance */
+TEST( EmitterSelectionFrequencies )
+{
+	TestScene scene;
+	BuildEmitterScene( scene );
+	EmitterTable emitters;
+	emitters.Build( scene.surfaces );
+
+	CHECK( emitters.size() == 2 * kNoQuads );
+
+	std::vector<double> weights;
+
+	for ( const EmitterQuad & quad : kQuads )
+	{
+		// both triangles of a quad have half of its area
+		const float luminance = Luminance( optix::make_float3( quad.emission.r, quad.emission.g, quad.emission.b ) );
+		weights.push_back( 0.5 * quad.width * quad.height * luminance );
+		weights.push_back( 0.5 * quad.width * quad.height * luminance );
+	}
+
+	const double sum = std::accumulate( weights.begin(), weights.end(), 0.0 );
+	const int no_samples = 1 << 21;
+	std::mt19937 generator( 5 );
+	std::uniform_real_distribution<float> uniform( 0.0f, 1.0f );
+	std::vector<int> observed( emitters.size(), 0 );
+
+	for ( int i = 0; i < no_samples; ++i )
+	{
+		const float u0 = uniform( generator ), u1 = uniform( generator );
+		++observed[SampleAlias( emitters.table().data(), emitters.size(), u0, u1 )];
+	}
+
+	std::vector<double> expected( weights.size() );
+
+	for ( size_t i = 0; i < weights.size(); ++i )
+	{
+		expected[i] = no_samples * weights[i] / sum;
+		CHECK_NEAR( emitters.emitters()[i].pdf, weights[i] / sum, 1e-5 );
+	}
+
+	int dof;
+	const double chi_square = ChiSquare( observed, expected, dof );
+
+	CHECK( chi_square < ChiSquareCritical( dof ) );
+}
+
+/* the density of the points generated by SampleEmitter, counted in the cells of the emitters, matches EmitterPdf */
+TEST( EmitterPdfMatchesSampling )
+{
+	TestScene scene;
+	BuildEmitterScene( scene );
+	EmitterTable emitters;
+	emitters.Build( scene.surfaces );
+
+	const optix::float3 p = optix::make_float3( 0.3f, -0.2f, 0.0f );
+	const int no_samples = 1 << 21;
+	std::mt19937 generator( 9 );
+	std::uniform_real_distribution<float> uniform( 0.0f, 1.0f );
+	std::vector<int> observed( kNoQuads * kCells * kCells, 0 );
+	int no_inconsistent = 0;
+
+	for ( int i = 0; i < no_samples; ++i )
+	{
+		const float u0 = uniform( generator ), u1 = uniform( generator ), u2 = uniform( generator ), u3 = uniform( generator );
+		optix::float3 omega_l, radiance;
+		float distance, pdf;
+
+		if ( !emitters.Sample( u0, u1, u2, u3, p, omega_l, distance, radiance, pdf ) )
+		{
+			continue;
+		}
+
+		// the density returned with the sample is the one the BSDF sampled paths get for the same point
+		const float cos_l = fabsf( omega_l.z );
+		const float pdf_hit = EmitterPdf( radiance, emitters.pdf_scale(), distance * distance, cos_l );
+		no_inconsistent += ( fabsf( pdf - pdf_hit ) > 1e-3f * pdf ) ? 1 : 0;
+
+		const optix::float3 x = p + omega_l * distance;
+
+		for ( int j = 0; j < kNoQuads; ++j )
+		{
+			const EmitterQuad & quad = kQuads[j];
+
+			if ( fabsf( x.z - quad.z ) < 1e-3f )
+			{
+				const int cx = std::min( kCells - 1, std::max( 0, static_cast<int>( ( x.x - quad.x ) / quad.width * kCells ) ) );
+				const int cy = std::min( kCells - 1, std::max( 0, static_cast<int>( ( x.y - quad.y ) / quad.height * kCells ) ) );
+				++observed[( j * kCells + cy ) * kCells + cx];
+			}
+		}
+	}
+
+	CHECK( no_inconsistent == 0 );
+
+	// the expected counts integrate EmitterPdf converted to the area measure over the cells
+	std::vector<double> expected( observed.size() );
+
+	for ( int j = 0; j < kNoQuads; ++j )
+	{
+		const EmitterQuad & quad = kQuads[j];
+		const optix::float3 emission = optix::make_float3( quad.emission.r, quad.emission.g, quad.emission.b );
+		const float cell_area = quad.width * quad.height / ( kCells * kCells );
+
+		for ( int c = 0; c < kCells * kCells; ++c )
+		{
+			const optix::float3 x = optix::make_float3( quad.x + ( c % kCells + 0.5f ) * quad.width / kCells,
+				quad.y + ( c / kCells + 0.5f ) * quad.height / kCells, quad.z );
+			const optix::float3 d = x - p;
+			const float sqr_distance = optix::dot( d, d );
+			const float cos_l = fabsf( d.z ) / sqrtf( sqr_distance );
+			const float pdf_area = EmitterPdf( emission, emitters.pdf_scale(), sqr_distance, cos_l ) * cos_l / sqr_distance;
+
+			expected[j * kCells * kCells + c] = double( no_samples ) * pdf_area * cell_area;
+		}
+	}
+
+	CHECK_NEAR( std::accumulate( expected.begin(), expected.end(), 0.0 ), no_samples, 1e-4 * no_samples );
+
+	int dof;
+	const double chi_square = ChiSquare( observed, expected, dof );
+
+	CHECK( chi_square < ChiSquareCritical( dof ) );
+}
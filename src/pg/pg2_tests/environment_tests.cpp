@@ -0,0 +1,237 @@
+#include "pch.h"
+#include "tests.h"
+#include "environment.h"
+
+/* synthetic map, a dim sky getting brighter towards the zenith, a small bright sun and a black ground */
+struct TestEnvironment
+{
+	static const int kWidth = 128;
+	static const int kHeight = 64;
+
+	std::vector<float> luminance;
+	std::vector<float> marginal;
+	std::vector<float> conditional;
+
+	TestEnvironment()
+	{
+		luminance.resize( kWidth * kHeight );
+
+		for ( int y = 0; y < kHeight; ++y )
+		{
+			for ( int x = 0; x < kWidth; ++x )
+			{
+				const bool sun = abs( x - 40 ) <= 1 && abs( y - 20 ) <= 1;
+				luminance[y * kWidth + x] = ( y >= kHeight / 2 + 4 ) ? 0.0f : ( sun ? 5000.0f : 1.0f - float( y ) / kHeight );
+			}
+		}
+
+		BuildEnvironmentCdf( luminance, kWidth, kHeight, marginal, conditional );
+	}
+
+	/* the nearest pixel, the luminance is used as a gray radiance */
+	optix::float3 operator()( const optix::float3 & omega ) const
+	{
+		const optix::float2 uv = EnvironmentUV( omega );
+		const int x = std::min( kWidth - 1, std::max( 0, static_cast<int>( uv.x * kWidth ) ) );
+		const int y = std::min( kHeight - 1, std::max( 0, static_cast<int>( uv.y * kHeight ) ) );
+
+		return optix::make_float3( luminance[y * kWidth + x] );
+	}
+};
+
+static void CheckCdf( const float * cdf, const int n )
+{
+	CHECK( cdf[0] == 0.0f );
+	CHECK( cdf[n] == 1.0f );
+
+	int no_decreasing = 0;
+
+	for ( int i = 0; i < n; ++i )
+	{
+		no_decreasing += ( cdf[i + 1] < cdf[i] ) ? 1 : 0;
+	}
+
+	CHECK( no_decreasing == 0 );
+}
+
+TEST( EnvironmentCdfIsMonotone )
+{
+	const TestEnvironment map;
+
+	CHECK( map.marginal.size() == TestEnvironment::kHeight + 1 );
+	CHECK( map.conditional.size() == TestEnvironment::kHeight * ( TestEnvironment::kWidth + 1 ) );
+	CheckCdf( map.marginal.data(), TestEnvironment::kHeight );
+
+	for ( int y = 0; y < TestEnvironment::kHeight; ++y )
+	{
+		CheckCdf( &map.conditional[y * ( TestEnvironment::kWidth + 1 )], TestEnvironment::kWidth );
+	}
+
+	// the black ground is never sampled, its black rows fall back to the uniform conditional cdf
+	CHECK( map.marginal[TestEnvironment::kHeight / 2 + 4] == 1.0f );
+	CHECK_NEAR( map.conditional[( TestEnvironment::kHeight - 1 ) * ( TestEnvironment::kWidth + 1 ) + 1], 1.0 / TestEnvironment::kWidth, 1e-6 );
+}
+
+TEST( SampleCdfInverts )
+{
+	// a cdf with empty bins at the start, in the middle and at the end
+	const float weights[] = { 0.0f, 1.0f, 3.0f, 0.0f, 0.0f, 2.0f, 0.5f, 0.0f };
+	const int n = sizeof( weights ) / sizeof( weights[0] );
+	float cdf[n + 1] = { 0.0f };
+	float sum = 0.0f; // the partial sums are exact, the empty bins have zero width
+
+	for ( int i = 0; i < n; ++i )
+	{
+		sum += weights[i];
+		cdf[i + 1] = sum / 6.5f;
+	}
+
+	const TestEnvironment map;
+	std::mt19937 generator( 31 );
+	std::uniform_real_distribution<float> uniform( 0.0f, 1.0f );
+	int no_empty = 0;
+	int no_outside = 0;
+
+	for ( int i = 0; i < ( 1 << 16 ); ++i )
+	{
+		const float u = ( i == 0 ) ? 0.0f : uniform( generator );
+		float du;
+		const int bin = SampleCdf( cdf, n, u, du );
+
+		// the selected bin contains u and the position within the bin maps back to u
+		no_empty += ( weights[bin] == 0.0f ) ? 1 : 0;
+		no_outside += ( u < cdf[bin] || u > cdf[bin + 1] || du < 0.0f || du > 1.0f ) ? 1 : 0;
+		CHECK_NEAR( cdf[bin] + du * ( cdf[bin + 1] - cdf[bin] ), u, 1e-6 );
+
+		// the same for the marginal cdf of the map and one conditional cdf with the sun
+		const int y = SampleCdf( map.marginal.data(), TestEnvironment::kHeight, u, du );
+		CHECK_NEAR( map.marginal[y] + du * ( map.marginal[y + 1] - map.marginal[y] ), u, 1e-6 );
+
+		const float * row = &map.conditional[20 * ( TestEnvironment::kWidth + 1 )];
+		const int x = SampleCdf( row, TestEnvironment::kWidth, u, du );
+		CHECK_NEAR( row[x] + du * ( row[x + 1] - row[x] ), u, 1e-6 );
+	}
+
+	CHECK( no_empty == 0 );
+	CHECK( no_outside == 0 );
+}
+
+TEST( EnvironmentPdfIntegratesToOne )
+{
+	const TestEnvironment map;
+	const int w = TestEnvironment::kWidth;
+	const int h = TestEnvironment::kHeight;
+
+	// midpoint rule on a grid four times finer than the map, dw = sin( theta ) dtheta dphi
+	const int n_theta = 4 * h, n_phi = 4 * w;
+	double integral = 0.0;
+
+	for ( int i = 0; i < n_theta; ++i )
+	{
+		const float v = ( i + 0.5f ) / n_theta;
+
+		for ( int j = 0; j < n_phi; ++j )
+		{
+			const float u = ( j + 0.5f ) / n_phi;
+			const optix::float3 omega = EnvironmentDirection( u, v );
+			integral += EnvironmentPdf( map.marginal.data(), map.conditional.data(), w, h, omega ) *
+				sinf( v * M_PIf ) * ( M_PI / n_theta ) * ( 2.0 * M_PI / n_phi );
+		}
+	}
+
+	CHECK_NEAR( integral, 1.0, 1e-3 );
+
+	// the density returned by the sampling is the one evaluated for the sampled direction
+	std::mt19937 generator( 37 );
+	std::uniform_real_distribution<float> uniform( 0.0f, 1.0f );
+	int no_inconsistent = 0;
+
+	for ( int i = 0; i < ( 1 << 16 ); ++i )
+	{
+		optix::float3 omega;
+		float pdf;
+
+		if ( SampleEnvironment( map.marginal.data(), map.conditional.data(), w, h, uniform( generator ), uniform( generator ), omega, pdf ) )
+		{
+			const float pdf_omega = EnvironmentPdf( map.marginal.data(), map.conditional.data(), w, h, omega );
+			no_inconsistent += ( fabsf( pdf - pdf_omega ) > 1e-3f * pdf ) ? 1 : 0;
+		}
+	}
+
+	// the directions at the pixel borders may round to the neighbouring pixel
+	CHECK( no_inconsistent < 16 );
+}
+
+/* cosine term of a white Lambertian surface */
+struct WhiteLambert
+{
+	optix::float3 normal;
+
+	optix::float3 operator()( const optix::float3 & omega_l ) const
+	{
+		return optix::make_float3( M_1_PIf * optix::dot( normal, omega_l ) );
+	}
+};
+
+struct Unoccluded
+{
+	bool operator()( const optix::float3 &, const optix::float3 &, const float ) const
+	{
+		return true;
+	}
+};
+
+/* both strategies of EvaluateEnvironment converge to the irradiance from the quadrature of the map,
+the importance sampling of the map with the sun has a much lower variance */
+TEST( EnvironmentSamplingConverges )
+{
+	const TestEnvironment map;
+	const int w = TestEnvironment::kWidth;
+	const int h = TestEnvironment::kHeight;
+	const WhiteLambert brdf{ optix::make_float3( 0.0f, 0.0f, 1.0f ) };
+
+	double reference = 0.0;
+	const int n_theta = 8 * h, n_phi = 8 * w;
+
+	for ( int i = 0; i < n_theta; ++i )
+	{
+		const float v = ( i + 0.5f ) / n_theta;
+
+		for ( int j = 0; j < n_phi; ++j )
+		{
+			const optix::float3 omega = EnvironmentDirection( ( j + 0.5f ) / n_phi, v );
+
+			if ( omega.z > 0.0f )
+			{
+				reference += map( omega ).x * brdf( omega ).x * sinf( v * M_PIf ) * ( M_PI / n_theta ) * ( 2.0 * M_PI / n_phi );
+			}
+		}
+	}
+
+	std::mt19937 generator( 41 );
+	std::uniform_real_distribution<float> uniform( 0.0f, 1.0f );
+	const int no_samples = 1 << 16;
+	double deviation[2];
+
+	for ( int importance = 0; importance < 2; ++importance )
+	{
+		double sum = 0.0, sqr_sum = 0.0;
+
+		for ( int i = 0; i < no_samples; ++i )
+		{
+			const float u0 = uniform( generator ), u1 = uniform( generator );
+			const double value = EvaluateEnvironment( map.marginal.data(), map.conditional.data(), w, h, importance != 0, u0, u1,
+				optix::make_float3( 0.0f ), brdf.normal, brdf, Unoccluded(), map ).x;
+
+			sum += value;
+			sqr_sum += value * value;
+		}
+
+		const double mean = sum / no_samples;
+		deviation[importance] = sqrt( std::max( 0.0, sqr_sum / no_samples - mean * mean ) );
+
+		CHECK_NEAR( mean, reference, 4.0 * deviation[importance] / sqrt( double( no_samples ) ) + 2e-3 * reference );
+	}
+
+	CHECK( deviation[1] < 0.25 * deviation[0] );
+}
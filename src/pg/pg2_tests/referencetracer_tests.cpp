@@ -0,0 +1,138 @@
+#include "pch.h"
+#include "tests.h"
+#include "testscene.h"
+#include "referencetracer.h"
+
+static const float kAlbedo = 0.5f;
+
+/* radiance reflected by a Lambertian plane z = 0 lit by an isotropic point light, I / d^2 * cos * albedo / pi */
+static float PlaneRadiance( const optix::float3 & light, const float intensity, const optix::float3 & p )
+{
+	const optix::float3 d = light - p;
+	const float sqr_distance = optix::dot( d, d );
+
+	return kAlbedo * M_1_PIf * intensity * ( d.z / sqrtf( sqr_distance ) ) / sqr_distance;
+}
+
+TEST( PointLightOverPlane )
+{
+	TestScene scene;
+	scene.AddQuad( Vector3( -50.0f, -50.0f, 0.0f ), Vector3( 100.0f, 0.0f, 0.0f ), Vector3( 0.0f, 100.0f, 0.0f ),
+		Color3f( kAlbedo, kAlbedo, kAlbedo ) );
+	ReferenceTracer tracer( scene.surfaces );
+	EmitterTable emitters;
+	emitters.Build( scene.surfaces );
+
+	const optix::float3 position = optix::make_float3( 0.0f, 0.0f, 2.0f );
+	const float intensity = 10.0f;
+	const std::vector<Light> lights = { MakePointLight( position, optix::make_float3( intensity ) ) };
+	const optix::float3 n = optix::make_float3( 0.0f, 0.0f, 1.0f );
+	std::mt19937 generator( 1 );
+
+	for ( const float x : { 0.0f, 0.5f, 1.0f, 3.0f } )
+	{
+		// off the diagonal shared by the triangles of the quad
+		const optix::float3 p = optix::make_float3( x, 0.25f * x + 0.3f, 0.0f );
+		const float expected = PlaneRadiance( position, intensity, p );
+
+		// the direct lighting alone and the whole path of a camera ray, the bounce off the single plane escapes
+		const optix::float3 direct = tracer.DirectLighting( lights, 1, 0.5f, 0.5f, p, n, optix::make_float3( kAlbedo ) );
+		const optix::float3 origin = p + optix::make_float3( -1.0f, 0.5f, 3.0f );
+		const optix::float3 path = tracer.PathRadiance( origin, optix::normalize( p - origin ), lights, emitters, 8, 3, generator );
+
+		CHECK_NEAR( direct.x, expected, 1e-4f * expected );
+		CHECK_NEAR( direct.z, expected, 1e-4f * expected );
+		CHECK_NEAR( path.y, expected, 1e-3f * expected );
+	}
+
+	// a square occluder between the light and the origin casts a shadow there but not far away
+	scene.AddQuad( Vector3( -0.5f, -0.5f, 1.0f ), Vector3( 1.0f, 0.0f, 0.0f ), Vector3( 0.0f, 1.0f, 0.0f ),
+		Color3f( kAlbedo, kAlbedo, kAlbedo ) );
+	ReferenceTracer occluded( scene.surfaces );
+	const optix::float3 far = optix::make_float3( 3.0f, 0.0f, 0.0f );
+
+	CHECK( occluded.DirectLighting( lights, 1, 0.5f, 0.5f, optix::make_float3( 0.0f ), n, optix::make_float3( kAlbedo ) ).x == 0.0f );
+	CHECK_NEAR( occluded.DirectLighting( lights, 1, 0.5f, 0.5f, far, n, optix::make_float3( kAlbedo ) ).x,
+		PlaneRadiance( position, intensity, far ), 1e-4f * PlaneRadiance( position, intensity, far ) );
+}
+
+TEST( DimLightRouletteIsUnbiased )
+{
+	TestScene scene;
+	scene.AddQuad( Vector3( -50.0f, -50.0f, 0.0f ), Vector3( 100.0f, 0.0f, 0.0f ), Vector3( 0.0f, 100.0f, 0.0f ),
+		Color3f( kAlbedo, kAlbedo, kAlbedo ) );
+	ReferenceTracer tracer( scene.surfaces );
+
+	// about a quarter of LIGHT_CUTOFF, most evaluations skip the shadow ray and the survivors make up for them
+	const optix::float3 position = optix::make_float3( 0.0f, 0.0f, 2.0f );
+	const float intensity = 0.25f * LIGHT_CUTOFF / PlaneRadiance( position, 1.0f, optix::make_float3( 0.0f ) );
+	const std::vector<Light> lights = { MakePointLight( position, optix::make_float3( intensity ) ) };
+	const optix::float3 p = optix::make_float3( 0.0f );
+	const float expected = PlaneRadiance( position, intensity, p );
+
+	const int no_samples = 1 << 16;
+	double sum = 0.0;
+	int no_survivors = 0;
+
+	for ( int i = 0; i < no_samples; ++i )
+	{
+		const float u_rr = ( i + 0.5f ) / no_samples;
+		const float value = tracer.DirectLighting( lights, 1, 0.5f, u_rr, p, optix::make_float3( 0.0f, 0.0f, 1.0f ),
+			optix::make_float3( kAlbedo ) ).x;
+
+		sum += value;
+		no_survivors += ( value > 0.0f ) ? 1 : 0;
+	}
+
+	CHECK_NEAR( sum / no_samples, expected, 1e-3 * expected );
+	CHECK_NEAR( double( no_survivors ) / no_samples, 0.25, 0.01 );
+}
+
+/* closed box whose walls emit Le and reflect albedo, the radiance inside is Le / ( 1 - albedo ) everywhere */
+TEST( FurnaceBox )
+{
+	const Color3f albedo( kAlbedo, kAlbedo, kAlbedo );
+	const Color3f emission( 1.0f, 1.0f, 1.0f );
+	const float expected = 1.0f / ( 1.0f - kAlbedo );
+
+	TestScene scene;
+	scene.AddQuad( Vector3( -1, -1, -1 ), Vector3( 0, 2, 0 ), Vector3( 2, 0, 0 ), albedo, emission ); // bottom
+	scene.AddQuad( Vector3( -1, -1, 1 ), Vector3( 2, 0, 0 ), Vector3( 0, 2, 0 ), albedo, emission ); // top
+	scene.AddQuad( Vector3( -1, -1, -1 ), Vector3( 2, 0, 0 ), Vector3( 0, 0, 2 ), albedo, emission ); // front
+	scene.AddQuad( Vector3( -1, 1, -1 ), Vector3( 0, 0, 2 ), Vector3( 2, 0, 0 ), albedo, emission ); // back
+	scene.AddQuad( Vector3( -1, -1, -1 ), Vector3( 0, 0, 2 ), Vector3( 0, 2, 0 ), albedo, emission ); // left
+	scene.AddQuad( Vector3( 1, -1, -1 ), Vector3( 0, 2, 0 ), Vector3( 0, 0, 2 ), albedo, emission ); // right
+
+	ReferenceTracer tracer( scene.surfaces );
+	EmitterTable emitters;
+	emitters.Build( scene.surfaces );
+	CHECK( emitters.size() == 12 );
+
+	std::mt19937 generator( 7 );
+	std::uniform_real_distribution<float> uniform( 0.0f, 1.0f );
+	const std::vector<Light> lights;
+	const int no_paths = 1 << 15;
+	double sum = 0.0, sqr_sum = 0.0;
+
+	for ( int i = 0; i < no_paths; ++i )
+	{
+		// uniformly distributed directions from points inside the box
+		const float z = 2.0f * uniform( generator ) - 1.0f;
+		const float phi = 2.0f * M_PIf * uniform( generator );
+		const float r = sqrtf( 1.0f - z * z );
+		const optix::float3 direction = optix::make_float3( r * cosf( phi ), r * sinf( phi ), z );
+		const optix::float3 origin = 0.9f * optix::make_float3( 2.0f * uniform( generator ) - 1.0f,
+			2.0f * uniform( generator ) - 1.0f, 2.0f * uniform( generator ) - 1.0f );
+
+		const double value = tracer.PathRadiance( origin, direction, lights, emitters, 64, 3, generator ).x;
+		sum += value;
+		sqr_sum += value * value;
+	}
+
+	// four standard errors of the mean
+	const double mean = sum / no_paths;
+	const double standard_error = sqrt( std::max( 0.0, sqr_sum / no_paths - mean * mean ) / no_paths );
+
+	CHECK_NEAR( mean, expected, 4.0 * standard_error + 1e-3 );
+	CHECK( standard_error < 0.01 * expected );
+}
@@ -0,0 +1,360 @@
+#include "pch.h"
+#include "tests.h"
+#include "testscene.h"
+#include "referencetracer.h"
+#include <numeric>
+
+/* discrete source and target pdfs of the candidates of the reservoir tests, the last candidate has a zero target */
+static const float kSourcePdf[] = { 0.4f, 0.1f, 0.2f, 0.05f, 0.25f };
+static const float kTargetPdf[] = { 1.0f, 3.0f, 0.5f, 2.0f, 0.0f };
+static const int kNoCandidates = sizeof( kSourcePdf ) / sizeof( kSourcePdf[0] );
+
+/* resamples M candidates drawn from kSourcePdf by the weights kTargetPdf / kSourcePdf */
+static Reservoir Resample( const int M, std::mt19937 & generator )
+{
+	std::discrete_distribution<int> source( kSourcePdf, kSourcePdf + kNoCandidates );
+	std::uniform_real_distribution<float> uniform( 0.0f, 1.0f );
+
+	Reservoir r;
+	ResetReservoir( r );
+
+	for ( int i = 0; i < M; ++i )
+	{
+		const LightCandidate x{ source( generator ), 0.0f, 0.0f };
+		UpdateReservoir( r, x, kTargetPdf[x.light] / kSourcePdf[x.light], 1.0f, uniform( generator ) );
+	}
+
+	FinalizeReservoir( r, ( r.y.light >= 0 ) ? kTargetPdf[r.y.light] : 0.0f );
+
+	return r;
+}
+
+/* W is an unbiased estimate of the reciprocal density of the selected sample, E[ W f( y ) ] equals the integral of f,
+for the indicator of a candidate the integral is one, with more candidates W approaches the reciprocal normalized target */
+TEST( ReservoirWeightIsUnbiased )
+{
+	std::mt19937 generator( 11 );
+	const float target_sum = std::accumulate( kTargetPdf, kTargetPdf + kNoCandidates, 0.0f );
+
+	for ( const int M : { 1, 4, 32 } )
+	{
+		const int no_trials = 1 << 18;
+		double indicator[kNoCandidates] = {};
+		double normalization = 0.0;
+		int no_selected[kNoCandidates] = {};
+
+		for ( int trial = 0; trial < no_trials; ++trial )
+		{
+			const Reservoir r = Resample( M, generator );
+
+			CHECK( r.M == float( M ) );
+
+			if ( r.y.light >= 0 && r.W > 0.0f )
+			{
+				indicator[r.y.light] += r.W;
+				normalization += r.W * kTargetPdf[r.y.light];
+				++no_selected[r.y.light];
+			}
+		}
+
+		for ( int i = 0; i < kNoCandidates; ++i )
+		{
+			CHECK_NEAR( indicator[i] / no_trials, ( kTargetPdf[i] > 0.0f ) ? 1.0 : 0.0, 0.03 );
+		}
+
+		CHECK_NEAR( normalization / no_trials, target_sum, 0.01 * target_sum );
+		CHECK( no_selected[kNoCandidates - 1] == 0 );
+	}
+
+	// the W of a large reservoir is close to sum( p_hat ) / p_hat( y ) for every selected sample
+	double deviation = 0.0;
+	const int no_trials = 1 << 12;
+
+	for ( int trial = 0; trial < no_trials; ++trial )
+	{
+		const Reservoir r = Resample( 1024, generator );
+		deviation += fabs( r.W * kTargetPdf[r.y.light] / target_sum - 1.0 );
+	}
+
+	CHECK( deviation / no_trials < 0.05 );
+}
+
+/* merging the same reservoirs in any order gives the same totals and the same distribution of the selected sample */
+TEST( ReservoirMergeOrderIndependence )
+{
+	std::mt19937 generator( 13 );
+	std::uniform_real_distribution<float> uniform( 0.0f, 1.0f );
+
+	// finalized reservoirs of the neighbours, their samples have the target p_hat[i] at the receiving pixel
+	const int no_reservoirs = 6;
+	Reservoir reservoirs[no_reservoirs];
+	float p_hat[no_reservoirs];
+	double weights[no_reservoirs];
+	double weight_sum = 0.0;
+
+	for ( int i = 0; i < no_reservoirs; ++i )
+	{
+		ResetReservoir( reservoirs[i] );
+		reservoirs[i].y = LightCandidate{ i, 0.0f, 0.0f };
+		reservoirs[i].M = float( 1 + 3 * i );
+		reservoirs[i].W = 0.5f + 0.25f * i;
+		reservoirs[i].w_sum = reservoirs[i].W * reservoirs[i].M;
+		p_hat[i] = ( i == 2 ) ? 0.0f : 1.0f + ( i % 3 );
+
+		weights[i] = p_hat[i] * reservoirs[i].W * reservoirs[i].M;
+		weight_sum += weights[i];
+	}
+
+	int orders[3][no_reservoirs] = { { 0, 1, 2, 3, 4, 5 }, { 5, 4, 3, 2, 1, 0 }, { 3, 0, 5, 2, 4, 1 } };
+	const int no_trials = 1 << 18;
+
+	for ( const auto & order : orders )
+	{
+		std::vector<int> observed( no_reservoirs, 0 );
+		Reservoir merged;
+
+		for ( int trial = 0; trial < no_trials; ++trial )
+		{
+			ResetReservoir( merged );
+
+			for ( const int i : order )
+			{
+				MergeReservoir( merged, reservoirs[i], p_hat[i], uniform( generator ) );
+			}
+
+			++observed[merged.y.light];
+		}
+
+		CHECK_NEAR( merged.w_sum, weight_sum, 1e-5 * weight_sum );
+		CHECK( merged.M == 1.0f + 4.0f + 7.0f + 10.0f + 13.0f + 16.0f );
+
+		double chi_square = 0.0;
+		int dof = -1;
+
+		for ( int i = 0; i < no_reservoirs; ++i )
+		{
+			const double expected = no_trials * weights[i] / weight_sum;
+
+			if ( expected > 0.0 )
+			{
+				chi_square += ( observed[i] - expected ) * ( observed[i] - expected ) / expected;
+				++dof;
+			}
+			else
+			{
+				CHECK( observed[i] == 0 );
+			}
+		}
+
+		CHECK( chi_square < ChiSquareCritical( dof ) );
+	}
+}
+
+/* receiver plane z = 0 under many point lights and a few emissive quads, an occluder shadows a part of the plane */
+struct ManyLightsScene
+{
+	TestScene scene;
+	std::vector<Light> lights;
+	EmitterTable emitters;
+	std::vector<optix::float3> points; // shading points on the plane
+	std::vector<float> reference; // luminance of the direct lighting at the points
+
+	ManyLightsScene()
+	{
+		const Color3f albedo( 0.5f, 0.5f, 0.5f );
+		scene.AddQuad( Vector3( -10.0f, -10.0f, 0.0f ), Vector3( 20.0f, 0.0f, 0.0f ), Vector3( 0.0f, 20.0f, 0.0f ), albedo );
+		scene.AddQuad( Vector3( -1.0f, -1.0f, 0.5f ), Vector3( 1.5f, 0.0f, 0.0f ), Vector3( 0.0f, 1.0f, 0.0f ), albedo );
+		scene.AddQuad( Vector3( -4.0f, 2.0f, 3.0f ), Vector3( 0.0f, 1.0f, 0.0f ), Vector3( 1.0f, 0.0f, 0.0f ), albedo,
+			Color3f( 8.0f, 8.0f, 6.0f ) );
+		scene.AddQuad( Vector3( 3.0f, -3.0f, 2.0f ), Vector3( 0.0f, 0.5f, 0.0f ), Vector3( 2.0f, 0.0f, 0.0f ), albedo,
+			Color3f( 1.0f, 2.0f, 4.0f ) );
+		emitters.Build( scene.surfaces );
+
+		std::mt19937 generator( 17 );
+		std::uniform_real_distribution<float> uniform( 0.0f, 1.0f );
+
+		for ( int i = 0; i < 64; ++i )
+		{
+			const optix::float3 position = optix::make_float3( 12.0f * uniform( generator ) - 6.0f, 12.0f * uniform( generator ) - 6.0f,
+				1.0f + 3.0f * uniform( generator ) );
+			const float intensity = powf( 10.0f, 2.0f * uniform( generator ) - 1.0f );
+			lights.push_back( MakePointLight( position, optix::make_float3( intensity, 0.8f * intensity, 0.6f * intensity ) ) );
+		}
+
+		for ( int i = 0; i < 64; ++i )
+		{
+			points.push_back( optix::make_float3( 8.0f * uniform( generator ) - 4.0f, 8.0f * uniform( generator ) - 4.0f, 0.0f ) );
+		}
+	}
+
+	/* the point lights evaluated one by one and the emitters averaged over many samples */
+	void BuildReference( const ReferenceTracer & tracer )
+	{
+		std::mt19937 generator( 19 );
+		std::uniform_real_distribution<float> uniform( 0.0f, 1.0f );
+		const int no_samples = 1 << 13;
+
+		for ( const optix::float3 & p : points )
+		{
+			double emitted = 0.0;
+
+			for ( int i = 0; i < no_samples; ++i )
+			{
+				const float u0 = uniform( generator ), u1 = uniform( generator ), u2 = uniform( generator ), u3 = uniform( generator );
+				emitted += Luminance( tracer.EmittedLighting( emitters, u0, u1, u2, u3, p, kNormal, kAlbedo ) );
+			}
+
+			// the point lights without the subsampling and the roulette of DirectLighting
+			optix::float3 direct = optix::make_float3( 0.0f );
+
+			for ( const Light & light : lights )
+			{
+				optix::float3 omega_l, radiance;
+				float distance;
+
+				if ( Illuminate( light, p, omega_l, distance, radiance ) && !tracer.Occluded( p, omega_l, 0.01f, distance - 0.01f ) )
+				{
+					direct += kAlbedo * M_1_PIf * radiance * std::max( 0.0f, optix::dot( kNormal, omega_l ) );
+				}
+			}
+
+			reference.push_back( Luminance( direct ) + static_cast<float>( emitted / no_samples ) );
+		}
+	}
+
+	unsigned int no_lights() const
+	{
+		return static_cast<unsigned int>( lights.size() );
+	}
+
+	static const optix::float3 kNormal;
+	static const optix::float3 kAlbedo;
+};
+
+const optix::float3 ManyLightsScene::kNormal = optix::make_float3( 0.0f, 0.0f, 1.0f );
+const optix::float3 ManyLightsScene::kAlbedo = optix::make_float3( 0.5f );
+
+/* the direct lighting estimators compared at equal time, one call estimates the lighting at a single point */
+enum class DirectEstimator { ALL_LIGHTS, ONE_LIGHT, RESAMPLED };
+
+static float EstimateDirect( const DirectEstimator estimator, const ManyLightsScene & s, const ReferenceTracer & tracer,
+	const optix::float3 & p, std::mt19937 & generator, RayStats & stats )
+{
+	std::uniform_real_distribution<float> uniform( 0.0f, 1.0f );
+	const optix::float3 & n = ManyLightsScene::kNormal;
+	const optix::float3 & albedo = ManyLightsScene::kAlbedo;
+
+	switch ( estimator )
+	{
+	case DirectEstimator::ALL_LIGHTS:
+	case DirectEstimator::ONE_LIGHT:
+		{
+			// the per-hit loop of primary_ray, every light or a single random one, and a single emitter sample
+			const unsigned int max_samples = ( estimator == DirectEstimator::ALL_LIGHTS ) ? s.no_lights() : 1;
+			const float u = uniform( generator ), u_rr = uniform( generator );
+			const float u0 = uniform( generator ), u1 = uniform( generator ), u2 = uniform( generator ), u3 = uniform( generator );
+
+			return Luminance( tracer.DirectLighting( s.lights, max_samples, u, u_rr, p, n, albedo, &stats ) +
+				tracer.EmittedLighting( s.emitters, u0, u1, u2, u3, p, n, albedo, &stats ) );
+		}
+
+	default:
+		return Luminance( tracer.ResampledLighting( s.lights, s.emitters, 32, p, n, albedo, generator, &stats ) );
+	}
+}
+
+/* resampling from the lights and the emitters with one shadow ray converges to the same lighting as the per-light loop */
+TEST( ResampledLightingIsUnbiased )
+{
+	ManyLightsScene s;
+	ReferenceTracer tracer( s.scene.surfaces );
+	s.BuildReference( tracer );
+
+	std::mt19937 generator( 23 );
+	RayStats stats;
+	ResetRayStats( stats );
+	const int no_samples = 1 << 14;
+
+	for ( size_t i = 0; i < s.points.size(); i += 8 )
+	{
+		double sum = 0.0, sqr_sum = 0.0;
+
+		for ( int j = 0; j < no_samples; ++j )
+		{
+			const double value = EstimateDirect( DirectEstimator::RESAMPLED, s, tracer, s.points[i], generator, stats );
+			sum += value;
+			sqr_sum += value * value;
+		}
+
+		// four standard errors of the mean, the reference of the emitters has an error of its own
+		const double mean = sum / no_samples;
+		const double standard_error = sqrt( std::max( 0.0, sqr_sum / no_samples - mean * mean ) / no_samples );
+
+		CHECK_NEAR( mean, s.reference[i], 4.0 * standard_error + 2e-3 * s.reference[i] );
+	}
+
+	CHECK( stats.shadow <= unsigned( no_samples * ( s.points.size() / 8 ) ) );
+}
+
+/* prints the shadow rays per point and the relative RMSE reached by each estimator in the same time,
+the device ReSTIR passes add the temporal and the spatial reuse to the resampled estimator */
+TEST( ResampledLightingEqualTime )
+{
+	ManyLightsScene s;
+	ReferenceTracer tracer( s.scene.surfaces );
+	s.BuildReference( tracer );
+
+	const char * names[] = { "all lights", "one random light", "resampled (32 candidates)" };
+	const double budget = 0.2; // seconds per estimator
+	double reference_sqr_sum = 0.0;
+
+	for ( const float reference : s.reference )
+	{
+		reference_sqr_sum += reference * reference;
+	}
+
+	printf( "Direct lighting of %d lights and %u emitters at equal time (%0.0f ms):\n", static_cast<int>( s.lights.size() ),
+		s.emitters.size(), budget * 1e+3 );
+
+	for ( const DirectEstimator estimator : { DirectEstimator::ALL_LIGHTS, DirectEstimator::ONE_LIGHT, DirectEstimator::RESAMPLED } )
+	{
+		std::mt19937 generator( 29 );
+		RayStats stats;
+		ResetRayStats( stats );
+		std::vector<double> sums( s.points.size(), 0.0 );
+		int no_passes = 0;
+
+		const auto t0 = std::chrono::high_resolution_clock::now();
+
+		while ( std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - t0 ).count() < budget || no_passes == 0 )
+		{
+			for ( size_t i = 0; i < s.points.size(); ++i )
+			{
+				sums[i] += EstimateDirect( estimator, s, tracer, s.points[i], generator, stats );
+			}
+
+			++no_passes;
+		}
+
+		double sqr_error = 0.0;
+
+		for ( size_t i = 0; i < s.points.size(); ++i )
+		{
+			const double d = sums[i] / no_passes - s.reference[i];
+			sqr_error += d * d;
+		}
+
+		const double shadow_rays = double( stats.shadow ) / ( double( no_passes ) * s.points.size() );
+		printf( "%-26s %6d passes, %5.1f shadow rays per point, relative RMSE %0.4f\n", names[static_cast<int>( estimator )],
+			no_passes, shadow_rays, sqrt( sqr_error / reference_sqr_sum ) );
+
+		if ( estimator == DirectEstimator::RESAMPLED )
+		{
+			CHECK( shadow_rays <= 1.0 );
+		}
+		else
+		{
+			CHECK( shadow_rays <= ( ( estimator == DirectEstimator::ALL_LIGHTS ) ? s.lights.size() + 1.0 : 2.0 ) );
+		}
+	}
+}
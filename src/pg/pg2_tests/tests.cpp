@@ -0,0 +1,92 @@
+#include "pch.h"
+#include "tests.h"
+
+struct Test
+{
+	const char * name;
+	void ( *function )();
+};
+
+/* the registrations run during the static initialization of the translation units, so the list is created on the first use */
+static std::vector<Test> & Tests()
+{
+	static std::vector<Test> tests;
+
+	return tests;
+}
+
+static int no_failed_checks = 0;
+
+int RegisterTest( const char * name, void ( *test )() )
+{
+	Tests().push_back( Test{ name, test } );
+
+	return static_cast<int>( Tests().size() );
+}
+
+void CheckFailed( const char * file, const int line, const char * message )
+{
+	printf( "%s(%d): check failed: %s\n", file, line, message );
+	++no_failed_checks;
+}
+
+bool CheckNear( const double value, const double expected, const double tolerance, const char * expression,
+	const char * file, const int line )
+{
+	if ( fabs( value - expected ) <= tolerance )
+	{
+		return true;
+	}
+
+	char message[512];
+	snprintf( message, sizeof( message ), "%s is %g, expected %g +- %g", expression, value, expected, tolerance );
+	CheckFailed( file, line, message );
+
+	return false;
+}
+
+double ChiSquareCritical( const int dof )
+{
+	const double z = 3.090232; // standard normal quantile of 0.999
+	const double a = 2.0 / ( 9.0 * dof );
+	const double c = 1.0 - a + z * sqrt( a );
+
+	return dof * c * c * c;
+}
+
+/* runs all tests or the tests whose names contain one of the arguments */
+int main( int argc, char * argv[] )
+{
+	int no_failed = 0;
+	int no_run = 0;
+
+	for ( const Test & test : Tests() )
+	{
+		bool selected = argc < 2;
+
+		for ( int i = 1; i < argc; ++i )
+		{
+			selected |= strstr( test.name, argv[i] ) != nullptr;
+		}
+
+		if ( !selected )
+		{
+			continue;
+		}
+
+		const int no_failed_before = no_failed_checks;
+		const auto t0 = std::chrono::high_resolution_clock::now();
+		test.function();
+		const double ms = std::chrono::duration<double, std::milli>( std::chrono::high_resolution_clock::now() - t0 ).count();
+
+		const bool passed = no_failed_checks == no_failed_before;
+		printf( "[%s] %s (%0.0f ms)\n", passed ? "  OK  " : " FAIL ", test.name, ms );
+
+		no_failed += passed ? 0 : 1;
+		++no_run;
+	}
+
+	printf( "%d of %d tests passed.\n", no_run - no_failed, no_run );
+
+	return no_failed;
+}
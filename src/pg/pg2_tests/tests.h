@@ -0,0 +1,28 @@
+#ifndef TESTS_H_
+#define TESTS_H_
+
+/* registers the test under its name, main runs the registered tests and returns the number of the failed ones */
+int RegisterTest( const char * name, void ( *test )() );
+
+/* records a failed check of the running test, the test goes on so all failed checks of a run are printed */
+void CheckFailed( const char * file, const int line, const char * message );
+bool CheckNear( const double value, const double expected, const double tolerance, const char * expression,
+	const char * file, const int line );
+
+/* value the chi-square statistic with the given degrees of freedom exceeds with the probability of 0.1 %,
+the Wilson-Hilferty approximation */
+double ChiSquareCritical( const int dof );
+
+#define TEST( name ) \
+	static void name(); \
+	static const int name##_registration = RegisterTest( #name, name ); \
+	static void name()
+
+#define CHECK( condition ) \
+	( ( condition ) ? true : ( CheckFailed( __FILE__, __LINE__, #condition ), false ) )
+
+/* checks that |value - expected| <= tolerance and prints both values otherwise */
+#define CHECK_NEAR( value, expected, tolerance ) \
+	CheckNear( ( value ), ( expected ), ( tolerance ), #value, __FILE__, __LINE__ )
+
+#endif
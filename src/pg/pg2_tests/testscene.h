@@ -0,0 +1,48 @@
+#ifndef TEST_SCENE_H_
+#define TEST_SCENE_H_
+
+#include "surface.h"
+
+/* scene of quads with one Lambertian material each, deletes the surfaces and the materials */
+struct TestScene
+{
+	std::vector<Surface *> surfaces;
+	std::vector<Material *> materials;
+
+	/* two triangles of the parallelogram origin + s * e1 + t * e2, s, t in [0, 1], the normal is e1 x e2 */
+	void AddQuad( const Vector3 & origin, const Vector3 & e1, const Vector3 & e2, const Color3f & albedo,
+		const Color3f & emission = Color3f() )
+	{
+		Material * material = new Material();
+		material->set_shader( Shader::LAMBERT );
+		material->diffuse_ = albedo;
+		material->emission_ = emission;
+		materials.push_back( material );
+
+		Vector3 normal = e1.CrossProduct( e2 );
+		normal.Normalize();
+
+		Coord2f uv[4] = { { 0.0f, 0.0f }, { 1.0f, 0.0f }, { 1.0f, 1.0f }, { 0.0f, 1.0f } };
+		const Vector3 corners[4] = { origin, origin + e1, origin + e1 + e2, origin + e2 };
+		const int indices[6] = { 0, 1, 2, 0, 2, 3 };
+
+		std::vector<Vertex> vertices;
+
+		for ( const int i : indices )
+		{
+			vertices.push_back( Vertex( corners[i], normal, Vector3( 1.0f, 1.0f, 1.0f ), &uv[i] ) );
+		}
+
+		Surface * surface = BuildSurface( "quad", vertices );
+		surface->set_material( material );
+		surfaces.push_back( surface );
+	}
+
+	~TestScene()
+	{
+		for ( auto surface : surfaces ) delete surface;
+		for ( auto material : materials ) delete material;
+	}
+};
+
+#endif
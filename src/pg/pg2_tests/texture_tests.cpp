@@ -0,0 +1,119 @@
+#include "pch.h"
+#include "tests.h"
+#include "texture.h"
+#include "colorkernels.h"
+#include "freeimage.h"
+
+static const int kGrayWidth = 37; // not a multiple of the vector widths, the tails are converted as well
+static const int kGrayHeight = 19;
+
+/* smooth gradient, the BC4 blocks encode it within a few levels */
+static BYTE GrayValue( const int x, const int y )
+{
+	return static_cast<BYTE>( 4 * x + 2 * y );
+}
+
+/* 8-bit gray image with the default grayscale palette, the rows of the dib are stored bottom-up */
+static bool SaveGrayImage( const std::string & file_name )
+{
+	FIBITMAP * dib = FreeImage_Allocate( kGrayWidth, kGrayHeight, 8 );
+
+	if ( !dib )
+	{
+		return false;
+	}
+
+	for ( int y = 0; y < kGrayHeight; ++y )
+	{
+		BYTE * row = FreeImage_GetScanLine( dib, kGrayHeight - 1 - y );
+
+		for ( int x = 0; x < kGrayWidth; ++x )
+		{
+			row[x] = GrayValue( x, y );
+		}
+	}
+
+	const bool saved = FreeImage_Save( FIF_PNG, dib, file_name.c_str() ) != 0;
+	FreeImage_Unload( dib );
+
+	return saved;
+}
+
+/* the gray texels are the same in all channels of the upload, of the host sampling and of the BC4 blocks */
+TEST( GrayTextureUploadAndSampling )
+{
+	const std::string file_name = "gray_test.png";
+	CHECK( SaveGrayImage( file_name ) );
+
+	Texture texture( file_name.c_str() );
+	remove( file_name.c_str() );
+
+	CHECK( texture.pixel_size() == 1 );
+	CHECK( texture.width() == kGrayWidth && texture.height() == kGrayHeight );
+
+	if ( texture.pixel_size() != 1 )
+	{
+		return;
+	}
+
+	// the RGBA bytes uploaded by Raytracer::CreateTextureBuffer
+	std::vector<BYTE> rgba( kGrayWidth * kGrayHeight * 4 );
+	texture.DecodeLevel( 0, rgba.data() );
+	int no_wrong_uploads = 0;
+
+	for ( int y = 0; y < kGrayHeight; ++y )
+	{
+		for ( int x = 0; x < kGrayWidth; ++x )
+		{
+			const BYTE * p = &rgba[( y * kGrayWidth + x ) * 4];
+			const BYTE value = GrayValue( x, y );
+			no_wrong_uploads += ( p[0] != value || p[1] != value || p[2] != value || p[3] != 255 ) ? 1 : 0;
+		}
+	}
+
+	CHECK( no_wrong_uploads == 0 );
+
+	// the host bilinear sampling at the texel corners, slightly inside to stay off the neighbours
+	const float * table = SrgbToLinearTable();
+	int no_wrong_texels = 0;
+
+	for ( int y = 0; y < kGrayHeight; ++y )
+	{
+		for ( int x = 0; x < kGrayWidth; ++x )
+		{
+			const float u = ( x + 1e-3f ) / kGrayWidth, v = ( y + 1e-3f ) / kGrayHeight;
+			const Color3f c = texture.texel( u, v, false );
+			const Color3f linear = texture.texel( u, v, true );
+			const float value = GrayValue( x, y ) / 255.0f;
+			const float linear_value = table[GrayValue( x, y )];
+
+			no_wrong_texels += ( fabsf( c.r - value ) > 1e-2f || c.g != c.r || c.b != c.r ) ? 1 : 0;
+			no_wrong_texels += ( fabsf( linear.r - linear_value ) > 1e-2f || linear.g != linear.r || linear.b != linear.r ) ? 1 : 0;
+		}
+	}
+
+	CHECK( no_wrong_texels == 0 );
+
+	// the block compressed copy is sampled and uploaded as the same gray
+	texture.Compress( TextureCompression::BC4 );
+	CHECK( texture.compression() == TextureCompression::BC4 );
+
+	std::vector<BYTE> rgba_bc4( rgba.size() );
+	texture.DecodeLevel( 0, rgba_bc4.data() );
+	int max_error = 0;
+
+	for ( int y = 0; y < kGrayHeight; ++y )
+	{
+		for ( int x = 0; x < kGrayWidth; ++x )
+		{
+			const int i = ( y * kGrayWidth + x ) * 4;
+			const Color3f c = texture.texel( ( x + 1e-3f ) / kGrayWidth, ( y + 1e-3f ) / kGrayHeight, false );
+
+			max_error = std::max( max_error, abs( rgba_bc4[i] - rgba[i] ) );
+			max_error = std::max( max_error, static_cast<int>( fabsf( c.r * 255.0f - rgba[i] ) + 0.5f ) );
+			CHECK( rgba_bc4[i] == rgba_bc4[i + 1] && rgba_bc4[i] == rgba_bc4[i + 2] );
+		}
+	}
+
+	CHECK( max_error <= 3 );
+}
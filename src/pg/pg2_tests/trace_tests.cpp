@@ -0,0 +1,72 @@
+#include "pch.h"
+#include "tests.h"
+#include "trace.h"
+#include "memoryaccounting.h"
+
+/* a thread recording more events than its ring holds, the saved trace keeps the latest ones with the scopes balanced */
+TEST( TraceRingKeepsScopesBalanced )
+{
+	const long long diagnostics = MemoryAccounting::Instance().current( MemoryTag::DIAGNOSTICS, MemoryDomain::HOST );
+	const std::string file_name = "trace_test.json";
+
+	std::thread( [&]()
+	{
+		TRACE_THREAD_NAME( "Test" );
+		TraceScope outer( "Outer" ); // its begin is overwritten, the end is skipped
+		TraceScope open( "Open" ); // still open when saved
+
+		for ( int i = 0; i < ( 1 << 20 ); ++i )
+		{
+			TraceScope inner( "Inner" );
+		}
+
+		Tracer::Instance().Save( file_name );
+	} ).join();
+
+	// the ring of the thread stopped growing, about 3 MB
+	const long long charged = MemoryAccounting::Instance().current( MemoryTag::DIAGNOSTICS, MemoryDomain::HOST ) - diagnostics;
+	CHECK( charged > 0 && charged < ( 4 << 20 ) );
+
+	FILE * file = fopen( file_name.c_str(), "rt" );
+	CHECK( file != nullptr );
+
+	if ( !file )
+	{
+		return;
+	}
+
+	std::map<std::string, int> depths; // open scopes per thread
+	int no_begins = 0, no_ends = 0, no_negative = 0, no_outer = 0;
+	char line[256];
+
+	while ( fgets( line, sizeof( line ), file ) )
+	{
+		const char * phase = strstr( line, "\"ph\":\"" );
+		const char * tid = strstr( line, "\"tid\":" );
+
+		if ( !phase || !tid || ( phase[6] != 'B' && phase[6] != 'E' ) )
+		{
+			continue;
+		}
+
+		int & depth = depths[std::string( tid, strcspn( tid, "},\n" ) )];
+		depth += ( phase[6] == 'B' ) ? 1 : -1;
+		no_begins += ( phase[6] == 'B' ) ? 1 : 0;
+		no_ends += ( phase[6] == 'E' ) ? 1 : 0;
+		no_negative += ( depth < 0 ) ? 1 : 0;
+		no_outer += ( strstr( line, "\"Outer\"" ) ) ? 1 : 0;
+	}
+
+	fclose( file );
+	remove( file_name.c_str() );
+
+	CHECK( no_negative == 0 );
+	CHECK( no_begins == no_ends );
+	CHECK( no_outer == 0 );
+	CHECK( no_begins > ( 1 << 15 ) ); // most of the ring
+
+	for ( const auto & depth : depths )
+	{
+		CHECK( depth.second == 0 );
+	}
+}